@@ -8,6 +8,7 @@
 #include "audio_codec.h"
 #include "network.h"
 #include "protocol.h"
+#include "screen_media.h"
 #include "tls_socket.h"
 
 #include <d3d11.h>
@@ -78,6 +79,7 @@ struct UserEntry {
     std::string name;
     bool        is_sharing = false;
     bool        in_voice = false;
+    std::string voice_room{};  // empty when not in voice
 };
 
 struct ChatMessage {
@@ -95,6 +97,12 @@ struct JitterBuffer {
     bool primed = false;  // true once pre-buffer threshold reached
     static constexpr size_t MAX_DEPTH  = 4;  // 80ms max buffering
     static constexpr size_t PRE_BUFFER = 2;  // 40ms pre-buffer before playback starts
+
+    // Sequence tracking for loss recovery and the sender's loss report
+    bool     seq_known = false;
+    uint32_t next_seq  = 0;
+    uint32_t received  = 0;  // since the last report
+    uint32_t lost      = 0;
 };
 
 // Item in the screen-share send queue (video frames + system audio)
@@ -123,6 +131,7 @@ struct AppState {
 
     // Voice channel (separate from text chat)
     std::atomic<bool> in_voice{false};
+    std::string       voice_room;  // room joined; UI thread only
 
     // Update notification (from server or background GitHub check)
     std::mutex              update_mutex;
@@ -171,6 +180,14 @@ struct AppState {
     std::unordered_map<uint32_t, JitterBuffer>              jitter_buffers;
     std::unordered_map<uint32_t, lilypad::OpusDecoderWrapper> voice_decoders;
 
+    // Loss our listeners report for our voice (per listener), sizes our Opus FEC
+    struct VoiceLossReport {
+        uint8_t                               loss_pct = 0;
+        std::chrono::steady_clock::time_point at;
+    };
+    std::mutex                                    voice_loss_mutex;
+    std::unordered_map<uint32_t, VoiceLossReport> voice_loss_reports;
+
     // Voice activity tracking (per-user, timestamp of last received voice packet)
     std::mutex                                                             voice_activity_mutex;
     std::unordered_map<uint32_t, std::chrono::steady_clock::time_point>    voice_last_seen;
@@ -215,9 +232,37 @@ struct AppState {
     int                           screen_srv_w     = 0;
     int                           screen_srv_h     = 0;
 
-    // Keyframe request from server
-    std::atomic<bool> force_keyframe{false};
-    std::atomic<int>  h264_bitrate{0};  // 0 = auto (set based on resolution)
+    // Screen media over UDP: sent and received on media_udp once the server hands
+    // out the stream's key (SCREEN_MEDIA_KEY); over TCP until then, or if it never does
+    std::atomic<bool>                     screen_udp{true};  // setting, applies from the next share / watch
+    std::unique_ptr<lilypad::Socket>      media_udp;
+    std::unique_ptr<std::thread>          media_thread;
+    std::mutex                            media_mutex;
+    sockaddr_in                           media_dest{};
+    std::unique_ptr<lilypad::MediaCipher> media_send_cipher;   // our own share
+    uint32_t                              media_watch_id = 0;  // stream media_watch_cipher opens
+    std::unique_ptr<lilypad::MediaCipher> media_watch_cipher;
+
+    // Receive statistics of the watched stream (TCP or UDP), reported to the server
+    std::mutex                            screen_stats_mutex;
+    lilypad::MediaRateMonitor             screen_stats;
+    uint32_t                              screen_stats_id = 0;
+
+    // Latest aggregate of our viewers' reports, for the capture thread's rate control
+    std::mutex                            screen_rate_mutex;
+    lilypad::ScreenReceiverReport         screen_rate_report;
+    bool                                  screen_rate_report_new = false;
+    std::atomic<int>                      screen_send_bitrate{0};  // what the encoder targets now
+
+    // Simulcast: also send the screen at half resolution and at a few frames per
+    // second, so the server can give slow viewers those instead (from the next share)
+    std::atomic<bool>                     screen_simulcast{false};
+
+    // Keyframe request from server, and from our own send thread for the layers it had to cut
+    std::atomic<bool>    force_keyframe{false};
+    std::atomic<uint8_t> screen_idr_layers{0};  // bit per simulcast layer
+    std::atomic<int>     h264_bitrate{0};  // 0 = auto (set based on resolution); the rate control's cap
+    std::atomic<int>     screen_auto_bitrate{0};  // what auto is for the current / last share
 
     void add_system_msg(const std::string& text) {
         std::lock_guard<std::mutex> lk(chat_mutex);
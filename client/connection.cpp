@@ -18,6 +18,20 @@ static void post_auth_setup(AppState& app, uint32_t my_id, uint16_t udp_port,
 
     app.udp      = std::move(udp);
     app.udp_dest = udp_dest;
+
+    // Screen media socket: large buffers, since a keyframe is a burst of datagrams
+    auto media_udp = std::make_unique<lilypad::Socket>(lilypad::create_udp_socket());
+    int media_buf = 4 * 1024 * 1024;
+    setsockopt(media_udp->get(), SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&media_buf), sizeof(media_buf));
+    setsockopt(media_udp->get(), SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&media_buf), sizeof(media_buf));
+    lilypad::set_nonblocking(media_udp->get());
+    {
+        std::lock_guard<std::mutex> lk(app.media_mutex);
+        app.media_udp = std::move(media_udp);
+        app.media_send_cipher.reset();
+        app.media_watch_cipher.reset();
+        app.media_watch_id = 0;
+    }
     app.my_id    = my_id;
     app.in_voice = false;
 
@@ -42,6 +56,7 @@ static void post_auth_setup(AppState& app, uint32_t my_id, uint16_t udp_port,
     app.screen_sharing = false;
     app.watching_user_id = 0;
     app.force_keyframe = false;
+    app.screen_idr_layers = 0;
     {
         std::lock_guard<std::mutex> lk(app.screen_frame_mutex);
         app.screen_frame_buf.clear();
@@ -77,9 +92,10 @@ static void post_auth_setup(AppState& app, uint32_t my_id, uint16_t udp_port,
     auto sync_msg = lilypad::make_chat_sync_msg(app.last_known_seq.load());
     app.send_tcp(sync_msg);
 
-    // Start TCP receive and screen decode threads
+    // Start TCP receive, screen decode and screen media threads
     app.tcp_thread = std::make_unique<std::thread>(tcp_receive_thread, std::ref(app));
     app.screen_decode_thread = std::make_unique<std::thread>(screen_decode_thread_func, std::ref(app));
+    app.media_thread = std::make_unique<std::thread>(media_receive_thread_func, std::ref(app));
 }
 
 void do_tls_connect(AppState& app, const std::string& server_ip) {
@@ -120,25 +136,30 @@ void do_tls_connect(AppState& app, const std::string& server_ip) {
         }
         freeaddrinfo(result);
 
-        // Create client SSL context
-        SSL_CTX* client_ctx = lilypad::create_client_ssl_ctx(app.trust_self_signed);
+        // Create client SSL context; every session ticket the server sends is saved
+        // so the next connect (after a blip or a server restart) can resume it
+        SSL_CTX* client_ctx = lilypad::create_client_ssl_ctx(
+            app.trust_self_signed,
+            [server_ip](const std::vector<uint8_t>& session) { save_tls_session(server_ip, session); });
         if (!client_ctx) {
             app.add_system_msg("Failed to create TLS context.");
             return;
         }
 
         auto tls = std::make_unique<lilypad::TlsSocket>();
-        if (!tls->connect(std::move(*tcp_raw), client_ctx)) {
+        if (!tls->connect(std::move(*tcp_raw), client_ctx, load_tls_session(server_ip))) {
             SSL_CTX_free(client_ctx);
             app.add_system_msg("TLS handshake failed. Server may use a self-signed certificate.");
             return;
         }
         SSL_CTX_free(client_ctx);
+        bool tls_resumed = tls->resumed();
 
         app.tcp = std::move(tls);
         app.server_ip = server_ip;
         app.auth_state = AuthState::CONNECTED_UNAUTH;
-        app.add_system_msg("TLS connected. Please log in or register.");
+        app.add_system_msg(tls_resumed ? "TLS connected (resumed session). Please log in or register."
+                                        : "TLS connected. Please log in or register.");
 
     } catch (const std::exception& e) {
         app.add_system_msg(std::string("Connection error: ") + e.what());
@@ -345,7 +366,7 @@ void do_logout(AppState& app) {
     do_disconnect(app);
 }
 
-void do_join_voice(AppState& app, int input_device, int output_device) {
+void do_join_voice(AppState& app, const std::string& room, int input_device, int output_device) {
     if (!app.connected || app.in_voice) return;
     try {
         app.capture = std::make_unique<lilypad::AudioCapture>(
@@ -353,8 +374,9 @@ void do_join_voice(AppState& app, int input_device, int output_device) {
         app.playback = std::make_unique<lilypad::AudioPlayback>(
             lilypad::SAMPLE_RATE, lilypad::CHANNELS, lilypad::FRAME_SIZE, output_device);
 
-        app.in_voice = true;
-        app.send_tcp(lilypad::make_voice_join_msg());
+        app.in_voice   = true;
+        app.voice_room = room.empty() ? std::string(lilypad::DEFAULT_VOICE_ROOM) : room;
+        app.send_tcp(lilypad::make_voice_join_msg(app.voice_room));
 
         app.send_thread     = std::make_unique<std::thread>(voice_send_thread, std::ref(app));
         app.udp_recv_thread = std::make_unique<std::thread>(udp_receive_thread_func, std::ref(app));
@@ -370,7 +392,7 @@ void do_leave_voice(AppState& app) {
 
     app.in_voice = false;
     if (app.connected) {
-        app.send_tcp(lilypad::make_voice_leave_msg());
+        app.send_tcp(lilypad::make_voice_leave_msg(app.voice_room));
     }
 
     if (app.udp) app.udp->close();
@@ -394,6 +416,10 @@ void do_leave_voice(AppState& app) {
         std::lock_guard<std::mutex> lk(app.voice_activity_mutex);
         app.voice_last_seen.clear();
     }
+    {
+        std::lock_guard<std::mutex> lk(app.voice_loss_mutex);
+        app.voice_loss_reports.clear();
+    }
 
     if (app.connected) {
         try {
@@ -437,17 +463,26 @@ void do_disconnect(AppState& app) {
     if (app.sys_audio_thread && app.sys_audio_thread->joinable()) app.sys_audio_thread->join();
     if (app.screen_send_thread && app.screen_send_thread->joinable()) app.screen_send_thread->join();
     if (app.screen_decode_thread && app.screen_decode_thread->joinable()) app.screen_decode_thread->join();
+    if (app.media_thread && app.media_thread->joinable()) app.media_thread->join();
 
     app.tcp_thread.reset();
     app.screen_thread.reset();
     app.sys_audio_thread.reset();
     app.screen_send_thread.reset();
     app.screen_decode_thread.reset();
+    app.media_thread.reset();
 
     // Now safe to close TLS and free everything
     if (app.tcp) app.tcp->close();
     app.tcp.reset();
     app.udp.reset();
+    {
+        std::lock_guard<std::mutex> lk(app.media_mutex);
+        app.media_udp.reset();
+        app.media_send_cipher.reset();
+        app.media_watch_cipher.reset();
+        app.media_watch_id = 0;
+    }
 
     {
         std::lock_guard<std::mutex> lk(app.jitter_mutex);
@@ -458,6 +493,10 @@ void do_disconnect(AppState& app) {
         std::lock_guard<std::mutex> lk(app.voice_activity_mutex);
         app.voice_last_seen.clear();
     }
+    {
+        std::lock_guard<std::mutex> lk(app.voice_loss_mutex);
+        app.voice_loss_reports.clear();
+    }
     {
         std::lock_guard<std::mutex> lk(app.sys_audio_mutex);
         app.sys_audio_frames.clear();
@@ -480,6 +519,7 @@ void do_disconnect(AppState& app) {
         app.screen_frame_new = false;
     }
     app.force_keyframe = false;
+    app.screen_idr_layers = 0;
     app.session_token.clear();
 
     {
@@ -26,7 +26,7 @@ void do_delete_account(AppState& app, const std::string& password);
 void do_logout(AppState& app);
 
 // Voice channel
-void do_join_voice(AppState& app, int input_device, int output_device);
+void do_join_voice(AppState& app, const std::string& room, int input_device, int output_device);
 void do_leave_voice(AppState& app);
 
 // Full disconnect (cleanup)
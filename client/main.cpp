@@ -25,6 +25,7 @@
 #include <windowsx.h>
 #include <shellapi.h>
 
+#include <algorithm>
 #include <thread>
 
 // ── Forward declarations ──
@@ -158,6 +159,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
     std::thread(check_for_update_thread, std::ref(app)).detach();
 
     char ip_buf[64]       = "127.0.0.1";
+    char voice_room_buf[lilypad::MAX_VOICE_ROOM_NAME + 1] = "General";
     char username_buf[64] = "";
     char chat_input[512]  = "";
     char password_buf[128]   = "";
@@ -875,6 +877,8 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
 
             // Join / Leave Voice button
             if (is_in_voice) {
+                ImGui::Text("Voice room: %s", app.voice_room.c_str());
+
                 // Leave Voice (red)
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.55f, 0.22f, 0.22f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.72f, 0.28f, 0.28f, 1.0f));
@@ -884,6 +888,10 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                 }
                 ImGui::PopStyleColor(3);
             } else {
+                ImGui::Text("Voice room");
+                ImGui::SetNextItemWidth(-1);
+                ImGui::InputText("##voice_room", voice_room_buf, sizeof(voice_room_buf));
+
                 // Join Voice (green)
                 ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.25f, 0.55f, 0.38f, 1.0f));
                 ImGui::PushStyleColor(ImGuiCol_ButtonHovered, ImVec4(0.33f, 0.72f, 0.48f, 1.0f));
@@ -896,7 +904,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                         ? input_devices[selected_input].index : -1;
                     int out_dev = (selected_output >= 0 && selected_output < static_cast<int>(output_devices.size()))
                         ? output_devices[selected_output].index : -1;
-                    do_join_voice(app, in_dev, out_dev);
+                    do_join_voice(app, voice_room_buf, in_dev, out_dev);
                 }
                 ImGui::PopStyleColor(3);
             }
@@ -936,7 +944,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
             ImGui::SetNextItemWidth(-1);
             if (bitrate_mbps == 0) {
                 // Show current auto value
-                int cur = app.h264_bitrate.load();
+                int cur = app.screen_auto_bitrate.load();
                 char auto_label[32];
                 snprintf(auto_label, sizeof(auto_label), "Auto (%d Mbps)", cur / 1000000);
                 ImGui::TextDisabled("%s", auto_label);
@@ -945,9 +953,21 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                 if (bitrate_mbps > 0) {
                     app.h264_bitrate.store(bitrate_mbps * 1000000);
                 } else {
-                    app.h264_bitrate.store(0);  // reset to auto on next share
+                    app.h264_bitrate.store(0);  // back to auto, also mid-share
                 }
             }
+            if (app.screen_sharing.load()) {
+                // The slider is a ceiling; the network decides how much of it is used
+                ImGui::TextDisabled("Sending at %.1f Mbps", app.screen_send_bitrate.load() / 1000000.0);
+            }
+
+            // Takes effect from the next share / watch
+            bool screen_udp = app.screen_udp.load();
+            if (ImGui::Checkbox("Send and receive over UDP##screen_udp", &screen_udp))
+                app.screen_udp = screen_udp;
+            bool simulcast = app.screen_simulcast.load();
+            if (ImGui::Checkbox("Also send lower quality for slow viewers##simulcast", &simulcast))
+                app.screen_simulcast = simulcast;
 
             ImGui::Spacing();
 
@@ -973,6 +993,10 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                         std::lock_guard<std::mutex> lk(app.screen_send_mutex);
                         app.screen_send_queue.clear();
                     }
+                    {
+                        std::lock_guard<std::mutex> lk(app.media_mutex);
+                        app.media_send_cipher.reset();
+                    }
                     app.send_tcp(lilypad::make_screen_stop_msg());
                 }
                 ImGui::PopStyleColor(3);
@@ -983,6 +1007,8 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                 if (ImGui::Button("Share Screen", ImVec2(-1, 30))) {
                     app.screen_sharing = true;
                     app.send_tcp(lilypad::make_screen_start_msg());
+                    if (app.screen_udp)
+                        app.send_tcp(lilypad::make_screen_media_req_msg(app.my_id));
                     app.screen_send_thread = std::make_unique<std::thread>(screen_send_thread_func, std::ref(app));
                     app.screen_thread = std::make_unique<std::thread>(screen_capture_thread_func, std::ref(app));
                     app.sys_audio_thread = std::make_unique<std::thread>(sys_audio_capture_thread_func, std::ref(app));
@@ -1054,6 +1080,8 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                                 }
                                 app.watching_user_id = u.id;
                                 app.send_tcp(lilypad::make_screen_subscribe_msg(u.id));
+                                if (app.screen_udp)
+                                    app.send_tcp(lilypad::make_screen_media_req_msg(u.id));
                             }
                             ImGui::PopStyleColor(3);
                         }
@@ -1089,14 +1117,20 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPSTR, _In
                 ImGui::Separator();
                 ImGui::Spacing();
 
-                bool any_voice = false;
+                // One sub-list per occupied room, in name order
+                std::vector<std::string> rooms;
                 for (auto& u : app.users) {
-                    if (u.in_voice) {
-                        render_user(u, true);
-                        any_voice = true;
+                    if (u.in_voice && std::find(rooms.begin(), rooms.end(), u.voice_room) == rooms.end())
+                        rooms.push_back(u.voice_room);
+                }
+                std::sort(rooms.begin(), rooms.end());
+                for (auto& room : rooms) {
+                    ImGui::TextDisabled("  # %s", room.c_str());
+                    for (auto& u : app.users) {
+                        if (u.in_voice && u.voice_room == room) render_user(u, true);
                     }
                 }
-                if (!any_voice) {
+                if (rooms.empty()) {
                     ImGui::TextDisabled("  No users in voice.");
                 }
 
@@ -6,8 +6,62 @@
 #include <rnnoise.h>
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 
+// Voice activity for the header extension: RNNoise's speech probability when
+// noise suppression is on, a plain energy gate otherwise. The hangover keeps
+// word endings from being flagged as silence.
+constexpr float VAD_PROBABILITY   = 0.6f;
+constexpr float VAD_ENERGY_DB     = -45.0f;   // dBFS, used without RNNoise
+constexpr float VAD_MIN_LEVEL_DB  = -60.0f;   // RNNoise alone can fire on very quiet input
+constexpr int   VAD_HANGOVER      = 10;       // frames (200ms)
+
+// Voice loss recovery. A gap of up to VOICE_MAX_CONCEALED_GAP frames is loss:
+// the last missing frame is rebuilt from the next packet's in-band FEC and any
+// before it concealed with PLC, as far as the jitter buffer has room. Longer
+// gaps are the talker pausing, or the server not forwarding them for a while
+// (it never stops doing so for fewer frames than this), and are left silent
+// and out of the loss report.
+constexpr uint32_t VOICE_MAX_CONCEALED_GAP    = 3;
+constexpr auto     VOICE_LOSS_REPORT_INTERVAL = std::chrono::seconds(2);
+constexpr uint32_t VOICE_LOSS_REPORT_MIN      = 25;  // frames heard before a report means anything
+constexpr auto     VOICE_LOSS_REPORT_MAX_AGE  = std::chrono::seconds(6);  // listener left or went quiet
+constexpr int      VOICE_FEC_UPDATE_FRAMES    = 50;  // re-tune the encoder once a second
+
+// Screen media over UDP
+constexpr auto MEDIA_KEEPALIVE_INTERVAL = std::chrono::seconds(1);
+constexpr auto MEDIA_KEYFRAME_INTERVAL  = std::chrono::seconds(1);  // between our keyframe requests
+
+// ── Screen frames and audio from the watched sharer, over TCP or UDP ──
+// body: width(2) + height(2) + flags(1) + h264_data
+static void deliver_screen_frame(AppState& app, const uint8_t* body, size_t len) {
+    uint8_t flags = body[4];
+    {
+        std::lock_guard<std::mutex> lk(app.screen_frame_mutex);
+        app.screen_frame_buf.assign(body + 5, body + len);
+        app.screen_frame_flags = flags;
+        app.screen_frame_new = true;
+    }
+    app.screen_decode_cv.notify_one();
+}
+
+static void deliver_screen_audio(AppState& app, const uint8_t* opus_data, size_t opus_len) {
+    std::lock_guard<std::mutex> lk(app.sys_audio_mutex);
+    // Create decoder on first use
+    if (!app.sys_audio_decoder) {
+        app.sys_audio_decoder = std::make_unique<lilypad::OpusDecoderWrapper>();
+    }
+    try {
+        auto pcm = app.sys_audio_decoder->decode(opus_data, static_cast<int>(opus_len));
+        app.sys_audio_frames.push_back(std::move(pcm));
+        // Limit buffer depth to prevent unbounded growth
+        while (app.sys_audio_frames.size() > 8) {
+            app.sys_audio_frames.pop_front();
+        }
+    } catch (...) {}
+}
+
 void tcp_receive_thread(AppState& app) {
     while (app.running && app.connected) {
         fd_set read_set;
@@ -107,7 +161,11 @@ void tcp_receive_thread(AppState& app) {
                 uint32_t uid = lilypad::read_u32(payload.data());
                 std::lock_guard<std::mutex> lk(app.users_mutex);
                 for (auto& u : app.users) {
-                    if (u.id == uid) { u.in_voice = true; break; }
+                    if (u.id == uid) {
+                        u.in_voice   = true;
+                        u.voice_room = lilypad::parse_voice_room(payload);
+                        break;
+                    }
                 }
             }
             break;
@@ -117,11 +175,20 @@ void tcp_receive_thread(AppState& app) {
                 uint32_t uid = lilypad::read_u32(payload.data());
                 std::lock_guard<std::mutex> lk(app.users_mutex);
                 for (auto& u : app.users) {
-                    if (u.id == uid) { u.in_voice = false; break; }
+                    if (u.id == uid) { u.in_voice = false; u.voice_room.clear(); break; }
                 }
             }
             break;
         }
+        case lilypad::MsgType::VOICE_LOSS_REPORT: {
+            // A listener's loss on our voice: reporter_id(4) + loss_pct(1)
+            if (payload.size() >= 5) {
+                uint32_t reporter = lilypad::read_u32(payload.data());
+                std::lock_guard<std::mutex> lk(app.voice_loss_mutex);
+                app.voice_loss_reports[reporter] = {payload[4], std::chrono::steady_clock::now()};
+            }
+            break;
+        }
         case lilypad::MsgType::SCREEN_START: {
             if (payload.size() >= 4) {
                 uint32_t uid = lilypad::read_u32(payload.data());
@@ -153,17 +220,12 @@ void tcp_receive_thread(AppState& app) {
             if (payload.size() >= 9) {
                 uint32_t sharer_id = lilypad::read_u32(payload.data());
                 if (sharer_id == app.watching_user_id.load()) {
-                    uint8_t flags = payload[8];
-                    const uint8_t* frame_data = payload.data() + 9;
-                    size_t frame_len = payload.size() - 9;
-
-                    {
-                        std::lock_guard<std::mutex> lk(app.screen_frame_mutex);
-                        app.screen_frame_buf.assign(frame_data, frame_data + frame_len);
-                        app.screen_frame_flags = flags;
-                        app.screen_frame_new = true;
+                    deliver_screen_frame(app, payload.data() + 4, payload.size() - 4);
+                    std::lock_guard<std::mutex> lk(app.screen_stats_mutex);
+                    if (app.screen_stats_id == sharer_id) {
+                        app.screen_stats.on_bytes(payload.size());
+                        app.screen_stats.on_frame(false);
                     }
-                    app.screen_decode_cv.notify_one();
                 }
             }
             break;
@@ -173,26 +235,42 @@ void tcp_receive_thread(AppState& app) {
             if (payload.size() > 4) {
                 uint32_t sharer_id = lilypad::read_u32(payload.data());
                 if (sharer_id == app.watching_user_id.load()) {
-                    const uint8_t* opus_data = payload.data() + 4;
-                    int opus_len = static_cast<int>(payload.size() - 4);
-
-                    std::lock_guard<std::mutex> lk(app.sys_audio_mutex);
-                    // Create decoder on first use
-                    if (!app.sys_audio_decoder) {
-                        app.sys_audio_decoder = std::make_unique<lilypad::OpusDecoderWrapper>();
-                    }
-                    try {
-                        auto pcm = app.sys_audio_decoder->decode(opus_data, opus_len);
-                        app.sys_audio_frames.push_back(std::move(pcm));
-                        // Limit buffer depth to prevent unbounded growth
-                        while (app.sys_audio_frames.size() > 8) {
-                            app.sys_audio_frames.pop_front();
-                        }
-                    } catch (...) {}
+                    deliver_screen_audio(app, payload.data() + 4, payload.size() - 4);
                 }
             }
             break;
         }
+        case lilypad::MsgType::SCREEN_MEDIA_KEY: {
+            // stream_id(4) + media_port(2) + key(32): our own share's sending key,
+            // or the key the watched stream reaches us under
+            if (payload.size() >= 6 + lilypad::SCREEN_MEDIA_KEY_SIZE) {
+                uint32_t stream_id = lilypad::read_u32(payload.data());
+                lilypad::MediaKey key;
+                std::memcpy(key.data(), payload.data() + 6, key.size());
+
+                std::lock_guard<std::mutex> lk(app.media_mutex);
+                app.media_dest          = app.udp_dest;
+                app.media_dest.sin_port = htons(lilypad::read_u16(payload.data() + 4));
+                if (stream_id == app.my_id) {
+                    if (app.screen_sharing) app.media_send_cipher = std::make_unique<lilypad::MediaCipher>(key);
+                } else if (stream_id == app.watching_user_id.load()) {
+                    app.media_watch_id     = stream_id;
+                    app.media_watch_cipher = std::make_unique<lilypad::MediaCipher>(key);
+                }
+            }
+            break;
+        }
+        case lilypad::MsgType::SCREEN_RECEIVER_REPORT: {
+            // How our viewers are doing, worst case, for the capture thread's bitrate
+            lilypad::ScreenReceiverReport report;
+            if (lilypad::parse_screen_receiver_report(payload.data(), payload.size(), report) &&
+                report.sharer_id == app.my_id) {
+                std::lock_guard<std::mutex> lk(app.screen_rate_mutex);
+                app.screen_rate_report     = report;
+                app.screen_rate_report_new = true;
+            }
+            break;
+        }
         case lilypad::MsgType::SCREEN_REQUEST_KEYFRAME: {
             // Server requests that we produce an IDR keyframe
             app.force_keyframe = true;
@@ -262,6 +340,9 @@ void voice_send_thread(AppState& app) {
     SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
     lilypad::OpusEncoderWrapper encoder;
     uint32_t sequence = 0;
+    int      vad_hangover = 0;
+    int      fec_countdown = 0;
+    const auto clock_origin = std::chrono::steady_clock::now();
 
     // RNNoise state -- created once, reused for the lifetime of the thread
     DenoiseState* rnn_st = rnnoise_create(nullptr);
@@ -270,6 +351,7 @@ void voice_send_thread(AppState& app) {
     while (app.running && app.connected && app.in_voice) {
         try {
             auto pcm = app.capture->read_frame();
+            auto captured = std::chrono::steady_clock::now();
 
             // Mute or push-to-talk: determine if we should transmit
             bool should_transmit = !app.muted.load();
@@ -283,6 +365,7 @@ void voice_send_thread(AppState& app) {
             }
 
             // Apply RNNoise noise suppression if enabled
+            float speech_prob = -1.0f;  // unknown without RNNoise
             if (app.noise_suppression.load()) {
                 // RNNoise expects float samples in [-32768, 32768] range
                 // Our PCM is in [-1.0, 1.0] (PortAudio float format)
@@ -293,7 +376,8 @@ void voice_send_thread(AppState& app) {
                     for (int i = 0; i < rnn_frame; ++i) {
                         rnn_buf[i] = pcm[sub * rnn_frame + i] * 32768.0f;
                     }
-                    rnnoise_process_frame(rnn_st, rnn_buf.data(), rnn_buf.data());
+                    float prob = rnnoise_process_frame(rnn_st, rnn_buf.data(), rnn_buf.data());
+                    speech_prob = (std::max)(speech_prob, prob);
                     // Scale back to [-1.0, 1.0]
                     for (int i = 0; i < rnn_frame; ++i) {
                         pcm[sub * rnn_frame + i] = rnn_buf[i] / 32768.0f;
@@ -301,12 +385,41 @@ void voice_send_thread(AppState& app) {
                 }
             }
 
+            // Level and VAD of what is actually sent, for the header extension
+            float level_db = lilypad::frame_level_db(pcm.data(), pcm.size());
+            bool  speech   = speech_prob >= 0.0f
+                ? speech_prob >= VAD_PROBABILITY && level_db >= VAD_MIN_LEVEL_DB
+                : level_db >= VAD_ENERGY_DB;
+            if (speech) vad_hangover = VAD_HANGOVER;
+            else if (vad_hangover > 0) { --vad_hangover; speech = true; }
+
+            // FEC sized for the worst recent listener report
+            if (--fec_countdown <= 0) {
+                fec_countdown = VOICE_FEC_UPDATE_FRAMES;
+                int loss = 0;
+                std::lock_guard<std::mutex> lk(app.voice_loss_mutex);
+                for (auto it = app.voice_loss_reports.begin(); it != app.voice_loss_reports.end();) {
+                    if (captured - it->second.at > VOICE_LOSS_REPORT_MAX_AGE) {
+                        it = app.voice_loss_reports.erase(it);
+                        continue;
+                    }
+                    loss = (std::max)(loss, static_cast<int>(it->second.loss_pct));
+                    ++it;
+                }
+                encoder.set_packet_loss(loss);
+            }
+
             auto opus_data = encoder.encode(pcm.data());
 
             lilypad::VoicePacket pkt;
-            pkt.client_id = app.my_id;
-            pkt.sequence  = sequence++;
-            pkt.opus_data = std::move(opus_data);
+            pkt.client_id        = app.my_id;
+            pkt.sequence         = sequence++;
+            pkt.audio.present    = true;
+            pkt.audio.vad        = speech;
+            pkt.audio.level      = lilypad::VoiceAudioLevel::encode_level(level_db);
+            pkt.audio.capture_ms = static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(captured - clock_origin).count());
+            pkt.opus_data        = std::move(opus_data);
 
             auto bytes = pkt.to_bytes();
             sendto(app.udp->get(), reinterpret_cast<const char*>(bytes.data()),
@@ -325,8 +438,29 @@ void voice_send_thread(AppState& app) {
 void udp_receive_thread_func(AppState& app) {
     SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
     uint8_t buf[lilypad::MAX_VOICE_PACKET];
+    auto next_report = std::chrono::steady_clock::now() + VOICE_LOSS_REPORT_INTERVAL;
+    std::vector<std::vector<uint8_t>> reports;
 
     while (app.running && app.connected && app.in_voice) {
+        // Tell each talker how much of them we lose (the mix has no talker to tell)
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_report) {
+            next_report = now + VOICE_LOSS_REPORT_INTERVAL;
+            reports.clear();
+            {
+                std::lock_guard<std::mutex> lk(app.jitter_mutex);
+                for (auto& [uid, jb] : app.jitter_buffers) {
+                    uint32_t expected = jb.received + jb.lost;
+                    if (lilypad::is_voice_mix_sender(uid) || expected < VOICE_LOSS_REPORT_MIN) continue;
+                    reports.push_back(lilypad::make_voice_loss_report_msg(
+                        uid, static_cast<uint8_t>((jb.lost * 100 + expected / 2) / expected)));
+                    jb.received = 0;
+                    jb.lost     = 0;
+                }
+            }
+            for (auto& msg : reports) app.send_tcp(msg);
+        }
+
         fd_set read_set;
         FD_ZERO(&read_set);
         FD_SET(app.udp->get(), &read_set);
@@ -348,8 +482,9 @@ void udp_receive_thread_func(AppState& app) {
 
             auto pkt = lilypad::VoicePacket::from_bytes(buf, static_cast<size_t>(received));
 
-            // Record voice activity for talking indicator
-            {
+            // Record voice activity for talking indicator. Senders with the header
+            // extension say whether they are talking; older clients only transmit.
+            if (!pkt.audio.present || pkt.audio.vad) {
                 std::lock_guard<std::mutex> lk(app.voice_activity_mutex);
                 app.voice_last_seen[pkt.client_id] = std::chrono::steady_clock::now();
             }
@@ -357,12 +492,38 @@ void udp_receive_thread_func(AppState& app) {
             std::lock_guard<std::mutex> lk(app.jitter_mutex);
             // Get or create decoder for this user
             auto [dec_it, dec_inserted] = app.voice_decoders.try_emplace(pkt.client_id);
-            auto pcm = dec_it->second.decode(pkt.opus_data.data(),
-                                              static_cast<int>(pkt.opus_data.size()));
+            auto& decoder = dec_it->second;
+            auto& jb      = app.jitter_buffers[pkt.client_id];
+
+            // Sequence gap: rebuild what was lost before decoding this packet. A
+            // packet from just behind was already concealed; a far jump back is a
+            // restarted sender.
+            uint32_t gap  = jb.seq_known ? pkt.sequence - jb.next_seq : 0;
+            bool     late = gap >= 0x80000000u && 0u - gap <= VOICE_MAX_CONCEALED_GAP;
+            if (!late) {
+                if (gap >= 0x80000000u) gap = 0;
+                jb.seq_known = true;
+                jb.next_seq  = pkt.sequence + 1;
+                jb.received++;
+                if (gap > 0 && gap <= VOICE_MAX_CONCEALED_GAP) {
+                    jb.lost += gap;
+                    // Only what fits beside this packet's frame: rebuilding more
+                    // would evict frames already queued in order. The newest
+                    // missing frames are the ones kept (FEC rebuilds the last).
+                    size_t   queued = jb.frames.size() + 1;
+                    uint32_t fill   = (std::min)(gap, static_cast<uint32_t>(
+                        queued < JitterBuffer::MAX_DEPTH ? JitterBuffer::MAX_DEPTH - queued : 0));
+                    for (uint32_t i = 1; i < fill; ++i) jb.frames.push_back(decoder.decode_plc());
+                    if (fill > 0) {
+                        jb.frames.push_back(decoder.decode_fec(pkt.opus_data.data(),
+                                                               static_cast<int>(pkt.opus_data.size())));
+                    }
+                }
 
-            // Push into jitter buffer
-            auto& jb = app.jitter_buffers[pkt.client_id];
-            jb.frames.push_back(std::move(pcm));
+                // Push into jitter buffer
+                jb.frames.push_back(decoder.decode(pkt.opus_data.data(),
+                                                   static_cast<int>(pkt.opus_data.size())));
+            }
             // Discard oldest if exceeded max depth to prevent latency buildup
             while (jb.frames.size() > JitterBuffer::MAX_DEPTH) {
                 jb.frames.pop_front();
@@ -378,6 +539,141 @@ void udp_receive_thread_func(AppState& app) {
     }
 }
 
+// ── Screen media receive thread (runs while connected) ──
+// Idle unless the watched stream comes over UDP: then keeps the server's route
+// to this socket alive, reassembles frames and feeds the same decode paths as
+// SCREEN_FRAME / SCREEN_AUDIO. After a lost video frame, deltas are useless
+// until the next keyframe, so they are skipped and the sharer is asked for one.
+// Of a simulcast share the server sends one layer, and moves us to another
+// starting at one of its keyframes. Also sends the receiver report on the
+// watched stream, whichever way it comes.
+void media_receive_thread_func(AppState& app) {
+    using clock = std::chrono::steady_clock;
+    std::vector<uint8_t>             buf(lilypad::MAX_MEDIA_PACKET);
+    std::vector<uint8_t>             body(lilypad::MAX_MEDIA_PACKET);
+    std::vector<lilypad::MediaFrame> frames;
+    lilypad::MediaReassembler        video, audio;
+    uint32_t          stream = 0;
+    uint32_t          keepalive_seq = 0;
+    uint8_t           layer = 0;  // simulcast layer of the video being reassembled
+    bool              need_keyframe = true;
+    clock::time_point next_keepalive{}, last_keyframe_request{};
+    clock::time_point next_report = clock::now() + lilypad::SCREEN_REPORT_INTERVAL;
+
+    while (app.running && app.connected) {
+        auto now = clock::now();
+        if (now >= next_report) {
+            next_report = now + lilypad::SCREEN_REPORT_INTERVAL;
+            uint32_t watching = app.watching_user_id.load();
+            lilypad::ScreenReceiverReport report;
+            {
+                std::lock_guard<std::mutex> lk(app.screen_stats_mutex);
+                if (app.screen_stats_id != watching) {
+                    app.screen_stats_id = watching;  // started, stopped or switched: start counting afresh
+                    app.screen_stats.reset(now);
+                } else if (watching != 0) {
+                    report = app.screen_stats.take(watching, now);
+                }
+            }
+            if (report.frames + report.lost > 0) app.send_tcp(lilypad::make_screen_receiver_report_msg(report));
+        }
+        {
+            std::lock_guard<std::mutex> lk(app.media_mutex);
+            if (app.media_watch_id != 0 && app.media_watch_id != app.watching_user_id.load()) {
+                app.media_watch_id = 0;  // stopped or switched: that key is done
+                app.media_watch_cipher.reset();
+            }
+            if (app.media_watch_id != stream) {
+                stream = app.media_watch_id;
+                video.reset();
+                audio.reset();
+                layer          = 0;
+                need_keyframe  = true;
+                next_keepalive = now;
+            }
+            if (app.media_watch_cipher && now >= next_keepalive) {
+                lilypad::MediaHeader h;
+                h.type      = lilypad::MediaType::KEEPALIVE;
+                h.client_id = app.my_id;
+                h.stream_id = stream;
+                h.seq       = keepalive_seq++;
+                size_t len  = app.media_watch_cipher->seal(h, nullptr, 0, buf.data());
+                sendto(app.media_udp->get(), reinterpret_cast<const char*>(buf.data()), static_cast<int>(len), 0,
+                       reinterpret_cast<const sockaddr*>(&app.media_dest), sizeof(app.media_dest));
+                next_keepalive = now + MEDIA_KEEPALIVE_INTERVAL;
+            }
+        }
+
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(app.media_udp->get(), &read_set);
+
+        timeval timeout{};
+        timeout.tv_sec  = 0;
+        timeout.tv_usec = 100000;
+
+        int ready = select(0, &read_set, nullptr, nullptr, &timeout);
+        if (ready <= 0) continue;
+
+        // Drain everything that arrived (socket is non-blocking)
+        while (true) {
+            int received = recv(app.media_udp->get(), reinterpret_cast<char*>(buf.data()),
+                                static_cast<int>(buf.size()), 0);
+            if (received == SOCKET_ERROR && WSAGetLastError() == WSAECONNRESET) continue;
+            if (received <= 0) break;
+
+            lilypad::MediaHeader h;
+            if (!lilypad::parse_media_header(buf.data(), static_cast<size_t>(received), h)) continue;
+            if (stream == 0 || h.stream_id != stream || h.type == lilypad::MediaType::KEEPALIVE) continue;
+            int body_len;
+            {
+                std::lock_guard<std::mutex> lk(app.media_mutex);
+                if (!app.media_watch_cipher || app.media_watch_id != stream) continue;
+                body_len = app.media_watch_cipher->open(h, buf.data(), static_cast<size_t>(received), body.data());
+            }
+            if (body_len < 0) continue;
+
+            bool is_video = h.type == lilypad::MediaType::VIDEO;
+            if (is_video && lilypad::screen_layer(h.flags) != layer) {
+                // Stragglers of the layer we were moved off, or the new one's first keyframe
+                if (!(h.flags & lilypad::SCREEN_FLAG_KEYFRAME)) continue;
+                layer = lilypad::screen_layer(h.flags);
+                video.reset();
+            }
+
+            frames.clear();
+            (is_video ? video : audio).push(h, body.data(), static_cast<size_t>(body_len), frames);
+            {
+                std::lock_guard<std::mutex> lk(app.screen_stats_mutex);
+                if (app.screen_stats_id == stream) {
+                    app.screen_stats.on_datagram(h, static_cast<size_t>(received), clock::now());
+                    if (is_video)
+                        for (auto& frame : frames) app.screen_stats.on_frame(frame.lost);
+                }
+            }
+            for (auto& frame : frames) {
+                if (!is_video) {
+                    if (!frame.lost) deliver_screen_audio(app, frame.data.data(), frame.data.size());
+                    continue;
+                }
+                if (frame.lost) {
+                    need_keyframe = true;
+                    auto t = clock::now();
+                    if (t - last_keyframe_request >= MEDIA_KEYFRAME_INTERVAL) {
+                        last_keyframe_request = t;
+                        app.send_tcp(lilypad::make_screen_request_keyframe_msg(stream));
+                    }
+                    continue;
+                }
+                if (frame.data.size() < 5) continue;
+                if (need_keyframe && !(frame.data[4] & lilypad::SCREEN_FLAG_KEYFRAME)) continue;
+                need_keyframe = false;
+                deliver_screen_frame(app, frame.data.data(), frame.data.size());
+            }
+        }
+    }
+}
+
 // ── Audio playback thread: hardware-paced, drains jitter buffers, mixes, writes ──
 void audio_playback_thread_func(AppState& app) {
     SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
@@ -4,6 +4,7 @@
 
 #include <fstream>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
 
 std::string get_lilypad_dir() {
@@ -203,9 +204,35 @@ void save_session(const std::string& server_ip, const std::string& username, con
     file << '\n';
 }
 
+// ── TLS session persistence ──
+// Kept next to the token file; the blob is a DER-encoded SSL_SESSION.
+
+static std::string get_tls_session_path(const std::string& server_ip) {
+    std::string dir = get_sessions_dir();
+    if (dir.empty()) return "";
+    return dir + "\\" + sanitize_ip(server_ip) + ".tls";
+}
+
 void clear_session(const std::string& server_ip) {
-    std::string path = get_session_path(server_ip);
-    if (!path.empty()) {
-        DeleteFileA(path.c_str());
+    // The TLS session holds its resumption secret: it goes with the token
+    for (const std::string& path : {get_session_path(server_ip), get_tls_session_path(server_ip)}) {
+        if (!path.empty()) DeleteFileA(path.c_str());
     }
 }
+
+std::vector<uint8_t> load_tls_session(const std::string& server_ip) {
+    std::string path = get_tls_session_path(server_ip);
+    if (path.empty()) return {};
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return {};
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void save_tls_session(const std::string& server_ip, const std::vector<uint8_t>& session) {
+    std::string path = get_tls_session_path(server_ip);
+    if (path.empty()) return;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(session.data()), static_cast<std::streamsize>(session.size()));
+}
@@ -28,3 +28,7 @@ struct SavedSession {
 SavedSession load_session(const std::string& server_ip);
 void save_session(const std::string& server_ip, const std::string& username, const uint8_t* token);
 void clear_session(const std::string& server_ip);
+
+// ── TLS sessions (fast reconnect: one-RTT resumption instead of a full handshake) ──
+std::vector<uint8_t> load_tls_session(const std::string& server_ip);
+void save_tls_session(const std::string& server_ip, const std::vector<uint8_t>& session);
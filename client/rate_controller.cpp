@@ -0,0 +1,57 @@
+#include "rate_controller.h"
+
+#include <algorithm>
+
+namespace lilypad {
+
+constexpr int    OVERUSE_SLOPE_MS   = 8;      // delay growing faster than this (ms/s) = a queue is building
+constexpr double HEAVY_LOSS         = 0.10;   // back off above this fraction of frames lost
+constexpr double LIGHT_LOSS         = 0.02;   // hold between the two
+constexpr double SKIP_BACKLOG       = 0.10;   // fraction of frames skipped at the sender that means backoff
+constexpr double BACKOFF_FACTOR     = 0.85;
+constexpr double FAST_INCREASE      = 1.08;   // per second, well below the last backoff
+constexpr int    SLOW_INCREASE_BPS  = 250000; // per second, near it
+constexpr auto   BACKOFF_HOLD       = std::chrono::milliseconds(1500);  // until a report covers only the new rate
+
+ScreenRateController::ScreenRateController(int cap_bps, int min_bps)
+    : cap_(cap_bps), min_((std::min)(min_bps, cap_bps)), estimate_(cap_bps) {}
+
+void ScreenRateController::set_cap(int cap_bps) {
+    cap_      = cap_bps;
+    min_      = (std::min)(min_, cap_);
+    estimate_ = (std::min)(estimate_, cap_);
+}
+
+void ScreenRateController::on_report(const ScreenReceiverReport& report, Clock::time_point now) {
+    uint32_t total    = static_cast<uint32_t>(report.frames) + report.lost;
+    double   loss     = total > 0 ? static_cast<double>(report.lost) / total : 0.0;
+    bool     overuse  = report.delay_slope != SCREEN_DELAY_UNKNOWN && report.delay_slope > OVERUSE_SLOPE_MS;
+    int      received = static_cast<int>((std::min)(report.recv_kbps, 2000000u)) * 1000;
+
+    if (overuse || loss > HEAVY_LOSS) {
+        // What got through is what the path carries; aim below it so the queue drains
+        decrease(received > 0 ? (std::min)(received, estimate_) : estimate_, now);
+    } else if (loss <= LIGHT_LOSS) {
+        increase(now);
+    }
+}
+
+void ScreenRateController::on_send_backlog(int skipped, int frames, Clock::time_point now) {
+    if (frames > 0 && static_cast<double>(skipped) / frames > SKIP_BACKLOG) decrease(estimate_, now);
+}
+
+void ScreenRateController::decrease(int toward_bps, Clock::time_point now) {
+    if (now < hold_until_) return;  // the previous backoff hasn't shown up in reports yet
+    last_backoff_ = toward_bps;
+    estimate_     = (std::max)(min_, static_cast<int>(toward_bps * BACKOFF_FACTOR));
+    hold_until_   = now + BACKOFF_HOLD;
+}
+
+void ScreenRateController::increase(Clock::time_point now) {
+    if (now < hold_until_ || estimate_ >= cap_) return;
+    bool near_backoff = last_backoff_ > 0 && estimate_ >= last_backoff_ * 0.8;
+    int  next = near_backoff ? estimate_ + SLOW_INCREASE_BPS : static_cast<int>(estimate_ * FAST_INCREASE);
+    estimate_ = (std::min)(cap_, next);
+}
+
+} // namespace lilypad
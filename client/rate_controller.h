@@ -0,0 +1,41 @@
+#pragma once
+
+#include "protocol.h"
+
+#include <chrono>
+
+namespace lilypad {
+
+// ── Delay-based bitrate control for screen sharing ──
+// Fed once a second with the server's aggregate of what the receivers saw
+// (SCREEN_RECEIVER_REPORT) and with how many frames the capture loop skipped
+// because the previous one was still being sent (the only signal a TCP sharer
+// without reports has). Backs off below the rate receivers actually get when
+// delay is building up, loss is heavy or frames pile up here; otherwise climbs
+// back, quickly while well below the last backoff and gently near it.
+class ScreenRateController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ScreenRateController(int cap_bps, int min_bps);
+
+    void on_report(const ScreenReceiverReport& report, Clock::time_point now);
+    void on_send_backlog(int skipped, int frames, Clock::time_point now);
+
+    // Upper bound from the resolution table or the user's bitrate setting
+    void set_cap(int cap_bps);
+
+    int target() const { return estimate_; }
+
+private:
+    void decrease(int toward_bps, Clock::time_point now);
+    void increase(Clock::time_point now);
+
+    int               cap_;
+    int               min_;
+    int               estimate_;
+    int               last_backoff_ = 0;  // rate the path carried at the last backoff; 0 = never
+    Clock::time_point hold_until_{};      // no increases while the last backoff takes effect
+};
+
+} // namespace lilypad
@@ -213,4 +213,112 @@ int ScreenCapturer::screen_height() const {
     return static_cast<ScreenCapturerImpl*>(impl_)->screen_h;
 }
 
+// ════════════════════════════════════════════════════════════════
+//  Half-resolution copies for simulcast
+// ════════════════════════════════════════════════════════════════
+
+struct TextureHalverImpl {
+    ID3D11Device*             device   = nullptr;  // not owned
+    ID3D11DeviceContext*      context  = nullptr;
+    ID3D11Texture2D*          mips     = nullptr;  // full size + one mip level
+    ID3D11ShaderResourceView* mips_srv = nullptr;
+    ID3D11Texture2D*          half     = nullptr;  // mip 1, trimmed to even dimensions
+    UINT                      src_w    = 0;
+    UINT                      src_h    = 0;
+    DXGI_FORMAT               format   = DXGI_FORMAT_UNKNOWN;
+    bool                      failed   = false;    // format can't generate mips: don't retry every frame
+};
+
+TextureHalver::TextureHalver() {
+    impl_ = new TextureHalverImpl();
+}
+
+TextureHalver::~TextureHalver() {
+    release();
+    delete static_cast<TextureHalverImpl*>(impl_);
+}
+
+void TextureHalver::release() {
+    auto* p = static_cast<TextureHalverImpl*>(impl_);
+    if (p->half)     { p->half->Release();     p->half     = nullptr; }
+    if (p->mips_srv) { p->mips_srv->Release(); p->mips_srv = nullptr; }
+    if (p->mips)     { p->mips->Release();     p->mips     = nullptr; }
+    if (p->context)  { p->context->Release();  p->context  = nullptr; }
+    p->device = nullptr;
+    p->src_w  = p->src_h = 0;
+}
+
+bool TextureHalver::create(ID3D11Texture2D* src) {
+    auto* p = static_cast<TextureHalverImpl*>(impl_);
+    release();
+
+    D3D11_TEXTURE2D_DESC sd{};
+    src->GetDesc(&sd);
+    src->GetDevice(&p->device);
+    p->device->Release();  // the source texture keeps it alive
+    p->device->GetImmediateContext(&p->context);
+
+    UINT support = 0;
+    if (FAILED(p->device->CheckFormatSupport(sd.Format, &support)) ||
+        !(support & D3D11_FORMAT_SUPPORT_MIP_AUTOGEN)) {
+        OutputDebugStringA("[ScreenCap] Capture format can't generate mips, no half-size layers\n");
+        p->failed = true;
+        return false;
+    }
+
+    D3D11_TEXTURE2D_DESC td{};
+    td.Width            = sd.Width;
+    td.Height           = sd.Height;
+    td.MipLevels        = 2;
+    td.ArraySize        = 1;
+    td.Format           = sd.Format;
+    td.SampleDesc.Count = 1;
+    td.Usage            = D3D11_USAGE_DEFAULT;
+    td.BindFlags        = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    td.MiscFlags        = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+    if (FAILED(p->device->CreateTexture2D(&td, nullptr, &p->mips)) ||
+        FAILED(p->device->CreateShaderResourceView(p->mips, nullptr, &p->mips_srv))) {
+        release();
+        return false;
+    }
+
+    // Encoder input, like ScreenCapturer's copy
+    td.Width     = (sd.Width / 2) & ~1u;
+    td.Height    = (sd.Height / 2) & ~1u;
+    td.MipLevels = 1;
+    td.BindFlags = 0;
+    td.MiscFlags = 0;
+    if (FAILED(p->device->CreateTexture2D(&td, nullptr, &p->half))) {
+        release();
+        return false;
+    }
+
+    p->src_w  = sd.Width;
+    p->src_h  = sd.Height;
+    p->format = sd.Format;
+    return true;
+}
+
+ID3D11Texture2D* TextureHalver::halve(ID3D11Texture2D* src) {
+    auto* p = static_cast<TextureHalverImpl*>(impl_);
+    if (!src || p->failed) return nullptr;
+
+    D3D11_TEXTURE2D_DESC sd{};
+    src->GetDesc(&sd);
+    if (!p->half || sd.Width != p->src_w || sd.Height != p->src_h || sd.Format != p->format) {
+        if (!create(src)) return nullptr;
+    }
+
+    // Full size into mip 0, let the GPU average it down into mip 1, keep that
+    p->context->CopySubresourceRegion(p->mips, 0, 0, 0, 0, src, 0, nullptr);
+    p->context->GenerateMips(p->mips_srv);
+
+    D3D11_BOX box{};
+    box.right  = (p->src_w / 2) & ~1u;
+    box.bottom = (p->src_h / 2) & ~1u;
+    box.back   = 1;
+    p->context->CopySubresourceRegion(p->half, 0, 0, 0, 0, p->mips, 1, &box);
+    return p->half;
+}
+
 } // namespace lilypad
@@ -66,4 +66,24 @@ private:
     void release_dxgi();
 };
 
+// Half-resolution copy of a captured frame, made on the GPU (box filter via the
+// texture's mip chain), for the lower simulcast layers. Sized from the first
+// frame it is given and resized if the capture size changes.
+class TextureHalver {
+public:
+    TextureHalver();
+    ~TextureHalver();
+    TextureHalver(const TextureHalver&) = delete;
+    TextureHalver& operator=(const TextureHalver&) = delete;
+
+    // Returns a D3D11_USAGE_DEFAULT texture of (width / 2) & ~1 by (height / 2) & ~1
+    // (owned by this class, valid until the next call), or nullptr on failure.
+    ID3D11Texture2D* halve(ID3D11Texture2D* src);
+
+private:
+    void* impl_ = nullptr;
+    bool create(ID3D11Texture2D* src);
+    void release();
+};
+
 } // namespace lilypad
@@ -2,14 +2,51 @@
 #include "d3d_helpers.h"
 #include "h264_encoder.h"
 #include "h264_decoder.h"
+#include "rate_controller.h"
 #include "screen_capture.h"
 #include "system_audio.h"
 
 #include <mfapi.h>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
+// Rate control never takes screen video below this
+constexpr int SCREEN_MIN_BITRATE = 1000000;
+
+// Frames of one layer the send thread may be behind before it cuts that layer
+constexpr int SCREEN_SEND_MAX_BACKLOG = 3;
+
+// Simulcast layers below the full-quality one, both at half resolution: every
+// frame, and every SCREEN_LOW_FPS_STEP-th (5 fps). Their bitrates follow the
+// full layer's target, as a share of it with a floor.
+struct SimulcastLayerSpec {
+    int    frame_step;
+    double share;
+    int    min_bps;
+};
+constexpr int                SCREEN_LOW_FPS_STEP = 6;
+constexpr SimulcastLayerSpec SIMULCAST_LAYERS[] = {
+    {1,                   0.25, 300000},  // layer 1
+    {SCREEN_LOW_FPS_STEP, 0.10, 150000},  // layer 2
+};
+constexpr int SIMULCAST_LOW_LAYERS = sizeof(SIMULCAST_LAYERS) / sizeof(SIMULCAST_LAYERS[0]);
+static_assert(SIMULCAST_LOW_LAYERS + 1 <= lilypad::SCREEN_LAYER_COUNT, "more layers than the protocol carries");
+
+// Bitrate cap for a capture this size when the setting is auto
+static int auto_bitrate(int width, int height) {
+    int pixels = width * height;
+    if (pixels >= 3686400) return 30000000;  // 2560x1440+: 30 Mbps
+    if (pixels >= 2073600) return 18000000;  // 1920x1080:  18 Mbps
+    if (pixels >= 921600)  return 10000000;  // 1280x720:   10 Mbps
+    return 6000000;                          // smaller:    6 Mbps
+}
+
+static int simulcast_bitrate(const SimulcastLayerSpec& spec, int full_bps) {
+    return (std::max)(spec.min_bps, static_cast<int>(full_bps * spec.share));
+}
+
 // ── Screen decode thread: decodes H.264->RGBA via Media Foundation ──
 void screen_decode_thread_func(AppState& app) {
     (void)CoInitializeEx(nullptr, COINIT_MULTITHREADED);
@@ -72,8 +109,48 @@ void screen_decode_thread_func(AppState& app) {
     CoUninitialize();
 }
 
-// ── Screen send thread: drains queue with audio priority, drops stale video frames ──
+// Flags byte of a queued SCREEN_FRAME (keyframe, simulcast layer)
+static uint8_t screen_frame_flags(const ScreenSendItem& item) {
+    return item.data[lilypad::SIGNAL_HEADER_SIZE + 4];
+}
+
+// ── Send one queued item over UDP if the server gave us a media key ──
+// Returns false (the caller falls back to TCP) until then. Frames are numbered
+// and stamped here, as sent, so receivers see a gap only for real loss and a
+// delay trend only from the network.
+static bool send_screen_media(AppState& app, lilypad::MediaPacketizer& packetizer,
+                              const ScreenSendItem& item, uint32_t& seq) {
+    std::lock_guard<std::mutex> lk(app.media_mutex);
+    if (!app.media_send_cipher || !app.media_udp) return false;
+
+    const uint8_t* body     = item.data.data() + lilypad::SIGNAL_HEADER_SIZE;
+    size_t         body_len = item.data.size() - lilypad::SIGNAL_HEADER_SIZE;
+    auto           type     = item.is_audio ? lilypad::MediaType::AUDIO : lilypad::MediaType::VIDEO;
+    uint8_t        flags    = item.is_audio ? 0 : screen_frame_flags(item);
+    auto           send_ms  = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  std::chrono::steady_clock::now().time_since_epoch()).count());
+    auto& packets = packetizer.packetize(*app.media_send_cipher, type, app.my_id, app.my_id, seq++, flags,
+                                         send_ms, body, body_len);
+    for (auto& pkt : packets) {
+        sendto(app.media_udp->get(), reinterpret_cast<const char*>(pkt.data()), static_cast<int>(pkt.size()), 0,
+               reinterpret_cast<const sockaddr*>(&app.media_dest), sizeof(app.media_dest));
+    }
+    return true;
+}
+
+// ── Screen send thread: drains queue with audio priority, then video in order ──
+// Every P-frame is the reference for the next one, so video is not thinned
+// here: the capture thread skips encoding a layer whose last frame is still
+// queued. A layer that falls SCREEN_SEND_MAX_BACKLOG frames behind anyway is
+// cut back to its newest keyframe, or if the batch has none, dropped until the
+// IDR we ask the capture thread for. Viewers then freeze on the last good
+// frame instead of decoding ones whose references never arrived.
 void screen_send_thread_func(AppState& app) {
+    lilypad::MediaPacketizer packetizer;
+    uint32_t video_seq[lilypad::SCREEN_LAYER_COUNT] = {};  // UDP frames are numbered per layer
+    uint32_t audio_seq = 0;
+    bool     awaiting_idr[lilypad::SCREEN_LAYER_COUNT] = {};  // a reference was dropped
+
     while (app.running && app.connected && app.screen_sharing) {
         std::deque<ScreenSendItem> batch;
         {
@@ -88,17 +165,49 @@ void screen_send_thread_func(AppState& app) {
         // Send ALL audio items first (small packets, latency-sensitive)
         for (auto& item : batch) {
             if (item.is_audio) {
-                app.send_tcp(item.data);
+                if (!send_screen_media(app, packetizer, item, audio_seq)) app.send_tcp(item.data);
             }
         }
 
-        // Send only the NEWEST video frame (drop older ones to prevent queue buildup)
-        for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
-            if (!it->is_audio) {
-                app.send_tcp(it->data);
-                break;
+        // Per layer: the first frame still worth sending. Nothing before a
+        // keyframe is referenced after it, so that much can always go.
+        int    frames[lilypad::SCREEN_LAYER_COUNT]     = {};
+        size_t newest_key[lilypad::SCREEN_LAYER_COUNT] = {};
+        bool   have_key[lilypad::SCREEN_LAYER_COUNT]   = {};
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i].is_audio) continue;
+            uint8_t flags = screen_frame_flags(batch[i]);
+            uint8_t layer = lilypad::screen_layer(flags);
+            frames[layer]++;
+            if (flags & lilypad::SCREEN_FLAG_KEYFRAME) {
+                newest_key[layer] = i;
+                have_key[layer]   = true;
+            }
+        }
+        size_t  send_from[lilypad::SCREEN_LAYER_COUNT] = {};
+        uint8_t cut = 0;
+        for (uint8_t l = 0; l < lilypad::SCREEN_LAYER_COUNT; ++l) {
+            if (frames[l] <= SCREEN_SEND_MAX_BACKLOG) continue;
+            if (have_key[l]) {
+                send_from[l] = newest_key[l];
+            } else {
+                send_from[l]    = batch.size();
+                awaiting_idr[l] = true;
+                cut |= static_cast<uint8_t>(1u << l);
             }
         }
+        if (cut) app.screen_idr_layers.fetch_or(cut);
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            auto& item = batch[i];
+            if (item.is_audio) continue;
+            uint8_t flags = screen_frame_flags(item);
+            uint8_t layer = lilypad::screen_layer(flags);
+            if (i < send_from[layer]) continue;
+            if (flags & lilypad::SCREEN_FLAG_KEYFRAME) awaiting_idr[layer] = false;
+            else if (awaiting_idr[layer]) continue;
+            if (!send_screen_media(app, packetizer, item, video_seq[layer])) app.send_tcp(item.data);
+        }
     }
 }
 
@@ -123,16 +232,11 @@ void screen_capture_thread_func(AppState& app) {
     int enc_w = capturer.screen_width() & ~1;
     int enc_h = capturer.screen_height() & ~1;
 
-    // Auto bitrate based on resolution
+    // Auto bitrate based on resolution, unless the user set one
+    const int auto_cap = auto_bitrate(enc_w, enc_h);
+    app.screen_auto_bitrate = auto_cap;
     int bitrate = app.h264_bitrate.load();
-    if (bitrate <= 0) {
-        int pixels = enc_w * enc_h;
-        if (pixels >= 3686400)       bitrate = 30000000;  // 2560x1440+: 30 Mbps
-        else if (pixels >= 2073600)  bitrate = 18000000;  // 1920x1080:  18 Mbps
-        else if (pixels >= 921600)   bitrate = 10000000;  // 1280x720:   10 Mbps
-        else                         bitrate = 6000000;   // smaller:    6 Mbps
-        app.h264_bitrate.store(bitrate);
-    }
+    if (bitrate <= 0) bitrate = auto_cap;
 
     lilypad::H264Encoder encoder;
     if (!encoder.init(capturer.get_device(), enc_w, enc_h, fps_val, bitrate)) {
@@ -141,32 +245,103 @@ void screen_capture_thread_func(AppState& app) {
         return;
     }
 
-    int cap_frame = 0;
+    // Simulcast: the lower layers, each its own encoder fed a half-size copy
+    lilypad::TextureHalver halver;
+    lilypad::H264Encoder   low_encoders[SIMULCAST_LOW_LAYERS];
+    int  low_w = (enc_w / 2) & ~1;
+    int  low_h = (enc_h / 2) & ~1;
+    bool simulcast = app.screen_simulcast.load();
+    for (int i = 0; simulcast && i < SIMULCAST_LOW_LAYERS; ++i) {
+        const auto& spec = SIMULCAST_LAYERS[i];
+        if (!low_encoders[i].init(capturer.get_device(), low_w, low_h, fps_val / spec.frame_step,
+                                  simulcast_bitrate(spec, bitrate))) {
+            app.add_system_msg("H.264 encoder init failed for the lower quality layers, sending full quality only");
+            simulcast = false;
+        }
+    }
+
+    // The bitrate above is the cap; the network estimate from our viewers'
+    // reports (and our own send backlog) decides how much of it to use
+    int cap = bitrate;
+    lilypad::ScreenRateController rate(cap, SCREEN_MIN_BITRATE);
+    app.screen_send_bitrate = bitrate;
+    {
+        std::lock_guard<std::mutex> lk(app.screen_rate_mutex);
+        app.screen_rate_report_new = false;  // left over from an earlier share
+    }
+    int  window_frames = 0, window_skipped = 0;
+    auto window_start  = clock::now();
+
+    bool force_idr[lilypad::SCREEN_LAYER_COUNT] = {};  // owed until that layer's next encode
+    int  cap_frame = 0;
     while (app.running && app.connected && app.screen_sharing) {
         next_frame += std::chrono::milliseconds(interval_ms);
 
-        // Skip this frame if a video frame is still queued (sender can't keep up)
+        // Rate control: feed it what's new, then follow its target
+        {
+            auto now = clock::now();
+            int setting = app.h264_bitrate.load();
+            int new_cap = setting > 0 ? setting : auto_cap;  // back to auto: the table's again
+            if (new_cap != cap) {
+                cap = new_cap;
+                rate.set_cap(cap);
+            }
+            lilypad::ScreenReceiverReport report;
+            bool have_report = false;
+            {
+                std::lock_guard<std::mutex> lk(app.screen_rate_mutex);
+                have_report = app.screen_rate_report_new;
+                report      = app.screen_rate_report;
+                app.screen_rate_report_new = false;
+            }
+            if (have_report) rate.on_report(report, now);
+            if (now - window_start >= lilypad::SCREEN_REPORT_INTERVAL) {
+                rate.on_send_backlog(window_skipped, window_frames, now);
+                window_frames = window_skipped = 0;
+                window_start  = now;
+            }
+            if (rate.target() != bitrate) {
+                bitrate = rate.target();
+                encoder.set_bitrate(bitrate);
+                for (int i = 0; simulcast && i < SIMULCAST_LOW_LAYERS; ++i)
+                    low_encoders[i].set_bitrate(simulcast_bitrate(SIMULCAST_LAYERS[i], bitrate));
+                app.screen_send_bitrate = bitrate;
+            }
+        }
+        window_frames++;
+
+        // A layer whose previous frame is still queued skips encoding this one
+        // (sender can't keep up). Its encoder then references only frames that
+        // go out; dropping encoded output instead would break the rest of the GOP.
+        bool pending[lilypad::SCREEN_LAYER_COUNT] = {};
         {
             std::lock_guard<std::mutex> lk(app.screen_send_mutex);
-            bool has_pending_frame = false;
             for (auto& item : app.screen_send_queue) {
-                if (!item.is_audio) { has_pending_frame = true; break; }
-            }
-            if (has_pending_frame) {
-                auto now = clock::now();
-                if (next_frame > now)
-                    std::this_thread::sleep_until(next_frame);
-                else
-                    next_frame = now;
-                continue;
+                if (!item.is_audio) pending[lilypad::screen_layer(screen_frame_flags(item))] = true;
             }
         }
+        bool encode[lilypad::SCREEN_LAYER_COUNT] = {!pending[0]};
+        bool encode_low = false;
+        for (int i = 0; simulcast && i < SIMULCAST_LOW_LAYERS; ++i) {
+            encode[i + 1] = !pending[i + 1] && (cap_frame + 1) % SIMULCAST_LAYERS[i].frame_step == 0;
+            encode_low   |= encode[i + 1];
+        }
+        if (pending[0]) window_skipped++;
+        if (!encode[0] && !encode_low) {
+            auto now = clock::now();
+            if (next_frame > now)
+                std::this_thread::sleep_until(next_frame);
+            else
+                next_frame = now;
+            continue;
+        }
 
-        // Update bitrate if changed
-        int new_bitrate = app.h264_bitrate.load();
-        if (new_bitrate != bitrate) {
-            bitrate = new_bitrate;
-            encoder.set_bitrate(bitrate);
+        // A keyframe request is for every layer: the viewer may be on any of them.
+        // The send thread's is for the layers it cut.
+        uint8_t idr_layers = app.screen_idr_layers.exchange(0);
+        if (app.force_keyframe.exchange(false)) idr_layers = 0xFF;
+        for (uint8_t l = 0; l < lilypad::SCREEN_LAYER_COUNT; ++l) {
+            if (idr_layers & (1u << l)) force_idr[l] = true;
         }
 
         int w = 0, h = 0;
@@ -175,25 +350,38 @@ void screen_capture_thread_func(AppState& app) {
         cap_frame++;
 
         if (tex) {
-            bool force_idr = app.force_keyframe.exchange(false);
-            bool is_keyframe = false;
-            auto h264 = encoder.encode(tex, force_idr, is_keyframe);
-
-            if (!h264.empty()) {
-                uint8_t flags = is_keyframe ? lilypad::SCREEN_FLAG_KEYFRAME : 0;
+            auto queue_frame = [&](uint8_t layer, int width, int height, const std::vector<uint8_t>& data, bool key) {
+                uint8_t flags = key ? lilypad::SCREEN_FLAG_KEYFRAME : 0;
                 auto msg = lilypad::make_screen_frame_msg(
-                    static_cast<uint16_t>(enc_w), static_cast<uint16_t>(enc_h),
-                    flags, h264.data(), h264.size());
-
+                    static_cast<uint16_t>(width), static_cast<uint16_t>(height),
+                    flags, layer, data.data(), data.size());
                 {
                     std::lock_guard<std::mutex> lk(app.screen_send_mutex);
                     app.screen_send_queue.push_back({std::move(msg), false});
                 }
                 app.screen_send_cv.notify_one();
-            } else if (cap_frame <= 10) {
-                char dbg[128];
-                snprintf(dbg, sizeof(dbg), "[CapThread] Frame %d: encode returned empty\n", cap_frame);
-                OutputDebugStringA(dbg);
+            };
+
+            if (encode[0]) {
+                bool is_keyframe = false;
+                auto h264 = encoder.encode(tex, force_idr[0], is_keyframe);
+                force_idr[0] = false;
+                if (!h264.empty()) {
+                    queue_frame(0, enc_w, enc_h, h264, is_keyframe);
+                } else if (cap_frame <= 10) {
+                    char dbg[128];
+                    snprintf(dbg, sizeof(dbg), "[CapThread] Frame %d: encode returned empty\n", cap_frame);
+                    OutputDebugStringA(dbg);
+                }
+            }
+
+            ID3D11Texture2D* half = encode_low ? halver.halve(tex) : nullptr;
+            for (int i = 0; half && i < SIMULCAST_LOW_LAYERS; ++i) {
+                if (!encode[i + 1]) continue;
+                bool low_key = false;
+                auto low = low_encoders[i].encode(half, force_idr[i + 1], low_key);
+                force_idr[i + 1] = false;
+                if (!low.empty()) queue_frame(static_cast<uint8_t>(i + 1), low_w, low_h, low, low_key);
             }
         } else if (cap_frame <= 10) {
             char dbg[128];
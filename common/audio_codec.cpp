@@ -1,7 +1,19 @@
 #include "audio_codec.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace lilypad {
 
+float frame_level_db(const float* pcm, size_t count) {
+    if (count == 0) return -100.0f;
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) sum += static_cast<double>(pcm[i]) * pcm[i];
+    double rms = std::sqrt(sum / static_cast<double>(count));
+    if (rms < 1e-5) return -100.0f;
+    return static_cast<float>(20.0 * std::log10(rms));
+}
+
 // ── OpusEncoderWrapper ──
 
 OpusEncoderWrapper::OpusEncoderWrapper() {
@@ -13,6 +25,8 @@ OpusEncoderWrapper::OpusEncoderWrapper() {
     }
     opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(BITRATE));
     opus_encoder_ctl(encoder_, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    opus_encoder_ctl(encoder_, OPUS_SET_INBAND_FEC(1));
+    opus_encoder_ctl(encoder_, OPUS_SET_PACKET_LOSS_PERC(0));
 }
 
 OpusEncoderWrapper::~OpusEncoderWrapper() {
@@ -33,6 +47,13 @@ std::vector<uint8_t> OpusEncoderWrapper::encode(const float* pcm, int frame_size
     return out;
 }
 
+void OpusEncoderWrapper::set_packet_loss(int loss_perc) {
+    loss_perc = (std::max)(0, (std::min)(loss_perc, MAX_FEC_LOSS_PERC));
+    if (loss_perc == loss_perc_) return;
+    loss_perc_ = loss_perc;
+    opus_encoder_ctl(encoder_, OPUS_SET_PACKET_LOSS_PERC(loss_perc_));
+}
+
 // ── OpusDecoderWrapper ──
 
 OpusDecoderWrapper::OpusDecoderWrapper() {
@@ -75,4 +96,13 @@ std::vector<float> OpusDecoderWrapper::decode_plc(int frame_size) {
     return pcm;
 }
 
+std::vector<float> OpusDecoderWrapper::decode_fec(const uint8_t* data, int len, int frame_size) {
+    std::vector<float> pcm(frame_size * CHANNELS);
+    int decoded = opus_decode_float(decoder_, data, len,
+                                    pcm.data(), frame_size, 1);
+    if (decoded < 0) return decode_plc(frame_size);
+    pcm.resize(static_cast<size_t>(decoded * CHANNELS));
+    return pcm;
+}
+
 } // namespace lilypad
@@ -2,6 +2,7 @@
 
 #include <opus/opus.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
@@ -17,6 +18,12 @@ constexpr int BITRATE     = 64000;
 // Maximum encoded frame size in bytes
 constexpr int MAX_OPUS_PACKET = 4000;
 
+// Loss the encoder plans its in-band FEC for is kept within this range (%)
+constexpr int MAX_FEC_LOSS_PERC = 30;
+
+// Level of one PCM frame in dBFS (-100 for digital silence)
+float frame_level_db(const float* pcm, size_t count);
+
 // ── Opus encoder wrapper (RAII) ──
 class OpusEncoderWrapper {
 public:
@@ -24,17 +31,23 @@ public:
     ~OpusEncoderWrapper();
     OpusEncoderWrapper(const OpusEncoderWrapper&) = delete;
     OpusEncoderWrapper& operator=(const OpusEncoderWrapper&) = delete;
-    OpusEncoderWrapper(OpusEncoderWrapper&& other) noexcept : encoder_(other.encoder_) { other.encoder_ = nullptr; }
+    OpusEncoderWrapper(OpusEncoderWrapper&& other) noexcept : encoder_(other.encoder_), loss_perc_(other.loss_perc_) { other.encoder_ = nullptr; }
     OpusEncoderWrapper& operator=(OpusEncoderWrapper&& other) noexcept {
-        if (this != &other) { if (encoder_) opus_encoder_destroy(encoder_); encoder_ = other.encoder_; other.encoder_ = nullptr; }
+        if (this != &other) { if (encoder_) opus_encoder_destroy(encoder_); encoder_ = other.encoder_; loss_perc_ = other.loss_perc_; other.encoder_ = nullptr; }
         return *this;
     }
 
     // Encode one frame of PCM float samples. Returns Opus-encoded bytes.
     std::vector<uint8_t> encode(const float* pcm, int frame_size = FRAME_SIZE);
 
+    // In-band FEC is always on; the expected loss decides how much of each packet
+    // goes to a low-bitrate copy of the previous frame (none at 0%).
+    void set_packet_loss(int loss_perc);
+    int  packet_loss() const { return loss_perc_; }
+
 private:
-    OpusEncoder* encoder_ = nullptr;
+    OpusEncoder* encoder_   = nullptr;
+    int          loss_perc_ = 0;
 };
 
 // ── Opus decoder wrapper (RAII) ──
@@ -56,6 +69,10 @@ public:
     // Packet Loss Concealment: generate interpolated audio when a packet is missing.
     std::vector<float> decode_plc(int frame_size = FRAME_SIZE);
 
+    // Recover the frame before `data` from the FEC copy it carries; falls back to
+    // PLC if the packet has none. Decode `data` itself normally afterwards.
+    std::vector<float> decode_fec(const uint8_t* data, int len, int frame_size = FRAME_SIZE);
+
 private:
     OpusDecoder* decoder_ = nullptr;
 };
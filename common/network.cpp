@@ -4,6 +4,7 @@ namespace lilypad {
 
 // ── WinsockInit ──
 
+#ifdef _WIN32
 WinsockInit::WinsockInit() {
     WSADATA wsa;
     int result = WSAStartup(MAKEWORD(2, 2), &wsa);
@@ -15,6 +16,10 @@ WinsockInit::WinsockInit() {
 WinsockInit::~WinsockInit() {
     WSACleanup();
 }
+#else
+WinsockInit::WinsockInit() = default;
+WinsockInit::~WinsockInit() = default;
+#endif
 
 // ── Socket ──
 
@@ -95,10 +100,17 @@ Socket create_udp_socket() {
 }
 
 void set_nonblocking(SOCKET s) {
+#ifdef _WIN32
     u_long mode = 1;
     if (ioctlsocket(s, FIONBIO, &mode) != 0) {
         throw std::runtime_error("Failed to set non-blocking: " + std::to_string(WSAGetLastError()));
     }
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) != 0) {
+        throw std::runtime_error("Failed to set non-blocking: " + std::to_string(WSAGetLastError()));
+    }
+#endif
 }
 
 } // namespace lilypad
@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef _WIN32
+
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
@@ -7,6 +9,28 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
+#else
+
+// ── POSIX shim: lets the server and tools build on Linux with the Winsock names ──
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int    SOCKET_ERROR   = -1;
+constexpr int    SD_BOTH        = SHUT_RDWR;
+
+inline int closesocket(SOCKET s) { return ::close(s); }
+inline int WSAGetLastError()     { return errno; }
+
+#endif
+
 #include <cstdint>
 #include <stdexcept>
 #include <string>
@@ -0,0 +1,183 @@
+#include "poller.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace lilypad {
+
+#ifdef _WIN32
+
+// ── WSAPoll backend ──
+
+static SHORT to_poll_mask(uint32_t events) {
+    SHORT mask = 0;
+    if (events & POLL_READ)  mask |= POLLRDNORM;
+    if (events & POLL_WRITE) mask |= POLLWRNORM;
+    return mask;
+}
+
+Poller::Poller() {
+    wake_sock_ = create_udp_socket();
+    wake_addr_.sin_family      = AF_INET;
+    wake_addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_addr_.sin_port        = 0;
+    if (bind(wake_sock_.get(), reinterpret_cast<sockaddr*>(&wake_addr_), sizeof(wake_addr_)) == SOCKET_ERROR) {
+        throw std::runtime_error("Poller wakeup bind failed: " + std::to_string(WSAGetLastError()));
+    }
+    int len = sizeof(wake_addr_);
+    getsockname(wake_sock_.get(), reinterpret_cast<sockaddr*>(&wake_addr_), &len);
+    set_nonblocking(wake_sock_.get());
+
+    fds_.push_back({wake_sock_.get(), POLLRDNORM, 0});
+    users_.push_back(nullptr);
+}
+
+Poller::~Poller() = default;
+
+bool Poller::add(SOCKET s, uint32_t events, void* user) {
+    if (index_.count(s)) return false;
+    index_[s] = fds_.size();
+    fds_.push_back({s, to_poll_mask(events), 0});
+    users_.push_back(user);
+    return true;
+}
+
+bool Poller::modify(SOCKET s, uint32_t events, void* user) {
+    auto it = index_.find(s);
+    if (it == index_.end()) return false;
+    fds_[it->second].events = to_poll_mask(events);
+    users_[it->second] = user;
+    return true;
+}
+
+void Poller::remove(SOCKET s) {
+    auto it = index_.find(s);
+    if (it == index_.end()) return;
+    size_t idx  = it->second;
+    size_t last = fds_.size() - 1;
+    if (idx != last) {
+        fds_[idx]   = fds_[last];
+        users_[idx] = users_[last];
+        index_[fds_[idx].fd] = idx;
+    }
+    fds_.pop_back();
+    users_.pop_back();
+    index_.erase(it);
+}
+
+int Poller::wait(std::vector<PollEvent>& out, int timeout_ms) {
+    out.clear();
+    int ready = WSAPoll(fds_.data(), static_cast<ULONG>(fds_.size()), timeout_ms);
+    if (ready <= 0) return 0;
+
+    if (fds_[0].revents) {
+        // Drain all pending wakeup datagrams
+        char drain[16];
+        while (recv(wake_sock_.get(), drain, sizeof(drain), 0) > 0) {}
+    }
+
+    for (size_t i = 1; i < fds_.size(); ++i) {
+        SHORT re = fds_[i].revents;
+        if (!re) continue;
+        PollEvent ev;
+        ev.user = users_[i];
+        if (re & (POLLRDNORM | POLLHUP)) ev.events |= POLL_READ;
+        if (re & POLLWRNORM)             ev.events |= POLL_WRITE;
+        if (re & (POLLERR | POLLHUP | POLLNVAL)) ev.events |= POLL_ERROR;
+        out.push_back(ev);
+    }
+    return static_cast<int>(out.size());
+}
+
+void Poller::wakeup() {
+    char b = 1;
+    sendto(wake_sock_.get(), &b, 1, 0,
+           reinterpret_cast<const sockaddr*>(&wake_addr_), sizeof(wake_addr_));
+}
+
+#else
+
+// ── epoll backend ──
+
+static uint32_t to_epoll_mask(uint32_t events) {
+    uint32_t mask = 0;
+    if (events & POLL_READ)  mask |= EPOLLIN | EPOLLRDHUP;
+    if (events & POLL_WRITE) mask |= EPOLLOUT;
+    return mask;
+}
+
+Poller::Poller() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error("epoll_create1 failed: " + std::to_string(errno));
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        ::close(epoll_fd_);
+        throw std::runtime_error("eventfd failed: " + std::to_string(errno));
+    }
+    epoll_event ev{};
+    ev.events   = EPOLLIN;
+    ev.data.ptr = this;  // sentinel: never handed out to callers
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+}
+
+Poller::~Poller() {
+    if (wake_fd_ >= 0)  ::close(wake_fd_);
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+}
+
+bool Poller::add(SOCKET s, uint32_t events, void* user) {
+    epoll_event ev{};
+    ev.events   = to_epoll_mask(events);
+    ev.data.ptr = user;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, s, &ev) == 0;
+}
+
+bool Poller::modify(SOCKET s, uint32_t events, void* user) {
+    epoll_event ev{};
+    ev.events   = to_epoll_mask(events);
+    ev.data.ptr = user;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, s, &ev) == 0;
+}
+
+void Poller::remove(SOCKET s) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s, nullptr);
+}
+
+int Poller::wait(std::vector<PollEvent>& out, int timeout_ms) {
+    out.clear();
+    epoll_event events[128];
+    int ready = epoll_wait(epoll_fd_, events, 128, timeout_ms);
+    if (ready <= 0) return 0;
+
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.ptr == this) {
+            uint64_t count;
+            while (read(wake_fd_, &count, sizeof(count)) > 0) {}
+            continue;
+        }
+        PollEvent ev;
+        ev.user = events[i].data.ptr;
+        uint32_t re = events[i].events;
+        if (re & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) ev.events |= POLL_READ;
+        if (re & EPOLLOUT)                         ev.events |= POLL_WRITE;
+        if (re & (EPOLLERR | EPOLLHUP))            ev.events |= POLL_ERROR;
+        out.push_back(ev);
+    }
+    return static_cast<int>(out.size());
+}
+
+void Poller::wakeup() {
+    uint64_t one = 1;
+    (void)!write(wake_fd_, &one, sizeof(one));
+}
+
+#endif
+
+} // namespace lilypad
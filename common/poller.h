@@ -0,0 +1,58 @@
+#pragma once
+
+#include "network.h"
+
+#include <cstdint>
+#include <vector>
+
+#ifdef _WIN32
+#include <unordered_map>
+#endif
+
+namespace lilypad {
+
+// Readiness flags reported by / requested from a Poller
+constexpr uint32_t POLL_READ  = 0x01;
+constexpr uint32_t POLL_WRITE = 0x02;
+constexpr uint32_t POLL_ERROR = 0x04;  // reported only: hangup or socket error
+
+struct PollEvent {
+    uint32_t events = 0;
+    void*    user   = nullptr;  // opaque pointer passed to add()/modify()
+};
+
+// ── Readiness-based socket multiplexer ──
+// epoll on Linux, WSAPoll on Windows. Level-triggered.
+// add/modify/remove/wait must be called from the owning thread; wakeup() is
+// safe from any thread and makes a blocked wait() return early.
+class Poller {
+public:
+    Poller();
+    ~Poller();
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    bool add(SOCKET s, uint32_t events, void* user);
+    bool modify(SOCKET s, uint32_t events, void* user);
+    void remove(SOCKET s);
+
+    // Wait up to timeout_ms (-1 = forever). Fills `out` with ready sockets and
+    // returns how many. Wakeups are consumed internally and not reported.
+    int wait(std::vector<PollEvent>& out, int timeout_ms);
+
+    void wakeup();
+
+private:
+#ifdef _WIN32
+    std::vector<WSAPOLLFD>             fds_;    // fds_[0] is the wakeup socket
+    std::vector<void*>                 users_;
+    std::unordered_map<SOCKET, size_t> index_;
+    Socket                             wake_sock_;  // loopback UDP, sends to itself
+    sockaddr_in                        wake_addr_{};
+#else
+    int epoll_fd_ = -1;
+    int wake_fd_  = -1;  // eventfd
+#endif
+};
+
+} // namespace lilypad
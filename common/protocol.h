@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <string>
@@ -29,15 +30,34 @@ enum class MsgType : uint8_t {
     UPDATE_AVAILABLE   = 0x0D,  // Server→Client: version\0url\0
 
     // Voice channel (separate from text chat)
-    VOICE_JOIN     = 0x0E,  // Client→Server: empty payload
-    VOICE_LEAVE    = 0x0F,  // Client→Server: empty payload
-    VOICE_JOINED   = 0x10,  // Server→All: client_id(4)
-    VOICE_LEFT     = 0x11,  // Server→All: client_id(4)
+    VOICE_JOIN     = 0x0E,  // Client→Server: room name (empty = default room)
+    VOICE_LEAVE    = 0x0F,  // Client→Server: room name (empty = current room)
+    VOICE_JOINED   = 0x10,  // Server→All: client_id(4) + room name
+    VOICE_LEFT     = 0x11,  // Server→All: client_id(4) + room name
 
     // Chat sync (persistent chat)
     CHAT_SYNC      = 0x12,  // Client→Server: last_known_seq(8)
 
     SCREEN_REQUEST_KEYFRAME = 0x13,  // Server→Client: empty payload (request IDR)
+                                     // Server→Peer: sharer_id(4)
+                                     // Client→Server: sharer_id(4) (UDP viewer lost a frame)
+
+    // Screen media over UDP (see screen_media.h). A sharer asks for its own
+    // stream_id to get the key it seals with; a subscriber asks for the stream it
+    // watches to get the key the server re-seals that stream with. No reply if
+    // the server has no media port or the stream can't go over UDP.
+    SCREEN_MEDIA_REQ        = 0x14,  // Client→Server: stream_id(4)
+    SCREEN_MEDIA_KEY        = 0x15,  // Server→Client: stream_id(4) + media_port(2) + key(32)
+
+    // How much of a talker's voice a listener is losing, so the talker can size
+    // its Opus in-band FEC. Sent every few seconds while it hears them.
+    VOICE_LOSS_REPORT       = 0x16,  // Client→Server: sender_id(4) + loss_pct(1)
+                                     // Server→Client: reporter_id(4) + loss_pct(1)
+
+    // What receivers of a screen share get through, every SCREEN_REPORT_INTERVAL.
+    // Viewers report the stream they watch; the sharer gets the worst of what
+    // the server and its viewers saw (see ScreenReceiverReport).
+    SCREEN_RECEIVER_REPORT  = 0x17,  // C→S and S→C: sharer_id(4) + recv_kbps(4) + frames(2) + lost(2) + delay_slope(2)
 
     // Authentication
     AUTH_REGISTER_REQ     = 0x20,  // C->S: username\0 + password\0
@@ -51,6 +71,11 @@ enum class MsgType : uint8_t {
     AUTH_DELETE_ACCT_REQ  = 0x28,  // C->S: password\0
     AUTH_DELETE_ACCT_RESP = 0x29,  // S->C: status(1) + message\0
     AUTH_LOGOUT           = 0x2A,  // C->S: empty
+
+    // Server federation. A peer link otherwise carries the Server→Client messages
+    // (USER_*, VOICE_*, SCREEN_*) for the sending server's own clients, and
+    // SCREEN_SUBSCRIBE / SCREEN_UNSUBSCRIBE for streams it wants relayed.
+    PEER_HELLO            = 0x30,  // S<->S: node_id(4) + udp_port(2) + mac(32)
 };
 
 enum class AuthStatus : uint8_t {
@@ -209,6 +234,11 @@ inline void write_u64(std::vector<uint8_t>& buf, uint64_t val) {
     buf.push_back(static_cast<uint8_t>((val >> 56) & 0xFF));
 }
 
+inline void write_u16(std::vector<uint8_t>& buf, uint16_t val) {
+    buf.push_back(static_cast<uint8_t>(val & 0xFF));
+    buf.push_back(static_cast<uint8_t>((val >> 8) & 0xFF));
+}
+
 inline void write_u32(std::vector<uint8_t>& buf, uint32_t val) {
     buf.push_back(static_cast<uint8_t>(val & 0xFF));
     buf.push_back(static_cast<uint8_t>((val >> 8) & 0xFF));
@@ -216,35 +246,120 @@ inline void write_u32(std::vector<uint8_t>& buf, uint32_t val) {
     buf.push_back(static_cast<uint8_t>((val >> 24) & 0xFF));
 }
 
-// ── UDP voice packet: [client_id:4][sequence:4][opus_data:variable] ──
+// ── UDP voice packet: [client_id:4][sequence:4][extension][opus_data:variable] ──
 constexpr size_t VOICE_HEADER_SIZE = 8;
 constexpr size_t MAX_VOICE_PACKET  = 1400; // safe for MTU
 
+// client_id on packets the server mixed itself (MCU mode); never a real client
+// id (federation node ids stop below 0x7F). The room's shared mix and a talker's
+// own mix-minus come from different encoders, so they are separate streams.
+constexpr uint32_t VOICE_MIX_SENDER_ID       = 0;
+constexpr uint32_t VOICE_MIX_MINUS_SENDER_ID = 0x7FFFFFFF;
+
+inline bool is_voice_mix_sender(uint32_t id) {
+    return id == VOICE_MIX_SENDER_ID || id == VOICE_MIX_MINUS_SENDER_ID;
+}
+
+// ── Voice header extension ──
+// Sender-side metadata the relay can read without decoding the Opus payload.
+// Present when the top bit of the client_id field is set; it then follows the
+// fixed header as [version:1][length:1][body:length]. Receivers skip versions
+// they don't know by `length`, so the body can grow without breaking them.
+//   version 1: [vad:1 bit | level:7 bits][capture_ms:4]
+// level is -dBov (0 = full scale, 127 = silence, as in RFC 6464); vad is the
+// sender's voice-activity decision; capture_ms is the sender's clock when the
+// frame was captured (wraps, only differences between packets are meaningful).
+constexpr uint32_t VOICE_FLAG_EXTENSION = 0x80000000u;
+constexpr uint8_t  VOICE_EXT_VERSION    = 1;
+constexpr size_t   VOICE_EXT_V1_SIZE    = 5;
+constexpr uint8_t  VOICE_LEVEL_SILENT   = 127;
+
+struct VoiceAudioLevel {
+    bool     present    = false;  // false on packets from older clients
+    bool     vad        = false;
+    uint8_t  level      = VOICE_LEVEL_SILENT;  // -dBov
+    uint32_t capture_ms = 0;
+
+    float level_db() const { return -static_cast<float>(level); }
+
+    static uint8_t encode_level(float level_db) {
+        if (!(level_db < 0.0f)) return 0;
+        if (level_db <= -static_cast<float>(VOICE_LEVEL_SILENT)) return VOICE_LEVEL_SILENT;
+        return static_cast<uint8_t>(-level_db + 0.5f);
+    }
+};
+
+// Parsed fixed header and extension; the Opus payload is data[payload_offset, len)
+struct VoiceHeader {
+    uint32_t        client_id      = 0;
+    uint32_t        sequence       = 0;
+    VoiceAudioLevel audio;
+    size_t          payload_offset = VOICE_HEADER_SIZE;
+};
+
+// Reads the header without copying the payload. False if the packet is
+// truncated or its extension runs past the end.
+inline bool parse_voice_header(const uint8_t* data, size_t len, VoiceHeader& out) {
+    if (len < VOICE_HEADER_SIZE) return false;
+    uint32_t id_field  = read_u32(data);
+    out.client_id      = id_field & ~VOICE_FLAG_EXTENSION;
+    out.sequence       = read_u32(data + 4);
+    out.audio          = VoiceAudioLevel{};
+    out.payload_offset = VOICE_HEADER_SIZE;
+    if (!(id_field & VOICE_FLAG_EXTENSION)) return true;
+
+    if (len < VOICE_HEADER_SIZE + 2) return false;
+    uint8_t version = data[VOICE_HEADER_SIZE];
+    size_t  ext_len = data[VOICE_HEADER_SIZE + 1];
+    out.payload_offset = VOICE_HEADER_SIZE + 2 + ext_len;
+    if (out.payload_offset > len) return false;
+
+    const uint8_t* body = data + VOICE_HEADER_SIZE + 2;
+    if (version == VOICE_EXT_VERSION && ext_len >= VOICE_EXT_V1_SIZE) {
+        out.audio.present    = true;
+        out.audio.vad        = (body[0] & 0x80) != 0;
+        out.audio.level      = body[0] & 0x7F;
+        out.audio.capture_ms = read_u32(body + 1);
+    }
+    return true;
+}
+
 struct VoicePacket {
     uint32_t             client_id = 0;
     uint32_t             sequence  = 0;
+    VoiceAudioLevel      audio;      // written as the header extension if present
     std::vector<uint8_t> opus_data;
 
     std::vector<uint8_t> to_bytes() const {
-        std::vector<uint8_t> buf(VOICE_HEADER_SIZE + opus_data.size());
-        buf[0] = static_cast<uint8_t>(client_id & 0xFF);
-        buf[1] = static_cast<uint8_t>((client_id >> 8) & 0xFF);
-        buf[2] = static_cast<uint8_t>((client_id >> 16) & 0xFF);
-        buf[3] = static_cast<uint8_t>((client_id >> 24) & 0xFF);
-        buf[4] = static_cast<uint8_t>(sequence & 0xFF);
-        buf[5] = static_cast<uint8_t>((sequence >> 8) & 0xFF);
-        buf[6] = static_cast<uint8_t>((sequence >> 16) & 0xFF);
-        buf[7] = static_cast<uint8_t>((sequence >> 24) & 0xFF);
-        std::memcpy(buf.data() + VOICE_HEADER_SIZE, opus_data.data(), opus_data.size());
+        size_t ext_size = audio.present ? 2 + VOICE_EXT_V1_SIZE : 0;
+        std::vector<uint8_t> buf;
+        buf.reserve(VOICE_HEADER_SIZE + ext_size + opus_data.size());
+        write_u32(buf, audio.present ? (client_id | VOICE_FLAG_EXTENSION) : client_id);
+        write_u32(buf, sequence);
+        if (audio.present) {
+            buf.push_back(VOICE_EXT_VERSION);
+            buf.push_back(static_cast<uint8_t>(VOICE_EXT_V1_SIZE));
+            buf.push_back(static_cast<uint8_t>((audio.vad ? 0x80 : 0x00) |
+                                               (std::min)(audio.level, VOICE_LEVEL_SILENT)));
+            write_u32(buf, audio.capture_ms);
+        }
+        buf.insert(buf.end(), opus_data.begin(), opus_data.end());
         return buf;
     }
 
     static VoicePacket from_bytes(const uint8_t* data, size_t len) {
         VoicePacket pkt;
-        pkt.client_id = read_u32(data);
-        pkt.sequence  = read_u32(data + 4);
-        if (len > VOICE_HEADER_SIZE) {
-            pkt.opus_data.assign(data + VOICE_HEADER_SIZE, data + len);
+        VoiceHeader hdr;
+        if (!parse_voice_header(data, len, hdr)) {
+            // Malformed extension: keep the sender id so callers can still attribute it
+            if (len >= VOICE_HEADER_SIZE) pkt.client_id = read_u32(data) & ~VOICE_FLAG_EXTENSION;
+            return pkt;
+        }
+        pkt.client_id = hdr.client_id;
+        pkt.sequence  = hdr.sequence;
+        pkt.audio     = hdr.audio;
+        if (len > hdr.payload_offset) {
+            pkt.opus_data.assign(data + hdr.payload_offset, data + len);
         }
         return pkt;
     }
@@ -310,11 +425,27 @@ inline std::vector<uint8_t> make_screen_unsubscribe_msg(uint32_t target_id) {
 
 // Screen frame flags bitmask
 constexpr uint8_t SCREEN_FLAG_KEYFRAME = 0x01;  // Bit 0: IDR keyframe
+constexpr uint8_t SCREEN_FLAG_LAYER    = 0x06;  // Bits 1-2: simulcast layer
+
+// ── Simulcast ──
+// A sharer may send the same screen as several independent H.264 streams
+// ("layers"), each with its own keyframes: 0 is full quality, higher ones are
+// cheaper. Every frame carries its layer in the flags; a sharer that doesn't
+// simulcast sends layer 0 only. The server forwards each viewer one layer and
+// moves it between them only at a keyframe of the layer it moves to.
+constexpr uint8_t SCREEN_LAYER_COUNT = 3;
+constexpr uint8_t SCREEN_LAYER_SHIFT = 1;
+
+inline uint8_t screen_layer(uint8_t flags) {
+    uint8_t layer = static_cast<uint8_t>((flags & SCREEN_FLAG_LAYER) >> SCREEN_LAYER_SHIFT);
+    return layer < SCREEN_LAYER_COUNT ? layer : SCREEN_LAYER_COUNT - 1;
+}
 
 // Client→Server: width(2) + height(2) + flags(1) + h264_data
 inline std::vector<uint8_t> make_screen_frame_msg(uint16_t width, uint16_t height,
-                                                   uint8_t flags,
+                                                   uint8_t flags, uint8_t layer,
                                                    const uint8_t* data, size_t data_len) {
+    flags = static_cast<uint8_t>((flags & ~SCREEN_FLAG_LAYER) | ((layer << SCREEN_LAYER_SHIFT) & SCREEN_FLAG_LAYER));
     uint32_t payload_len = static_cast<uint32_t>(5 + data_len); // 2+2+1+data
     SignalHeader h{MsgType::SCREEN_FRAME, payload_len};
     auto buf = serialize_header(h);
@@ -348,12 +479,98 @@ inline std::vector<uint8_t> make_screen_frame_relay(uint32_t sharer_id, uint16_t
     return buf;
 }
 
+// The relayed SCREEN_FRAME / SCREEN_AUDIO is the sender's payload unchanged,
+// preceded by [header:5][sharer_id:4]. The server reserves this much headroom in
+// front of every received payload and writes the prefix there in place.
+constexpr size_t SCREEN_RELAY_PREFIX = SIGNAL_HEADER_SIZE + 4;
+
+inline void write_screen_relay_prefix(uint8_t* dst, MsgType type, uint32_t sharer_id,
+                                      size_t body_len) {
+    uint32_t payload_len = static_cast<uint32_t>(4 + body_len);
+    dst[0] = static_cast<uint8_t>(type);
+    dst[1] = static_cast<uint8_t>(payload_len & 0xFF);
+    dst[2] = static_cast<uint8_t>((payload_len >> 8) & 0xFF);
+    dst[3] = static_cast<uint8_t>((payload_len >> 16) & 0xFF);
+    dst[4] = static_cast<uint8_t>((payload_len >> 24) & 0xFF);
+    dst[5] = static_cast<uint8_t>(sharer_id & 0xFF);
+    dst[6] = static_cast<uint8_t>((sharer_id >> 8) & 0xFF);
+    dst[7] = static_cast<uint8_t>((sharer_id >> 16) & 0xFF);
+    dst[8] = static_cast<uint8_t>((sharer_id >> 24) & 0xFF);
+}
+
 // Server→Client: request keyframe from sharer (empty payload)
 inline std::vector<uint8_t> make_screen_request_keyframe_msg() {
     SignalHeader h{MsgType::SCREEN_REQUEST_KEYFRAME, 0};
     return serialize_header(h);
 }
 
+// Server→Peer: request keyframe from one of the peer's sharers
+// Client→Server: a UDP viewer lost a frame of `sharer_id`
+inline std::vector<uint8_t> make_screen_request_keyframe_msg(uint32_t sharer_id) {
+    SignalHeader h{MsgType::SCREEN_REQUEST_KEYFRAME, 4};
+    auto buf = serialize_header(h);
+    write_u32(buf, sharer_id);
+    return buf;
+}
+
+// Client→Server: ask for the UDP media key of a stream
+inline std::vector<uint8_t> make_screen_media_req_msg(uint32_t stream_id) {
+    SignalHeader h{MsgType::SCREEN_MEDIA_REQ, 4};
+    auto buf = serialize_header(h);
+    write_u32(buf, stream_id);
+    return buf;
+}
+
+// Server→Client: stream_id(4) + media_port(2) + key(32)
+constexpr size_t SCREEN_MEDIA_KEY_SIZE = 32;
+
+inline std::vector<uint8_t> make_screen_media_key_msg(uint32_t stream_id, uint16_t media_port,
+                                                      const uint8_t* key) {
+    SignalHeader h{MsgType::SCREEN_MEDIA_KEY, static_cast<uint32_t>(4 + 2 + SCREEN_MEDIA_KEY_SIZE)};
+    auto buf = serialize_header(h);
+    write_u32(buf, stream_id);
+    buf.push_back(static_cast<uint8_t>(media_port & 0xFF));
+    buf.push_back(static_cast<uint8_t>((media_port >> 8) & 0xFF));
+    buf.insert(buf.end(), key, key + SCREEN_MEDIA_KEY_SIZE);
+    return buf;
+}
+
+// ── Screen receiver report ──
+// One receiver's view of a stream over the last interval: the rate it received,
+// video frames received and lost, and the trend of one-way delay in ms per
+// second (rising = a queue is building somewhere on the path). Receivers that
+// can't measure delay (TCP) send SCREEN_DELAY_UNKNOWN.
+constexpr int16_t SCREEN_DELAY_UNKNOWN = INT16_MIN;
+
+struct ScreenReceiverReport {
+    uint32_t sharer_id   = 0;
+    uint32_t recv_kbps   = 0;
+    uint16_t frames      = 0;
+    uint16_t lost        = 0;
+    int16_t  delay_slope = SCREEN_DELAY_UNKNOWN;
+};
+
+inline std::vector<uint8_t> make_screen_receiver_report_msg(const ScreenReceiverReport& r) {
+    SignalHeader h{MsgType::SCREEN_RECEIVER_REPORT, 14};
+    auto buf = serialize_header(h);
+    write_u32(buf, r.sharer_id);
+    write_u32(buf, r.recv_kbps);
+    write_u16(buf, r.frames);
+    write_u16(buf, r.lost);
+    write_u16(buf, static_cast<uint16_t>(r.delay_slope));
+    return buf;
+}
+
+inline bool parse_screen_receiver_report(const uint8_t* data, size_t len, ScreenReceiverReport& out) {
+    if (len < 14) return false;
+    out.sharer_id   = read_u32(data);
+    out.recv_kbps   = read_u32(data + 4);
+    out.frames      = read_u16(data + 8);
+    out.lost        = read_u16(data + 10);
+    out.delay_slope = static_cast<int16_t>(read_u16(data + 12));
+    return true;
+}
+
 // ── System audio (screen sharing audio) message helpers ──
 
 // Client→Server: opus_data
@@ -381,34 +598,68 @@ inline std::vector<uint8_t> make_screen_audio_relay(uint32_t sharer_id,
 
 // ── Voice channel message helpers ──
 
-// Client→Server: empty payload
-inline std::vector<uint8_t> make_voice_join_msg() {
-    SignalHeader h{MsgType::VOICE_JOIN, 0};
-    return serialize_header(h);
+// Voice rooms are created on first join and vanish when empty. Clients that
+// send an empty room name (including older ones) land in the default room.
+constexpr const char* DEFAULT_VOICE_ROOM  = "General";
+constexpr size_t      MAX_VOICE_ROOM_NAME = 32;
+
+inline bool is_valid_voice_room(const std::string& room) {
+    if (room.empty() || room.size() > MAX_VOICE_ROOM_NAME) return false;
+    for (unsigned char ch : room) {
+        if (ch < 0x20 || ch == 0x7F) return false;
+    }
+    return true;
 }
 
-// Client→Server: empty payload
-inline std::vector<uint8_t> make_voice_leave_msg() {
-    SignalHeader h{MsgType::VOICE_LEAVE, 0};
-    return serialize_header(h);
+// Client→Server: room name
+inline std::vector<uint8_t> make_voice_join_msg(const std::string& room) {
+    SignalHeader h{MsgType::VOICE_JOIN, static_cast<uint32_t>(room.size())};
+    auto buf = serialize_header(h);
+    buf.insert(buf.end(), room.begin(), room.end());
+    return buf;
+}
+
+// Client→Server: room name
+inline std::vector<uint8_t> make_voice_leave_msg(const std::string& room) {
+    SignalHeader h{MsgType::VOICE_LEAVE, static_cast<uint32_t>(room.size())};
+    auto buf = serialize_header(h);
+    buf.insert(buf.end(), room.begin(), room.end());
+    return buf;
 }
 
-// Server→All: client_id(4)
-inline std::vector<uint8_t> make_voice_joined_broadcast(uint32_t client_id) {
-    SignalHeader h{MsgType::VOICE_JOINED, 4};
+// Server→All: client_id(4) + room name
+inline std::vector<uint8_t> make_voice_joined_broadcast(uint32_t client_id, const std::string& room) {
+    SignalHeader h{MsgType::VOICE_JOINED, static_cast<uint32_t>(4 + room.size())};
     auto buf = serialize_header(h);
     write_u32(buf, client_id);
+    buf.insert(buf.end(), room.begin(), room.end());
     return buf;
 }
 
-// Server→All: client_id(4)
-inline std::vector<uint8_t> make_voice_left_broadcast(uint32_t client_id) {
-    SignalHeader h{MsgType::VOICE_LEFT, 4};
+// Server→All: client_id(4) + room name
+inline std::vector<uint8_t> make_voice_left_broadcast(uint32_t client_id, const std::string& room) {
+    SignalHeader h{MsgType::VOICE_LEFT, static_cast<uint32_t>(4 + room.size())};
     auto buf = serialize_header(h);
     write_u32(buf, client_id);
+    buf.insert(buf.end(), room.begin(), room.end());
     return buf;
 }
 
+// Client→Server: sender_id + loss_pct; Server→Client (the sender): reporter_id + loss_pct
+inline std::vector<uint8_t> make_voice_loss_report_msg(uint32_t client_id, uint8_t loss_pct) {
+    SignalHeader h{MsgType::VOICE_LOSS_REPORT, 5};
+    auto buf = serialize_header(h);
+    write_u32(buf, client_id);
+    buf.push_back(loss_pct);
+    return buf;
+}
+
+// Room name from a VOICE_JOINED / VOICE_LEFT payload; older servers send none
+inline std::string parse_voice_room(const std::vector<uint8_t>& payload) {
+    if (payload.size() <= 4) return DEFAULT_VOICE_ROOM;
+    return std::string(payload.begin() + 4, payload.end());
+}
+
 // Client→Server: last_known_seq(8)
 inline std::vector<uint8_t> make_chat_sync_msg(uint64_t last_seq) {
     SignalHeader h{MsgType::CHAT_SYNC, 8};
@@ -606,4 +857,20 @@ inline bool is_valid_password(const std::string& password) {
     return password.size() >= MIN_PASSWORD_LEN && password.size() <= MAX_PASSWORD_LEN;
 }
 
+// ── Server federation helpers ──
+
+constexpr size_t PEER_HELLO_MAC_SIZE = 32;
+constexpr size_t PEER_HELLO_SIZE     = 4 + 2 + PEER_HELLO_MAC_SIZE;
+
+// S<->S: node_id(4) + udp_port(2) + mac(32)
+inline std::vector<uint8_t> make_peer_hello_msg(uint32_t node_id, uint16_t udp_port, const uint8_t* mac) {
+    SignalHeader h{MsgType::PEER_HELLO, static_cast<uint32_t>(PEER_HELLO_SIZE)};
+    auto buf = serialize_header(h);
+    write_u32(buf, node_id);
+    buf.push_back(static_cast<uint8_t>(udp_port & 0xFF));
+    buf.push_back(static_cast<uint8_t>((udp_port >> 8) & 0xFF));
+    buf.insert(buf.end(), mac, mac + PEER_HELLO_MAC_SIZE);
+    return buf;
+}
+
 } // namespace lilypad
@@ -0,0 +1,363 @@
+#include "screen_media.h"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace lilypad {
+
+constexpr size_t   MEDIA_NONCE_SIZE = 12;
+constexpr uint32_t MEDIA_MAX_AHEAD  = 64;  // frames past the oldest undelivered one before resyncing
+
+static void put_u16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xFF);
+    p[1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xFF);
+    p[1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+    p[2] = static_cast<uint8_t>((v >> 16) & 0xFF);
+    p[3] = static_cast<uint8_t>((v >> 24) & 0xFF);
+}
+
+static uint16_t get_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// ── Header ──
+
+void write_media_header(uint8_t* dst, const MediaHeader& h) {
+    dst[0] = static_cast<uint8_t>(h.type);
+    put_u32(dst + 1, h.client_id);
+    put_u32(dst + 5, h.stream_id);
+    put_u32(dst + 9, h.seq);
+    put_u16(dst + 13, h.index);
+    put_u16(dst + 15, h.count);
+    put_u16(dst + 17, h.parity);
+    dst[19] = h.flags;
+    put_u32(dst + 20, h.frame_len);
+    put_u32(dst + 24, h.send_ms);
+}
+
+uint16_t media_fragment_count(uint32_t frame_len) {
+    return static_cast<uint16_t>((frame_len + MEDIA_FRAGMENT_SIZE - 1) / MEDIA_FRAGMENT_SIZE);
+}
+
+uint16_t media_parity_count(uint16_t count) {
+    return static_cast<uint16_t>((count + MEDIA_FEC_GROUP - 1) / MEDIA_FEC_GROUP);
+}
+
+bool parse_media_header(const uint8_t* data, size_t len, MediaHeader& out) {
+    if (len < MEDIA_HEADER_SIZE + MEDIA_TAG_SIZE) return false;
+    if (len - MEDIA_HEADER_SIZE - MEDIA_TAG_SIZE > MEDIA_FRAGMENT_SIZE) return false;
+    out.type      = static_cast<MediaType>(data[0]);
+    out.client_id = get_u32(data + 1);
+    out.stream_id = get_u32(data + 5);
+    out.seq       = get_u32(data + 9);
+    out.index     = get_u16(data + 13);
+    out.count     = get_u16(data + 15);
+    out.parity    = get_u16(data + 17);
+    out.flags     = data[19];
+    out.frame_len = get_u32(data + 20);
+    out.send_ms   = get_u32(data + 24);
+
+    switch (out.type) {
+    case MediaType::KEEPALIVE:
+        return out.count == 0 && out.parity == 0 && out.frame_len == 0;
+    case MediaType::VIDEO:
+    case MediaType::AUDIO:
+        return out.frame_len > 0 && out.frame_len <= MAX_MEDIA_FRAME &&
+               out.count == media_fragment_count(out.frame_len) &&
+               out.parity == media_parity_count(out.count) &&
+               out.index < out.count + out.parity;
+    }
+    return false;
+}
+
+// ── MediaCipher ──
+
+static void media_nonce(const MediaHeader& h, uint8_t nonce[MEDIA_NONCE_SIZE]) {
+    put_u32(nonce, h.client_id);
+    put_u32(nonce + 4, h.seq);
+    nonce[8] = static_cast<uint8_t>(h.type);
+    put_u16(nonce + 9, h.index);
+    nonce[11] = screen_layer(h.flags);
+}
+
+MediaCipher::MediaCipher(const MediaKey& key)
+    : enc_(EVP_CIPHER_CTX_new()), dec_(EVP_CIPHER_CTX_new()) {
+    if (!enc_ || !dec_ ||
+        EVP_EncryptInit_ex(enc_, EVP_aes_256_gcm(), nullptr, key.data(), nullptr) != 1 ||
+        EVP_DecryptInit_ex(dec_, EVP_aes_256_gcm(), nullptr, key.data(), nullptr) != 1) {
+        EVP_CIPHER_CTX_free(enc_);
+        EVP_CIPHER_CTX_free(dec_);
+        throw std::runtime_error("AES-256-GCM unavailable");
+    }
+}
+
+MediaCipher::~MediaCipher() {
+    EVP_CIPHER_CTX_free(enc_);
+    EVP_CIPHER_CTX_free(dec_);
+}
+
+size_t MediaCipher::seal(const MediaHeader& h, const uint8_t* body, size_t body_len, uint8_t* out) {
+    uint8_t nonce[MEDIA_NONCE_SIZE];
+    media_nonce(h, nonce);
+    write_media_header(out, h);
+
+    int n = 0, fin = 0;
+    uint8_t* ct = out + MEDIA_HEADER_SIZE;
+    EVP_EncryptInit_ex(enc_, nullptr, nullptr, nullptr, nonce);
+    EVP_EncryptUpdate(enc_, nullptr, &n, out, static_cast<int>(MEDIA_HEADER_SIZE));
+    EVP_EncryptUpdate(enc_, ct, &n, body, static_cast<int>(body_len));
+    EVP_EncryptFinal_ex(enc_, ct + n, &fin);
+    EVP_CIPHER_CTX_ctrl(enc_, EVP_CTRL_GCM_GET_TAG, static_cast<int>(MEDIA_TAG_SIZE), ct + body_len);
+    return MEDIA_HEADER_SIZE + body_len + MEDIA_TAG_SIZE;
+}
+
+int MediaCipher::open(const MediaHeader& h, const uint8_t* data, size_t len, uint8_t* body) {
+    if (len < MEDIA_HEADER_SIZE + MEDIA_TAG_SIZE) return -1;
+    size_t body_len = len - MEDIA_HEADER_SIZE - MEDIA_TAG_SIZE;
+    uint8_t nonce[MEDIA_NONCE_SIZE];
+    media_nonce(h, nonce);
+
+    int n = 0, fin = 0;
+    const uint8_t* ct = data + MEDIA_HEADER_SIZE;
+    EVP_DecryptInit_ex(dec_, nullptr, nullptr, nullptr, nonce);
+    EVP_DecryptUpdate(dec_, nullptr, &n, data, static_cast<int>(MEDIA_HEADER_SIZE));
+    EVP_DecryptUpdate(dec_, body, &n, ct, static_cast<int>(body_len));
+    EVP_CIPHER_CTX_ctrl(dec_, EVP_CTRL_GCM_SET_TAG, static_cast<int>(MEDIA_TAG_SIZE),
+                        const_cast<uint8_t*>(ct + body_len));
+    if (EVP_DecryptFinal_ex(dec_, body + n, &fin) != 1) return -1;
+    return static_cast<int>(body_len);
+}
+
+// ── MediaPacketizer ──
+
+const std::vector<std::vector<uint8_t>>& MediaPacketizer::packetize(MediaCipher& cipher, MediaType type,
+                                                                    uint32_t client_id, uint32_t stream_id,
+                                                                    uint32_t seq, uint8_t flags, uint32_t send_ms,
+                                                                    const uint8_t* frame, size_t frame_len) {
+    MediaHeader h;
+    h.type      = type;
+    h.client_id = client_id;
+    h.stream_id = stream_id;
+    h.seq       = seq;
+    h.flags     = flags;
+    h.frame_len = static_cast<uint32_t>(frame_len);
+    h.send_ms   = send_ms;
+    h.count     = media_fragment_count(h.frame_len);
+    h.parity    = media_parity_count(h.count);
+
+    packets_.resize(h.count + h.parity);
+    parity_.assign(h.parity * MEDIA_FRAGMENT_SIZE, 0);
+
+    for (uint16_t i = 0; i < h.count; ++i) {
+        size_t         off  = i * MEDIA_FRAGMENT_SIZE;
+        size_t         len  = (std::min)(MEDIA_FRAGMENT_SIZE, frame_len - off);
+        const uint8_t* frag = frame + off;
+        uint8_t*       par  = parity_.data() + (i % h.parity) * MEDIA_FRAGMENT_SIZE;
+        for (size_t k = 0; k < len; ++k) par[k] ^= frag[k];
+
+        h.index = i;
+        auto& pkt = packets_[i];
+        pkt.resize(MAX_MEDIA_PACKET);
+        pkt.resize(cipher.seal(h, frag, len, pkt.data()));
+    }
+
+    // Every group holds a full-size fragment, except in a one-fragment frame
+    size_t parity_len = h.count == 1 ? frame_len : MEDIA_FRAGMENT_SIZE;
+    for (uint16_t g = 0; g < h.parity; ++g) {
+        h.index = static_cast<uint16_t>(h.count + g);
+        auto& pkt = packets_[h.index];
+        pkt.resize(MAX_MEDIA_PACKET);
+        pkt.resize(cipher.seal(h, parity_.data() + g * MEDIA_FRAGMENT_SIZE, parity_len, pkt.data()));
+    }
+    return packets_;
+}
+
+// ── MediaReassembler ──
+
+static size_t data_fragment_len(uint32_t frame_len, uint16_t index) {
+    return (std::min)(MEDIA_FRAGMENT_SIZE, frame_len - static_cast<size_t>(index) * MEDIA_FRAGMENT_SIZE);
+}
+
+void MediaReassembler::reset() {
+    started_ = false;
+    partial_.clear();
+}
+
+void MediaReassembler::push(const MediaHeader& h, const uint8_t* body, size_t body_len,
+                            std::vector<MediaFrame>& out) {
+    if (h.type == MediaType::KEEPALIVE) return;
+    if (!started_) {
+        started_ = true;
+        next_    = h.seq;
+        newest_  = h.seq;
+    }
+
+    int32_t ahead = static_cast<int32_t>(h.seq - next_);
+    if (ahead < 0) return;  // delivered or given up on already
+    if (static_cast<uint32_t>(ahead) > MEDIA_MAX_AHEAD) {
+        // Long outage or a restarted sender: report the gap once and start over here
+        MediaFrame lost;
+        lost.seq  = next_;
+        lost.lost = true;
+        out.push_back(std::move(lost));
+        partial_.clear();
+        next_ = newest_ = h.seq;
+    }
+
+    Partial& p = partial_[h.seq];
+    if (p.fragments.empty()) {
+        p.count     = h.count;
+        p.parity    = h.parity;
+        p.flags     = h.flags;
+        p.frame_len = h.frame_len;
+        p.fragments.resize(h.count + h.parity);
+    } else if (p.count != h.count || p.frame_len != h.frame_len) {
+        return;  // inconsistent with the fragments already held
+    }
+
+    if (!p.complete && p.fragments[h.index].empty()) {
+        bool is_data = h.index < p.count;
+        if (is_data && body_len != data_fragment_len(p.frame_len, h.index)) return;
+        if (body_len == 0) return;
+        p.fragments[h.index].assign(body, body + body_len);
+        p.complete = try_complete(p);
+    }
+
+    if (static_cast<int32_t>(h.seq - newest_) > 0) newest_ = h.seq;
+    deliver(out);
+}
+
+// Complete once no parity group misses more than one data fragment, or misses
+// one without its parity at hand; rebuilds those fragments in place. (Every
+// frame parse_media_header accepts has at least one parity fragment.)
+bool MediaReassembler::try_complete(Partial& p) {
+    std::vector<uint16_t> rebuild;
+    for (uint16_t g = 0; g < p.parity; ++g) {
+        size_t   missing = 0;
+        uint16_t which   = 0;
+        for (uint32_t i = g; i < p.count; i += p.parity) {
+            if (p.fragments[i].empty()) {
+                missing++;
+                which = static_cast<uint16_t>(i);
+            }
+        }
+        if (missing == 0) continue;
+        if (missing > 1 || p.fragments[p.count + g].empty()) return false;
+        rebuild.push_back(which);
+    }
+
+    for (uint16_t i : rebuild) {
+        uint16_t g   = static_cast<uint16_t>(i % p.parity);
+        auto&    dst = p.fragments[i];
+        dst = p.fragments[p.count + g];
+        dst.resize(MEDIA_FRAGMENT_SIZE, 0);
+        for (uint32_t j = g; j < p.count; j += p.parity) {
+            if (j == i) continue;
+            const auto& src = p.fragments[j];
+            for (size_t k = 0; k < src.size(); ++k) dst[k] ^= src[k];
+        }
+        dst.resize(data_fragment_len(p.frame_len, i));
+    }
+    return true;
+}
+
+void MediaReassembler::deliver(std::vector<MediaFrame>& out) {
+    for (;;) {
+        auto it = partial_.find(next_);
+        if (it != partial_.end() && it->second.complete) {
+            MediaFrame frame;
+            frame.seq   = next_;
+            frame.flags = it->second.flags;
+            frame.data.reserve(it->second.frame_len);
+            for (uint16_t i = 0; i < it->second.count; ++i)
+                frame.data.insert(frame.data.end(), it->second.fragments[i].begin(), it->second.fragments[i].end());
+            out.push_back(std::move(frame));
+        } else if (static_cast<int32_t>(newest_ - next_) >= static_cast<int32_t>(MEDIA_REORDER_FRAMES)) {
+            MediaFrame lost;
+            lost.seq  = next_;
+            lost.lost = true;
+            out.push_back(std::move(lost));
+        } else {
+            break;
+        }
+        if (it != partial_.end()) partial_.erase(it);
+        next_++;
+    }
+}
+
+// ── MediaRateMonitor ──
+
+constexpr size_t MEDIA_MIN_DELAY_SAMPLES = 8;
+constexpr double MEDIA_MIN_DELAY_SPAN_MS = 200.0;
+
+void MediaRateMonitor::on_datagram(const MediaHeader& h, size_t len, Clock::time_point now) {
+    bytes_ += len;
+    if (h.type != MediaType::VIDEO) return;
+    uint8_t layer = screen_layer(h.flags);
+    uint8_t bit   = static_cast<uint8_t>(1u << layer);
+    if ((have_seq_ & bit) && static_cast<int32_t>(h.seq - newest_seq_[layer]) <= 0) return;  // not a new frame
+    have_seq_           |= bit;
+    newest_seq_[layer]   = h.seq;
+
+    if (samples_.empty()) {
+        origin_at_   = now;
+        origin_send_ = h.send_ms;
+    }
+    double at    = std::chrono::duration<double, std::milli>(now - origin_at_).count();
+    double sent  = static_cast<double>(static_cast<int32_t>(h.send_ms - origin_send_));
+    samples_.emplace_back(at, at - sent);
+}
+
+ScreenReceiverReport MediaRateMonitor::take(uint32_t sharer_id, Clock::time_point now) {
+    ScreenReceiverReport r;
+    r.sharer_id = sharer_id;
+    double ms   = (std::max)(1.0, std::chrono::duration<double, std::milli>(now - start_).count());
+    r.recv_kbps = static_cast<uint32_t>(static_cast<double>(bytes_) * 8.0 / ms);
+    r.frames    = static_cast<uint16_t>((std::min)(frames_, 0xFFFFu));
+    r.lost      = static_cast<uint16_t>((std::min)(lost_, 0xFFFFu));
+
+    if (samples_.size() >= MEDIA_MIN_DELAY_SAMPLES &&
+        samples_.back().first - samples_.front().first >= MEDIA_MIN_DELAY_SPAN_MS) {
+        double mx = 0.0, my = 0.0;
+        for (auto& [x, y] : samples_) { mx += x; my += y; }
+        mx /= static_cast<double>(samples_.size());
+        my /= static_cast<double>(samples_.size());
+        double sxy = 0.0, sxx = 0.0;
+        for (auto& [x, y] : samples_) {
+            sxy += (x - mx) * (y - my);
+            sxx += (x - mx) * (x - mx);
+        }
+        double slope = sxy / sxx * 1000.0;  // ms of delay gained per second
+        r.delay_slope = static_cast<int16_t>((std::max)(-32767.0, (std::min)(slope, 32767.0)));
+    }
+
+    restart(now);
+    return r;
+}
+
+void MediaRateMonitor::reset(Clock::time_point now) {
+    have_seq_ = 0;
+    restart(now);
+}
+
+void MediaRateMonitor::restart(Clock::time_point now) {
+    start_  = now;
+    bytes_  = 0;
+    frames_ = 0;
+    lost_   = 0;
+    samples_.clear();
+}
+
+} // namespace lilypad
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "protocol.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+namespace lilypad {
+
+// ── Screen media over UDP ──
+// Screen video and audio can bypass the TLS stream, so a lost segment no longer
+// stalls everything queued behind it. Each frame (the same body a SCREEN_FRAME /
+// SCREEN_AUDIO message would carry from the sharer) is cut into fragments that
+// fit one datagram, followed by XOR parity fragments, and every datagram is
+// sealed with AES-256-GCM under a per-share key handed out over TLS
+// (SCREEN_MEDIA_KEY). Layout:
+//
+//   [type:1][client_id:4][stream_id:4][seq:4][index:2][count:2][parity:2][flags:1][frame_len:4]
+//   [send_ms:4][ciphertext][tag:16]
+//
+// The header is authenticated (GCM additional data) but not encrypted, so the
+// relay can route without a key lookup first. client_id is whoever sent the
+// datagram (the sharer, the server re-sealing for viewers, or a viewer's
+// keepalive); stream_id is the sharer. seq numbers frames per type, stream and
+// simulcast layer (the layer rides in flags, see SCREEN_FLAG_LAYER).
+// send_ms is the sharer's clock when the frame went out (wraps; the server keeps
+// it when re-sealing), for receivers to see delay building up on the path.
+// Fragments 0..count-1 carry data; count..count+parity-1 are parity, where
+// parity p is the XOR of every data fragment i with i % parity == p (zero
+// padded), so one loss per group is recovered and a burst of consecutive losses
+// lands in different groups.
+
+enum class MediaType : uint8_t {
+    VIDEO     = 1,  // body: width(2) + height(2) + flags(1) + h264
+    AUDIO     = 2,  // body: opus
+    KEEPALIVE = 3,  // viewer → server, empty: "send this stream to my address"
+};
+
+constexpr size_t   MEDIA_HEADER_SIZE   = 28;
+constexpr size_t   MEDIA_TAG_SIZE      = 16;
+constexpr size_t   MEDIA_KEY_SIZE      = SCREEN_MEDIA_KEY_SIZE;
+constexpr size_t   MEDIA_FRAGMENT_SIZE = 1100;  // + header + tag stays well under a 1280-byte path MTU
+constexpr size_t   MAX_MEDIA_PACKET    = MEDIA_HEADER_SIZE + MEDIA_FRAGMENT_SIZE + MEDIA_TAG_SIZE;
+constexpr size_t   MEDIA_FEC_GROUP     = 8;     // data fragments per parity fragment
+constexpr uint32_t MAX_MEDIA_FRAME     = 8 * 1024 * 1024;
+
+using MediaKey = std::array<uint8_t, MEDIA_KEY_SIZE>;
+
+struct MediaHeader {
+    MediaType type      = MediaType::VIDEO;
+    uint32_t  client_id = 0;
+    uint32_t  stream_id = 0;
+    uint32_t  seq       = 0;
+    uint16_t  index     = 0;
+    uint16_t  count     = 0;  // data fragments in the frame
+    uint16_t  parity    = 0;  // parity fragments in the frame
+    uint8_t   flags     = 0;  // SCREEN_FLAG_* of the frame
+    uint32_t  frame_len = 0;
+    uint32_t  send_ms   = 0;
+};
+
+void write_media_header(uint8_t* dst, const MediaHeader& h);
+
+// False if the datagram is too short to hold a header and tag, or the fragment
+// counts don't match frame_len (so nothing downstream has to re-check them).
+bool parse_media_header(const uint8_t* data, size_t len, MediaHeader& out);
+
+// Data and parity fragment counts for a frame of `frame_len` bytes
+uint16_t media_fragment_count(uint32_t frame_len);
+uint16_t media_parity_count(uint16_t count);
+
+// ── AES-256-GCM sealing of media datagrams ──
+// The nonce is derived from the header (sender, seq, type, layer, index), which is
+// unique per key as long as each sender numbers its frames without repeating;
+// every share gets fresh keys. Not thread-safe: one per thread.
+class MediaCipher {
+public:
+    explicit MediaCipher(const MediaKey& key);
+    ~MediaCipher();
+    MediaCipher(const MediaCipher&) = delete;
+    MediaCipher& operator=(const MediaCipher&) = delete;
+
+    // Writes header + ciphertext + tag of `body` into `out`; returns the datagram size
+    size_t seal(const MediaHeader& h, const uint8_t* body, size_t body_len, uint8_t* out);
+
+    // Authenticates and decrypts datagram `data` (header already parsed into `h`)
+    // into `body`; returns the body length, or -1 if it was not sealed with this key.
+    int open(const MediaHeader& h, const uint8_t* data, size_t len, uint8_t* body);
+
+private:
+    EVP_CIPHER_CTX* enc_;
+    EVP_CIPHER_CTX* dec_;
+};
+
+// ── Cuts a frame into sealed datagrams ──
+class MediaPacketizer {
+public:
+    // Datagrams for one frame; valid until the next call
+    const std::vector<std::vector<uint8_t>>& packetize(MediaCipher& cipher, MediaType type,
+                                                       uint32_t client_id, uint32_t stream_id,
+                                                       uint32_t seq, uint8_t flags, uint32_t send_ms,
+                                                       const uint8_t* frame, size_t frame_len);
+
+private:
+    std::vector<std::vector<uint8_t>> packets_;
+    std::vector<uint8_t>              parity_;
+};
+
+// One frame out of a MediaReassembler: either complete, or given up on
+struct MediaFrame {
+    uint32_t             seq   = 0;
+    bool                 lost  = false;
+    uint8_t              flags = 0;
+    std::vector<uint8_t> data;
+};
+
+// ── Puts one stream's frames back together, in order ──
+// Frames are delivered as soon as they are complete (directly or via parity).
+// A frame still incomplete once MEDIA_REORDER_FRAMES newer ones have started
+// arriving is reported lost, and the stream moves on past it.
+constexpr uint32_t MEDIA_REORDER_FRAMES = 3;
+
+class MediaReassembler {
+public:
+    // Adds one decrypted fragment and appends whatever became deliverable to `out`
+    void push(const MediaHeader& h, const uint8_t* body, size_t body_len, std::vector<MediaFrame>& out);
+    void reset();
+
+private:
+    struct Partial {
+        uint16_t                          count  = 0;
+        uint16_t                          parity = 0;
+        uint8_t                           flags  = 0;
+        uint32_t                          frame_len = 0;
+        std::vector<std::vector<uint8_t>> fragments;  // count + parity, empty = missing
+        bool                              complete  = false;
+    };
+
+    bool try_complete(Partial& p);
+    void deliver(std::vector<MediaFrame>& out);
+
+    bool                        started_ = false;
+    uint32_t                    next_    = 0;  // oldest frame not yet delivered
+    uint32_t                    newest_  = 0;
+    std::map<uint32_t, Partial> partial_;      // frames from next_ on that have fragments, by seq
+};
+
+// ── What one receiver of a stream saw, for SCREEN_RECEIVER_REPORT ──
+// The delay trend is the least-squares slope of one-way delay (arrival time
+// minus send_ms; the clock offset cancels out) over the report interval,
+// sampled at the first datagram of each video frame (of any layer: they share
+// the sharer's clock and the path) so a frame's own size doesn't skew it, only
+// the queue ahead of it. A bottleneck that is filling up shows as a rising
+// slope well before anything is lost.
+constexpr auto SCREEN_REPORT_INTERVAL = std::chrono::seconds(1);
+
+class MediaRateMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // A datagram of the stream (sealed size); video ones sample the delay
+    void on_datagram(const MediaHeader& h, size_t len, Clock::time_point now);
+    // A frame that came over TCP: counts towards the rate, no delay sample
+    void on_bytes(size_t len) { bytes_ += len; }
+    void on_frame(bool lost) { (lost ? lost_ : frames_)++; }
+
+    // Everything since the previous take() or reset(), then starts over
+    ScreenReceiverReport take(uint32_t sharer_id, Clock::time_point now);
+    void                 reset(Clock::time_point now);
+
+private:
+    void restart(Clock::time_point now);
+
+    Clock::time_point start_{};
+    uint64_t          bytes_  = 0;
+    uint32_t          frames_ = 0;
+    uint32_t          lost_   = 0;
+    uint8_t           have_seq_ = 0;  // bit per simulcast layer
+    uint32_t          newest_seq_[SCREEN_LAYER_COUNT] = {};
+    Clock::time_point origin_at_{};  // first sample of the interval
+    uint32_t          origin_send_ = 0;
+    std::vector<std::pair<double, double>> samples_;  // (ms since origin, delay relative to origin)
+};
+
+} // namespace lilypad
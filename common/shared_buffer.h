@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace lilypad {
+
+// ── Immutable, reference-counted byte buffer ──
+// Copies share one allocation, so a relayed frame can sit in many subscribers'
+// queues and the keyframe cache at the cost of a refcount each.
+class SharedBuffer {
+public:
+    SharedBuffer() = default;
+
+    // Adopt an existing vector without copying its bytes
+    explicit SharedBuffer(std::vector<uint8_t> bytes) {
+        auto owner = std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+        data_  = owner->data();
+        size_  = owner->size();
+        owner_ = std::move(owner);
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t         size() const { return size_; }
+    bool           empty() const { return size_ == 0; }
+
+private:
+    friend class MutableBuffer;
+    SharedBuffer(std::shared_ptr<const void> owner, const uint8_t* data, size_t size)
+        : owner_(std::move(owner)), data_(data), size_(size) {}
+
+    std::shared_ptr<const void> owner_;
+    const uint8_t*              data_ = nullptr;
+    size_t                      size_ = 0;
+};
+
+// ── Single-owner buffer with reserved headroom, frozen into a SharedBuffer ──
+// Used for inbound payloads: a relay header can be written in place in front of
+// the received bytes (prepend), then the whole message is shared without copying.
+// Contents start uninitialized; one NUL byte always follows the data so
+// C-string fields in a payload can be parsed without overrunning it.
+class MutableBuffer {
+public:
+    MutableBuffer() = default;
+
+    explicit MutableBuffer(size_t size, size_t headroom = 0)
+        : storage_(new uint8_t[headroom + size + 1], std::default_delete<uint8_t[]>()),
+          offset_(headroom), size_(size) {
+        storage_.get()[headroom + size] = 0;
+    }
+
+    uint8_t*       data()       { return storage_.get() + offset_; }
+    const uint8_t* data() const { return storage_.get() + offset_; }
+    size_t         size() const { return size_; }
+    bool           empty() const { return size_ == 0; }
+    size_t         headroom() const { return offset_; }
+
+    uint8_t&       operator[](size_t i)       { return data()[i]; }
+    const uint8_t& operator[](size_t i) const { return data()[i]; }
+
+    // Grow the buffer `n` bytes to the front, into the headroom. Returns the new front.
+    uint8_t* prepend(size_t n) {
+        if (n > offset_) throw std::length_error("MutableBuffer: not enough headroom");
+        offset_ -= n;
+        size_   += n;
+        return data();
+    }
+
+    // Hand the bytes over as an immutable SharedBuffer; this buffer becomes empty.
+    SharedBuffer freeze() {
+        if (!storage_) return {};
+        const uint8_t* bytes = data();
+        size_t         len   = size_;
+        offset_ = 0;
+        size_   = 0;
+        return SharedBuffer(std::shared_ptr<const void>(std::move(storage_)), bytes, len);
+    }
+
+private:
+    std::shared_ptr<uint8_t> storage_;  // array allocation (delete[])
+    size_t                   offset_ = 0;
+    size_t                   size_   = 0;
+};
+
+} // namespace lilypad
@@ -5,8 +5,12 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#ifdef _WIN32
 #include <wincrypt.h>
+#endif
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace lilypad {
@@ -28,7 +32,7 @@ TlsSocket::~TlsSocket() {
 }
 
 TlsSocket::TlsSocket(TlsSocket&& other) noexcept
-    : socket_(std::move(other.socket_)), ssl_(other.ssl_) {
+    : socket_(std::move(other.socket_)), ssl_(other.ssl_), gather_(std::move(other.gather_)) {
     other.ssl_ = nullptr;
 }
 
@@ -38,6 +42,7 @@ TlsSocket& TlsSocket::operator=(TlsSocket&& other) noexcept {
         socket_ = std::move(other.socket_);
         ssl_ = other.ssl_;
         other.ssl_ = nullptr;
+        gather_ = std::move(other.gather_);
     }
     return *this;
 }
@@ -60,7 +65,8 @@ bool TlsSocket::accept(Socket&& raw_socket, SSL_CTX* ctx) {
     return true;
 }
 
-bool TlsSocket::connect(Socket&& raw_socket, SSL_CTX* ctx) {
+bool TlsSocket::connect(Socket&& raw_socket, SSL_CTX* ctx,
+                        const std::vector<uint8_t>& resume_session) {
     socket_ = std::move(raw_socket);
 
     ssl_ = SSL_new(ctx);
@@ -68,6 +74,16 @@ bool TlsSocket::connect(Socket&& raw_socket, SSL_CTX* ctx) {
 
     SSL_set_fd(ssl_, static_cast<int>(socket_.get()));
 
+    if (!resume_session.empty()) {
+        const unsigned char* der = resume_session.data();
+        SSL_SESSION* session = d2i_SSL_SESSION(nullptr, &der, static_cast<long>(resume_session.size()));
+        if (session) {
+            SSL_set_session(ssl_, session);  // ignored by OpenSSL if expired or unusable
+            SSL_SESSION_free(session);
+        }
+        ERR_clear_error();
+    }
+
     int ret = SSL_connect(ssl_);
     if (ret <= 0) {
         SSL_free(ssl_);
@@ -78,6 +94,18 @@ bool TlsSocket::connect(Socket&& raw_socket, SSL_CTX* ctx) {
     return true;
 }
 
+bool TlsSocket::resumed() const {
+    return ssl_ && SSL_session_reused(ssl_) == 1;
+}
+
+bool TlsSocket::ktls_send() const {
+#ifdef BIO_get_ktls_send
+    return ssl_ && BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#else
+    return false;
+#endif
+}
+
 SOCKET TlsSocket::get() const {
     return socket_.get();
 }
@@ -86,9 +114,14 @@ bool TlsSocket::valid() const {
     return socket_.valid() && ssl_ != nullptr;
 }
 
+bool TlsSocket::has_pending() const {
+    return ssl_ && SSL_has_pending(ssl_) == 1;
+}
+
 void TlsSocket::close() {
     if (ssl_) {
         SSL_shutdown(ssl_);
+        ERR_clear_error();  // a failed shutdown must not leak into the next SSL call on this thread
         SSL_free(ssl_);
         ssl_ = nullptr;
     }
@@ -125,10 +158,81 @@ bool TlsSocket::recv_all(uint8_t* buf, size_t len) {
     return true;
 }
 
+void TlsSocket::set_nonblocking() {
+    lilypad::set_nonblocking(socket_.get());
+    if (ssl_) {
+        SSL_set_mode(ssl_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    }
+}
+
+// Map an SSL_read/SSL_write return value to a TlsIo state
+static TlsIo classify_ssl_result(SSL* ssl, int result) {
+    switch (SSL_get_error(ssl, result)) {
+    case SSL_ERROR_WANT_READ:   return TlsIo::WANT_READ;
+    case SSL_ERROR_WANT_WRITE:  return TlsIo::WANT_WRITE;
+    case SSL_ERROR_ZERO_RETURN: return TlsIo::CLOSED;
+    default:
+        ERR_clear_error();
+        return TlsIo::FAILED;
+    }
+}
+
+TlsIo TlsSocket::read_some(uint8_t* buf, size_t len, size_t& out_len) {
+    out_len = 0;
+    if (!ssl_) return TlsIo::FAILED;
+    ERR_clear_error();  // SSL_get_error() consults the per-thread queue, shared by many sockets
+    int result = SSL_read(ssl_, buf, static_cast<int>(len));
+    if (result > 0) {
+        out_len = static_cast<size_t>(result);
+        return TlsIo::OK;
+    }
+    return classify_ssl_result(ssl_, result);
+}
+
+TlsIo TlsSocket::write_some(const uint8_t* data, size_t len, size_t& out_len) {
+    out_len = 0;
+    if (!ssl_) return TlsIo::FAILED;
+    ERR_clear_error();
+    int result = SSL_write(ssl_, data, static_cast<int>(len));
+    if (result > 0) {
+        out_len = static_cast<size_t>(result);
+        return TlsIo::OK;
+    }
+    return classify_ssl_result(ssl_, result);
+}
+
+TlsIo TlsSocket::writev_some(const TlsSlice* slices, size_t count, size_t& out_len) {
+    out_len = 0;
+    if (count == 0) return TlsIo::OK;
+    if (count == 1 || slices[0].len >= TLS_MAX_RECORD)
+        return write_some(slices[0].data, slices[0].len, out_len);
+
+    // A retry after WANT_* regathers the same bytes, which is all OpenSSL needs
+    // (SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER is set in non-blocking mode)
+    gather_.resize(TLS_MAX_RECORD);
+    size_t len = 0;
+    for (size_t i = 0; i < count && len < TLS_MAX_RECORD; ++i) {
+        size_t n = (std::min)(slices[i].len, TLS_MAX_RECORD - len);
+        std::memcpy(gather_.data() + len, slices[i].data, n);
+        len += n;
+    }
+    return write_some(gather_.data(), len, out_len);
+}
+
+std::vector<uint8_t> TlsSocket::export_keying_material(const std::string& label, size_t len) const {
+    std::vector<uint8_t> out(len);
+    if (!ssl_ || SSL_export_keying_material(ssl_, out.data(), out.size(), label.data(), label.size(),
+                                            nullptr, 0, 0) != 1) {
+        ERR_clear_error();
+        return {};
+    }
+    return out;
+}
+
 std::string TlsSocket::peer_ip() const {
     if (!socket_.valid()) return "";
     sockaddr_in addr{};
-    int len = sizeof(addr);
+    socklen_t len = sizeof(addr);
     if (getpeername(socket_.get(), reinterpret_cast<sockaddr*>(&addr), &len) != 0)
         return "";
     char ip_str[INET_ADDRSTRLEN] = {};
@@ -138,6 +242,7 @@ std::string TlsSocket::peer_ip() const {
 
 // ── Client SSL context factory ──
 
+#ifdef _WIN32
 // Load CA certificates from the Windows system certificate store into OpenSSL
 static bool load_windows_cert_store(SSL_CTX* ctx) {
     HCERTSTORE store = CertOpenSystemStoreA(0, "ROOT");
@@ -160,8 +265,33 @@ static bool load_windows_cert_store(SSL_CTX* ctx) {
     CertCloseStore(store, 0);
     return loaded > 0;
 }
+#endif
+
+// The TlsSessionSink lives in the SSL_CTX's ex_data and is freed with it
+static void free_session_sink(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+    delete static_cast<TlsSessionSink*>(ptr);
+}
+
+static int session_sink_index() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_session_sink);
+    return index;
+}
 
-SSL_CTX* create_client_ssl_ctx(bool trust_self_signed) {
+static int on_new_client_session(SSL* ssl, SSL_SESSION* session) {
+    auto* sink = static_cast<TlsSessionSink*>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), session_sink_index()));
+    if (!sink || !SSL_SESSION_is_resumable(session)) return 0;
+
+    int len = i2d_SSL_SESSION(session, nullptr);
+    if (len <= 0) return 0;
+    std::vector<uint8_t> der(static_cast<size_t>(len));
+    unsigned char* out = der.data();
+    i2d_SSL_SESSION(session, &out);
+    (*sink)(der);
+    return 0;  // we did not keep a reference to `session`
+}
+
+SSL_CTX* create_client_ssl_ctx(bool trust_self_signed, TlsSessionSink on_session) {
     const SSL_METHOD* method = TLS_client_method();
     SSL_CTX* ctx = SSL_CTX_new(method);
     if (!ctx) return nullptr;
@@ -169,11 +299,22 @@ SSL_CTX* create_client_ssl_ctx(bool trust_self_signed) {
     // Require TLS 1.2 minimum
     SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
 
+    // Sessions are kept by the caller (per server, on disk), not in this context
+    if (on_session) {
+        SSL_CTX_set_ex_data(ctx, session_sink_index(), new TlsSessionSink(std::move(on_session)));
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, on_new_client_session);
+    }
+
     if (trust_self_signed) {
         SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
     } else {
+#ifdef _WIN32
         // Load CA certs from the Windows certificate store
         load_windows_cert_store(ctx);
+#else
+        SSL_CTX_set_default_verify_paths(ctx);
+#endif
         SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
     }
 
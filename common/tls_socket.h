@@ -6,6 +6,7 @@
 #include <openssl/err.h>
 #include <openssl/x509.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -21,6 +22,24 @@ public:
     OpenSSLInit& operator=(const OpenSSLInit&) = delete;
 };
 
+// Largest TLS record payload; a write up to this size goes out as one record
+constexpr size_t TLS_MAX_RECORD = 16 * 1024;
+
+// One piece of a gathered write
+struct TlsSlice {
+    const uint8_t* data;
+    size_t         len;
+};
+
+// Outcome of a single non-blocking TLS read/write step
+enum class TlsIo {
+    OK,          // some bytes were transferred
+    WANT_READ,   // retry once the socket is readable
+    WANT_WRITE,  // retry once the socket is writable
+    CLOSED,      // peer sent close_notify or closed the connection
+    FAILED,      // protocol or socket error; the connection is unusable
+};
+
 // RAII TLS socket wrapper -- mirrors Socket API (send_all, recv_all, get, valid, close)
 class TlsSocket {
 public:
@@ -39,7 +58,16 @@ public:
     // Client-side: wrap a connected raw socket with TLS
     // Takes ownership of the Socket. Returns false if TLS handshake fails.
     // If trust_self_signed is true, disables certificate verification.
-    bool connect(Socket&& raw_socket, SSL_CTX* ctx);
+    // `resume_session` (DER, as handed to a TlsSessionSink) offers an earlier
+    // session with the same server for an abbreviated handshake.
+    bool connect(Socket&& raw_socket, SSL_CTX* ctx,
+                 const std::vector<uint8_t>& resume_session = {});
+
+    // True if the handshake resumed a previous session
+    bool resumed() const;
+
+    // True if records are sent through kernel TLS (see SSL_OP_ENABLE_KTLS)
+    bool ktls_send() const;
 
     // Underlying socket handle (for select() calls)
     SOCKET get() const;
@@ -53,16 +81,50 @@ public:
     // Receive exactly `len` bytes into `buf`. Returns false on error/disconnect.
     bool recv_all(uint8_t* buf, size_t len);
 
+    // ── Non-blocking mode (event-driven server) ──
+    // Switches the underlying socket to non-blocking and enables partial writes.
+    // After this, use read_some/write_some instead of send_all/recv_all.
+    void set_nonblocking();
+
+    // One SSL_read/SSL_write step. `out_len` receives the byte count on OK.
+    // A WANT_* result must be retried with the same (or a moved copy of the) data.
+    TlsIo read_some(uint8_t* buf, size_t len, size_t& out_len);
+    TlsIo write_some(const uint8_t* data, size_t len, size_t& out_len);
+
+    // Gathered write_some: the front of `slices`, up to TLS_MAX_RECORD bytes, goes
+    // out as a single record (one SSL_write, one send). `out_len` counts bytes
+    // across the slices. Small slices are copied into a staging buffer; a first
+    // slice that fills a record by itself is written in place. The WANT_* retry
+    // rule applies to the whole slice list.
+    TlsIo writev_some(const TlsSlice* slices, size_t count, size_t& out_len);
+
+    // True if decrypted or buffered TLS data is waiting that a socket-level
+    // readiness check would not report
+    bool has_pending() const;
+
     // Get the peer's IP address as a string
     std::string peer_ip() const;
 
+    // RFC 5705 keying material bound to this session (empty on failure). Both
+    // ends derive the same bytes, so a MAC over them proves neither side is
+    // talking to a relaying man in the middle.
+    std::vector<uint8_t> export_keying_material(const std::string& label, size_t len) const;
+
 private:
-    Socket socket_;
-    SSL*   ssl_ = nullptr;
+    Socket               socket_;
+    SSL*                 ssl_ = nullptr;
+    std::vector<uint8_t> gather_;  // staging for writev_some
 };
 
+// Receives each resumable session (DER-encoded) a server issues, e.g. to persist it.
+// TLS 1.3 tickets arrive after the handshake, so this runs on whichever thread
+// is reading the connection at the time.
+using TlsSessionSink = std::function<void(const std::vector<uint8_t>& session)>;
+
 // Create a client SSL_CTX with default verification settings
 // If trust_self_signed is true, sets SSL_CTX_set_verify to SSL_VERIFY_NONE
-SSL_CTX* create_client_ssl_ctx(bool trust_self_signed = false);
+// If `on_session` is set, sessions from connections made with this context are
+// passed to it.
+SSL_CTX* create_client_ssl_ctx(bool trust_self_signed = false, TlsSessionSink on_session = nullptr);
 
 } // namespace lilypad
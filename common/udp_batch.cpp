@@ -0,0 +1,130 @@
+#include "udp_batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lilypad {
+
+// ── UdpBatchReceiver ──
+
+UdpBatchReceiver::UdpBatchReceiver(size_t max_datagram, size_t batch)
+    : max_datagram_(max_datagram), batch_((std::max)(batch, size_t{1})),
+      buffers_(max_datagram_ * batch_), sizes_(batch_), addrs_(batch_) {
+#ifndef _WIN32
+    iovs_.resize(batch_);
+    msgs_.resize(batch_);
+#endif
+}
+
+#ifndef _WIN32
+
+size_t UdpBatchReceiver::receive(SOCKET s) {
+    for (size_t i = 0; i < batch_; ++i) {
+        iovs_[i].iov_base = buffers_.data() + i * max_datagram_;
+        iovs_[i].iov_len  = max_datagram_;
+        std::memset(&msgs_[i], 0, sizeof(mmsghdr));
+        msgs_[i].msg_hdr.msg_iov     = &iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen  = 1;
+        msgs_[i].msg_hdr.msg_name    = &addrs_[i];
+        msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    int n;
+    do {
+        syscalls_++;
+        n = recvmmsg(s, msgs_.data(), static_cast<unsigned>(batch_), MSG_DONTWAIT, nullptr);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return 0;
+
+    for (int i = 0; i < n; ++i) sizes_[i] = msgs_[i].msg_len;
+    return static_cast<size_t>(n);
+}
+
+#else
+
+size_t UdpBatchReceiver::receive(SOCKET s) {
+    size_t n = 0;
+    while (n < batch_) {
+        socklen_t addr_len = sizeof(sockaddr_in);
+        syscalls_++;
+        int got = recvfrom(s, reinterpret_cast<char*>(buffers_.data() + n * max_datagram_),
+                           static_cast<int>(max_datagram_), 0,
+                           reinterpret_cast<sockaddr*>(&addrs_[n]), &addr_len);
+        if (got == SOCKET_ERROR) {
+            // Stale ICMP port-unreachable from an old peer: skip it and keep draining
+            if (WSAGetLastError() == WSAECONNRESET) continue;
+            break;  // WSAEWOULDBLOCK: drained
+        }
+        sizes_[n++] = static_cast<size_t>(got);
+    }
+    return n;
+}
+
+#endif
+
+// ── UdpBatchSender ──
+
+void UdpBatchSender::add(const uint8_t* data, size_t len, const sockaddr_in& to) {
+    items_.push_back({data, len, to});
+}
+
+#ifndef _WIN32
+
+// Kernel limit on messages per sendmmsg call (UIO_MAXIOV)
+constexpr size_t SENDMMSG_MAX = 1024;
+
+size_t UdpBatchSender::flush(SOCKET s) {
+    size_t count = items_.size();
+    if (count == 0) return 0;
+
+    iovs_.resize(count);
+    msgs_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        iovs_[i].iov_base = const_cast<uint8_t*>(items_[i].data);
+        iovs_[i].iov_len  = items_[i].len;
+        std::memset(&msgs_[i], 0, sizeof(mmsghdr));
+        msgs_[i].msg_hdr.msg_iov     = &iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen  = 1;
+        msgs_[i].msg_hdr.msg_name    = &items_[i].to;
+        msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    size_t sent = 0;
+    size_t next = 0;
+    while (next < count) {
+        unsigned chunk = static_cast<unsigned>((std::min)(count - next, SENDMMSG_MAX));
+        syscalls_++;
+        int n = sendmmsg(s, msgs_.data() + next, chunk, MSG_DONTWAIT);
+        if (n > 0) {
+            next += static_cast<size_t>(n);
+            sent += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;   // send buffer full: drop the rest of this batch
+        } else {
+            next++;  // this datagram was rejected (e.g. unreachable peer): skip it
+        }
+    }
+
+    items_.clear();
+    return sent;
+}
+
+#else
+
+size_t UdpBatchSender::flush(SOCKET s) {
+    size_t sent = 0;
+    for (auto& item : items_) {
+        syscalls_++;
+        int n = sendto(s, reinterpret_cast<const char*>(item.data), static_cast<int>(item.len), 0,
+                       reinterpret_cast<const sockaddr*>(&item.to), sizeof(item.to));
+        if (n != SOCKET_ERROR) sent++;
+    }
+    items_.clear();
+    return sent;
+}
+
+#endif
+
+} // namespace lilypad
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "network.h"
+
+#include <cstdint>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+namespace lilypad {
+
+// Datagrams drained per receive() call
+constexpr size_t UDP_BATCH_SIZE = 64;
+
+// ── Receive up to a batch of datagrams per system call ──
+// recvmmsg on Linux; a recvfrom loop elsewhere (socket must be non-blocking).
+class UdpBatchReceiver {
+public:
+    UdpBatchReceiver(size_t max_datagram, size_t batch = UDP_BATCH_SIZE);
+
+    // Drain whatever is ready on `s` without blocking. Returns the datagram count;
+    // data()/size()/from() stay valid until the next receive().
+    size_t receive(SOCKET s);
+
+    const uint8_t*     data(size_t i) const { return buffers_.data() + i * max_datagram_; }
+    size_t             size(size_t i) const { return sizes_[i]; }
+    const sockaddr_in& from(size_t i) const { return addrs_[i]; }
+
+    uint64_t syscalls() const { return syscalls_; }
+
+private:
+    size_t                   max_datagram_;
+    size_t                   batch_;
+    std::vector<uint8_t>     buffers_;
+    std::vector<size_t>      sizes_;
+    std::vector<sockaddr_in> addrs_;
+#ifndef _WIN32
+    std::vector<iovec>       iovs_;
+    std::vector<mmsghdr>     msgs_;
+#endif
+    uint64_t                 syscalls_ = 0;
+};
+
+// ── Collect outgoing datagrams and emit them with as few system calls as possible ──
+// sendmmsg on Linux; a sendto loop elsewhere. add() only records the pointer, so
+// the payload must stay alive until flush().
+class UdpBatchSender {
+public:
+    void   add(const uint8_t* data, size_t len, const sockaddr_in& to);
+    size_t pending() const { return items_.size(); }
+
+    // Send everything queued. Datagrams the kernel rejects are dropped (voice is
+    // real-time; a retry would only arrive late). Returns how many were sent.
+    size_t flush(SOCKET s);
+
+    uint64_t syscalls() const { return syscalls_; }
+
+private:
+    struct Item {
+        const uint8_t* data;
+        size_t         len;
+        sockaddr_in    to;
+    };
+    std::vector<Item>    items_;
+#ifndef _WIN32
+    std::vector<iovec>   iovs_;
+    std::vector<mmsghdr> msgs_;
+#endif
+    uint64_t             syscalls_ = 0;
+};
+
+} // namespace lilypad
@@ -0,0 +1,104 @@
+#include "h264_source.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+namespace lilypad {
+
+constexpr uint32_t KEYFRAME_WEIGHT = 5;
+
+// NAL unit types that matter for splitting a stream into access units
+constexpr uint8_t NAL_SLICE     = 1;
+constexpr uint8_t NAL_IDR_SLICE = 5;
+constexpr uint8_t NAL_SEI       = 6;
+constexpr uint8_t NAL_SPS       = 7;
+constexpr uint8_t NAL_PPS       = 8;
+constexpr uint8_t NAL_AUD       = 9;
+
+// Offset of the next 00 00 01 start code at or after `from` (size if none)
+static size_t find_start_code(const std::vector<uint8_t>& buf, size_t from) {
+    for (size_t i = from; i + 3 <= buf.size(); ++i) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) return i;
+    }
+    return buf.size();
+}
+
+bool H264Source::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    frames_.clear();
+    H264Frame current;
+    bool      has_slice = false;
+
+    size_t pos = find_start_code(stream, 0);
+    while (pos < stream.size()) {
+        size_t nal_begin = pos + 3;
+        size_t next      = find_start_code(stream, nal_begin);
+        size_t nal_end   = next;
+        if (nal_end < stream.size() && nal_end > nal_begin && stream[nal_end - 1] == 0)
+            --nal_end;  // 4-byte start code of the next NAL
+        if (nal_begin >= nal_end) { pos = next; continue; }
+
+        uint8_t type = stream[nal_begin] & 0x1F;
+        bool    vcl  = type == NAL_SLICE || type == NAL_IDR_SLICE;
+        // first_mb_in_slice is ue(v); it is 0, the start of a picture, iff the first bit is 1
+        bool first_slice = vcl && nal_end > nal_begin + 1 && (stream[nal_begin + 1] & 0x80);
+        bool starts_au   = type == NAL_AUD || type == NAL_SPS || type == NAL_PPS ||
+                           type == NAL_SEI || first_slice;
+        if (starts_au && has_slice) {
+            frames_.push_back(std::move(current));
+            current   = H264Frame{};
+            has_slice = false;
+        }
+
+        static const uint8_t start_code[] = {0, 0, 0, 1};
+        current.data.insert(current.data.end(), start_code, start_code + 4);
+        current.data.insert(current.data.end(), stream.begin() + nal_begin, stream.begin() + nal_end);
+        if (vcl) has_slice = true;
+        if (type == NAL_IDR_SLICE) current.keyframe = true;
+        pos = next;
+    }
+    if (has_slice) frames_.push_back(std::move(current));
+
+    for (auto& f : frames_) {
+        if (f.keyframe) return true;
+    }
+    frames_.clear();
+    return false;
+}
+
+void H264Source::synthesize(uint32_t kbps, uint32_t fps, uint32_t gop) {
+    frames_.clear();
+    gop = (std::max)(gop, 1u);
+    size_t gop_bytes = static_cast<size_t>(kbps) * 1000 / 8 * gop / (std::max)(fps, 1u);
+    size_t delta     = gop_bytes / (gop - 1 + KEYFRAME_WEIGHT);
+
+    std::mt19937 rng(0x11Fu);
+    for (uint32_t i = 0; i < gop; ++i) {
+        H264Frame f;
+        f.keyframe = i == 0;
+        f.data.resize((std::max)(delta * (f.keyframe ? KEYFRAME_WEIGHT : 1), size_t{16}));
+        for (auto& b : f.data) b = static_cast<uint8_t>(rng());
+        frames_.push_back(std::move(f));
+    }
+}
+
+size_t H264Source::next_keyframe(size_t from) const {
+    for (size_t i = 0; i < frames_.size(); ++i) {
+        if (frame(from + i).keyframe) return from + i;
+    }
+    return from;
+}
+
+double H264Source::kbps_at(uint32_t fps) const {
+    if (frames_.empty()) return 0.0;
+    size_t total = 0;
+    for (auto& f : frames_) total += f.data.size();
+    return static_cast<double>(total) * 8.0 / 1000.0 * fps / frames_.size();
+}
+
+} // namespace lilypad
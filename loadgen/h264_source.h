@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lilypad {
+
+struct H264Frame {
+    std::vector<uint8_t> data;  // Annex-B access unit
+    bool                 keyframe = false;
+};
+
+// ── Screen-share frames for simulated sharers ──
+// Either a recorded Annex-B H.264 stream split into access units, or a
+// synthetic GOP of random bytes sized for a target bitrate. The relay never
+// looks inside the bitstream, so only frame sizes and keyframe spacing matter.
+// Immutable once built; every sharer walks it with its own cursor.
+class H264Source {
+public:
+    // Loads and splits `path`. Returns false if it holds no keyframe.
+    bool load(const std::string& path);
+
+    // One GOP of `gop` frames totalling `kbps` at `fps`; the keyframe is
+    // KEYFRAME_WEIGHT times the size of a delta frame.
+    void synthesize(uint32_t kbps, uint32_t fps, uint32_t gop);
+
+    size_t           size() const { return frames_.size(); }
+    const H264Frame& frame(size_t i) const { return frames_[i % frames_.size()]; }
+
+    // Index of the first keyframe at or after `from`, for keyframe requests
+    size_t next_keyframe(size_t from) const;
+
+    // Average bitrate when played at `fps`
+    double kbps_at(uint32_t fps) const;
+
+private:
+    std::vector<H264Frame> frames_;
+};
+
+} // namespace lilypad
@@ -0,0 +1,70 @@
+#include "load_stats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace lilypad {
+
+int64_t SendTimes::elapsed_us(uint64_t seq, LoadClock::time_point now) const {
+    LoadClock::rep sent = slots_[seq % SEND_TIME_SLOTS].load(std::memory_order_relaxed);
+    if (sent == 0) return -1;
+    auto elapsed = now - LoadClock::time_point(LoadClock::duration(sent));
+    if (elapsed < LoadClock::duration::zero()) return -1;  // slot reused by a newer packet
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void LoadStats::merge(const LoadStats& other) {
+    voice_sent        += other.voice_sent;
+    voice_received    += other.voice_received;
+    voice_expected    += other.voice_expected;
+    voice_mixed       += other.voice_mixed;
+    frames_sent       += other.frames_sent;
+    frames_skipped    += other.frames_skipped;
+    frames_received   += other.frames_received;
+    frames_expected   += other.frames_expected;
+    keyframe_requests += other.keyframe_requests;
+    churn_ops         += other.churn_ops;
+    tcp_bytes_out     += other.tcp_bytes_out;
+    tcp_bytes_in      += other.tcp_bytes_in;
+    udp_bytes_out     += other.udp_bytes_out;
+    udp_bytes_in      += other.udp_bytes_in;
+    voice_latency_us.insert(voice_latency_us.end(), other.voice_latency_us.begin(), other.voice_latency_us.end());
+    frame_latency_us.insert(frame_latency_us.end(), other.frame_latency_us.begin(), other.frame_latency_us.end());
+}
+
+uint32_t percentile(std::vector<uint32_t>& samples, double p) {
+    if (samples.empty()) return 0;
+    size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(samples.size() - 1) + 0.5);
+    rank = (std::min)(rank, samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+double process_cpu_seconds(int pid) {
+#ifdef __linux__
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string   stat;
+    if (!std::getline(file, stat)) return -1.0;
+
+    // Fields count from after the command name, which is parenthesized and may hold spaces
+    size_t close = stat.rfind(')');
+    if (close == std::string::npos || close + 2 > stat.size()) return -1.0;
+    std::istringstream fields(stat.substr(close + 2));
+    std::string        skip;
+    for (int field = 3; field <= 13; ++field) fields >> skip;
+    unsigned long long utime = 0, stime = 0;
+    if (!(fields >> utime >> stime)) return -1.0;
+    return static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+#else
+    (void)pid;
+    return -1.0;
+#endif
+}
+
+} // namespace lilypad
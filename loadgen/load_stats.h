@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace lilypad {
+
+using LoadClock = std::chrono::steady_clock;
+
+// ── Send times of one simulated stream, by sequence number ──
+// Written by the sending worker, read by whichever worker receives the packet.
+// Keeps the last SEND_TIME_SLOTS entries (20s of voice, 4s of 60fps video).
+constexpr size_t SEND_TIME_SLOTS = 1024;
+
+class SendTimes {
+public:
+    void record(uint64_t seq, LoadClock::time_point t) {
+        slots_[seq % SEND_TIME_SLOTS].store(t.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+    // Microseconds from send of `seq` to `now` (-1 if unknown)
+    int64_t elapsed_us(uint64_t seq, LoadClock::time_point now) const;
+
+private:
+    std::array<std::atomic<LoadClock::rep>, SEND_TIME_SLOTS> slots_{};
+};
+
+// ── Loss accounting for one received stream ──
+// Every packet above the highest sequence seen adds the gap to `expected`;
+// late or reordered packets only count as received.
+struct StreamCounter {
+    uint64_t highest  = 0;
+    bool     started  = false;
+
+    // Returns how many packets this one makes the stream expect
+    uint64_t on_packet(uint64_t seq) {
+        if (!started) { started = true; highest = seq; return 1; }
+        if (seq <= highest) return 0;
+        uint64_t gap = seq - highest;
+        highest = seq;
+        return gap;
+    }
+};
+
+// ── Counters for one reporting interval ──
+struct LoadStats {
+    uint64_t voice_sent      = 0;
+    uint64_t voice_received  = 0;  // forwarded packets from simulated talkers
+    uint64_t voice_expected  = 0;
+    uint64_t voice_mixed     = 0;  // packets of a server mix (no per-talker latency)
+    uint64_t frames_sent     = 0;
+    uint64_t frames_skipped  = 0;  // sharer's own TCP backlog was full
+    uint64_t frames_received = 0;
+    uint64_t frames_expected = 0;
+    uint64_t keyframe_requests = 0;
+    uint64_t churn_ops       = 0;  // join/leave/subscribe messages sent by churners
+    uint64_t tcp_bytes_out = 0, tcp_bytes_in = 0;
+    uint64_t udp_bytes_out = 0, udp_bytes_in = 0;
+    std::vector<uint32_t> voice_latency_us;
+    std::vector<uint32_t> frame_latency_us;
+
+    void merge(const LoadStats& other);
+};
+
+// The p-th percentile (0-100) of `samples`, which get reordered; 0 if empty
+uint32_t percentile(std::vector<uint32_t>& samples, double p);
+
+// User plus system CPU time used so far by local process `pid`, in seconds;
+// negative if it cannot be read (Linux /proc only)
+double process_cpu_seconds(int pid);
+
+} // namespace lilypad
@@ -0,0 +1,496 @@
+#include "load_worker.h"
+#include "audio_codec.h"
+#include "protocol.h"
+
+#ifndef _WIN32
+#include <netdb.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace lilypad {
+
+constexpr auto   VOICE_TICK            = std::chrono::milliseconds(20);
+constexpr auto   STATS_FLUSH           = std::chrono::milliseconds(100);
+constexpr int    CHURN_BURST           = 64;     // most churn messages per loop pass
+constexpr int    TONE_FRAMES           = 50;     // one second, looped
+constexpr float  TONE_AMPLITUDE        = 0.1f;   // about -23 dBFS
+constexpr size_t SHARER_BACKLOG_LIMIT  = 4 * 1024 * 1024;  // beyond this, delta frames are skipped
+constexpr size_t TCP_READ_CHUNK        = 64 * 1024;
+constexpr uint16_t SIM_WIDTH  = 1920;
+constexpr uint16_t SIM_HEIGHT = 1080;
+
+// Frames carry their sequence number in a filler-data NAL in front of the
+// access unit: "LPLG" and 16 hex digits (no zero bytes, so no false start codes)
+constexpr uint8_t FRAME_TAG_MAGIC[] = {'L', 'P', 'L', 'G'};
+constexpr size_t  FRAME_TAG_SIZE    = 4 + 1 + 4 + 16 + 1;  // start code, NAL header, magic, seq, trailing bits
+
+static void write_frame_tag(std::vector<uint8_t>& out, uint64_t seq) {
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t prefix[] = {0, 0, 0, 1, 0x0C};  // NAL type 12: filler data
+    out.insert(out.end(), prefix, prefix + 5);
+    out.insert(out.end(), FRAME_TAG_MAGIC, FRAME_TAG_MAGIC + 4);
+    for (int shift = 60; shift >= 0; shift -= 4) out.push_back(static_cast<uint8_t>(hex[(seq >> shift) & 0xF]));
+    out.push_back(0x80);
+}
+
+static bool read_frame_tag(const uint8_t* h264, size_t len, uint64_t& seq) {
+    if (len < FRAME_TAG_SIZE || std::memcmp(h264 + 5, FRAME_TAG_MAGIC, 4) != 0) return false;
+    seq = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        char c = static_cast<char>(h264[9 + i]);
+        seq = (seq << 4) | static_cast<uint64_t>(c >= 'a' ? c - 'a' + 10 : c - '0');
+    }
+    return true;
+}
+
+// Blocking read of one framed message during login
+static bool recv_message(TlsSocket& tls, SignalHeader& header, std::vector<uint8_t>& payload) {
+    uint8_t hdr_buf[SIGNAL_HEADER_SIZE];
+    if (!tls.recv_all(hdr_buf, SIGNAL_HEADER_SIZE)) return false;
+    header = deserialize_header(hdr_buf);
+    if (header.payload_len > 64 * 1024) return false;
+    payload.resize(header.payload_len);
+    return header.payload_len == 0 || tls.recv_all(payload.data(), header.payload_len);
+}
+
+static uint32_t micros(int64_t us) {
+    return static_cast<uint32_t>((std::min)(us, int64_t{UINT32_MAX}));
+}
+
+LoadWorker::LoadWorker(const LoadConfig& cfg, const H264Source& source, SSL_CTX* ctx, size_t index)
+    : cfg_(cfg), source_(source), ctx_(ctx), index_(index), udp_rx_(MAX_VOICE_PACKET) {
+    // Every talker loops the same encoded tone; the relay only needs valid Opus
+    OpusEncoderWrapper encoder;
+    std::vector<float> pcm(FRAME_SIZE);
+    const float step = 2.0f * 3.14159265f * 440.0f / SAMPLE_RATE;
+    for (int f = 0; f < TONE_FRAMES; ++f) {
+        for (int i = 0; i < FRAME_SIZE; ++i)
+            pcm[i] = TONE_AMPLITUDE * std::sin(step * static_cast<float>(f * FRAME_SIZE + i));
+        opus_frames_.push_back(encoder.encode(pcm.data()));
+    }
+    tone_level_db_ = frame_level_db(pcm.data(), pcm.size());
+}
+
+LoadWorker::~LoadWorker() {
+    join();
+}
+
+void LoadWorker::add_client(size_t index) {
+    auto c = std::make_unique<SimClient>();
+    c->index    = index;
+    c->username = cfg_.user_prefix + std::to_string(index);
+    c->talker   = index < cfg_.talkers;
+    c->sharer   = index >= cfg_.talkers && index < cfg_.talkers + cfg_.sharers;
+    c->viewer   = index >= cfg_.talkers + cfg_.sharers && index < cfg_.talkers + cfg_.sharers + cfg_.viewers;
+    c->churner  = index >= cfg_.talkers + cfg_.sharers + cfg_.viewers &&
+                  index < cfg_.talkers + cfg_.sharers + cfg_.viewers + cfg_.churners;
+    c->viewer_ordinal = index - (std::min)(index, cfg_.talkers + cfg_.sharers);
+    c->tcp_handle = {c.get(), false};
+    c->udp_handle = {c.get(), true};
+    if (c->talker) c->voice_times = std::make_unique<SendTimes>();
+    if (c->sharer) c->frame_times = std::make_unique<SendTimes>();
+    clients_.push_back(std::move(c));
+}
+
+size_t LoadWorker::connect_all() {
+    size_t ok = 0;
+    for (auto& c : clients_) {
+        if (connect_client(*c)) ok++;
+    }
+    return ok;
+}
+
+bool LoadWorker::connect_client(SimClient& c) {
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo*   result = nullptr;
+    std::string port   = std::to_string(cfg_.port);
+    if (getaddrinfo(cfg_.host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        std::cerr << "[Loadgen] Cannot resolve " << cfg_.host << "\n";
+        return false;
+    }
+    sockaddr_in server_addr = *reinterpret_cast<const sockaddr_in*>(result->ai_addr);
+
+    Socket raw = create_tcp_socket();
+    int nodelay = 1;
+    setsockopt(raw.get(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+    int rc = connect(raw.get(), result->ai_addr, static_cast<int>(result->ai_addrlen));
+    freeaddrinfo(result);
+    if (rc == SOCKET_ERROR) {
+        std::cerr << "[Loadgen] " << c.username << ": connect failed: " << WSAGetLastError() << "\n";
+        return false;
+    }
+    if (!c.tls.connect(std::move(raw), ctx_)) {
+        std::cerr << "[Loadgen] " << c.username << ": TLS handshake failed\n";
+        return false;
+    }
+
+    // Register (an existing account is fine), then log in
+    SignalHeader         header;
+    std::vector<uint8_t> payload;
+    if (!c.tls.send_all(make_auth_register_req(c.username, cfg_.password)) ||
+        !recv_message(c.tls, header, payload) ||
+        !c.tls.send_all(make_auth_login_req(c.username, cfg_.password)) ||
+        !recv_message(c.tls, header, payload)) {
+        std::cerr << "[Loadgen] " << c.username << ": connection lost during login\n";
+        return false;
+    }
+    if (header.type != MsgType::AUTH_LOGIN_RESP || payload.size() < 7 ||
+        payload[0] != static_cast<uint8_t>(AuthStatus::OK)) {
+        std::cerr << "[Loadgen] " << c.username << ": login refused\n";
+        return false;
+    }
+    c.id = read_u32(payload.data() + 1);
+    c.udp_dest          = server_addr;
+    c.udp_dest.sin_port = htons(read_u16(payload.data() + 5));
+
+    c.udp = create_udp_socket();
+    set_nonblocking(c.udp.get());
+    c.alive = true;
+    return true;
+}
+
+void LoadWorker::publish(LoadDirectory& dir) const {
+    for (auto& c : clients_) {
+        if (!c->alive) continue;
+        if (c->talker) dir.voice[c->id] = c->voice_times.get();
+        if (c->sharer) {
+            dir.screen[c->id] = c->frame_times.get();
+            dir.sharer_ids.push_back(c->id);
+        }
+    }
+}
+
+void LoadWorker::begin() {
+    for (auto& c : clients_) {
+        if (!c->alive) continue;
+        c->tls.send_all(make_voice_join_msg(cfg_.room));
+        if (c->sharer) c->tls.send_all(make_screen_start_msg());
+
+        // Announce the UDP address with a silent frame, so listeners that never
+        // talk are reachable too
+        VoicePacket pkt;
+        pkt.client_id     = c->id;
+        pkt.sequence      = c->voice_seq++;
+        pkt.audio.present = true;
+        pkt.opus_data     = opus_frames_[0];
+        auto bytes = pkt.to_bytes();
+        sendto(c->udp.get(), reinterpret_cast<const char*>(bytes.data()), static_cast<int>(bytes.size()), 0,
+               reinterpret_cast<const sockaddr*>(&c->udp_dest), sizeof(c->udp_dest));
+    }
+}
+
+void LoadWorker::subscribe(const LoadDirectory& dir) {
+    if (dir.sharer_ids.empty()) return;
+    for (auto& c : clients_) {
+        if (!c->alive || !c->viewer) continue;
+        c->watching = dir.sharer_ids[c->viewer_ordinal % dir.sharer_ids.size()];
+        c->tls.send_all(make_screen_subscribe_msg(c->watching));
+    }
+}
+
+void LoadWorker::start(const LoadDirectory& dir, LoadClock::time_point until) {
+    thread_ = std::thread(&LoadWorker::run, this, std::cref(dir), until);
+}
+
+void LoadWorker::join() {
+    if (thread_.joinable()) thread_.join();
+}
+
+size_t LoadWorker::churners() const {
+    size_t n = 0;
+    for (auto& c : clients_) {
+        if (c->alive && c->churner) n++;
+    }
+    return n;
+}
+
+LoadStats LoadWorker::take_stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    LoadStats out = std::move(shared_);
+    shared_ = LoadStats{};
+    return out;
+}
+
+void LoadWorker::publish_stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    shared_.merge(local_);
+    local_ = LoadStats{};
+}
+
+void LoadWorker::run(const LoadDirectory& dir, LoadClock::time_point until) {
+    auto start = LoadClock::now();
+    // Spread the workers' ticks over the 20ms so the server sees a steady stream
+    auto next_voice = start + VOICE_TICK * static_cast<int>(index_ % 8) / 8;
+    auto frame_interval = std::chrono::duration_cast<LoadClock::duration>(std::chrono::seconds(1)) / (std::max)(cfg_.fps, 1u);
+    auto next_churn = start;
+
+    std::vector<SimClient*> churners;
+    for (auto& c : clients_) {
+        if (c->alive && c->churner) churners.push_back(c.get());
+    }
+
+    for (auto& c : clients_) {
+        if (!c->alive) continue;
+        c->tls.set_nonblocking();
+        poller_.add(c->tls.get(), POLL_READ, &c->tcp_handle);
+        poller_.add(c->udp.get(), POLL_READ, &c->udp_handle);
+        if (c->sharer) c->next_frame = start + frame_interval * static_cast<int>(c->index % 8) / 8;
+    }
+
+    std::vector<PollEvent> events;
+    auto last_flush = start;
+    while (true) {
+        auto now = LoadClock::now();
+        if (now >= until) break;
+
+        // The churn rate can change between passes; zero pauses it
+        double churn_rate = churners.empty() ? 0.0 : churn_rate_.load(std::memory_order_relaxed);
+        auto   churn_interval = churn_rate > 0.0
+            ? std::chrono::duration_cast<LoadClock::duration>(std::chrono::duration<double>(1.0 / churn_rate))
+            : LoadClock::duration::zero();
+
+        auto wake = (std::min)(next_voice, until);
+        for (auto& c : clients_) {
+            if (c->alive && c->sharer) wake = (std::min)(wake, c->next_frame);
+        }
+        if (churn_rate > 0.0) wake = (std::min)(wake, next_churn);
+        int timeout_ms = wake > now
+            ? static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count()) + 1
+            : 0;
+        int n = poller_.wait(events, (std::min)(timeout_ms, 50));
+
+        for (int i = 0; i < n; ++i) {
+            auto* handle = static_cast<Handle*>(events[i].user);
+            SimClient& c = *handle->client;
+            if (!c.alive) continue;
+            if (handle->udp) {
+                on_udp_readable(c, dir);
+            } else {
+                if (events[i].events & (POLL_READ | POLL_ERROR)) on_tcp_readable(c, dir);
+                if (c.alive && (events[i].events & POLL_WRITE)) flush_tx(c);
+            }
+        }
+
+        now = LoadClock::now();
+        if (now >= next_voice) {
+            for (auto& c : clients_) {
+                if (c->alive && c->talker) send_voice(*c, now);
+            }
+            next_voice += VOICE_TICK;
+            if (now - next_voice > VOICE_TICK * 5) next_voice = now + VOICE_TICK;  // fell behind: resync
+        }
+        for (auto& c : clients_) {
+            if (!c->alive || !c->sharer || now < c->next_frame) continue;
+            send_frame(*c, now);
+            c->next_frame += frame_interval;
+            if (now - c->next_frame > frame_interval * 5) c->next_frame = now + frame_interval;
+        }
+
+        if (churn_rate > 0.0) {
+            if (now - next_churn > churn_interval * 5) next_churn = now;  // paused or fell behind: resync
+            for (int sent = 0; now >= next_churn && sent < CHURN_BURST; ++sent) {
+                SimClient& c = *churners[churn_cursor_++ % churners.size()];
+                if (c.alive) send_churn(c, dir);
+                next_churn += churn_interval;
+            }
+        }
+
+        if (now - last_flush >= STATS_FLUSH) {
+            publish_stats();
+            last_flush = now;
+        }
+    }
+    publish_stats();
+
+    for (auto& c : clients_) {
+        if (!c->alive) continue;
+        poller_.remove(c->tls.get());
+        poller_.remove(c->udp.get());
+        c->tls.close();
+        c->alive = false;
+    }
+}
+
+void LoadWorker::send_voice(SimClient& c, LoadClock::time_point now) {
+    VoicePacket pkt;
+    pkt.client_id        = c.id;
+    pkt.sequence         = c.voice_seq;
+    pkt.audio.present    = true;
+    pkt.audio.vad        = true;
+    pkt.audio.level      = VoiceAudioLevel::encode_level(tone_level_db_);
+    pkt.audio.capture_ms = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count());
+    pkt.opus_data        = opus_frames_[c.voice_seq % opus_frames_.size()];
+    auto bytes = pkt.to_bytes();
+
+    c.voice_times->record(c.voice_seq, now);
+    c.voice_seq++;
+    if (sendto(c.udp.get(), reinterpret_cast<const char*>(bytes.data()), static_cast<int>(bytes.size()), 0,
+               reinterpret_cast<const sockaddr*>(&c.udp_dest), sizeof(c.udp_dest)) != SOCKET_ERROR) {
+        local_.voice_sent++;
+        local_.udp_bytes_out += bytes.size();
+    }
+}
+
+void LoadWorker::send_frame(SimClient& c, LoadClock::time_point now) {
+    const H264Frame& frame = source_.frame(c.cursor);
+    if (!frame.keyframe && c.tx_bytes > SHARER_BACKLOG_LIMIT) {
+        // Like an encoder behind a congested uplink: the frame is never sent
+        local_.frames_skipped++;
+        c.cursor++;
+        return;
+    }
+
+    std::vector<uint8_t> h264;
+    h264.reserve(FRAME_TAG_SIZE + frame.data.size());
+    write_frame_tag(h264, c.frame_seq);
+    h264.insert(h264.end(), frame.data.begin(), frame.data.end());
+    auto msg = make_screen_frame_msg(SIM_WIDTH, SIM_HEIGHT, frame.keyframe ? SCREEN_FLAG_KEYFRAME : 0,
+                                     0, h264.data(), h264.size());
+
+    c.frame_times->record(c.frame_seq, now);
+    c.frame_seq++;
+    c.cursor++;
+    local_.frames_sent++;
+    c.tx_bytes += msg.size();
+    c.tx.push_back(std::move(msg));
+    flush_tx(c);
+}
+
+void LoadWorker::send_churn(SimClient& c, const LoadDirectory& dir) {
+    // Leave and rejoin the room, then subscribe to a sharer and drop it again:
+    // each one is a registry update on the server and most are broadcast
+    size_t steps = dir.sharer_ids.empty() ? 2 : 4;
+    std::vector<uint8_t> msg;
+    switch (c.churn_step++ % steps) {
+    case 0: msg = make_voice_leave_msg(cfg_.room); break;
+    case 1: msg = make_voice_join_msg(cfg_.room); break;
+    case 2:
+        c.churn_target = dir.sharer_ids[(c.index + c.churn_step / 4) % dir.sharer_ids.size()];
+        msg = make_screen_subscribe_msg(c.churn_target);
+        break;
+    default: msg = make_screen_unsubscribe_msg(c.churn_target); break;
+    }
+    local_.churn_ops++;
+    c.tx_bytes += msg.size();
+    c.tx.push_back(std::move(msg));
+    flush_tx(c);
+}
+
+void LoadWorker::flush_tx(SimClient& c) {
+    while (!c.tx.empty()) {
+        auto&  front = c.tx.front();
+        size_t written = 0;
+        TlsIo  io = c.tls.write_some(front.data() + c.tx_offset, front.size() - c.tx_offset, written);
+        if (io == TlsIo::OK) {
+            c.tx_offset += written;
+            local_.tcp_bytes_out += written;
+            if (c.tx_offset == front.size()) {
+                c.tx_bytes -= front.size();
+                c.tx_offset = 0;
+                c.tx.pop_front();
+            }
+        } else if (io == TlsIo::WANT_WRITE) {
+            if (!c.want_write) {
+                poller_.modify(c.tls.get(), POLL_READ | POLL_WRITE, &c.tcp_handle);
+                c.want_write = true;
+            }
+            return;
+        } else if (io == TlsIo::WANT_READ) {
+            return;  // retried after the next read
+        } else {
+            fail(c, "connection lost while sending");
+            return;
+        }
+    }
+    if (c.want_write) {
+        poller_.modify(c.tls.get(), POLL_READ, &c.tcp_handle);
+        c.want_write = false;
+    }
+}
+
+void LoadWorker::on_tcp_readable(SimClient& c, const LoadDirectory& dir) {
+    uint8_t buf[TCP_READ_CHUNK];
+    while (true) {
+        size_t got = 0;
+        TlsIo  io = c.tls.read_some(buf, sizeof(buf), got);
+        if (io == TlsIo::OK) {
+            local_.tcp_bytes_in += got;
+            c.rx.insert(c.rx.end(), buf, buf + got);
+            continue;
+        }
+        if (io == TlsIo::CLOSED || io == TlsIo::FAILED) {
+            fail(c, "disconnected by the server");
+            return;
+        }
+        break;  // WANT_READ / WANT_WRITE: drained for now
+    }
+
+    size_t offset = 0;
+    while (c.rx.size() - offset >= SIGNAL_HEADER_SIZE) {
+        SignalHeader header = deserialize_header(c.rx.data() + offset);
+        if (c.rx.size() - offset - SIGNAL_HEADER_SIZE < header.payload_len) break;
+        on_message(c, static_cast<uint8_t>(header.type), c.rx.data() + offset + SIGNAL_HEADER_SIZE,
+                   header.payload_len, dir);
+        offset += SIGNAL_HEADER_SIZE + header.payload_len;
+    }
+    c.rx.erase(c.rx.begin(), c.rx.begin() + offset);
+
+    // A write that wanted a read can go on now
+    if (!c.tx.empty() && c.alive) flush_tx(c);
+}
+
+void LoadWorker::on_message(SimClient& c, uint8_t type, const uint8_t* payload, size_t len,
+                            const LoadDirectory& dir) {
+    if (type == static_cast<uint8_t>(MsgType::SCREEN_FRAME) && len >= 9) {
+        // sharer_id(4) + width(2) + height(2) + flags(1) + h264
+        uint32_t sharer = read_u32(payload);
+        uint64_t seq    = 0;
+        if (sharer != c.watching || !read_frame_tag(payload + 9, len - 9, seq)) return;
+        local_.frames_received++;
+        local_.frames_expected += c.frame_stream.on_packet(seq);
+        auto it = dir.screen.find(sharer);
+        int64_t us = it != dir.screen.end() ? it->second->elapsed_us(seq, LoadClock::now()) : -1;
+        if (us >= 0) local_.frame_latency_us.push_back(micros(us));
+    } else if (type == static_cast<uint8_t>(MsgType::SCREEN_REQUEST_KEYFRAME) && c.sharer) {
+        local_.keyframe_requests++;
+        c.cursor = source_.next_keyframe(c.cursor);
+    }
+}
+
+void LoadWorker::on_udp_readable(SimClient& c, const LoadDirectory& dir) {
+    size_t count = udp_rx_.receive(c.udp.get());
+    auto   now   = LoadClock::now();
+    for (size_t i = 0; i < count; ++i) {
+        local_.udp_bytes_in += udp_rx_.size(i);
+        if (c.churner) continue;  // in and out of the room: its gaps are not loss
+        VoiceHeader hdr;
+        if (!parse_voice_header(udp_rx_.data(i), udp_rx_.size(i), hdr)) continue;
+        if (is_voice_mix_sender(hdr.client_id)) {
+            local_.voice_mixed++;
+            continue;
+        }
+        auto it = dir.voice.find(hdr.client_id);
+        if (it == dir.voice.end()) continue;  // a listener's silent registration frame
+        local_.voice_received++;
+        local_.voice_expected += c.voice_streams[hdr.client_id].on_packet(hdr.sequence);
+        int64_t us = it->second->elapsed_us(hdr.sequence, now);
+        if (us >= 0) local_.voice_latency_us.push_back(micros(us));
+    }
+}
+
+void LoadWorker::fail(SimClient& c, const char* what) {
+    std::cerr << "[Loadgen] " << c.username << ": " << what << "\n";
+    poller_.remove(c.tls.get());
+    poller_.remove(c.udp.get());
+    c.alive = false;
+}
+
+} // namespace lilypad
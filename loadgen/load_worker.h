@@ -0,0 +1,164 @@
+#pragma once
+
+#include "h264_source.h"
+#include "load_stats.h"
+#include "network.h"
+#include "poller.h"
+#include "tls_socket.h"
+#include "udp_batch.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+struct LoadConfig {
+    std::string host     = "127.0.0.1";
+    uint16_t    port     = 7777;
+    size_t      clients  = 10;
+    size_t      talkers  = 2;   // clients [0, talkers)
+    size_t      sharers  = 0;   // the next `sharers` clients
+    size_t      viewers  = 0;   // the next `viewers`, round-robin over the sharers
+    size_t      churners = 0;   // the next `churners`, cycling through signaling messages
+    std::string room     = "General";
+    std::string user_prefix = "lg";
+    std::string password    = "loadgen-password";
+    uint32_t    fps      = 30;
+};
+
+// Ids and send-time tables of every simulated talker and sharer. Filled in
+// once all clients are logged in, read-only while the load runs.
+struct LoadDirectory {
+    std::unordered_map<uint32_t, const SendTimes*> voice;   // talker id
+    std::unordered_map<uint32_t, const SendTimes*> screen;  // sharer id
+    std::vector<uint32_t>                          sharer_ids;
+};
+
+// ── One thread driving a slice of the simulated clients ──
+// Each client is a real TLS connection plus a UDP socket, logged in like the
+// desktop client. While running, one Poller covers all of the slice's sockets;
+// talkers send a 20ms Opus frame per tick and sharers a frame every 1/fps.
+// Receivers time every packet against the sender's SendTimes, so latency is
+// measured on one clock: send by this process, relay by the server, receive here.
+// Churners leave and rejoin the voice room and, if anyone shares, subscribe and
+// unsubscribe, at the rate set_churn_rate() asks for; what they receive is not
+// counted, so the voice figures are those of the steady listeners.
+class LoadWorker {
+public:
+    LoadWorker(const LoadConfig& cfg, const H264Source& source, SSL_CTX* ctx, size_t index);
+    ~LoadWorker();
+    LoadWorker(const LoadWorker&) = delete;
+    LoadWorker& operator=(const LoadWorker&) = delete;
+
+    void add_client(size_t index);
+
+    // Connect, register and log in every client (blocking). Returns how many made it.
+    size_t connect_all();
+
+    // Record our talkers and sharers in `dir`
+    void publish(LoadDirectory& dir) const;
+
+    // Join the voice room and start sharing; viewers then subscribe once every
+    // sharer has started (blocking sends, before start())
+    void begin();
+    void subscribe(const LoadDirectory& dir);
+
+    // Drive the load until `until`, on the worker's own thread
+    void start(const LoadDirectory& dir, LoadClock::time_point until);
+    void join();
+
+    // Signaling messages per second, shared by this worker's churners; thread-safe
+    void   set_churn_rate(double ops_per_sec) { churn_rate_.store(ops_per_sec, std::memory_order_relaxed); }
+    size_t churners() const;
+
+    // Counters since the last call; thread-safe
+    LoadStats take_stats();
+
+private:
+    struct SimClient;
+    struct Handle {
+        SimClient* client;
+        bool       udp;
+    };
+
+    struct SimClient {
+        size_t      index = 0;
+        std::string username;
+        uint32_t    id = 0;
+        bool        talker = false, sharer = false, viewer = false, churner = false;
+        size_t      viewer_ordinal = 0;
+        bool        alive = false;
+
+        TlsSocket   tls;
+        Socket      udp;
+        sockaddr_in udp_dest{};
+        Handle      tcp_handle{nullptr, false};
+        Handle      udp_handle{nullptr, true};
+
+        // TCP framing
+        std::vector<uint8_t>             rx;
+        std::deque<std::vector<uint8_t>> tx;
+        size_t                           tx_offset  = 0;
+        size_t                           tx_bytes   = 0;
+        bool                             want_write = false;
+
+        // Voice
+        uint32_t                                    voice_seq = 0;
+        std::unordered_map<uint32_t, StreamCounter> voice_streams;  // by sender
+        std::unique_ptr<SendTimes>                  voice_times;
+
+        // Screen share
+        uint64_t                   frame_seq = 0;
+        size_t                     cursor = 0;
+        LoadClock::time_point      next_frame;
+        std::unique_ptr<SendTimes> frame_times;
+        uint32_t                   watching = 0;
+        StreamCounter              frame_stream;
+
+        // Signaling churn
+        uint32_t churn_step   = 0;
+        uint32_t churn_target = 0;  // sharer subscribed to, not counted as watching
+    };
+
+    void run(const LoadDirectory& dir, LoadClock::time_point until);
+    bool connect_client(SimClient& c);
+    void send_voice(SimClient& c, LoadClock::time_point now);
+    void send_frame(SimClient& c, LoadClock::time_point now);
+    void send_churn(SimClient& c, const LoadDirectory& dir);
+    void on_tcp_readable(SimClient& c, const LoadDirectory& dir);
+    void on_udp_readable(SimClient& c, const LoadDirectory& dir);
+    void on_message(SimClient& c, uint8_t type, const uint8_t* payload, size_t len,
+                    const LoadDirectory& dir);
+    void flush_tx(SimClient& c);
+    void fail(SimClient& c, const char* what);
+    void publish_stats();
+
+    const LoadConfig&  cfg_;
+    const H264Source&  source_;
+    SSL_CTX*           ctx_;
+    size_t             index_;
+
+    std::vector<std::unique_ptr<SimClient>> clients_;
+    std::vector<std::vector<uint8_t>>       opus_frames_;  // a looped test tone
+    float                                   tone_level_db_ = -100.0f;
+    Poller                                  poller_;
+    UdpBatchReceiver                        udp_rx_;
+
+    std::atomic<double> churn_rate_{0.0};
+    size_t              churn_cursor_ = 0;  // next churner to send
+
+    LoadStats  local_;  // worker thread only; published every STATS_FLUSH
+    std::mutex stats_mutex_;
+    LoadStats  shared_;
+
+    std::thread thread_;
+};
+
+} // namespace lilypad
@@ -0,0 +1,282 @@
+// lilypad_loadgen: synthetic load for sizing a server and catching regressions.
+// Opens N authenticated connections; the first M talk (20ms Opus frames over
+// UDP), the next S share their screen, the next V watch one sharer each, and
+// everyone listens in the voice room. Reports relay latency percentiles, loss
+// and throughput every few seconds and for the whole run.
+//
+// With --churners and --churn-rate the next C clients keep leaving and joining
+// the room and subscribing to sharers, so relay throughput can be read against
+// signaling load; several rates run back to back and are summed up per rate.
+
+#include "h264_source.h"
+#include "load_stats.h"
+#include "load_worker.h"
+#include "network.h"
+#include "tls_socket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr auto SUBSCRIBE_DELAY = std::chrono::milliseconds(500);  // let SCREEN_START land first
+
+static void print_usage() {
+    std::cout <<
+        "Usage: lilypad_loadgen [options]\n"
+        "  --host H            server address (127.0.0.1)\n"
+        "  --port P            server TCP port (7777)\n"
+        "  --clients N         connections to open (10)\n"
+        "  --talkers M         clients sending voice (2)\n"
+        "  --sharers S         clients sharing their screen (0)\n"
+        "  --viewers V         clients watching a share (0)\n"
+        "  --churners C        clients cycling through join/leave/subscribe (0)\n"
+        "  --churn-rate R,...  their messages per second in total (0); each rate\n"
+        "                      runs for --duration, then one summary line per rate\n"
+        "  --room NAME         voice room everyone joins (General)\n"
+        "  --duration SECS     length of the run (30)\n"
+        "  --report SECS       interval between report lines (5)\n"
+        "  --threads T         worker threads\n"
+        "  --h264 FILE         Annex-B H.264 to share, looped (default: synthetic)\n"
+        "  --screen-kbps K     bitrate of the synthetic stream (2500)\n"
+        "  --fps F             screen frames per second (30)\n"
+        "  --user-prefix P     account names are P0, P1, ... (lg)\n"
+        "  --password PW       password for those accounts\n"
+        "  --server-pid PID    also report the CPU a server on this host uses (Linux)\n";
+}
+
+// One report line for `stats` collected over `secs` seconds, in which the server
+// used `server_cpu` seconds of CPU (negative if unknown)
+static void print_stats(const char* label, lilypad::LoadStats& stats, double secs, double server_cpu) {
+    auto pct = [](uint64_t lost, uint64_t expected) {
+        return expected ? 100.0 * static_cast<double>(lost) / static_cast<double>(expected) : 0.0;
+    };
+    auto ms = [](uint32_t us) { return us / 1000.0; };
+    uint64_t voice_lost = stats.voice_expected - (std::min)(stats.voice_received, stats.voice_expected);
+    uint64_t frames_lost = stats.frames_expected - (std::min)(stats.frames_received, stats.frames_expected);
+    double   mbit_in  = (stats.tcp_bytes_out + stats.udp_bytes_out) * 8.0 / 1e6 / secs;
+    double   mbit_out = (stats.tcp_bytes_in + stats.udp_bytes_in) * 8.0 / 1e6 / secs;
+
+    char line[512];
+    std::snprintf(line, sizeof(line),
+        "[Loadgen] %s voice: %.0f pkt/s out, %.0f pkt/s in (%.2f%% lost, %.0f mixed/s), "
+        "latency p50 %.2f p95 %.2f p99 %.2f ms\n",
+        label, stats.voice_sent / secs, stats.voice_received / secs, pct(voice_lost, stats.voice_expected),
+        stats.voice_mixed / secs, ms(lilypad::percentile(stats.voice_latency_us, 50)),
+        ms(lilypad::percentile(stats.voice_latency_us, 95)), ms(lilypad::percentile(stats.voice_latency_us, 99)));
+    std::cout << line;
+    if (stats.frames_sent > 0 || stats.frames_received > 0) {
+        std::snprintf(line, sizeof(line),
+            "[Loadgen] %s screen: %.1f fps out, %.1f fps in (%.2f%% lost, %llu skipped, %llu keyframe requests), "
+            "latency p50 %.2f p95 %.2f p99 %.2f ms\n",
+            label, stats.frames_sent / secs, stats.frames_received / secs, pct(frames_lost, stats.frames_expected),
+            static_cast<unsigned long long>(stats.frames_skipped),
+            static_cast<unsigned long long>(stats.keyframe_requests),
+            ms(lilypad::percentile(stats.frame_latency_us, 50)), ms(lilypad::percentile(stats.frame_latency_us, 95)),
+            ms(lilypad::percentile(stats.frame_latency_us, 99)));
+        std::cout << line;
+    }
+    int n = std::snprintf(line, sizeof(line), "[Loadgen] %s server: receives %.2f Mbit/s, sends %.2f Mbit/s",
+                          label, mbit_in, mbit_out);
+    if (server_cpu >= 0.0 && n > 0) {
+        // CPU per Gbit sent is the figure to compare across server builds and options
+        double gbit_out = mbit_out * secs / 1000.0;
+        std::snprintf(line + n, sizeof(line) - n, ", CPU %.2f cores (%.2f core-seconds per Gbit sent)",
+                      server_cpu / secs, gbit_out > 0.0 ? server_cpu / gbit_out : 0.0);
+    }
+    std::cout << line << "\n";
+    if (stats.churn_ops > 0) {
+        std::snprintf(line, sizeof(line), "[Loadgen] %s signaling: %.0f churn msg/s\n",
+                      label, stats.churn_ops / secs);
+        std::cout << line;
+    }
+}
+
+// Relay throughput at one churn rate, as one line of the closing summary
+static void print_churn_step(double rate, lilypad::LoadStats& stats, double secs) {
+    uint64_t voice_lost = stats.voice_expected - (std::min)(stats.voice_received, stats.voice_expected);
+    char line[256];
+    std::snprintf(line, sizeof(line),
+        "[Loadgen] churn %6.0f msg/s asked, %6.0f sent: relay %.0f pkt/s in (%.2f%% lost, %.0f mixed/s), "
+        "latency p50 %.2f p99 %.2f ms\n",
+        rate, stats.churn_ops / secs, stats.voice_received / secs,
+        stats.voice_expected ? 100.0 * static_cast<double>(voice_lost) / static_cast<double>(stats.voice_expected) : 0.0,
+        stats.voice_mixed / secs,
+        lilypad::percentile(stats.voice_latency_us, 50) / 1000.0,
+        lilypad::percentile(stats.voice_latency_us, 99) / 1000.0);
+    std::cout << line;
+}
+
+// "0,100,1000" as rates; false if any is not a number >= 0
+static bool parse_rates(const std::string& arg, std::vector<double>& rates) {
+    rates.clear();
+    size_t pos = 0;
+    while (pos <= arg.size()) {
+        size_t comma = arg.find(',', pos);
+        if (comma == std::string::npos) comma = arg.size();
+        std::string item = arg.substr(pos, comma - pos);
+        char*  end  = nullptr;
+        double rate = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(rate >= 0.0)) return false;
+        rates.push_back(rate);
+        pos = comma + 1;
+    }
+    return !rates.empty();
+}
+
+int main(int argc, char* argv[]) {
+    lilypad::LoadConfig cfg;
+    int         duration_secs = 30;
+    int         report_secs   = 5;
+    size_t      threads       = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 8);
+    std::string h264_path;
+    uint32_t    screen_kbps = 2500;
+    int         server_pid  = 0;
+    std::vector<double> churn_rates = {0.0};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--host" && i + 1 < argc) cfg.host = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) cfg.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--clients" && i + 1 < argc) cfg.clients = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--talkers" && i + 1 < argc) cfg.talkers = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--sharers" && i + 1 < argc) cfg.sharers = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--viewers" && i + 1 < argc) cfg.viewers = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--churners" && i + 1 < argc) cfg.churners = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--churn-rate" && i + 1 < argc && parse_rates(argv[i + 1], churn_rates)) ++i;
+        else if (arg == "--room" && i + 1 < argc) cfg.room = argv[++i];
+        else if (arg == "--duration" && i + 1 < argc) duration_secs = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--report" && i + 1 < argc) report_secs = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc) threads = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--h264" && i + 1 < argc) h264_path = argv[++i];
+        else if (arg == "--screen-kbps" && i + 1 < argc) screen_kbps = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--fps" && i + 1 < argc) cfg.fps = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--user-prefix" && i + 1 < argc) cfg.user_prefix = argv[++i];
+        else if (arg == "--password" && i + 1 < argc) cfg.password = argv[++i];
+        else if (arg == "--server-pid" && i + 1 < argc) server_pid = std::atoi(argv[++i]);
+        else { print_usage(); return arg == "--help" ? 0 : 1; }
+    }
+    size_t roles = cfg.talkers + cfg.sharers + cfg.viewers + cfg.churners;
+    if (cfg.clients < roles) cfg.clients = roles;
+    threads = (std::min)(threads, cfg.clients);
+
+    lilypad::H264Source source;
+    if (!h264_path.empty()) {
+        if (!source.load(h264_path)) {
+            std::cerr << "[Loadgen] " << h264_path << " has no H.264 keyframe\n";
+            return 1;
+        }
+        std::cout << "[Loadgen] " << h264_path << ": " << source.size() << " frames, "
+                  << static_cast<int>(source.kbps_at(cfg.fps)) << " kbps at " << cfg.fps << " fps\n";
+    } else {
+        source.synthesize(screen_kbps, cfg.fps, cfg.fps * 2);
+    }
+
+    try {
+        lilypad::WinsockInit winsock;
+        lilypad::OpenSSLInit openssl;
+        SSL_CTX* ctx = lilypad::create_client_ssl_ctx(true);
+        if (!ctx) {
+            std::cerr << "[Loadgen] Failed to create TLS context\n";
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<lilypad::LoadWorker>> workers;
+        for (size_t t = 0; t < threads; ++t)
+            workers.push_back(std::make_unique<lilypad::LoadWorker>(cfg, source, ctx, t));
+        for (size_t i = 0; i < cfg.clients; ++i) workers[i % threads]->add_client(i);
+
+        // ── Log everyone in (in parallel; the server's Argon2 work dominates) ──
+        auto login_start = lilypad::LoadClock::now();
+        std::vector<size_t>      connected(threads);
+        std::vector<std::thread> login_threads;
+        for (size_t t = 0; t < threads; ++t)
+            login_threads.emplace_back([&, t] { connected[t] = workers[t]->connect_all(); });
+        for (auto& th : login_threads) th.join();
+        size_t total_connected = 0;
+        for (size_t n : connected) total_connected += n;
+        double login_secs = std::chrono::duration<double>(lilypad::LoadClock::now() - login_start).count();
+        std::cout << "[Loadgen] " << total_connected << "/" << cfg.clients << " clients logged in in "
+                  << login_secs << " s (" << cfg.talkers << " talkers, " << cfg.sharers << " sharers, "
+                  << cfg.viewers << " viewers, " << cfg.churners << " churners, " << threads << " threads)\n";
+        if (total_connected == 0) {
+            SSL_CTX_free(ctx);
+            return 1;
+        }
+
+        lilypad::LoadDirectory dir;
+        for (auto& w : workers) w->publish(dir);
+        for (auto& w : workers) w->begin();
+        std::this_thread::sleep_for(SUBSCRIBE_DELAY);
+        for (auto& w : workers) w->subscribe(dir);
+
+        // ── Run, reporting as we go ──
+        size_t churners = 0;
+        for (auto& w : workers) churners += w->churners();
+        auto step_length = std::chrono::seconds(duration_secs);
+        auto start = lilypad::LoadClock::now();
+        auto until = start + step_length * static_cast<int>(churn_rates.size());
+        for (auto& w : workers) w->start(dir, until);
+
+        // Server CPU since `mark`, moving the mark up (negative if not measured)
+        double cpu_start = server_pid > 0 ? lilypad::process_cpu_seconds(server_pid) : -1.0;
+        double cpu_mark  = cpu_start;
+        if (server_pid > 0 && cpu_start < 0.0)
+            std::cerr << "[Loadgen] Cannot read the CPU time of process " << server_pid << "\n";
+        auto server_cpu = [&](double& mark) {
+            if (mark < 0.0) return -1.0;
+            double now = lilypad::process_cpu_seconds(server_pid);
+            double used = now - mark;
+            mark = now;
+            return now < 0.0 ? -1.0 : used;
+        };
+
+        lilypad::LoadStats              total;
+        std::vector<lilypad::LoadStats> steps(churn_rates.size());
+        auto last = start;
+        for (size_t s = 0; s < churn_rates.size(); ++s) {
+            // Each worker's churners take their share of the rate
+            for (auto& w : workers) {
+                w->set_churn_rate(churners ? churn_rates[s] * static_cast<double>(w->churners()) /
+                                             static_cast<double>(churners) : 0.0);
+            }
+            auto step_end = start + step_length * static_cast<int>(s + 1);
+            while (last < step_end) {
+                auto next = (std::min)(last + std::chrono::seconds(report_secs), step_end);
+                std::this_thread::sleep_until(next);
+                if (next == until) break;  // the final interval is taken after the join
+
+                lilypad::LoadStats interval;
+                for (auto& w : workers) interval.merge(w->take_stats());
+                steps[s].merge(interval);
+                total.merge(interval);
+                double secs = std::chrono::duration<double>(next - last).count();
+                std::string label = std::to_string(static_cast<int>(
+                    std::chrono::duration<double>(next - start).count() + 0.5)) + "s";
+                print_stats(label.c_str(), interval, secs, server_cpu(cpu_mark));
+                last = next;
+            }
+        }
+        for (auto& w : workers) w->join();
+        lilypad::LoadStats rest;
+        for (auto& w : workers) rest.merge(w->take_stats());
+        steps.back().merge(rest);
+        total.merge(rest);
+
+        if (churners > 0) {
+            for (size_t s = 0; s < churn_rates.size(); ++s)
+                print_churn_step(churn_rates[s], steps[s], static_cast<double>(duration_secs));
+        }
+        print_stats("total", total, static_cast<double>(duration_secs * churn_rates.size()), server_cpu(cpu_start));
+        workers.clear();
+        SSL_CTX_free(ctx);
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
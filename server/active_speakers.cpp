@@ -0,0 +1,121 @@
+#include "active_speakers.h"
+
+#include <algorithm>
+
+namespace lilypad {
+
+constexpr float SPEECH_FLOOR_DB   = -50.0f;  // below this a sender counts as silent
+constexpr float ATTACK            = 0.5f;    // per-frame smoothing when getting louder
+constexpr float RELEASE           = 0.05f;   // ... and when getting quieter (~400ms)
+constexpr float SELECTED_BONUS_DB = 6.0f;    // hysteresis for current speakers
+constexpr auto  STALE_AFTER       = std::chrono::milliseconds(300);  // muted, left or lost
+
+ActiveSpeakers::ActiveSpeakers(size_t k, size_t workers)
+    : k_(k), workers_((std::max)(workers, size_t{1})), shards_(workers_.size()),
+      current_(std::make_shared<Ranking>()) {
+    for (Worker& w : workers_) w.ranking = current_;
+}
+
+void ActiveSpeakers::record(size_t worker, const std::string& room, uint32_t sender, float level_db,
+                            Clock::time_point now) {
+    Senders& senders = workers_[worker].rooms[room];
+    auto [it, inserted] = senders.try_emplace(sender);
+    Estimate& e = it->second;
+    if (inserted || now - e.last_frame > STALE_AFTER) {
+        e.level_db = level_db;
+    } else {
+        float rate = level_db > e.level_db ? ATTACK : RELEASE;
+        e.level_db += rate * (level_db - e.level_db);
+    }
+    e.last_frame = now;
+}
+
+const ActiveSpeakers::Ranked& ActiveSpeakers::ranked(size_t worker, const std::string& room) const {
+    static const Ranked nobody;
+    const Ranking& ranking = *workers_[worker].ranking;
+    auto it = ranking.find(room);
+    return it != ranking.end() ? it->second.ranked : nobody;
+}
+
+bool ActiveSpeakers::forwards(const Ranked& ranked, uint32_t sender, uint32_t listener) const {
+    size_t slots = 0;
+    for (uint32_t id : ranked) {
+        if (id == listener) continue;
+        if (id == sender) return true;
+        if (++slots == k_) break;
+    }
+    return false;
+}
+
+bool ActiveSpeakers::cuts_off(const Ranked& from, const Ranked& to) const {
+    auto cut_for = [&](uint32_t listener) {
+        for (uint32_t sender : from) {
+            if (forwards(from, sender, listener) && !forwards(to, sender, listener)) return true;
+        }
+        return false;
+    };
+    // Only ranked listeners hear a different top K; everyone else hears the
+    // same one as a listener id that is never a talker (0)
+    if (cut_for(0)) return true;
+    for (uint32_t l : from) if (cut_for(l)) return true;
+    for (uint32_t l : to) if (cut_for(l)) return true;
+    return false;
+}
+
+void ActiveSpeakers::publish(size_t worker, Clock::time_point now) {
+    Worker& w = workers_[worker];
+    for (auto room = w.rooms.begin(); room != w.rooms.end();) {
+        Senders& senders = room->second;
+        for (auto it = senders.begin(); it != senders.end();) {
+            if (now - it->second.last_frame > STALE_AFTER) it = senders.erase(it);
+            else ++it;
+        }
+        if (senders.empty()) room = w.rooms.erase(room);
+        else ++room;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_[worker] = w.rooms;
+
+    // Every room any worker has a talker in, ranked across all workers' levels.
+    // Other workers' handovers may be up to RANK_INTERVAL old; their stale
+    // senders are skipped here and dropped at their own next publish.
+    auto next = std::make_shared<Ranking>();
+    for (const Rooms& shard : shards_) {
+        for (const auto& [room, senders] : shard) next->try_emplace(room);
+    }
+    for (auto& [room, entry] : *next) {
+        // The previous top K keep a bonus
+        auto          prev   = current_->find(room);
+        const Ranked* before = prev != current_->end() ? &prev->second.ranked : nullptr;
+        auto selected = [&](uint32_t id) {
+            if (!before) return false;
+            auto top_end = before->begin() + (std::min)(before->size(), k_);
+            return std::find(before->begin(), top_end, id) != top_end;
+        };
+        scratch_.clear();
+        for (const Rooms& shard : shards_) {
+            auto senders = shard.find(room);
+            if (senders == shard.end()) continue;
+            for (const auto& [id, est] : senders->second) {
+                if (now - est.last_frame > STALE_AFTER || est.level_db < SPEECH_FLOOR_DB) continue;
+                scratch_.emplace_back(est.level_db + (selected(id) ? SELECTED_BONUS_DB : 0.0f), id);
+            }
+        }
+        size_t n = (std::min)(scratch_.size(), k_ + 1);
+        std::partial_sort(scratch_.begin(), scratch_.begin() + n, scratch_.end(),
+                          [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (size_t i = 0; i < n; ++i) entry.ranked.push_back(scratch_[i].second);
+
+        if (!before) continue;
+        entry.cut_at = prev->second.cut_at;
+        if (entry.ranked != *before && cuts_off(*before, entry.ranked)) {
+            if (now - prev->second.cut_at < RANK_HOLD) entry = prev->second;  // too soon after the last cut
+            else entry.cut_at = now;
+        }
+    }
+    current_  = std::move(next);
+    w.ranking = current_;
+}
+
+} // namespace lilypad
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+// ── Active-speaker selection for voice forwarding ──
+// Keeps a short-window loudness estimate per sender (fast attack, slow release)
+// and ranks, per voice room, the senders that are actually talking. Each
+// listener is sent only the K loudest of their room, not counting themselves, so
+// downstream bandwidth and client decode cost stay bounded however large the
+// room grows. A speaker already selected gets a small bonus so near-equal
+// talkers don't flap.
+//
+// Relay workers share nothing per packet: the kernel pins each sender to one
+// worker, which smooths that sender's level on its own. Every RANK_INTERVAL a
+// worker hands its levels over under the lock, the rooms are re-ranked and the
+// result published as an immutable ranking the worker then reads lock-free.
+//
+// A new ranking that would cut any sender off from any listener waits until
+// RANK_HOLD after the last one that did, so a talker is never left out for
+// fewer frames than a receiver conceals as loss (VOICE_MAX_CONCEALED_GAP on the
+// client); a gap from selection always reads as a pause there. Rankings that
+// only add talkers go out at once.
+class ActiveSpeakers {
+public:
+    using Clock  = std::chrono::steady_clock;
+    using Ranked = std::vector<uint32_t>;
+
+    ActiveSpeakers(size_t k, size_t workers);
+
+    size_t k() const { return k_; }
+
+    // Record one frame from `sender` in `room` on relay worker `worker`.
+    // Only that worker's thread may call it.
+    void record(size_t worker, const std::string& room, uint32_t sender, float level_db,
+                Clock::time_point now);
+
+    // Up to K+1 talking senders of `room`, loudest first, as last ranked (the
+    // spare lets a listener in the top K still hear K others). Worker thread only.
+    const Ranked& ranked(size_t worker, const std::string& room) const;
+
+    // Should `sender`'s packet reach `listener`, given `ranked` from ranked()?
+    bool forwards(const Ranked& ranked, uint32_t sender, uint32_t listener) const;
+
+    // Hand over this worker's levels, drop senders that stopped sending and re-rank.
+    // Called every RANK_INTERVAL from each worker; the only call that takes the lock.
+    void publish(size_t worker, Clock::time_point now);
+
+    static constexpr auto RANK_INTERVAL = std::chrono::milliseconds(20);   // one voice frame
+    static constexpr auto RANK_HOLD     = std::chrono::milliseconds(120);  // 6 frames
+
+private:
+    struct Estimate {
+        float             level_db = -100.0f;
+        Clock::time_point last_frame;
+    };
+
+    struct RoomRanking {
+        Ranked            ranked;
+        Clock::time_point cut_at{};  // last change that stopped a sender reaching a listener
+    };
+
+    using Senders = std::unordered_map<uint32_t, Estimate>;
+    using Rooms   = std::unordered_map<std::string, Senders>;
+    using Ranking = std::unordered_map<std::string, RoomRanking>;
+
+    // Would going from `from` to `to` stop some sender reaching some listener?
+    bool cuts_off(const Ranked& from, const Ranked& to) const;
+
+    struct Worker {
+        Rooms                          rooms;    // the senders pinned to this worker
+        std::shared_ptr<const Ranking> ranking;  // as of this worker's last publish
+    };
+
+    size_t              k_;
+    std::vector<Worker> workers_;
+
+    std::mutex                               mutex_;    // guards the members below
+    std::vector<Rooms>                       shards_;   // each worker's last handover
+    std::shared_ptr<const Ranking>           current_;
+    std::vector<std::pair<float, uint32_t>>  scratch_;
+};
+
+} // namespace lilypad
@@ -5,6 +5,7 @@
 
 #include <openssl/sha.h>
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -13,7 +14,8 @@ namespace lilypad {
 
 static constexpr int SESSION_EXPIRY_DAYS = 30;
 
-AuthDB::AuthDB(const std::string& db_path) {
+AuthDB::AuthDB(const std::string& db_path, size_t max_concurrent_hashes)
+    : hash_slots_((std::max)(max_concurrent_hashes, size_t{1})) {
     if (sqlite3_open(db_path.c_str(), &db_) != SQLITE_OK) {
         throw std::runtime_error(std::string("Failed to open auth database: ") + sqlite3_errmsg(db_));
     }
@@ -27,6 +29,24 @@ AuthDB::~AuthDB() {
     if (db_) sqlite3_close(db_);
 }
 
+size_t AuthDB::hash_memory_per_op() {
+    return crypto_pwhash_MEMLIMIT_MODERATE;
+}
+
+AuthDB::HashPermit::HashPermit(AuthDB& db) : db_(db) {
+    std::unique_lock<std::mutex> lock(db_.hash_mutex_);
+    db_.hash_cv_.wait(lock, [this] { return db_.hash_slots_ > 0; });
+    db_.hash_slots_--;
+}
+
+AuthDB::HashPermit::~HashPermit() {
+    {
+        std::lock_guard<std::mutex> lock(db_.hash_mutex_);
+        db_.hash_slots_++;
+    }
+    db_.hash_cv_.notify_one();
+}
+
 void AuthDB::init_schema() {
     const char* sql = R"(
         CREATE TABLE IF NOT EXISTS users (
@@ -75,12 +95,16 @@ std::string AuthDB::get_password_hash(int64_t user_id) {
 AuthResult AuthDB::register_user(const std::string& username, const std::string& password) {
     // Hash password with Argon2id
     char hash[crypto_pwhash_STRBYTES];
-    if (crypto_pwhash_str(hash, password.c_str(), password.size(),
-                          crypto_pwhash_OPSLIMIT_MODERATE,
-                          crypto_pwhash_MEMLIMIT_MODERATE) != 0) {
-        return {false, 0, "Server error: failed to hash password"};
+    {
+        HashPermit permit(*this);
+        if (crypto_pwhash_str(hash, password.c_str(), password.size(),
+                              crypto_pwhash_OPSLIMIT_MODERATE,
+                              crypto_pwhash_MEMLIMIT_MODERATE) != 0) {
+            return {false, 0, "Server error: failed to hash password"};
+        }
     }
 
+    std::lock_guard<std::mutex> lock(db_mutex_);
     sqlite3_stmt* stmt = nullptr;
     sqlite3_prepare_v2(db_, "INSERT INTO users (username, password_hash) VALUES (?, ?)",
                         -1, &stmt, nullptr);
@@ -103,30 +127,37 @@ AuthResult AuthDB::register_user(const std::string& username, const std::string&
 }
 
 AuthResult AuthDB::verify_login(const std::string& username, const std::string& password) {
-    sqlite3_stmt* stmt = nullptr;
-    sqlite3_prepare_v2(db_, "SELECT id, password_hash FROM users WHERE username = ?",
-                        -1, &stmt, nullptr);
-    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
-
-    AuthResult result;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        int64_t user_id = sqlite3_column_int64(stmt, 0);
-        const char* stored_hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-
-        if (crypto_pwhash_str_verify(stored_hash, password.c_str(), password.size()) == 0) {
-            result = {true, user_id, "Login successful"};
-        } else {
-            result = {false, 0, "Invalid username or password"};
+    int64_t     user_id = 0;
+    std::string stored_hash;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex_);
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v2(db_, "SELECT id, password_hash FROM users WHERE username = ?",
+                            -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            user_id     = sqlite3_column_int64(stmt, 0);
+            stored_hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
         }
-    } else {
-        result = {false, 0, "Invalid username or password"};
+        sqlite3_finalize(stmt);
+    }
+    if (stored_hash.empty()) {
+        return {false, 0, "Invalid username or password"};
     }
 
-    sqlite3_finalize(stmt);
-    return result;
+    HashPermit permit(*this);
+    if (crypto_pwhash_str_verify(stored_hash.c_str(), password.c_str(), password.size()) == 0) {
+        return {true, user_id, "Login successful"};
+    }
+    return {false, 0, "Invalid username or password"};
 }
 
 std::vector<uint8_t> AuthDB::create_session(int64_t user_id) {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    return create_session_locked(user_id);
+}
+
+std::vector<uint8_t> AuthDB::create_session_locked(int64_t user_id) {
     std::vector<uint8_t> raw_token(32);
     randombytes_buf(raw_token.data(), raw_token.size());
 
@@ -149,6 +180,7 @@ std::vector<uint8_t> AuthDB::create_session(int64_t user_id) {
 TokenResult AuthDB::validate_token(const std::string& username, const uint8_t* raw_token) {
     std::string token_hash = hash_token(raw_token, 32);
 
+    std::lock_guard<std::mutex> lock(db_mutex_);
     sqlite3_stmt* stmt = nullptr;
     sqlite3_prepare_v2(db_,
         "SELECT s.id, s.user_id, u.username FROM sessions s "
@@ -173,7 +205,7 @@ TokenResult AuthDB::validate_token(const std::string& username, const uint8_t* r
         sqlite3_finalize(del_stmt);
 
         // Issue new token
-        result.new_token = create_session(result.user_id);
+        result.new_token = create_session_locked(result.user_id);
         result.success = true;
         result.message = "Token login successful";
     } else {
@@ -186,6 +218,11 @@ TokenResult AuthDB::validate_token(const std::string& username, const uint8_t* r
 }
 
 void AuthDB::invalidate_all_sessions(int64_t user_id) {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    invalidate_all_sessions_locked(user_id);
+}
+
+void AuthDB::invalidate_all_sessions_locked(int64_t user_id) {
     sqlite3_stmt* stmt = nullptr;
     sqlite3_prepare_v2(db_, "DELETE FROM sessions WHERE user_id = ?", -1, &stmt, nullptr);
     sqlite3_bind_int64(stmt, 1, user_id);
@@ -196,23 +233,32 @@ void AuthDB::invalidate_all_sessions(int64_t user_id) {
 AuthResult AuthDB::change_password(int64_t user_id, const std::string& old_password,
                                     const std::string& new_password) {
     // Verify old password
-    std::string stored_hash = get_password_hash(user_id);
+    std::string stored_hash;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex_);
+        stored_hash = get_password_hash(user_id);
+    }
     if (stored_hash.empty()) {
         return {false, 0, "User not found"};
     }
-    if (crypto_pwhash_str_verify(stored_hash.c_str(), old_password.c_str(), old_password.size()) != 0) {
-        return {false, 0, "Current password is incorrect"};
-    }
 
-    // Hash new password
     char new_hash[crypto_pwhash_STRBYTES];
-    if (crypto_pwhash_str(new_hash, new_password.c_str(), new_password.size(),
-                          crypto_pwhash_OPSLIMIT_MODERATE,
-                          crypto_pwhash_MEMLIMIT_MODERATE) != 0) {
-        return {false, 0, "Server error: failed to hash password"};
+    {
+        HashPermit permit(*this);
+        if (crypto_pwhash_str_verify(stored_hash.c_str(), old_password.c_str(), old_password.size()) != 0) {
+            return {false, 0, "Current password is incorrect"};
+        }
+
+        // Hash new password
+        if (crypto_pwhash_str(new_hash, new_password.c_str(), new_password.size(),
+                              crypto_pwhash_OPSLIMIT_MODERATE,
+                              crypto_pwhash_MEMLIMIT_MODERATE) != 0) {
+            return {false, 0, "Server error: failed to hash password"};
+        }
     }
 
     // Update
+    std::lock_guard<std::mutex> lock(db_mutex_);
     sqlite3_stmt* stmt = nullptr;
     sqlite3_prepare_v2(db_, "UPDATE users SET password_hash = ? WHERE id = ?", -1, &stmt, nullptr);
     sqlite3_bind_text(stmt, 1, new_hash, -1, SQLITE_STATIC);
@@ -221,7 +267,7 @@ AuthResult AuthDB::change_password(int64_t user_id, const std::string& old_passw
     sqlite3_finalize(stmt);
 
     // Invalidate all sessions
-    invalidate_all_sessions(user_id);
+    invalidate_all_sessions_locked(user_id);
 
     std::cout << "[Auth] Password changed for user_id=" << user_id << "\n";
     return {true, user_id, "Password changed successfully"};
@@ -229,15 +275,23 @@ AuthResult AuthDB::change_password(int64_t user_id, const std::string& old_passw
 
 AuthResult AuthDB::delete_account(int64_t user_id, const std::string& password) {
     // Verify password
-    std::string stored_hash = get_password_hash(user_id);
+    std::string stored_hash;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex_);
+        stored_hash = get_password_hash(user_id);
+    }
     if (stored_hash.empty()) {
         return {false, 0, "User not found"};
     }
-    if (crypto_pwhash_str_verify(stored_hash.c_str(), password.c_str(), password.size()) != 0) {
-        return {false, 0, "Password is incorrect"};
+    {
+        HashPermit permit(*this);
+        if (crypto_pwhash_str_verify(stored_hash.c_str(), password.c_str(), password.size()) != 0) {
+            return {false, 0, "Password is incorrect"};
+        }
     }
 
     // Delete user (cascades to sessions)
+    std::lock_guard<std::mutex> lock(db_mutex_);
     sqlite3_stmt* stmt = nullptr;
     sqlite3_prepare_v2(db_, "DELETE FROM users WHERE id = ?", -1, &stmt, nullptr);
     sqlite3_bind_int64(stmt, 1, user_id);
@@ -249,6 +303,7 @@ AuthResult AuthDB::delete_account(int64_t user_id, const std::string& password)
 }
 
 void AuthDB::cleanup_expired_sessions() {
+    std::lock_guard<std::mutex> lock(db_mutex_);
     sqlite3_stmt* stmt = nullptr;
     sqlite3_prepare_v2(db_, "DELETE FROM sessions WHERE expires_at <= strftime('%s','now')",
                         -1, &stmt, nullptr);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -22,9 +24,12 @@ struct TokenResult {
     std::string          message;
 };
 
+// Thread-safe: database access is serialized internally, while Argon2 hashing runs
+// outside that lock, at most `max_concurrent_hashes` at a time (each one needs
+// hash_memory_per_op() bytes).
 class AuthDB {
 public:
-    explicit AuthDB(const std::string& db_path);
+    explicit AuthDB(const std::string& db_path, size_t max_concurrent_hashes = 1);
     ~AuthDB();
     AuthDB(const AuthDB&) = delete;
     AuthDB& operator=(const AuthDB&) = delete;
@@ -55,15 +60,37 @@ public:
     // Clean up expired sessions
     void cleanup_expired_sessions();
 
+    // Memory one Argon2id hash/verify allocates
+    static size_t hash_memory_per_op();
+
 private:
-    sqlite3* db_ = nullptr;
+    sqlite3*   db_ = nullptr;
+    std::mutex db_mutex_;
     void init_schema();
 
+    // Argon2 admission: blocks until one of the hash slots is free
+    class HashPermit {
+    public:
+        explicit HashPermit(AuthDB& db);
+        ~HashPermit();
+        HashPermit(const HashPermit&) = delete;
+        HashPermit& operator=(const HashPermit&) = delete;
+    private:
+        AuthDB& db_;
+    };
+    std::mutex              hash_mutex_;
+    std::condition_variable hash_cv_;
+    size_t                  hash_slots_;
+
     // Hash raw token with SHA-256 for storage
     std::string hash_token(const uint8_t* raw_token, size_t len);
 
-    // Get stored password hash for a user
+    // Get stored password hash for a user (caller holds db_mutex_)
     std::string get_password_hash(int64_t user_id);
+
+    // Insert a session row and return the raw token (caller holds db_mutex_)
+    std::vector<uint8_t> create_session_locked(int64_t user_id);
+    void                 invalidate_all_sessions_locked(int64_t user_id);
 };
 
 } // namespace lilypad
@@ -0,0 +1,185 @@
+#include "auth_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace lilypad {
+
+constexpr int LOBBY_TICK_MS = 250;  // deadline resolution
+
+AuthPool::AuthPool(size_t threads, size_t max_pending, size_t max_parked)
+    : threads_count_((std::max)(threads, size_t{1})),
+      max_pending_((std::max)(max_pending, size_t{1})),
+      max_parked_((std::max)(max_parked, size_t{1})) {}
+
+AuthPool::~AuthPool() {
+    stop();
+}
+
+void AuthPool::start() {
+    running_ = true;
+    for (size_t i = 0; i < threads_count_; ++i) {
+        threads_.emplace_back(&AuthPool::run, this);
+    }
+    lobby_thread_ = std::thread(&AuthPool::lobby, this);
+}
+
+void AuthPool::stop() {
+    std::deque<Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!running_) return;
+        running_ = false;
+        dropped.swap(queue_);
+    }
+    queue_cv_.notify_all();
+    poller_.wakeup();
+
+    // Unblock every task still waiting on a socket
+    {
+        std::lock_guard<std::mutex> lock(deadline_mutex_);
+        for (auto& [id, armed] : deadlines_) {
+            shutdown(armed.sock, SD_BOTH);
+        }
+    }
+    for (auto& t : threads_) {
+        if (t.joinable()) t.join();
+    }
+    threads_.clear();
+    if (lobby_thread_.joinable()) lobby_thread_.join();
+}
+
+bool AuthPool::submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!running_ || queue_.size() >= max_pending_) return false;
+        queue_.push_back(std::move(task));
+    }
+    queue_cv_.notify_one();
+    return true;
+}
+
+bool AuthPool::park(SOCKET sock, Clock::time_point expires, Task on_ready) {
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        if (!running_ || parked_count_.load() >= max_parked_) return false;
+        parked_count_++;
+        park_inbox_.push_back({sock, expires, std::move(on_ready)});
+    }
+    poller_.wakeup();
+    return true;
+}
+
+size_t AuthPool::pending() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size();
+}
+
+void AuthPool::run() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if (!running_) return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+void AuthPool::lobby() {
+    std::vector<PollEvent> events;
+    std::vector<Parked>    inbox;
+
+    while (running_) {
+        {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            inbox.swap(park_inbox_);
+        }
+        for (auto& p : inbox) {
+            SOCKET sock = p.sock;
+            auto [it, inserted] = parked_.insert_or_assign(sock, std::move(p));
+            poller_.add(sock, POLL_READ, &it->second);
+        }
+        inbox.clear();
+
+        int n = poller_.wait(events, LOBBY_TICK_MS);
+        for (int i = 0; i < n; ++i) {
+            SOCKET sock = static_cast<Parked*>(events[i].user)->sock;
+            auto it = parked_.find(sock);
+            if (it == parked_.end()) continue;
+            poller_.remove(sock);
+            Task task = std::move(it->second.on_ready);
+            parked_.erase(it);
+            parked_count_--;
+            if (!submit(std::move(task)) && running_) {
+                std::cout << "[Auth] Pending queue full, dropping a connection\n";
+            }
+        }
+
+        auto now = Clock::now();
+        for (auto it = parked_.begin(); it != parked_.end();) {
+            if (it->second.expires <= now) {
+                poller_.remove(it->first);
+                it = parked_.erase(it);  // closes the connection the task owned
+                parked_count_--;
+            } else {
+                ++it;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(deadline_mutex_);
+        for (auto it = deadlines_.begin(); it != deadlines_.end();) {
+            if (it->second.when <= now) {
+                // The owner still holds the socket open: it can only close it after
+                // disarming, which needs this lock
+                shutdown(it->second.sock, SD_BOTH);
+                it = deadlines_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto& [sock, p] : parked_) poller_.remove(sock);
+    parked_.clear();
+    std::lock_guard<std::mutex> lock(park_mutex_);
+    park_inbox_.clear();
+    parked_count_ = 0;
+}
+
+uint64_t AuthPool::arm(SOCKET sock, Clock::time_point when) {
+    std::lock_guard<std::mutex> lock(deadline_mutex_);
+    uint64_t id = next_deadline_id_++;
+    deadlines_[id] = {sock, when};
+    return id;
+}
+
+void AuthPool::disarm(uint64_t id) {
+    std::lock_guard<std::mutex> lock(deadline_mutex_);
+    deadlines_.erase(id);
+}
+
+// ── Deadline ──
+
+AuthPool::Deadline::Deadline(AuthPool& pool, SOCKET sock, Clock::time_point when)
+    : pool_(pool), sock_(sock), id_(pool.arm(sock, when)) {}
+
+AuthPool::Deadline::~Deadline() {
+    disarm();
+}
+
+void AuthPool::Deadline::reset(Clock::time_point when) {
+    disarm();
+    id_ = pool_.arm(sock_, when);
+}
+
+void AuthPool::Deadline::disarm() {
+    if (id_ == 0) return;
+    pool_.disarm(id_);
+    id_ = 0;
+}
+
+} // namespace lilypad
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "network.h"
+#include "poller.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+// ── Worker pool for connection setup (TLS handshake + login) and other Argon2 work ──
+// The accept thread only submits; tasks wait in a bounded pending queue and run on
+// a fixed set of threads. A connection whose peer has not sent anything yet (no
+// ClientHello, or a user still typing credentials) does not hold a thread: it is
+// parked on the pool's lobby poller and submitted once readable. Blocking socket
+// I/O inside a task is bounded by a Deadline: when it expires the socket is shut
+// down, which fails the pending SSL_accept/recv and lets the task unwind.
+class AuthPool {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task  = std::function<void()>;
+
+    AuthPool(size_t threads, size_t max_pending, size_t max_parked);
+    ~AuthPool();
+    AuthPool(const AuthPool&) = delete;
+    AuthPool& operator=(const AuthPool&) = delete;
+
+    void start();
+    void stop();  // drops queued and parked tasks, joins running ones
+
+    // Thread-safe. Returns false (task not queued) when the pending queue is full.
+    bool submit(Task task);
+
+    // Thread-safe: submit `on_ready` once `sock` is readable. If that does not
+    // happen by `expires`, or the queue is full at that point, the task is
+    // destroyed instead -- it should own the connection so that closes it.
+    // Returns false (task destroyed) when max_parked connections are waiting.
+    bool park(SOCKET sock, Clock::time_point expires, Task on_ready);
+
+    size_t pending() const;
+    size_t parked() const { return parked_count_.load(std::memory_order_relaxed); }
+
+    // RAII: shuts `sock` down if still armed at the deadline. Declare it after the
+    // object owning the socket so it disarms before the socket is closed, and
+    // call disarm() before handing the socket to another owner.
+    class Deadline {
+    public:
+        Deadline(AuthPool& pool, SOCKET sock, Clock::time_point when);
+        ~Deadline();
+        Deadline(const Deadline&) = delete;
+        Deadline& operator=(const Deadline&) = delete;
+
+        void reset(Clock::time_point when);  // move on to the next stage
+        void disarm();
+
+    private:
+        AuthPool& pool_;
+        SOCKET    sock_;
+        uint64_t  id_ = 0;
+    };
+
+private:
+    struct Parked {
+        SOCKET            sock;
+        Clock::time_point expires;
+        Task              on_ready;
+    };
+
+    void run();
+    void lobby();
+
+    uint64_t arm(SOCKET sock, Clock::time_point when);
+    void     disarm(uint64_t id);
+
+    size_t threads_count_;
+    size_t max_pending_;
+    size_t max_parked_;
+
+    mutable std::mutex       queue_mutex_;
+    std::condition_variable  queue_cv_;
+    std::deque<Task>         queue_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool>        running_{false};
+
+    // Lobby: parked connections and deadline enforcement, on one thread
+    std::thread                        lobby_thread_;
+    Poller                             poller_;
+    std::mutex                         park_mutex_;
+    std::vector<Parked>                park_inbox_;
+    std::unordered_map<SOCKET, Parked> parked_;  // owned by the lobby thread
+    std::atomic<size_t>                parked_count_{0};  // inbox + parked_
+
+    struct Armed {
+        SOCKET            sock;
+        Clock::time_point when;
+    };
+    std::mutex                          deadline_mutex_;
+    std::unordered_map<uint64_t, Armed> deadlines_;
+    uint64_t                            next_deadline_id_ = 1;
+};
+
+} // namespace lilypad
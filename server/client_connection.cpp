@@ -0,0 +1,290 @@
+#include "client_connection.h"
+#include "io_worker.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+
+namespace lilypad {
+
+ClientConnection::ClientConnection(uint32_t id, TlsSocket&& tls)
+    : id_(id), tls_(std::move(tls)) {}
+
+bool ClientConnection::send(SharedBuffer msg) {
+    if (close_requested_ || msg.empty()) return false;
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        auto c = static_cast<size_t>(SendClass::SIGNAL);
+        if (class_bytes_[c] + msg.size() > SIGNAL_QUEUE_LIMIT) {
+            overflowed_      = true;
+            close_requested_ = true;
+        } else {
+            enqueue_locked(SendClass::SIGNAL, 0, std::move(msg));
+        }
+    }
+    wake_worker();
+    return !overflowed_;
+}
+
+bool ClientConnection::send_media(SendClass cls, uint32_t stream_id, SharedBuffer msg, uint64_t seq,
+                                  uint8_t layer) {
+    if (close_requested_ || msg.empty()) return false;
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        auto c = static_cast<size_t>(cls);
+
+        // Already queued by a GOP replay
+        if (seq != 0) {
+            auto& st = streams_[stream_id];
+            if (seq <= st.last_seq) return true;
+        }
+
+        switch (cls) {
+        case SendClass::SCREEN_AUDIO:
+            // Late audio is worthless: shed the oldest to make room
+            while (!queues_[c].empty() && class_bytes_[c] + msg.size() > SCREEN_AUDIO_QUEUE_LIMIT) {
+                class_bytes_[c] -= queues_[c].front().data.size();
+                queued_bytes_   -= queues_[c].front().data.size();
+                queues_[c].pop_front();
+                dropped_++;
+                metric_add(Counter::DROP_AUDIO_OVERFLOW);
+            }
+            break;
+
+        case SendClass::KEYFRAME:
+            // Everything still queued for this layer of the stream is superseded by the new IDR
+            metric_add(Counter::DROP_SUPERSEDED, purge_stream_locked(SendClass::KEYFRAME, stream_id, layer) +
+                                                 purge_stream_locked(SendClass::DELTA, stream_id, layer));
+            streams_[stream_id].synced[layer] = true;
+            break;
+
+        case SendClass::DELTA: {
+            auto it = streams_.find(stream_id);
+            if (it == streams_.end() || !it->second.synced[layer]) {
+                dropped_++;  // undecodable without the keyframe it depends on
+                metric_add(Counter::DROP_UNSYNCED);
+                return false;
+            }
+            if (class_bytes_[c] + msg.size() > DELTA_QUEUE_LIMIT) {
+                it->second.synced[layer] = false;  // gap: hold the layer until its next keyframe
+                dropped_++;
+                metric_add(Counter::DROP_DELTA_BUDGET);
+                return false;
+            }
+            break;
+        }
+
+        case SendClass::SIGNAL:
+            break;
+        }
+
+        if (seq != 0) streams_[stream_id].last_seq = seq;
+        enqueue_locked(cls, stream_id, std::move(msg), layer);
+    }
+    wake_worker();
+    return true;
+}
+
+void ClientConnection::send_gop(uint32_t stream_id, uint8_t layer, const std::vector<SharedBuffer>& frames,
+                                uint64_t last_seq, bool complete) {
+    if (close_requested_ || frames.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(out_mutex_);
+        metric_add(Counter::DROP_SUPERSEDED, purge_stream_locked(SendClass::KEYFRAME, stream_id, layer) +
+                                             purge_stream_locked(SendClass::DELTA, stream_id, layer));
+
+        // All in the keyframe class: FIFO keeps the burst in decode order, a
+        // newer keyframe still supersedes it, and live deltas follow it.
+        for (auto& frame : frames) enqueue_locked(SendClass::KEYFRAME, stream_id, frame, layer);
+
+        auto& st         = streams_[stream_id];
+        st.synced[layer] = complete;
+        st.last_seq      = (std::max)(st.last_seq, last_seq);
+    }
+    wake_worker();
+}
+
+void ClientConnection::drop_stream(uint32_t stream_id) {
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    metric_add(Counter::DROP_STREAM_CLOSED, purge_stream_locked(SendClass::SCREEN_AUDIO, stream_id) +
+                                            purge_stream_locked(SendClass::KEYFRAME, stream_id) +
+                                            purge_stream_locked(SendClass::DELTA, stream_id));
+    streams_.erase(stream_id);
+}
+
+void ClientConnection::drop_layer(uint32_t stream_id, uint8_t layer) {
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    metric_add(Counter::DROP_SUPERSEDED, purge_stream_locked(SendClass::KEYFRAME, stream_id, layer) +
+                                         purge_stream_locked(SendClass::DELTA, stream_id, layer));
+    auto it = streams_.find(stream_id);
+    if (it != streams_.end()) it->second.synced[layer] = false;
+}
+
+void ClientConnection::desync_stream(uint32_t stream_id, uint8_t layer) {
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    auto it = streams_.find(stream_id);
+    if (it != streams_.end()) it->second.synced[layer] = false;
+}
+
+void ClientConnection::request_close() {
+    if (close_requested_.exchange(true)) return;
+    wake_worker();
+}
+
+void ClientConnection::enqueue_locked(SendClass cls, uint32_t stream, SharedBuffer msg, uint8_t layer) {
+    auto c = static_cast<size_t>(cls);
+    class_bytes_[c] += msg.size();
+    queued_bytes_   += msg.size();
+    auto queued = stream != 0 ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+    queues_[c].push_back({std::move(msg), stream, layer, queued});
+}
+
+size_t ClientConnection::purge_stream_locked(SendClass cls, uint32_t stream, int layer) {
+    auto  c = static_cast<size_t>(cls);
+    auto& q = queues_[c];
+    auto  keep = std::remove_if(q.begin(), q.end(), [&](const OutItem& item) {
+        if (item.stream != stream || (layer >= 0 && item.layer != layer)) return false;
+        class_bytes_[c] -= item.data.size();
+        queued_bytes_   -= item.data.size();
+        dropped_++;
+        return true;
+    });
+    size_t purged = static_cast<size_t>(q.end() - keep);
+    q.erase(keep, q.end());
+    return purged;
+}
+
+void ClientConnection::wake_worker() {
+    IoWorker* worker = worker_.load();
+    if (worker && !flush_pending_.exchange(true)) {
+        worker->request_flush(this);
+    }
+}
+
+ClientConnection::ReadResult ClientConnection::on_readable(const MessageFn& on_message) {
+    read_wants_write_ = false;
+
+    // SSL may hold decrypted bytes the poller cannot see, so read until WANT_*
+    while (!close_requested_) {
+        size_t got = 0;
+        TlsIo io;
+        if (hdr_got_ < SIGNAL_HEADER_SIZE) {
+            io = tls_.read_some(hdr_buf_ + hdr_got_, SIGNAL_HEADER_SIZE - hdr_got_, got);
+            if (io == TlsIo::OK) {
+                hdr_got_ += got;
+                if (hdr_got_ < SIGNAL_HEADER_SIZE) continue;
+                header_ = deserialize_header(hdr_buf_);
+                if (header_.payload_len > MAX_CLIENT_PAYLOAD) return ReadResult::CLOSED;
+                payload_     = MutableBuffer(header_.payload_len, SCREEN_RELAY_PREFIX);
+                payload_got_ = 0;
+            }
+        } else {
+            io = tls_.read_some(payload_.data() + payload_got_, payload_.size() - payload_got_, got);
+            if (io == TlsIo::OK) payload_got_ += got;
+        }
+
+        if (io == TlsIo::WANT_READ) return ReadResult::OK;
+        if (io == TlsIo::WANT_WRITE) {
+            read_wants_write_ = true;
+            return ReadResult::OK;
+        }
+        if (io != TlsIo::OK) return ReadResult::CLOSED;
+
+        if (hdr_got_ == SIGNAL_HEADER_SIZE && payload_got_ == payload_.size()) {
+            MutableBuffer payload;
+            std::swap(payload, payload_);
+            hdr_got_     = 0;
+            payload_got_ = 0;
+            LP_TRACE_SCOPE_ARG("conn.message", static_cast<uint8_t>(header_.type));
+            on_message(*this, header_, payload);
+        }
+    }
+    return ReadResult::OK;
+}
+
+bool ClientConnection::flush() {
+    write_blocked_ = false;
+    for (;;) {
+        if (in_flight_.empty()) {
+            // Next messages in priority order, as many whole ones as fit in a
+            // record (a larger message goes alone). Once taken they are no longer
+            // subject to the drop policies, which keeps a WANT_* retry identical.
+            std::lock_guard<std::mutex> lock(out_mutex_);
+            size_t batch_bytes = 0;
+            for (;;) {
+                size_t c = 0;
+                while (c < SEND_CLASS_COUNT && queues_[c].empty()) ++c;
+                if (c == SEND_CLASS_COUNT) break;
+                size_t size = queues_[c].front().data.size();
+                if (!in_flight_.empty() && batch_bytes + size > TLS_MAX_RECORD) break;
+                batch_bytes     += size;
+                class_bytes_[c] -= size;
+                in_flight_.push_back(std::move(queues_[c].front()));
+                queues_[c].pop_front();
+            }
+            if (in_flight_.empty()) return true;
+            out_offset_ = 0;
+        }
+
+        slices_.clear();
+        for (auto& item : in_flight_) slices_.push_back({item.data.data(), item.data.size()});
+        slices_.front().data += out_offset_;
+        slices_.front().len  -= out_offset_;
+
+        // Written without holding out_mutex_, so producers never wait on the socket
+        size_t written = 0;
+        TlsIo io;
+        {
+            LP_TRACE_SCOPE_ARG("conn.write", slices_.size());
+            io = tls_.writev_some(slices_.data(), slices_.size(), written);
+        }
+        if (io == TlsIo::WANT_READ || io == TlsIo::WANT_WRITE) {
+            write_blocked_ = true;
+            return true;
+        }
+        if (io != TlsIo::OK) return false;
+
+        // Retire every message the record completed, dropping references promptly
+        out_offset_   += written;
+        queued_bytes_ -= written;
+        while (!in_flight_.empty() && out_offset_ >= in_flight_.front().data.size()) {
+            const OutItem& item = in_flight_.front();
+            if (item.stream != 0)
+                metric_observe(Histogram::SUBSCRIBER_SEND, std::chrono::steady_clock::now() - item.queued);
+            out_offset_ -= item.data.size();
+            in_flight_.pop_front();
+        }
+    }
+}
+
+bool ClientConnection::has_output() const {
+    if (!in_flight_.empty()) return true;
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    for (auto& q : queues_) {
+        if (!q.empty()) return true;
+    }
+    return false;
+}
+
+uint32_t ClientConnection::wanted_events() const {
+    // A closing connection reads nothing more; left registered for reads, a
+    // peer that keeps sending would wake the worker on every wait until it goes
+    uint32_t events = close_requested_ ? 0 : POLL_READ;
+    if (write_blocked_ || read_wants_write_) events |= POLL_WRITE;
+    return events;
+}
+
+void ClientConnection::shutdown() {
+    tls_.close();
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    for (size_t c = 0; c < SEND_CLASS_COUNT; ++c) {
+        queues_[c].clear();
+        class_bytes_[c] = 0;
+    }
+    streams_.clear();
+    in_flight_.clear();
+    out_offset_   = 0;
+    queued_bytes_ = 0;
+}
+
+} // namespace lilypad
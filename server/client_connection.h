@@ -0,0 +1,162 @@
+#pragma once
+
+#include "poller.h"
+#include "protocol.h"
+#include "shared_buffer.h"
+#include "tls_socket.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+class IoWorker;
+
+// Largest payload accepted from an authenticated client (screen keyframes are the big ones)
+constexpr uint32_t MAX_CLIENT_PAYLOAD = 64 * 1024 * 1024;
+
+// Outbound priority classes, highest first. The writer always picks the next
+// message from the highest non-empty class; a partially written message is
+// never preempted. Consecutive small messages are coalesced into one TLS record
+// of up to TLS_MAX_RECORD bytes, so a burst of signaling costs one write.
+enum class SendClass : uint8_t {
+    SIGNAL = 0,     // control, roster, chat -- never dropped
+    SCREEN_AUDIO,   // bounded, oldest dropped first
+    KEYFRAME,       // one per stream; a newer keyframe supersedes queued video
+    DELTA,          // bounded; dropping one stalls that stream until its next keyframe
+};
+constexpr size_t SEND_CLASS_COUNT = 4;
+
+// Per-connection media budgets (bytes queued but not yet handed to SSL_write)
+constexpr size_t SCREEN_AUDIO_QUEUE_LIMIT = 256 * 1024;
+constexpr size_t DELTA_QUEUE_LIMIT        = 2 * 1024 * 1024;
+
+// Signaling is never dropped, so a client that stops reading would grow its
+// queue forever. Past this it is disconnected instead (a full CHAT_SYNC fits).
+constexpr size_t SIGNAL_QUEUE_LIMIT = 16 * 1024 * 1024;
+
+// ── One authenticated client's TLS stream, driven by an IoWorker ──
+// All SSL_read/SSL_write calls happen on the owning worker thread. send() and
+// request_close() are safe from any thread: they queue work and wake the worker.
+class ClientConnection {
+public:
+    // Payloads arrive with SCREEN_RELAY_PREFIX bytes of headroom for in-place relaying
+    using MessageFn = std::function<void(ClientConnection&, const SignalHeader&, MutableBuffer&)>;
+
+    ClientConnection(uint32_t id, TlsSocket&& tls);
+    ClientConnection(const ClientConnection&) = delete;
+    ClientConnection& operator=(const ClientConnection&) = delete;
+
+    uint32_t id() const { return id_; }
+
+    // Queue a complete signaling message. Returns false once the connection is closing.
+    // A message that would take the signaling queue past SIGNAL_QUEUE_LIMIT marks
+    // the connection a slow consumer: nothing more is queued and it is dropped.
+    bool   send(SharedBuffer msg);
+    bool   send(std::vector<uint8_t> msg) { return send(SharedBuffer(std::move(msg))); }
+
+    // Queue a screen-share message belonging to `stream_id` (the sharer's client id).
+    // Applies this connection's drop policy; returns false if the message was dropped.
+    // Deltas are dropped until a keyframe for the stream has been queued. Video
+    // frames carry the sharer's frame `seq`; ones already queued are skipped.
+    // Each simulcast `layer` of a stream is synced (and superseded by its own
+    // keyframes) independently, for peer servers that carry every layer.
+    bool   send_media(SendClass cls, uint32_t stream_id, SharedBuffer msg, uint64_t seq = 0,
+                      uint8_t layer = 0);
+
+    // Queue a cached GOP of one layer (keyframe first, frames up to `last_seq`)
+    // as one ordered burst that bypasses the delta budget. If `complete` is false
+    // the cache was truncated, and the layer waits for the next keyframe after the burst.
+    void   send_gop(uint32_t stream_id, uint8_t layer, const std::vector<SharedBuffer>& frames,
+                    uint64_t last_seq, bool complete);
+
+    // Forget a stream: purge its queued media and require a fresh keyframe.
+    void   drop_stream(uint32_t stream_id);
+
+    // Forget one layer of a stream (a viewer moved off it): purge its queued
+    // video and require a fresh keyframe should it come back.
+    void   drop_layer(uint32_t stream_id, uint8_t layer);
+
+    // A frame of the stream's `layer` was lost upstream: keep what is queued,
+    // but hold that layer's deltas until its next keyframe.
+    void   desync_stream(uint32_t stream_id, uint8_t layer);
+
+    size_t   queued_bytes() const { return queued_bytes_.load(std::memory_order_relaxed); }
+    uint64_t dropped_messages() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Flush whatever is already queued, then close. Idempotent.
+    void request_close();
+    bool close_requested() const { return close_requested_.load(); }
+    bool overflowed() const { return overflowed_.load(); }
+
+private:
+    friend class IoWorker;
+
+    enum class ReadResult { OK, CLOSED };
+
+    struct OutItem {
+        SharedBuffer data;
+        uint32_t     stream = 0;
+        uint8_t      layer  = 0;
+        std::chrono::steady_clock::time_point queued;  // media only, for the send-time metric
+    };
+
+    // Per screen-share stream, as seen by this subscriber
+    struct StreamState {
+        bool     synced[SCREEN_LAYER_COUNT] = {};  // per layer: keyframe queued since the last gap
+        uint64_t last_seq = 0;                     // newest video frame queued, any layer
+    };
+
+    // ── Worker-thread only ──
+    SOCKET     socket() const { return tls_.get(); }
+    ReadResult on_readable(const MessageFn& on_message);
+    bool       flush();                 // false on a fatal write error
+    bool       has_output() const;
+    uint32_t   wanted_events() const;   // POLL_READ until closing, plus POLL_WRITE while blocked
+    void       shutdown();
+
+    void enqueue_locked(SendClass cls, uint32_t stream, SharedBuffer msg, uint8_t layer = 0);
+    // Returns how many were dropped; `layer` -1 = all of the stream's
+    size_t purge_stream_locked(SendClass cls, uint32_t stream, int layer = -1);
+    void wake_worker();
+
+    const uint32_t id_;
+    TlsSocket      tls_;
+
+    // Inbound state machine: header first, then payload_len bytes of payload
+    uint8_t              hdr_buf_[SIGNAL_HEADER_SIZE] = {};
+    size_t               hdr_got_     = 0;
+    SignalHeader         header_{};
+    MutableBuffer        payload_;
+    size_t               payload_got_ = 0;
+    bool                 read_wants_write_ = false;  // SSL_read returned WANT_WRITE
+    bool                 write_blocked_    = false;  // SSL_write returned WANT_*
+
+    // Outbound queues, one per SendClass (guarded by out_mutex_)
+    mutable std::mutex                        out_mutex_;
+    std::deque<OutItem>                       queues_[SEND_CLASS_COUNT];
+    size_t                                    class_bytes_[SEND_CLASS_COUNT] = {};
+    std::unordered_map<uint32_t, StreamState> streams_;
+    std::atomic<size_t>                       queued_bytes_{0};
+    std::atomic<uint64_t>                     dropped_{0};
+
+    // Messages taken off the queues for the current record(s), and how much of
+    // the first is written (worker-thread only, outside out_mutex_)
+    std::deque<OutItem>   in_flight_;
+    size_t                out_offset_ = 0;
+    std::vector<TlsSlice> slices_;
+
+    std::atomic<IoWorker*> worker_{nullptr};
+    std::atomic<bool>      flush_pending_{false};
+    std::atomic<bool>      close_requested_{false};
+    std::atomic<bool>      overflowed_{false};       // slow consumer: drop without flushing
+    std::chrono::steady_clock::time_point close_deadline_{};  // set by the worker once closing
+};
+
+} // namespace lilypad
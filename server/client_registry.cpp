@@ -0,0 +1,113 @@
+#include "client_registry.h"
+
+#include <algorithm>
+
+namespace lilypad {
+
+// ── RegistryTxn ──
+
+const ClientView* RegistryTxn::find(uint32_t id) const {
+    auto it = clients_.find(id);
+    return it == clients_.end() ? nullptr : it->second.get();
+}
+
+ClientView* RegistryTxn::edit(uint32_t id) {
+    auto ed = edited_.find(id);
+    if (ed != edited_.end()) return ed->second.get();
+
+    auto it = clients_.find(id);
+    if (it == clients_.end()) return nullptr;
+    auto copy = std::make_shared<ClientView>(*it->second);
+    it->second = copy;
+    edited_[id] = copy;
+    return copy.get();
+}
+
+void RegistryTxn::insert(ClientView view) {
+    uint32_t id = view.id;
+    auto fresh = std::make_shared<ClientView>(std::move(view));
+    clients_[id] = fresh;
+    edited_[id]  = fresh;
+}
+
+bool RegistryTxn::erase(uint32_t id) {
+    edited_.erase(id);
+    return clients_.erase(id) > 0;
+}
+
+void RegistryTxn::set_peer(PeerView peer) {
+    uint32_t node = peer.node;
+    peers_[node]  = std::make_shared<const PeerView>(std::move(peer));
+}
+
+bool RegistryTxn::erase_peer(uint32_t node) {
+    return peers_.erase(node) > 0;
+}
+
+// ── ClientRegistry ──
+
+ClientRegistry::ClientRegistry()
+    : current_(std::make_shared<RegistrySnapshot>()) {}
+
+std::shared_ptr<const RegistrySnapshot> ClientRegistry::snapshot() const {
+    // Per-thread cache: only re-fetched (under a pointer-copy lock) after a write
+    thread_local const ClientRegistry*                     tl_owner   = nullptr;
+    thread_local uint64_t                                  tl_version = 0;
+    thread_local std::shared_ptr<const RegistrySnapshot>   tl_snap;
+
+    uint64_t v = version_.load(std::memory_order_acquire);
+    if (tl_owner != this || tl_version != v || !tl_snap) {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        tl_snap    = current_;
+        tl_version = tl_snap->version;
+        tl_owner   = this;
+    }
+    return tl_snap;
+}
+
+std::shared_ptr<const RegistrySnapshot> ClientRegistry::publish(RegistryTxn&& txn) {
+    auto snap = std::make_shared<RegistrySnapshot>();
+    snap->version = current_->version + 1;
+    snap->clients = std::move(txn.clients_);
+    snap->peers   = std::move(txn.peers_);
+
+    for (auto& [id, view] : snap->clients) {
+        if (!view->in_voice()) continue;
+        if (view->local() && !view->udp_known) continue;
+        VoiceRoom& room = snap->voice_rooms[view->voice_room];
+        if (room.name.empty()) room.name = view->voice_room;
+        if (view->local()) {
+            room.ids.push_back(view->id);
+            room.addrs.push_back(view->udp_addr);
+            continue;
+        }
+        // Remote member: their server gets each local talker once and fans out itself
+        const PeerView* peer = snap->find_peer(view->home_node);
+        if (!peer) continue;
+        bool known = std::any_of(room.peer_addrs.begin(), room.peer_addrs.end(), [&](const sockaddr_in& a) {
+            return a.sin_addr.s_addr == peer->udp_addr.sin_addr.s_addr && a.sin_port == peer->udp_addr.sin_port;
+        });
+        if (!known) room.peer_addrs.push_back(peer->udp_addr);
+    }
+
+    for (auto& [id, view] : snap->clients) {
+        if (view->media_stream == 0 || !view->local()) continue;
+        const ClientView* sharer = snap->find(view->media_stream);
+        if (!sharer || !sharer->screen_sharing || !sharer->media_keys) continue;
+        if (!std::binary_search(sharer->screen_subscribers.begin(), sharer->screen_subscribers.end(), id))
+            continue;
+        MediaRoute& route = snap->media_routes[sharer->id];
+        route.ids.push_back(id);
+        route.addrs.push_back(view->media_addr);
+    }
+
+    std::shared_ptr<const RegistrySnapshot> published = snap;
+    {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        current_ = published;
+    }
+    version_.store(published->version, std::memory_order_release);
+    return published;
+}
+
+} // namespace lilypad
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "client_connection.h"
+#include "network.h"
+#include "screen_media.h"
+#include "shared_buffer.h"
+#include "simulcast.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+// Upper bound on one sharer's GOP cache per layer (a 2 s GOP at 30 Mbps is ~7.5 MB)
+constexpr size_t GOP_CACHE_LIMIT = 16 * 1024 * 1024;
+
+// Screen-share state that changes on every frame -- too often to republish the
+// registry for, so it lives behind its own mutex and is shared by pointer.
+struct ScreenCache {
+    // One simulcast layer's last keyframe + every frame since, in order
+    struct Gop {
+        std::vector<SharedBuffer> frames;
+        size_t                    bytes    = 0;
+        bool                      complete = true;  // false once a frame didn't fit GOP_CACHE_LIMIT
+    };
+
+    std::mutex      mutex;
+    Gop             gop[SCREEN_LAYER_COUNT];
+    SimulcastLayers layers;
+    uint64_t        next_seq = 1;  // per-sharer video frame sequence, across layers
+    std::chrono::steady_clock::time_point last_keyframe_request{};  // asked on a viewer's behalf
+
+    // Layer each local viewer is sent (and moving to), by viewer id
+    std::unordered_map<uint32_t, ViewerLayer> viewer_layers;
+
+    // Latest SCREEN_RECEIVER_REPORT per receiver (0 = the media relay's own view
+    // of the sharer's uplink), and when the sharer was last sent their aggregate
+    struct ReceiverReport {
+        ScreenReceiverReport                  report;
+        std::chrono::steady_clock::time_point at;
+    };
+    std::unordered_map<uint32_t, ReceiverReport> receiver_reports;
+    std::chrono::steady_clock::time_point        last_receiver_report{};
+};
+
+// Keys of one screen share over UDP, made fresh on every SCREEN_START. The
+// sharer seals with `sender`; the server re-seals for viewers with `viewer`,
+// so a viewer cannot forge the sharer's stream.
+struct MediaKeys {
+    MediaKey sender;
+    MediaKey viewer;
+};
+
+// ── Immutable view of one client. Shared between snapshots until edited. ──
+// Clients of federated peer servers appear here too, with `home_node` set and
+// `conn` pointing at the link to that peer; messages for local clients must
+// skip them (see local()).
+struct ClientView {
+    uint32_t    id = 0;
+    std::string username;
+    int64_t     db_user_id = 0;
+    uint32_t    home_node  = 0;  // peer node the client is connected to; 0 = this server
+    std::shared_ptr<ClientConnection> conn;
+    std::shared_ptr<ScreenCache>      screen_cache;
+
+    bool local() const { return home_node == 0; }
+
+    sockaddr_in udp_addr{};   // filled in when first UDP packet arrives
+    bool        udp_known = false;
+
+    // Voice room; empty when not in voice
+    std::string voice_room;
+    bool        in_voice() const { return !voice_room.empty(); }
+
+    // Screen sharing
+    bool                  screen_sharing = false;
+    std::vector<uint32_t> screen_subscribers;  // IDs of local clients watching this user
+    std::vector<uint32_t> peer_subscribers;    // peer nodes relaying this (local) user's stream
+
+    // Screen media over UDP
+    std::shared_ptr<const MediaKeys> media_keys;    // set while this (local) user shares
+    uint32_t                         media_stream = 0;  // stream this viewer gets over UDP; 0 = none
+    sockaddr_in                      media_addr{};      // where, learned from its keepalives
+};
+
+// ── One federation link to a peer server ──
+struct PeerView {
+    uint32_t                          node = 0;
+    std::shared_ptr<ClientConnection> conn;
+    sockaddr_in                       udp_addr{};  // the peer's voice relay port
+};
+
+// ── UDP viewers of one local screen share, rebuilt on every publish ──
+// Only subscribers whose keepalive named this stream; everyone else watching
+// gets it over TCP.
+struct MediaRoute {
+    std::vector<uint32_t>    ids;
+    std::vector<sockaddr_in> addrs;  // parallel to ids
+};
+
+using ClientMap = std::unordered_map<uint32_t, std::shared_ptr<const ClientView>>;
+using PeerMap   = std::unordered_map<uint32_t, std::shared_ptr<const PeerView>>;
+
+// ── Routing table of one voice room, rebuilt on every publish ──
+// Holds only local members whose UDP address is known, plus one entry per peer
+// server with members in the room. The relay's per-packet fan-out walks these
+// flat arrays, so it costs O(room size) and never touches the rest of the server.
+struct VoiceRoom {
+    std::string              name;
+    std::vector<uint32_t>    ids;
+    std::vector<sockaddr_in> addrs;       // parallel to ids
+    std::vector<sockaddr_in> peer_addrs;  // local talkers are sent once to each
+
+    size_t size() const { return ids.size(); }
+};
+
+// ── One published, never-mutated version of the registry ──
+struct RegistrySnapshot {
+    uint64_t  version = 0;
+    ClientMap clients;
+    PeerMap   peers;
+
+    // Derived on publish: occupied voice rooms by name
+    std::unordered_map<std::string, VoiceRoom> voice_rooms;
+
+    // Derived on publish: UDP viewers by sharer id
+    std::unordered_map<uint32_t, MediaRoute> media_routes;
+
+    const ClientView* find(uint32_t id) const {
+        auto it = clients.find(id);
+        return it == clients.end() ? nullptr : it->second.get();
+    }
+
+    const PeerView* find_peer(uint32_t node) const {
+        auto it = peers.find(node);
+        return it == peers.end() ? nullptr : it->second.get();
+    }
+
+    const VoiceRoom* find_room(const std::string& name) const {
+        auto it = voice_rooms.find(name);
+        return it == voice_rooms.end() ? nullptr : &it->second;
+    }
+
+    const MediaRoute* find_media_route(uint32_t sharer_id) const {
+        auto it = media_routes.find(sharer_id);
+        return it == media_routes.end() ? nullptr : &it->second;
+    }
+};
+
+// ── Private working copy handed to ClientRegistry::update() ──
+class RegistryTxn {
+public:
+    RegistryTxn(ClientMap clients, PeerMap peers)
+        : clients_(std::move(clients)), peers_(std::move(peers)) {}
+
+    const ClientMap&  clients() const { return clients_; }
+    const ClientView* find(uint32_t id) const;
+
+    const PeerMap&    peers() const { return peers_; }
+    void              set_peer(PeerView peer);
+    bool              erase_peer(uint32_t node);
+
+    // Copy-on-write access to one client; nullptr if absent
+    ClientView* edit(uint32_t id);
+    void        insert(ClientView view);
+    bool        erase(uint32_t id);
+
+private:
+    friend class ClientRegistry;
+    ClientMap                                                clients_;
+    std::unordered_map<uint32_t, std::shared_ptr<ClientView>> edited_;
+    PeerMap                                                  peers_;
+};
+
+// ── Read-mostly client registry ──
+// Readers get the current snapshot without taking any lock on the fast path
+// (a per-thread cached pointer checked against an atomic version). Writers
+// (join, leave, voice, subscribe) serialize on a writer mutex, mutate a copy
+// and publish it; nothing is ever modified in place.
+class ClientRegistry {
+public:
+    ClientRegistry();
+
+    std::shared_ptr<const RegistrySnapshot> snapshot() const;
+
+    // Run fn(RegistryTxn&) on a private copy, then publish it. Writers are
+    // serialized, so fn may also send membership-dependent messages atomically
+    // with the change. Returns the published snapshot.
+    template <typename Fn>
+    std::shared_ptr<const RegistrySnapshot> update(Fn&& fn) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        RegistryTxn txn(current_->clients, current_->peers);
+        fn(txn);
+        return publish(std::move(txn));
+    }
+
+private:
+    std::shared_ptr<const RegistrySnapshot> publish(RegistryTxn&& txn);
+
+    std::mutex                              writer_mutex_;
+    mutable std::mutex                      publish_mutex_;  // guards current_ (pointer copy only)
+    std::shared_ptr<const RegistrySnapshot> current_;
+    std::atomic<uint64_t>                   version_{0};
+};
+
+} // namespace lilypad
@@ -0,0 +1,223 @@
+#include "federation.h"
+#include "protocol.h"
+
+#include <sodium.h>
+
+#ifndef _WIN32
+#include <netdb.h>
+#endif
+
+#include <iostream>
+
+namespace lilypad {
+
+constexpr int  PEER_IO_TIMEOUT_SECS  = 5;     // TLS handshake and PEER_HELLO, each way
+constexpr int  PEER_TICK_MS          = 200;
+constexpr auto PEER_REDIAL_MIN       = std::chrono::seconds(2);
+constexpr int  PEER_REDIAL_JITTER_MS = 2000;  // so two servers dialing each other settle
+constexpr char PEER_EXPORTER_LABEL[] = "EXPORTER-lilypad-peer-link";
+
+// Blocking I/O deadline for the handshake; 0 clears it before the link goes non-blocking
+static void set_io_timeout(SOCKET s, int seconds) {
+#ifdef _WIN32
+    DWORD ms = static_cast<DWORD>(seconds) * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&ms), sizeof(ms));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&ms), sizeof(ms));
+#else
+    timeval tv{};
+    tv.tv_sec = seconds;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+Federation::Federation(uint32_t node_id, uint16_t udp_port, std::string secret,
+                       SSL_CTX* server_ctx, LinkFn on_link)
+    : node_id_(node_id), udp_port_(udp_port), secret_(std::move(secret)),
+      server_ctx_(server_ctx), on_link_(std::move(on_link)) {
+    // Peers usually run self-signed certs; the HELLO MAC is what authenticates them
+    client_ctx_ = create_client_ssl_ctx(true);
+}
+
+Federation::~Federation() {
+    stop();
+    if (client_ctx_) SSL_CTX_free(client_ctx_);
+}
+
+void Federation::add_peer(const std::string& host, uint16_t port) {
+    ConfiguredPeer peer;
+    peer.host = host;
+    peer.port = port;
+    peers_.push_back(std::move(peer));
+}
+
+bool Federation::listen(uint16_t port) {
+    Socket sock = create_tcp_socket();
+    int opt = 1;
+    setsockopt(sock.get(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(port);
+    if (bind(sock.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+        ::listen(sock.get(), 16) == SOCKET_ERROR) {
+        std::cerr << "[Federation] Cannot listen on port " << port << ": " << WSAGetLastError() << "\n";
+        return false;
+    }
+    listen_sock_ = std::move(sock);
+    return true;
+}
+
+void Federation::start() {
+    running_ = true;
+    if (listen_sock_.valid()) accept_thread_ = std::thread(&Federation::accept_loop, this);
+    if (!peers_.empty()) dial_thread_ = std::thread(&Federation::dial_loop, this);
+}
+
+void Federation::stop() {
+    running_ = false;
+    if (accept_thread_.joinable()) accept_thread_.join();
+    if (dial_thread_.joinable()) dial_thread_.join();
+    listen_sock_.close();
+}
+
+void Federation::link_closed(uint32_t node) {
+    std::lock_guard<std::mutex> lock(linked_mutex_);
+    linked_.erase(node);
+}
+
+void Federation::accept_loop() {
+    while (running_) {
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(listen_sock_.get(), &read_set);
+        timeval timeout{};
+        timeout.tv_usec = PEER_TICK_MS * 1000;
+        if (select(static_cast<int>(listen_sock_.get()) + 1, &read_set, nullptr, nullptr, &timeout) <= 0)
+            continue;
+
+        sockaddr_in from{};
+        socklen_t   from_len = sizeof(from);
+        SOCKET s = accept(listen_sock_.get(), reinterpret_cast<sockaddr*>(&from), &from_len);
+        if (s == INVALID_SOCKET) continue;
+
+        // Handled inline: peers are few, and the timeout bounds a stalled one
+        Socket raw(s);
+        set_io_timeout(raw.get(), PEER_IO_TIMEOUT_SECS);
+        TlsSocket tls;
+        uint32_t  node = 0;
+        if (!tls.accept(std::move(raw), server_ctx_) || !establish(std::move(tls), false, node)) {
+            char ip[INET_ADDRSTRLEN] = {};
+            inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+            std::cout << "[Federation] Rejected link from " << ip << "\n";
+        }
+    }
+}
+
+void Federation::dial_loop() {
+    while (running_) {
+        auto now = std::chrono::steady_clock::now();
+        for (auto& peer : peers_) {
+            if (!running_) break;
+            if (now < peer.next_attempt) continue;
+            if (peer.node != 0) {
+                std::lock_guard<std::mutex> lock(linked_mutex_);
+                if (linked_.count(peer.node)) continue;
+            }
+            dial(peer);
+            peer.next_attempt = std::chrono::steady_clock::now() + PEER_REDIAL_MIN +
+                                std::chrono::milliseconds(randombytes_uniform(PEER_REDIAL_JITTER_MS));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(PEER_TICK_MS));
+    }
+}
+
+bool Federation::dial(ConfiguredPeer& peer) {
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result  = nullptr;
+    std::string port  = std::to_string(peer.port);
+    if (getaddrinfo(peer.host.c_str(), port.c_str(), &hints, &result) != 0 || !result) return false;
+
+    Socket raw = create_tcp_socket();
+    set_io_timeout(raw.get(), PEER_IO_TIMEOUT_SECS);
+    int rc = connect(raw.get(), result->ai_addr, static_cast<int>(result->ai_addrlen));
+    freeaddrinfo(result);
+    if (rc == SOCKET_ERROR) return false;
+
+    int nodelay = 1;
+    setsockopt(raw.get(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+
+    TlsSocket tls;
+    if (!tls.connect(std::move(raw), client_ctx_)) return false;
+    uint32_t node = 0;
+    bool ok = establish(std::move(tls), true, node);
+    if (node != 0) peer.node = node;
+    if (!ok) std::cout << "[Federation] Link to " << peer.host << ":" << peer.port << " refused\n";
+    return ok;
+}
+
+void Federation::hello_mac(const std::vector<uint8_t>& exported, bool dialer, uint32_t node,
+                           uint16_t udp_port, uint8_t* out) const {
+    uint8_t fields[7] = {
+        static_cast<uint8_t>(dialer ? 'D' : 'A'),
+        static_cast<uint8_t>(node & 0xFF),         static_cast<uint8_t>((node >> 8) & 0xFF),
+        static_cast<uint8_t>((node >> 16) & 0xFF), static_cast<uint8_t>((node >> 24) & 0xFF),
+        static_cast<uint8_t>(udp_port & 0xFF),     static_cast<uint8_t>((udp_port >> 8) & 0xFF),
+    };
+    crypto_auth_hmacsha256_state st;
+    crypto_auth_hmacsha256_init(&st, reinterpret_cast<const unsigned char*>(secret_.data()), secret_.size());
+    crypto_auth_hmacsha256_update(&st, exported.data(), exported.size());
+    crypto_auth_hmacsha256_update(&st, fields, sizeof(fields));
+    crypto_auth_hmacsha256_final(&st, out);
+}
+
+bool Federation::establish(TlsSocket&& tls, bool dialer, uint32_t& node_out) {
+    auto exported = tls.export_keying_material(PEER_EXPORTER_LABEL, 32);
+    if (exported.empty()) return false;
+
+    uint8_t mac[PEER_HELLO_MAC_SIZE];
+    hello_mac(exported, dialer, node_id_, udp_port_, mac);
+    if (!tls.send_all(make_peer_hello_msg(node_id_, udp_port_, mac))) return false;
+
+    uint8_t hdr_buf[SIGNAL_HEADER_SIZE];
+    if (!tls.recv_all(hdr_buf, SIGNAL_HEADER_SIZE)) return false;
+    auto header = deserialize_header(hdr_buf);
+    if (header.type != MsgType::PEER_HELLO || header.payload_len != PEER_HELLO_SIZE) return false;
+    uint8_t hello[PEER_HELLO_SIZE];
+    if (!tls.recv_all(hello, PEER_HELLO_SIZE)) return false;
+
+    uint32_t node     = read_u32(hello);
+    uint16_t udp_port = read_u16(hello + 4);
+    uint8_t  expected[PEER_HELLO_MAC_SIZE];
+    hello_mac(exported, !dialer, node, udp_port, expected);
+    if (sodium_memcmp(expected, hello + 6, PEER_HELLO_MAC_SIZE) != 0) {
+        std::cout << "[Federation] Peer failed authentication\n";
+        return false;
+    }
+    if (node == 0 || node > MAX_NODE_ID || node == node_id_) {
+        std::cout << "[Federation] Peer announced unusable node id " << node << "\n";
+        return false;
+    }
+    node_out = node;
+
+    {
+        std::lock_guard<std::mutex> lock(linked_mutex_);
+        if (!linked_.insert(node).second) return false;  // already linked
+    }
+
+    sockaddr_in peer_udp{};
+    socklen_t   len = sizeof(peer_udp);
+    getpeername(tls.get(), reinterpret_cast<sockaddr*>(&peer_udp), &len);
+    peer_udp.sin_port = htons(udp_port);
+
+    set_io_timeout(tls.get(), 0);
+    std::cout << "[Federation] Linked to node " << node << " (" << tls.peer_ip() << ", "
+              << (dialer ? "outbound" : "inbound") << ")\n";
+    on_link_(node, std::move(tls), peer_udp);
+    return true;
+}
+
+} // namespace lilypad
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "network.h"
+#include "tls_socket.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace lilypad {
+
+// Client ids carry their server's node id in the top byte, so ids stay unique
+// across a federation. Node 0 (the default) keeps ids unchanged for a server
+// that runs alone; node ids stop below 0x7F, so the voice-extension bit and the
+// peer-link ids below can never collide with a client id.
+constexpr uint32_t MAX_NODE_ID       = 126;
+constexpr int      NODE_ID_SHIFT     = 24;
+constexpr uint32_t PEER_LINK_ID_BASE = 0x7F000000;  // ClientConnection ids of peer links
+
+inline uint32_t peer_link_id(uint32_t node)      { return PEER_LINK_ID_BASE | node; }
+inline bool     is_peer_link(uint32_t conn_id)   { return (conn_id & 0xFF000000) == PEER_LINK_ID_BASE; }
+inline uint32_t peer_link_node(uint32_t conn_id) { return conn_id & 0x00FFFFFF; }
+
+// ── Server-to-server links ──
+// Dials every configured peer (again after a link drops) and accepts links on
+// a dedicated port. After the TLS handshake both ends send PEER_HELLO with
+// their node id, voice port and an HMAC, keyed by the shared secret, over TLS
+// keying material and their role, so a link is only established between
+// servers that know the secret and talk to each other directly. At most one
+// link per peer node is up; a second one is refused.
+// What travels over an established link is up to the server (see main.cpp).
+class Federation {
+public:
+    // Called on a federation thread for each new link; `tls` is still blocking
+    using LinkFn = std::function<void(uint32_t node, TlsSocket&& tls, const sockaddr_in& peer_udp)>;
+
+    Federation(uint32_t node_id, uint16_t udp_port, std::string secret,
+               SSL_CTX* server_ctx, LinkFn on_link);
+    ~Federation();
+    Federation(const Federation&) = delete;
+    Federation& operator=(const Federation&) = delete;
+
+    uint32_t node_id() const { return node_id_; }
+
+    void add_peer(const std::string& host, uint16_t port);
+    bool listen(uint16_t port);
+
+    void start();
+    void stop();
+
+    // The link to `node` closed: free its slot so it can be re-established
+    void link_closed(uint32_t node);
+
+private:
+    struct ConfiguredPeer {
+        std::string host;
+        uint16_t    port = 0;
+        uint32_t    node = 0;  // learned from its PEER_HELLO
+        std::chrono::steady_clock::time_point next_attempt{};
+    };
+
+    void accept_loop();
+    void dial_loop();
+    bool dial(ConfiguredPeer& peer);
+
+    // TLS is up: exchange and verify PEER_HELLO, claim the node, hand off the link
+    bool establish(TlsSocket&& tls, bool dialer, uint32_t& node_out);
+    void hello_mac(const std::vector<uint8_t>& exported, bool dialer, uint32_t node,
+                   uint16_t udp_port, uint8_t* out) const;
+
+    const uint32_t node_id_;
+    const uint16_t udp_port_;
+    const std::string secret_;
+    SSL_CTX*       server_ctx_;
+    SSL_CTX*       client_ctx_ = nullptr;
+    LinkFn         on_link_;
+
+    Socket                      listen_sock_;
+    std::vector<ConfiguredPeer> peers_;  // dial thread only once started
+
+    std::mutex                   linked_mutex_;
+    std::unordered_set<uint32_t> linked_;
+
+    std::atomic<bool> running_{false};
+    std::thread       accept_thread_;
+    std::thread       dial_thread_;
+};
+
+} // namespace lilypad
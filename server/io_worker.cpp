@@ -0,0 +1,198 @@
+#include "io_worker.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace lilypad {
+
+// How long a closing connection may keep flushing its queued output
+constexpr auto CLOSE_LINGER = std::chrono::seconds(2);
+
+// ── IoWorker ──
+
+IoWorker::IoWorker(ClientConnection::MessageFn on_message, CloseFn on_close)
+    : on_message_(std::move(on_message)), on_close_(std::move(on_close)) {}
+
+IoWorker::~IoWorker() {
+    stop();
+}
+
+void IoWorker::start() {
+    running_ = true;
+    thread_ = std::thread(&IoWorker::run, this);
+}
+
+void IoWorker::stop() {
+    if (!running_.exchange(false)) return;
+    poller_.wakeup();
+    if (thread_.joinable()) thread_.join();
+}
+
+void IoWorker::adopt(std::shared_ptr<ClientConnection> conn) {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        conn->worker_ = this;
+        adopt_queue_.push_back(std::move(conn));
+    }
+    count_++;
+    poller_.wakeup();
+}
+
+void IoWorker::request_flush(ClientConnection* conn) {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        flush_queue_.push_back(conn);
+    }
+    poller_.wakeup();
+}
+
+void IoWorker::run() {
+    std::vector<PollEvent>                         events;
+    std::vector<std::shared_ptr<ClientConnection>> adopted;
+    std::vector<ClientConnection*>                 flushes;
+    auto next_sweep = std::chrono::steady_clock::now();
+    LP_TRACE_THREAD("io_worker");
+
+    while (running_) {
+        poller_.wait(events, 500);
+
+        for (auto& ev : events) {
+            auto* conn = static_cast<ClientConnection*>(ev.user);
+            if (!conns_.count(conn)) continue;
+            if (conn->close_requested() && (ev.events & POLL_ERROR)) {
+                drop(*conn);  // hangup or error is reported whatever we ask for; the rest can't be delivered
+                continue;
+            }
+
+            bool readable = (ev.events & (POLL_READ | POLL_ERROR)) ||
+                            (conn->read_wants_write_ && (ev.events & POLL_WRITE));
+            if (readable && conn->on_readable(on_message_) == ClientConnection::ReadResult::CLOSED) {
+                drop(*conn);
+                continue;
+            }
+            service_flush(*conn);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex_);
+            adopted.swap(adopt_queue_);
+            flushes.swap(flush_queue_);
+        }
+
+        for (auto& conn : adopted) {
+            ClientConnection* raw = conn.get();
+            conns_[raw] = std::move(conn);
+            interest_[raw] = POLL_READ;
+            poller_.add(raw->socket(), POLL_READ, raw);
+            raw->flush_pending_ = false;
+            service_flush(*raw);  // anything queued before adoption
+        }
+        adopted.clear();
+
+        for (auto* conn : flushes) {
+            if (!conns_.count(conn)) continue;  // already dropped
+            conn->flush_pending_ = false;
+            service_flush(*conn);
+        }
+        flushes.clear();
+
+        // Closing connections whose peer stopped reading are dropped after the linger period
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_sweep) {
+            next_sweep = now + std::chrono::milliseconds(500);
+            std::vector<ClientConnection*> expired;
+            for (auto& [raw, conn] : conns_) {
+                auto deadline = raw->close_deadline_;
+                if (deadline != std::chrono::steady_clock::time_point{} && now >= deadline) {
+                    expired.push_back(raw);
+                }
+            }
+            for (auto* raw : expired) drop(*raw);
+        }
+    }
+
+    // Shutdown: close everything still attached
+    std::vector<ClientConnection*> remaining;
+    for (auto& [raw, conn] : conns_) remaining.push_back(raw);
+    for (auto* raw : remaining) drop(*raw);
+}
+
+void IoWorker::service_flush(ClientConnection& conn) {
+    if (conn.overflowed()) {
+        // It is not reading; flushing what it already has would only linger
+        std::cout << "[Server] Disconnecting client " << conn.id() << ": more than "
+                  << SIGNAL_QUEUE_LIMIT / (1024 * 1024) << " MB of signaling queued\n";
+        metric_add(Counter::SLOW_CONSUMER_DISCONNECTS);
+        drop(conn);
+        return;
+    }
+    if (!conn.flush()) {
+        drop(conn);
+        return;
+    }
+    if (conn.close_requested()) {
+        if (!conn.has_output()) {
+            drop(conn);
+            return;
+        }
+        if (conn.close_deadline_ == std::chrono::steady_clock::time_point{}) {
+            conn.close_deadline_ = std::chrono::steady_clock::now() + CLOSE_LINGER;
+        }
+    }
+    update_interest(conn);
+}
+
+void IoWorker::update_interest(ClientConnection& conn) {
+    uint32_t wanted = conn.wanted_events();
+    auto& current = interest_[&conn];
+    if (wanted != current) {
+        poller_.modify(conn.socket(), wanted, &conn);
+        current = wanted;
+    }
+}
+
+void IoWorker::drop(ClientConnection& conn) {
+    auto it = conns_.find(&conn);
+    if (it == conns_.end()) return;
+    auto keep_alive = std::move(it->second);
+    conns_.erase(it);
+    interest_.erase(&conn);
+    count_--;
+
+    poller_.remove(conn.socket());
+    conn.close_requested_ = true;
+    conn.shutdown();
+    conn.worker_ = nullptr;
+    on_close_(conn);
+}
+
+// ── IoWorkerPool ──
+
+IoWorkerPool::IoWorkerPool(size_t threads, ClientConnection::MessageFn on_message,
+                           IoWorker::CloseFn on_close) {
+    threads = (std::max)(threads, size_t{1});
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<IoWorker>(on_message, on_close));
+    }
+}
+
+void IoWorkerPool::start() {
+    for (auto& w : workers_) w->start();
+}
+
+void IoWorkerPool::stop() {
+    for (auto& w : workers_) w->stop();
+}
+
+void IoWorkerPool::adopt(std::shared_ptr<ClientConnection> conn) {
+    IoWorker* best = workers_.front().get();
+    for (auto& w : workers_) {
+        if (w->connection_count() < best->connection_count()) best = w.get();
+    }
+    best->adopt(std::move(conn));
+}
+
+} // namespace lilypad
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "client_connection.h"
+#include "poller.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+// ── One event-loop thread multiplexing many ClientConnections ──
+class IoWorker {
+public:
+    using CloseFn = std::function<void(ClientConnection&)>;
+
+    IoWorker(ClientConnection::MessageFn on_message, CloseFn on_close);
+    ~IoWorker();
+    IoWorker(const IoWorker&) = delete;
+    IoWorker& operator=(const IoWorker&) = delete;
+
+    void start();
+    void stop();
+
+    // Thread-safe: hand a connection (socket already non-blocking) to this worker.
+    void adopt(std::shared_ptr<ClientConnection> conn);
+
+    // Thread-safe: the connection has new output or a pending close.
+    void request_flush(ClientConnection* conn);
+
+    size_t connection_count() const { return count_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    void service_flush(ClientConnection& conn);
+    void update_interest(ClientConnection& conn);
+    void drop(ClientConnection& conn);
+
+    ClientConnection::MessageFn on_message_;
+    CloseFn                     on_close_;
+
+    Poller            poller_;
+    std::thread       thread_;
+    std::atomic<bool> running_{false};
+
+    // Owned by the worker thread
+    std::unordered_map<ClientConnection*, std::shared_ptr<ClientConnection>> conns_;
+    std::unordered_map<ClientConnection*, uint32_t>                          interest_;
+    std::atomic<size_t>                                                      count_{0};
+
+    // Cross-thread inbox
+    std::mutex                                     inbox_mutex_;
+    std::vector<std::shared_ptr<ClientConnection>> adopt_queue_;
+    std::vector<ClientConnection*>                 flush_queue_;
+};
+
+// ── Fixed pool of IoWorkers; new connections go to the least-loaded one ──
+class IoWorkerPool {
+public:
+    IoWorkerPool(size_t threads, ClientConnection::MessageFn on_message, IoWorker::CloseFn on_close);
+
+    void start();
+    void stop();
+    void adopt(std::shared_ptr<ClientConnection> conn);
+
+private:
+    std::vector<std::unique_ptr<IoWorker>> workers_;
+};
+
+} // namespace lilypad
@@ -1,17 +1,30 @@
 #include "auth_db.h"
+#include "auth_pool.h"
 #include "chat_persistence.h"
+#include "client_connection.h"
+#include "client_registry.h"
+#include "federation.h"
+#include "io_worker.h"
+#include "media_relay.h"
+#include "metrics.h"
 #include "network.h"
 #include "protocol.h"
+#include "screen_media.h"
 #include "tls_config.h"
 #include "tls_socket.h"
+#include "trace.h"
+#include "voice_relay.h"
 
 #include <sodium.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <ctime>
 #include <condition_variable>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <fstream>
 #include <iostream>
@@ -19,12 +32,13 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 // ── Configuration ──
-constexpr uint16_t TCP_PORT = 7777;
-constexpr uint16_t UDP_PORT = 7778;
+constexpr uint16_t DEFAULT_TCP_PORT = 7777;
+constexpr uint16_t DEFAULT_UDP_PORT = 7778;
+constexpr size_t   AUTH_PENDING_LIMIT = 256;   // readable connections waiting for an auth thread
+constexpr size_t   AUTH_PARKED_LIMIT  = 4096;  // connections waiting for their peer to speak
 
 // ── Global state ──
 static std::atomic<bool> g_running{true};
@@ -33,32 +47,37 @@ void signal_handler(int) {
     g_running = false;
 }
 
-struct ClientInfo {
-    uint32_t           id = 0;
-    std::string        username;
-    lilypad::TlsSocket tls_socket;
-    sockaddr_in        udp_addr{};   // filled in when first UDP packet arrives
-    bool               udp_known = false;
-    int64_t            db_user_id = 0;
+// Connected clients. Relay/chat paths read lock-free snapshots; membership
+// changes go through g_registry.update().
+static lilypad::ClientRegistry                      g_registry;
+static std::atomic<uint32_t>                        g_next_id{1};
+static uint32_t                                     g_node_id  = 0;  // federation node (top byte of client ids)
+static uint16_t                                     g_udp_port = DEFAULT_UDP_PORT;
+static uint16_t                                     g_media_port = 0;  // screen media relay; 0 = TCP only
 
-    // Voice channel
-    bool               in_voice = false;
+static uint32_t next_client_id() {
+    return (g_node_id << lilypad::NODE_ID_SHIFT) | (g_next_id++ & 0x00FFFFFF);
+}
 
-    // Screen sharing
-    bool                             screen_sharing = false;
-    std::unordered_set<uint32_t>     screen_subscribers; // IDs of clients watching this user
-    std::vector<uint8_t>             cached_keyframe;    // last H.264 keyframe relay msg
-};
+// Kernel TLS offload requested (--ktls); the first client reports whether it took
+static bool              g_ktls = false;
+static std::atomic<bool> g_ktls_reported{false};
+
+// ── Links to peer servers (null unless federation is configured) ──
+static std::unique_ptr<lilypad::Federation> g_federation;
 
-static std::mutex                                   g_clients_mutex;
-static std::unordered_map<uint32_t, ClientInfo>     g_clients;
-static uint32_t                                     g_next_id = 1;
+// ── Event-driven I/O: all authenticated TLS connections are multiplexed across this pool ──
+static std::unique_ptr<lilypad::IoWorkerPool> g_io_pool;
 
 // ── Auth database ──
 static std::unique_ptr<lilypad::AuthDB> g_auth_db;
 
+// ── Handshakes and Argon2 work run here, off the accept and I/O threads ──
+static std::unique_ptr<lilypad::AuthPool> g_auth_pool;
+
 // ── TLS ──
 static SSL_CTX* g_ssl_ctx = nullptr;
+static std::unique_ptr<lilypad::TicketKeyRing> g_ticket_keys;
 
 // ── Rate limiting (per-IP) ──
 struct RateLimitEntry {
@@ -131,6 +150,7 @@ static void load_chat_history() {
 }
 
 static void append_chat_to_file(const ChatEntry& entry) {
+    lilypad::MetricTimer timer(lilypad::Histogram::CHAT_APPEND);
     std::ofstream file(CHAT_HISTORY_FILE, std::ios::app);
     if (file.is_open()) {
         file << lilypad::serialize_chat_line(entry.seq, entry.sender_name, entry.timestamp, entry.text) << '\n';
@@ -157,145 +177,549 @@ static void load_update_config() {
     }
 }
 
-// ── Screen relay queue (decouples tcp_read_loop from blocking subscriber sends) ──
+// ── Screen relay queue (hands frames from IoWorker threads to the fan-out thread) ──
 struct RelayItem {
-    std::vector<uint8_t> data;
-    uint32_t             sharer_id;
-    bool                 is_audio;     // true = SCREEN_AUDIO (high priority)
-    bool                 is_keyframe;  // true = H.264 IDR (don't drop)
+    lilypad::SharedBuffer data;         // complete relay msg, shared by every subscriber
+    uint32_t              sharer_id;
+    bool                  is_audio;     // true = SCREEN_AUDIO (high priority)
+    bool                  is_keyframe;  // true = H.264 IDR (don't drop)
+    uint64_t              seq;          // sharer's video frame sequence (0 for audio)
+    uint8_t               layer;        // simulcast layer of a video frame
+    bool                  from_udp;     // the media relay already sent it to the UDP viewers
+    bool                  gap;          // no data: a video frame was lost on the way in
 };
 
 static std::mutex               g_relay_mutex;
 static std::condition_variable  g_relay_cv;
 static std::deque<RelayItem>    g_relay_queue;
 
-static void enqueue_relay(std::vector<uint8_t> data, uint32_t sharer_id, bool is_audio, bool is_keyframe = false) {
+static void enqueue_relay(lilypad::SharedBuffer data, uint32_t sharer_id, bool is_audio,
+                          bool is_keyframe = false, uint64_t seq = 0, uint8_t layer = 0,
+                          bool from_udp = false) {
+    LP_TRACE_SCOPE_ARG("relay.enqueue", sharer_id);
+    lilypad::metric_add(is_audio ? lilypad::Counter::SCREEN_AUDIO_IN : lilypad::Counter::SCREEN_FRAMES_IN);
+    lilypad::metric_add(is_audio ? lilypad::Counter::SCREEN_AUDIO_BYTES_IN : lilypad::Counter::SCREEN_FRAME_BYTES_IN,
+                        data.size());
     {
         std::lock_guard<std::mutex> lock(g_relay_mutex);
-        g_relay_queue.push_back({std::move(data), sharer_id, is_audio, is_keyframe});
-        // Limit queue depth — drop oldest non-audio, non-keyframe items to prevent unbounded growth
-        while (g_relay_queue.size() > 60) {
-            bool dropped = false;
-            for (auto it = g_relay_queue.begin(); it != g_relay_queue.end(); ++it) {
-                if (!it->is_audio && !it->is_keyframe) {
-                    g_relay_queue.erase(it);
-                    dropped = true;
-                    break;
-                }
+        // Fan-out only queues onto connections and never blocks, so this stays short;
+        // slow viewers shed load in their own per-connection queues.
+        g_relay_queue.push_back({std::move(data), sharer_id, is_audio, is_keyframe, seq, layer, from_udp, false});
+        lilypad::metric_set(lilypad::Gauge::SCREEN_RELAY_QUEUE_DEPTH, static_cast<int64_t>(g_relay_queue.size()));
+    }
+    g_relay_cv.notify_one();
+}
+
+// ── Broadcast a TCP message to every local client in `clients` ──
+// Serialized once: every recipient queues a reference to the same buffer and
+// its own I/O worker writes it, so a client with a full TCP window only backs
+// up its own queue (and is disconnected past SIGNAL_QUEUE_LIMIT).
+static void broadcast_tcp(const lilypad::ClientMap& clients, const lilypad::SharedBuffer& msg) {
+    for (auto& [id, client] : clients) {
+        if (client->local()) client->conn->send(msg);
+    }
+}
+
+static void broadcast_tcp(const lilypad::ClientMap& clients, std::vector<uint8_t> msg) {
+    broadcast_tcp(clients, lilypad::SharedBuffer(std::move(msg)));
+}
+
+// ── Broadcast a membership change about `subject` ──
+// Local clients always hear it; peer servers only about our own clients (they
+// learn about each other's directly), so nothing is relayed twice.
+static void broadcast_event(const lilypad::RegistryTxn& txn, const lilypad::ClientView& subject,
+                            std::vector<uint8_t> msg) {
+    lilypad::SharedBuffer shared(std::move(msg));
+    broadcast_tcp(txn.clients(), shared);
+    if (!subject.local()) return;
+    for (auto& [node, peer] : txn.peers()) {
+        peer->conn->send(shared);
+    }
+}
+
+// ── Ask a sharer for a keyframe; a remote one via its server ──
+static void request_keyframe(const lilypad::ClientView& sharer) {
+    if (sharer.local())
+        sharer.conn->send(lilypad::make_screen_request_keyframe_msg());
+    else
+        sharer.conn->send(lilypad::make_screen_request_keyframe_msg(sharer.id));
+}
+
+// A subscriber that had to drop video asks the sharer for a new IDR at most this often
+constexpr auto KEYFRAME_REQUEST_INTERVAL = std::chrono::seconds(1);
+
+// ── Ask for a keyframe on a viewer's behalf, rate-limited per sharer ──
+static void request_keyframe_throttled(const lilypad::ClientView& sharer) {
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> cache_lock(sharer.screen_cache->mutex);
+        if (now - sharer.screen_cache->last_keyframe_request < KEYFRAME_REQUEST_INTERVAL) return;
+        sharer.screen_cache->last_keyframe_request = now;
+    }
+    request_keyframe(sharer);
+}
+
+// Receiver reports older than this no longer say anything about the path
+constexpr auto RECEIVER_REPORT_MAX_AGE = std::chrono::seconds(3);
+
+// ── Fold one receiver's report into what the sharer is told ──
+// At most once per SCREEN_REPORT_INTERVAL the sharer gets the worst of the
+// recent reports: lowest rate, highest loss, steepest delay trend. The sharer's
+// rate is that of its full-quality layer, so viewers who were moved to a lower
+// simulcast layer don't count; a slow path only holds back everyone when there
+// is nothing lower to move it to.
+static void merge_receiver_report(const lilypad::ClientView& sharer, uint32_t reporter,
+                                  const lilypad::ScreenReceiverReport& report) {
+    auto now = std::chrono::steady_clock::now();
+    lilypad::ScreenReceiverReport worst;
+    worst.sharer_id = sharer.id;
+    {
+        std::lock_guard<std::mutex> cache_lock(sharer.screen_cache->mutex);
+        auto& cache = *sharer.screen_cache;
+        auto  layer = cache.viewer_layers.find(reporter);
+        if (reporter != 0 && layer != cache.viewer_layers.end() && layer->second.current != 0)
+            cache.receiver_reports.erase(reporter);
+        else
+            cache.receiver_reports[reporter] = {report, now};
+        if (now - cache.last_receiver_report < lilypad::SCREEN_REPORT_INTERVAL) return;
+        cache.last_receiver_report = now;
+
+        bool any = false;
+        for (auto it = cache.receiver_reports.begin(); it != cache.receiver_reports.end();) {
+            if (now - it->second.at > RECEIVER_REPORT_MAX_AGE) {
+                it = cache.receiver_reports.erase(it);
+                continue;
+            }
+            const auto& r = it->second.report;
+            // Loss fractions compared as lost_a / total_a > lost_b / total_b
+            uint64_t total       = static_cast<uint64_t>(r.frames) + r.lost;
+            uint64_t worst_total = static_cast<uint64_t>(worst.frames) + worst.lost;
+            if (!any || r.lost * worst_total > static_cast<uint64_t>(worst.lost) * total) {
+                worst.frames = r.frames;
+                worst.lost   = r.lost;
             }
-            if (!dropped) break; // all items are audio or keyframes, stop dropping
+            worst.recv_kbps = any ? (std::min)(worst.recv_kbps, r.recv_kbps) : r.recv_kbps;
+            if (r.delay_slope != lilypad::SCREEN_DELAY_UNKNOWN &&
+                (worst.delay_slope == lilypad::SCREEN_DELAY_UNKNOWN || r.delay_slope > worst.delay_slope))
+                worst.delay_slope = r.delay_slope;
+            any = true;
+            ++it;
         }
+        if (!any) return;
     }
-    g_relay_cv.notify_one();
+    sharer.conn->send(lilypad::make_screen_receiver_report_msg(worst));
 }
 
-// ── Broadcast a TCP message to all clients (caller must hold g_clients_mutex) ──
-static void broadcast_tcp(const std::vector<uint8_t>& msg) {
-    for (auto& [id, client] : g_clients) {
-        client.tls_socket.send_all(msg);
+// ── Re-pick the simulcast layer a viewer is sent, from its latest report ──
+static void choose_viewer_layer(const lilypad::ClientView& sharer, uint32_t viewer_id,
+                                const lilypad::ClientConnection& conn,
+                                const lilypad::ScreenReceiverReport& report) {
+    auto     now     = std::chrono::steady_clock::now();
+    uint64_t dropped = conn.dropped_messages();
+    uint8_t  before = 0, after = 0;
+    {
+        std::lock_guard<std::mutex> cache_lock(sharer.screen_cache->mutex);
+        auto& v = sharer.screen_cache->viewer_layers[viewer_id];
+        lilypad::ViewerHealth health;
+        health.report       = report;
+        health.queued_bytes = conn.queued_bytes();
+        health.dropped      = dropped != v.dropped;
+        v.dropped           = dropped;
+        before              = v.target;
+        lilypad::choose_layer(v, health, sharer.screen_cache->layers, now);
+        after               = v.target;
+    }
+    if (after != before) {
+        std::cout << "[Server] Viewer " << viewer_id << " of " << sharer.id << ": layer "
+                  << static_cast<int>(before) << " -> " << static_cast<int>(after) << "\n";
     }
 }
 
-// ── Remove a client and notify others ──
+// Empty every layer's GOP; callers hold the cache mutex
+static void clear_gops(lilypad::ScreenCache& cache) {
+    for (auto& gop : cache.gop) gop = lilypad::ScreenCache::Gop();
+    cache.layers.reset();
+}
+
+// ── Sorted subscriber-list helpers ──
+static void add_subscriber(std::vector<uint32_t>& subs, uint32_t id) {
+    auto it = std::lower_bound(subs.begin(), subs.end(), id);
+    if (it == subs.end() || *it != id) subs.insert(it, id);
+}
+
+static bool remove_subscriber(std::vector<uint32_t>& subs, uint32_t id) {
+    auto it = std::lower_bound(subs.begin(), subs.end(), id);
+    if (it == subs.end() || *it != id) return false;
+    subs.erase(it);
+    return true;
+}
+
+// ── End a screen share: drop it from every viewer and peer, clear its cache ──
+static void stop_screen_share(lilypad::RegistryTxn& txn, uint32_t sharer_id) {
+    lilypad::ClientView* self = txn.edit(sharer_id);
+    if (!self) return;
+    self->screen_sharing = false;
+    self->media_keys.reset();
+    for (uint32_t sub_id : self->screen_subscribers) {
+        if (const lilypad::ClientView* sub = txn.find(sub_id)) {
+            sub->conn->drop_stream(sharer_id);
+            if (sub->media_stream == sharer_id) txn.edit(sub_id)->media_stream = 0;
+        }
+    }
+    for (uint32_t node : self->peer_subscribers) {
+        auto peer = txn.peers().find(node);
+        if (peer != txn.peers().end()) peer->second->conn->drop_stream(sharer_id);
+    }
+    self->screen_subscribers.clear();
+    self->peer_subscribers.clear();
+    {
+        std::lock_guard<std::mutex> cache_lock(self->screen_cache->mutex);
+        clear_gops(*self->screen_cache);
+        self->screen_cache->viewer_layers.clear();
+        self->screen_cache->receiver_reports.clear();
+    }
+    broadcast_event(txn, *self, lilypad::make_screen_stop_broadcast(sharer_id));
+}
+
+// ── Stop relaying a remote sharer once nobody here watches it any more ──
+static void release_remote_stream(lilypad::RegistryTxn& txn, uint32_t sharer_id) {
+    const lilypad::ClientView* sharer = txn.find(sharer_id);
+    if (!sharer || sharer->local() || !sharer->screen_subscribers.empty()) return;
+    sharer->conn->send(lilypad::make_screen_unsubscribe_msg(sharer_id));
+    sharer->conn->drop_stream(sharer_id);
+
+    // Frames stop arriving now; a later viewer gets a fresh GOP from the peer
+    std::lock_guard<std::mutex> cache_lock(sharer->screen_cache->mutex);
+    clear_gops(*sharer->screen_cache);
+    sharer->screen_cache->viewer_layers.clear();
+}
+
+// ── Remove a client (local, or a peer server's) and notify others ──
+// Returns false if the client was already gone.
+static bool remove_client_locked(lilypad::RegistryTxn& txn, uint32_t client_id, std::string& name) {
+    auto it = txn.clients().find(client_id);
+    if (it == txn.clients().end()) return false;
+    std::shared_ptr<const lilypad::ClientView> self = it->second;
+    name = self->username;
+
+    if (self->screen_sharing) stop_screen_share(txn, client_id);
+
+    if (self->local()) self->conn->request_close();
+    txn.erase(client_id);
+
+    if (self->in_voice()) {
+        broadcast_event(txn, *self, lilypad::make_voice_left_broadcast(client_id, self->voice_room));
+    }
+
+    // Remove this client from all subscriber lists
+    std::vector<uint32_t> watched;
+    for (auto& [id, c] : txn.clients()) {
+        if (std::binary_search(c->screen_subscribers.begin(), c->screen_subscribers.end(), client_id))
+            watched.push_back(id);
+    }
+    for (uint32_t id : watched) {
+        lilypad::ClientView* sharer = txn.edit(id);
+        remove_subscriber(sharer->screen_subscribers, client_id);
+        {
+            std::lock_guard<std::mutex> cache_lock(sharer->screen_cache->mutex);
+            sharer->screen_cache->viewer_layers.erase(client_id);
+        }
+        release_remote_stream(txn, id);
+    }
+
+    broadcast_event(txn, *self, lilypad::make_user_left_msg(client_id));
+    return true;
+}
+
 static void remove_client(uint32_t client_id) {
     std::string name;
-    {
-        std::lock_guard<std::mutex> lock(g_clients_mutex);
-        auto it = g_clients.find(client_id);
-        if (it == g_clients.end()) return;
-        name = it->second.username;
+    bool        removed = false;
+    g_registry.update([&](lilypad::RegistryTxn& txn) {
+        removed = remove_client_locked(txn, client_id, name);
+    });
+    if (!removed) return;
+    std::cout << "[Server] " << name << " (id=" << client_id << ") left.\n";
+}
 
-        // If this client was in voice, broadcast VOICE_LEFT
-        if (it->second.in_voice) {
-            auto voice_left = lilypad::make_voice_left_broadcast(client_id);
-            for (auto& [id, c] : g_clients) {
-                if (id != client_id)
-                    c.tls_socket.send_all(voice_left);
-            }
+// ── Helper: complete post-auth setup for an authenticated client ──
+// Queues `login_resp` first (the client reads it synchronously), then the current
+// roster, registers the client and hands its connection to the I/O pool.
+// Runs as one registry update so no membership change can interleave.
+static void setup_authenticated_client(lilypad::TlsSocket&& tls, uint32_t client_id,
+                                       const std::string& username, int64_t db_user_id,
+                                       std::vector<uint8_t> login_resp) {
+    bool ktls = tls.ktls_send();
+    lilypad::metric_add(ktls ? lilypad::Counter::TLS_SEND_KERNEL : lilypad::Counter::TLS_SEND_USERSPACE);
+    if (g_ktls && !g_ktls_reported.exchange(true)) {
+        std::cout << (ktls ? "[TLS] Kernel TLS offload active\n"
+                           : "[TLS] Kernel TLS offload unavailable (no kernel tls module or unsupported "
+                             "cipher); sending through userspace\n");
+    }
+    tls.set_nonblocking();
+    auto conn = std::make_shared<lilypad::ClientConnection>(client_id, std::move(tls));
+    conn->send(std::move(login_resp));
+
+    g_registry.update([&](lilypad::RegistryTxn& txn) {
+        // Send update notification if configured
+        if (!g_update_version.empty() && !g_update_url.empty()) {
+            conn->send(lilypad::make_update_available_msg(g_update_version, g_update_url));
+        }
+
+        // Send existing user list
+        for (auto& [id, existing] : txn.clients()) {
+            conn->send(lilypad::make_user_joined_msg(existing->id, existing->username));
         }
 
-        // If this client was sharing, broadcast SCREEN_STOP
-        if (it->second.screen_sharing) {
-            auto stop_msg = lilypad::make_screen_stop_broadcast(client_id);
-            for (auto& [id, c] : g_clients) {
-                if (id != client_id)
-                    c.tls_socket.send_all(stop_msg);
+        // Send SCREEN_START for any currently-sharing users
+        for (auto& [id, existing] : txn.clients()) {
+            if (existing->screen_sharing) {
+                conn->send(lilypad::make_screen_start_broadcast(existing->id));
             }
         }
 
-        // Remove this client from all subscriber sets
-        for (auto& [id, c] : g_clients) {
-            c.screen_subscribers.erase(client_id);
+        // Send VOICE_JOINED for any users currently in voice
+        for (auto& [id, existing] : txn.clients()) {
+            if (existing->in_voice()) {
+                conn->send(lilypad::make_voice_joined_broadcast(existing->id, existing->voice_room));
+            }
         }
 
-        it->second.tls_socket.close();
-        g_clients.erase(it);
+        // Broadcast USER_JOINED to all existing clients and peer servers
+        lilypad::SharedBuffer joined(lilypad::make_user_joined_msg(client_id, username));
+        broadcast_tcp(txn.clients(), joined);
+        for (auto& [node, peer] : txn.peers()) {
+            peer->conn->send(joined);
+        }
 
-        // Broadcast USER_LEFT to remaining clients
-        auto msg = lilypad::make_user_left_msg(client_id);
-        broadcast_tcp(msg);
-    }
-    std::cout << "[Server] " << name << " (id=" << client_id << ") left.\n";
+        // Add the new client
+        lilypad::ClientView info;
+        info.id           = client_id;
+        info.username     = username;
+        info.conn         = conn;
+        info.screen_cache = std::make_shared<lilypad::ScreenCache>();
+        info.udp_known    = false;
+        info.db_user_id   = db_user_id;
+        txn.insert(std::move(info));
+    });
+
+    g_io_pool->adopt(std::move(conn));
 }
 
-// ── Per-client read threads (forward declarations for tcp_accept_loop) ──
-static std::mutex               g_client_threads_mutex;
-static std::vector<std::thread> g_client_threads;
-static void client_read_loop(uint32_t id);
+// ── Connection setup (TLS handshake + login), run on the auth pool ──
+// Per-stage budgets for a connection that has not logged in yet
+constexpr auto TLS_HANDSHAKE_TIMEOUT = std::chrono::seconds(10);  // accept -> handshake done, queueing included
+constexpr auto AUTH_IDLE_TIMEOUT     = std::chrono::minutes(5);   // login screen left open
+constexpr auto AUTH_MESSAGE_TIMEOUT  = std::chrono::seconds(10);  // one request, once it starts arriving
+
+struct PendingConnection {
+    lilypad::Socket    raw;      // until the handshake
+    lilypad::TlsSocket tls;
+    std::string        peer_ip;
+    lilypad::AuthPool::Clock::time_point auth_expires;
+};
 
-// ── Helper: complete post-auth setup for an authenticated client ──
-// Caller must NOT hold g_clients_mutex. Returns true on success.
-static bool setup_authenticated_client(lilypad::TlsSocket&& tls, const std::string& username,
-                                        int64_t db_user_id, uint32_t& out_client_id) {
-    std::lock_guard<std::mutex> lock(g_clients_mutex);
-    uint32_t client_id = g_next_id++;
+static void serve_pending_connection(std::shared_ptr<PendingConnection> pc);
 
-    // Send update notification if configured
-    if (!g_update_version.empty() && !g_update_url.empty()) {
-        auto update_msg = lilypad::make_update_available_msg(g_update_version, g_update_url);
-        tls.send_all(update_msg);
+// Wait, without holding a pool thread, for the client's next auth request
+static void park_pending_connection(std::shared_ptr<PendingConnection> pc) {
+    SOCKET sock = pc->tls.get();
+    auto expires = pc->auth_expires;
+    if (!g_auth_pool->park(sock, expires, [pc = std::move(pc)]() mutable {
+            serve_pending_connection(std::move(pc));
+        })) {
+        std::cout << "[Server] Too many connections logging in, dropping one\n";
     }
+}
 
-    // Send existing user list
-    for (auto& [id, existing] : g_clients) {
-        auto msg = lilypad::make_user_joined_msg(existing.id, existing.username);
-        tls.send_all(msg);
+// Runs once the ClientHello has arrived
+static void handshake_pending_connection(std::shared_ptr<PendingConnection> pc,
+                                         lilypad::AuthPool::Clock::time_point accepted_at) {
+    auto deadline_at = accepted_at + TLS_HANDSHAKE_TIMEOUT;
+    if (lilypad::AuthPool::Clock::now() >= deadline_at) {
+        std::cout << "[Server] Dropping connection that waited too long for a handshake slot\n";
+        return;
     }
 
-    // Send SCREEN_START for any currently-sharing users
-    for (auto& [id, existing] : g_clients) {
-        if (existing.screen_sharing) {
-            auto msg = lilypad::make_screen_start_broadcast(existing.id);
-            tls.send_all(msg);
+    SOCKET sock = pc->raw.get();
+    {
+        lilypad::AuthPool::Deadline deadline(*g_auth_pool, sock, deadline_at);
+        if (!pc->tls.accept(std::move(pc->raw), g_ssl_ctx)) {
+            std::cout << "[Server] TLS handshake failed from " << pc->tls.peer_ip() << "\n";
+            return;
         }
     }
 
-    // Send VOICE_JOINED for any users currently in voice
-    for (auto& [id, existing] : g_clients) {
-        if (existing.in_voice) {
-            auto msg = lilypad::make_voice_joined_broadcast(existing.id);
-            tls.send_all(msg);
+    pc->peer_ip      = pc->tls.peer_ip();
+    pc->auth_expires = lilypad::AuthPool::Clock::now() + AUTH_IDLE_TIMEOUT;
+    park_pending_connection(std::move(pc));
+}
+
+// Handle the auth requests that have arrived -- client can register then login,
+// or just login -- then park again, or hand the connection to the I/O pool.
+static void serve_pending_connection(std::shared_ptr<PendingConnection> pc) {
+    lilypad::AuthPool::Deadline deadline(*g_auth_pool, pc->tls.get(),
+                                         lilypad::AuthPool::Clock::now() + AUTH_MESSAGE_TIMEOUT);
+
+    for (bool first = true; first || pc->tls.has_pending(); first = false) {
+        deadline.reset(lilypad::AuthPool::Clock::now() + AUTH_MESSAGE_TIMEOUT);
+
+        // Read signal header
+        uint8_t hdr_buf[lilypad::SIGNAL_HEADER_SIZE];
+        if (!pc->tls.recv_all(hdr_buf, lilypad::SIGNAL_HEADER_SIZE)) {
+            return; // connection lost
         }
-    }
 
-    // Broadcast USER_JOINED to all existing clients
-    auto joined_msg = lilypad::make_user_joined_msg(client_id, username);
-    broadcast_tcp(joined_msg);
+        auto header = lilypad::deserialize_header(hdr_buf);
+
+        // Read payload
+        std::vector<uint8_t> payload;
+        if (header.payload_len > 0) {
+            if (header.payload_len > 4096) return; // auth messages should be small
+            payload.resize(header.payload_len);
+            if (!pc->tls.recv_all(payload.data(), header.payload_len)) return;
+        }
 
-    // Add the new client
-    ClientInfo info;
-    info.id          = client_id;
-    info.username    = username;
-    info.tls_socket  = std::move(tls);
-    info.udp_known   = false;
-    info.db_user_id  = db_user_id;
-    g_clients[client_id] = std::move(info);
+        if (header.type == lilypad::MsgType::AUTH_REGISTER_REQ) {
+            // Parse: username\0 + password\0
+            const char* p = reinterpret_cast<const char*>(payload.data());
+            std::string username(p);
+            size_t pass_offset = username.size() + 1;
+            if (pass_offset >= payload.size()) {
+                auto resp = lilypad::make_auth_register_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
+                                                              "Invalid request");
+                pc->tls.send_all(resp);
+                continue;
+            }
+            std::string password(reinterpret_cast<const char*>(payload.data() + pass_offset));
 
-    out_client_id = client_id;
-    return true;
+            // Validate input
+            if (!lilypad::is_valid_username(username)) {
+                auto resp = lilypad::make_auth_register_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
+                                                              "Username must be 1-32 alphanumeric/underscore characters");
+                pc->tls.send_all(resp);
+                continue;
+            }
+            if (!lilypad::is_valid_password(password)) {
+                auto resp = lilypad::make_auth_register_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
+                                                              "Password must be 8-128 characters");
+                pc->tls.send_all(resp);
+                continue;
+            }
+
+            lilypad::MetricTimer timer(lilypad::Histogram::AUTH_REGISTER);
+            auto result = g_auth_db->register_user(username, password);
+            auto status = result.success ? lilypad::AuthStatus::OK : lilypad::AuthStatus::ERR_USERNAME_TAKEN;
+            auto resp = lilypad::make_auth_register_resp(status, result.message);
+            pc->tls.send_all(resp);
+            // Don't break -- client should now send a login request
+            continue;
+
+        } else if (header.type == lilypad::MsgType::AUTH_LOGIN_REQ) {
+            // Rate limit check
+            if (!check_rate_limit(pc->peer_ip)) {
+                auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::ERR_RATE_LIMITED,
+                                                           0, 0, std::vector<uint8_t>(32, 0).data(),
+                                                           "Too many failed attempts. Try again later.");
+                pc->tls.send_all(resp);
+                continue;
+            }
+
+            // Parse: username\0 + password\0
+            const char* p = reinterpret_cast<const char*>(payload.data());
+            std::string username(p);
+            size_t pass_offset = username.size() + 1;
+            if (pass_offset >= payload.size()) {
+                auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
+                                                           0, 0, std::vector<uint8_t>(32, 0).data(),
+                                                           "Invalid request");
+                pc->tls.send_all(resp);
+                continue;
+            }
+            std::string password(reinterpret_cast<const char*>(payload.data() + pass_offset));
+
+            lilypad::MetricTimer timer(lilypad::Histogram::AUTH_LOGIN);
+            auto result = g_auth_db->verify_login(username, password);
+            if (!result.success) {
+                record_auth_failure(pc->peer_ip);
+                auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::ERR_INVALID_CREDS,
+                                                           0, 0, std::vector<uint8_t>(32, 0).data(),
+                                                           result.message);
+                pc->tls.send_all(resp);
+                continue;
+            }
+
+            // Create session token
+            auto token = g_auth_db->create_session(result.user_id);
+
+            // AUTH_LOGIN_RESP (replaces WELCOME) goes out ahead of the roster
+            uint32_t client_id = next_client_id();
+            auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::OK,
+                                                      client_id, g_udp_port, token.data(),
+                                                      "Login successful");
+            deadline.disarm();
+            setup_authenticated_client(std::move(pc->tls), client_id, username, result.user_id,
+                                       std::move(resp));
+
+            std::cout << "[Server] " << username << " (id=" << client_id << ") authenticated.\n";
+            return;
+
+        } else if (header.type == lilypad::MsgType::AUTH_TOKEN_LOGIN_REQ) {
+            // Rate limit check
+            if (!check_rate_limit(pc->peer_ip)) {
+                auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::ERR_RATE_LIMITED,
+                                                                 0, 0, std::vector<uint8_t>(32, 0).data(),
+                                                                 "Too many failed attempts. Try again later.");
+                pc->tls.send_all(resp);
+                continue;
+            }
+
+            // Parse: username\0 + token(32)
+            const char* p = reinterpret_cast<const char*>(payload.data());
+            std::string username(p);
+            size_t token_offset = username.size() + 1;
+            if (token_offset + lilypad::SESSION_TOKEN_SIZE > payload.size()) {
+                auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
+                                                                 0, 0, std::vector<uint8_t>(32, 0).data(),
+                                                                 "Invalid request");
+                pc->tls.send_all(resp);
+                continue;
+            }
+            const uint8_t* raw_token = payload.data() + token_offset;
+
+            lilypad::MetricTimer timer(lilypad::Histogram::AUTH_TOKEN_LOGIN);
+            auto result = g_auth_db->validate_token(username, raw_token);
+            if (!result.success) {
+                record_auth_failure(pc->peer_ip);
+                auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::ERR_TOKEN_EXPIRED,
+                                                                 0, 0, std::vector<uint8_t>(32, 0).data(),
+                                                                 result.message);
+                pc->tls.send_all(resp);
+                continue;
+            }
+
+            uint32_t client_id = next_client_id();
+            auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::OK,
+                                                            client_id, g_udp_port, result.new_token.data(),
+                                                            "Token login successful");
+            deadline.disarm();
+            setup_authenticated_client(std::move(pc->tls), client_id, result.username, result.user_id,
+                                       std::move(resp));
+
+            std::cout << "[Server] " << result.username << " (id=" << client_id << ") token-authenticated.\n";
+            return;
+
+        } else {
+            // Unknown message type during auth handshake, reject
+            return;
+        }
+    }
+
+    deadline.disarm();
+    park_pending_connection(std::move(pc));
 }
 
 // ── Thread 1: Accept new TCP connections ──
+// Only accepts and parks the socket: the handshake and login run on the auth pool.
 static void tcp_accept_loop(SOCKET listen_sock) {
     while (g_running) {
         fd_set read_set;
@@ -306,11 +730,11 @@ static void tcp_accept_loop(SOCKET listen_sock) {
         timeout.tv_sec  = 0;
         timeout.tv_usec = 200000; // 200ms
 
-        int ready = select(0, &read_set, nullptr, nullptr, &timeout);
+        int ready = select(static_cast<int>(listen_sock) + 1, &read_set, nullptr, nullptr, &timeout);
         if (ready <= 0) continue;
 
         sockaddr_in client_addr{};
-        int addr_len = sizeof(client_addr);
+        socklen_t addr_len = sizeof(client_addr);
         SOCKET new_sock = accept(listen_sock,
                                  reinterpret_cast<sockaddr*>(&client_addr), &addr_len);
         if (new_sock == INVALID_SOCKET) continue;
@@ -330,209 +754,75 @@ static void tcp_accept_loop(SOCKET listen_sock) {
         setsockopt(new_sock, SOL_SOCKET, SO_RCVBUF,
                    reinterpret_cast<const char*>(&rcvbuf), sizeof(rcvbuf));
 
-        lilypad::Socket raw_socket(new_sock);
-        lilypad::TlsSocket tls;
-
-        // TLS handshake
-        if (!tls.accept(std::move(raw_socket), g_ssl_ctx)) {
-            std::cout << "[Server] TLS handshake failed from " << inet_ntoa(client_addr.sin_addr) << "\n";
-            continue;
+        auto pc = std::make_shared<PendingConnection>();
+        pc->raw = lilypad::Socket(new_sock);
+        auto accepted_at = lilypad::AuthPool::Clock::now();
+        if (!g_auth_pool->park(new_sock, accepted_at + TLS_HANDSHAKE_TIMEOUT,
+                               [pc, accepted_at]() mutable {
+                                   handshake_pending_connection(std::move(pc), accepted_at);
+                               })) {
+            std::cout << "[Server] Too many pending connections, refusing "
+                      << inet_ntoa(client_addr.sin_addr) << "\n";
         }
+    }
+}
 
-        std::string peer_ip = tls.peer_ip();
-
-        // Auth handshake loop -- client can register then login, or just login
-        bool authenticated = false;
-        uint32_t client_id = 0;
-
-        while (g_running && !authenticated) {
-            // Read signal header
-            uint8_t hdr_buf[lilypad::SIGNAL_HEADER_SIZE];
-            if (!tls.recv_all(hdr_buf, lilypad::SIGNAL_HEADER_SIZE)) {
-                break; // connection lost
-            }
-
-            auto header = lilypad::deserialize_header(hdr_buf);
-
-            // Read payload
-            std::vector<uint8_t> payload;
-            if (header.payload_len > 0) {
-                if (header.payload_len > 4096) break; // auth messages should be small
-                payload.resize(header.payload_len);
-                if (!tls.recv_all(payload.data(), header.payload_len)) break;
-            }
-
-            if (header.type == lilypad::MsgType::AUTH_REGISTER_REQ) {
-                // Parse: username\0 + password\0
-                const char* p = reinterpret_cast<const char*>(payload.data());
-                std::string username(p);
-                size_t pass_offset = username.size() + 1;
-                if (pass_offset >= payload.size()) {
-                    auto resp = lilypad::make_auth_register_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
-                                                                  "Invalid request");
-                    tls.send_all(resp);
-                    continue;
-                }
-                std::string password(reinterpret_cast<const char*>(payload.data() + pass_offset));
-
-                // Validate input
-                if (!lilypad::is_valid_username(username)) {
-                    auto resp = lilypad::make_auth_register_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
-                                                                  "Username must be 1-32 alphanumeric/underscore characters");
-                    tls.send_all(resp);
-                    continue;
-                }
-                if (!lilypad::is_valid_password(password)) {
-                    auto resp = lilypad::make_auth_register_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
-                                                                  "Password must be 8-128 characters");
-                    tls.send_all(resp);
-                    continue;
-                }
-
-                auto result = g_auth_db->register_user(username, password);
-                auto status = result.success ? lilypad::AuthStatus::OK : lilypad::AuthStatus::ERR_USERNAME_TAKEN;
-                auto resp = lilypad::make_auth_register_resp(status, result.message);
-                tls.send_all(resp);
-                // Don't break -- client should now send a login request
-                continue;
-
-            } else if (header.type == lilypad::MsgType::AUTH_LOGIN_REQ) {
-                // Rate limit check
-                if (!check_rate_limit(peer_ip)) {
-                    auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::ERR_RATE_LIMITED,
-                                                               0, 0, std::vector<uint8_t>(32, 0).data(),
-                                                               "Too many failed attempts. Try again later.");
-                    tls.send_all(resp);
-                    continue;
-                }
-
-                // Parse: username\0 + password\0
-                const char* p = reinterpret_cast<const char*>(payload.data());
-                std::string username(p);
-                size_t pass_offset = username.size() + 1;
-                if (pass_offset >= payload.size()) {
-                    auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
-                                                               0, 0, std::vector<uint8_t>(32, 0).data(),
-                                                               "Invalid request");
-                    tls.send_all(resp);
-                    continue;
-                }
-                std::string password(reinterpret_cast<const char*>(payload.data() + pass_offset));
-
-                auto result = g_auth_db->verify_login(username, password);
-                if (!result.success) {
-                    record_auth_failure(peer_ip);
-                    auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::ERR_INVALID_CREDS,
-                                                               0, 0, std::vector<uint8_t>(32, 0).data(),
-                                                               result.message);
-                    tls.send_all(resp);
-                    continue;
-                }
-
-                // Create session token
-                auto token = g_auth_db->create_session(result.user_id);
-
-                // Setup client
-                if (!setup_authenticated_client(std::move(tls), username, result.user_id, client_id)) {
-                    break;
-                }
-
-                // Send AUTH_LOGIN_RESP (replaces WELCOME)
-                {
-                    std::lock_guard<std::mutex> lock(g_clients_mutex);
-                    auto it = g_clients.find(client_id);
-                    if (it != g_clients.end()) {
-                        auto resp = lilypad::make_auth_login_resp(lilypad::AuthStatus::OK,
-                                                                    client_id, UDP_PORT, token.data(),
-                                                                    "Login successful");
-                        it->second.tls_socket.send_all(resp);
-                    }
-                }
-
-                authenticated = true;
-                std::cout << "[Server] " << username << " (id=" << client_id << ") authenticated.\n";
-
-            } else if (header.type == lilypad::MsgType::AUTH_TOKEN_LOGIN_REQ) {
-                // Rate limit check
-                if (!check_rate_limit(peer_ip)) {
-                    auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::ERR_RATE_LIMITED,
-                                                                     0, 0, std::vector<uint8_t>(32, 0).data(),
-                                                                     "Too many failed attempts. Try again later.");
-                    tls.send_all(resp);
-                    continue;
-                }
-
-                // Parse: username\0 + token(32)
-                const char* p = reinterpret_cast<const char*>(payload.data());
-                std::string username(p);
-                size_t token_offset = username.size() + 1;
-                if (token_offset + lilypad::SESSION_TOKEN_SIZE > payload.size()) {
-                    auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
-                                                                     0, 0, std::vector<uint8_t>(32, 0).data(),
-                                                                     "Invalid request");
-                    tls.send_all(resp);
-                    continue;
-                }
-                const uint8_t* raw_token = payload.data() + token_offset;
-
-                auto result = g_auth_db->validate_token(username, raw_token);
-                if (!result.success) {
-                    record_auth_failure(peer_ip);
-                    auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::ERR_TOKEN_EXPIRED,
-                                                                     0, 0, std::vector<uint8_t>(32, 0).data(),
-                                                                     result.message);
-                    tls.send_all(resp);
-                    continue;
-                }
-
-                // Setup client
-                if (!setup_authenticated_client(std::move(tls), result.username, result.user_id, client_id)) {
-                    break;
-                }
-
-                // Send AUTH_TOKEN_LOGIN_RESP
-                {
-                    std::lock_guard<std::mutex> lock(g_clients_mutex);
-                    auto it = g_clients.find(client_id);
-                    if (it != g_clients.end()) {
-                        auto resp = lilypad::make_auth_token_login_resp(lilypad::AuthStatus::OK,
-                                                                         client_id, UDP_PORT, result.new_token.data(),
-                                                                         "Token login successful");
-                        it->second.tls_socket.send_all(resp);
-                    }
-                }
-
-                authenticated = true;
-                std::cout << "[Server] " << result.username << " (id=" << client_id << ") token-authenticated.\n";
-
-            } else {
-                // Unknown message type during auth handshake, reject
-                break;
-            }
-        }
-
-        if (!authenticated) continue;
-
-        // Spawn dedicated read thread
-        {
-            std::lock_guard<std::mutex> lock(g_client_threads_mutex);
-            g_client_threads.emplace_back(client_read_loop, client_id);
+// ── GOP cache: the last keyframe and every frame since, for instant joins ──
+// One per simulcast layer. Returns the frame's sequence number (0 if the sharer
+// is gone); the sequence runs across layers, so a connection that got a replay
+// can tell which live frames it already has whatever their layer.
+static uint64_t cache_screen_frame(uint32_t sharer_id, const lilypad::SharedBuffer& relay,
+                                   bool is_keyframe, uint8_t layer) {
+    auto snap = g_registry.snapshot();
+    const lilypad::ClientView* sharer = snap->find(sharer_id);
+    if (!sharer) return 0;
+
+    auto& cache = *sharer->screen_cache;
+    auto& gop   = cache.gop[layer];
+    std::lock_guard<std::mutex> cache_lock(cache.mutex);
+    uint64_t seq = cache.next_seq++;
+    cache.layers.on_frame(layer, relay.size(), std::chrono::steady_clock::now());
+    if (is_keyframe) {
+        gop.frames.clear();
+        gop.bytes    = 0;
+        gop.complete = true;
+    }
+    if (gop.complete && (is_keyframe || !gop.frames.empty())) {
+        if (gop.bytes + relay.size() <= lilypad::GOP_CACHE_LIMIT) {
+            gop.frames.push_back(relay);
+            gop.bytes += relay.size();
+        } else {
+            gop.complete = false;
         }
     }
+    return seq;
 }
 
-// ── Screen relay thread helper: send with timeout via SO_SNDTIMEO ──
-// TLS doesn't work with non-blocking send approach, so use send timeout instead.
-static bool tls_send_with_timeout(lilypad::TlsSocket& tls, const uint8_t* data, size_t len) {
-    // SO_SNDTIMEO is set on the socket level, SSL_write will respect it
-    return tls.send_all(data, len);
+// ── Replay every layer's GOP to a peer server (it picks layers for its own viewers) ──
+// Caller holds the cache mutex. Returns false if some layer being sent has no
+// complete GOP to start from, so the sharer should be asked for a keyframe.
+static bool send_all_gops(lilypad::ClientConnection& link, uint32_t sharer_id, lilypad::ScreenCache& cache) {
+    uint8_t live   = cache.layers.live(std::chrono::steady_clock::now());
+    bool    usable = live != 0;
+    for (uint8_t layer = 0; layer < lilypad::SCREEN_LAYER_COUNT; ++layer) {
+        const auto& gop = cache.gop[layer];
+        if (!gop.frames.empty()) link.send_gop(sharer_id, layer, gop.frames, cache.next_seq - 1, gop.complete);
+        if ((live & (1u << layer)) && (gop.frames.empty() || !gop.complete)) usable = false;
+    }
+    return usable;
 }
 
 // ── Thread 2: Dedicated screen relay thread ──
+// Queues every item on each subscriber's connection in its priority class; each
+// connection then applies its own drop policy, so one slow viewer only loses its
+// own frames. Peer servers watching a local sharer are fed the same way, once
+// per server however many of its clients watch.
 static void screen_relay_loop() {
+    LP_TRACE_THREAD("screen_relay");
+    std::vector<const lilypad::ClientView*> recipients;
+
     while (g_running) {
-        std::vector<RelayItem> audio_items;
-        std::vector<RelayItem> frame_items;
+        std::deque<RelayItem> items;
 
         {
             std::unique_lock<std::mutex> lock(g_relay_mutex);
@@ -540,356 +830,571 @@ static void screen_relay_loop() {
                 return !g_relay_queue.empty() || !g_running;
             });
             if (!g_running && g_relay_queue.empty()) break;
-
-            for (auto& item : g_relay_queue) {
-                if (item.is_audio)
-                    audio_items.push_back(std::move(item));
-                else
-                    frame_items.push_back(std::move(item));
-            }
-            g_relay_queue.clear();
+            items.swap(g_relay_queue);
+            lilypad::metric_set(lilypad::Gauge::SCREEN_RELAY_QUEUE_DEPTH, 0);
         }
+        if (!items.empty()) LP_TRACE_INSTANT("relay.dequeue", items.size());
+
+        auto snap = g_registry.snapshot();
+        for (auto& item : items) {
+            LP_TRACE_SCOPE_ARG("relay.fanout", item.sharer_id);
+            const lilypad::ClientView* sharer = snap->find(item.sharer_id);
+            if (!sharer) {
+                if (!item.gap) lilypad::metric_add(lilypad::Counter::DROP_SHARER_GONE);
+                continue;
+            }
 
-        // Helper: collect subscriber TLS sockets with SO_SNDTIMEO set
-        auto send_to_subscribers = [](uint32_t sharer_id, const uint8_t* data, size_t len, bool set_timeout) {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(sharer_id);
-            if (it == g_clients.end()) return;
-            for (uint32_t sub_id : it->second.screen_subscribers) {
-                auto sub_it = g_clients.find(sub_id);
-                if (sub_it == g_clients.end()) continue;
-
-                if (set_timeout) {
-                    // Set 50ms send timeout for video frames
-                    DWORD timeout_ms = 50;
-                    setsockopt(sub_it->second.tls_socket.get(), SOL_SOCKET, SO_SNDTIMEO,
-                               reinterpret_cast<const char*>(&timeout_ms), sizeof(timeout_ms));
+            // Viewers the media relay serves skip what it already sent them
+            auto via_udp = [&](const lilypad::ClientView& sub) {
+                return item.from_udp && sub.media_stream == item.sharer_id;
+            };
+
+            // A frame lost over UDP: everyone fed from here is missing a reference
+            // now, so hold their deltas until the keyframe asked for below
+            if (item.gap) {
+                for (uint32_t sub_id : sharer->screen_subscribers) {
+                    const lilypad::ClientView* sub = snap->find(sub_id);
+                    if (sub && !via_udp(*sub)) sub->conn->desync_stream(item.sharer_id, item.layer);
                 }
+                for (uint32_t node : sharer->peer_subscribers) {
+                    const lilypad::PeerView* peer = snap->find_peer(node);
+                    if (peer) peer->conn->desync_stream(item.sharer_id, item.layer);
+                }
+                request_keyframe_throttled(*sharer);
+                continue;
+            }
 
-                sub_it->second.tls_socket.send_all(data, len);
+            // Each local viewer gets one layer of the video. One moving to another
+            // layer does so at that layer's keyframe, dropping what it still had
+            // queued of the old one.
+            auto& cache = *sharer->screen_cache;
+            auto  now   = std::chrono::steady_clock::now();
+            recipients.clear();
+            {
+                std::unique_lock<std::mutex> cache_lock(cache.mutex, std::defer_lock);
+                if (!item.is_audio) cache_lock.lock();
+                for (uint32_t sub_id : sharer->screen_subscribers) {
+                    const lilypad::ClientView* sub = snap->find(sub_id);
+                    if (!sub || via_udp(*sub)) continue;
+                    if (!item.is_audio) {
+                        auto& v = cache.viewer_layers[sub_id];
+                        if (item.layer != v.current) {
+                            if (!item.is_keyframe || item.layer != v.target) continue;
+                            sub->conn->drop_layer(item.sharer_id, v.current);
+                            v.current     = item.layer;
+                            v.switched_at = now;
+                        }
+                    }
+                    recipients.push_back(sub);
+                }
+            }
 
-                if (set_timeout) {
-                    // Reset send timeout
-                    DWORD timeout_ms = 0;
-                    setsockopt(sub_it->second.tls_socket.get(), SOL_SOCKET, SO_SNDTIMEO,
-                               reinterpret_cast<const char*>(&timeout_ms), sizeof(timeout_ms));
+            auto cls = item.is_audio    ? lilypad::SendClass::SCREEN_AUDIO
+                     : item.is_keyframe ? lilypad::SendClass::KEYFRAME
+                                        : lilypad::SendClass::DELTA;
+
+            // Whatever a connection accepts counts as relayed; what it sheds later
+            // is counted by the connection under its drop reason
+            bool     need_keyframe = false;
+            uint64_t accepted      = 0;
+            auto send = [&](lilypad::ClientConnection& conn) {
+                if (conn.send_media(cls, item.sharer_id, item.data, item.seq, item.layer)) {
+                    accepted++;
+                    return true;
+                }
+                if (cls == lilypad::SendClass::DELTA) need_keyframe = true;
+                return false;
+            };
+            for (const lilypad::ClientView* sub : recipients) {
+                // A viewer whose queue is backing up is moved down a layer
+                // straight away rather than at its next report
+                if (!send(*sub->conn) && cls == lilypad::SendClass::DELTA &&
+                    sub->conn->queued_bytes() > lilypad::SIMULCAST_QUEUE_BACKLOG) {
+                    std::lock_guard<std::mutex> cache_lock(cache.mutex);
+                    lilypad::step_down(cache.viewer_layers[sub->id], cache.layers, now);
                 }
             }
-        };
+            for (uint32_t node : sharer->peer_subscribers) {
+                const lilypad::PeerView* peer = snap->find_peer(node);
+                if (peer) send(*peer->conn);
+            }
+            if (accepted > 0) {
+                lilypad::metric_add(item.is_audio ? lilypad::Counter::SCREEN_AUDIO_RELAYED
+                                                  : lilypad::Counter::SCREEN_FRAMES_RELAYED, accepted);
+                lilypad::metric_add(item.is_audio ? lilypad::Counter::SCREEN_AUDIO_BYTES_RELAYED
+                                                  : lilypad::Counter::SCREEN_FRAME_BYTES_RELAYED,
+                                    accepted * item.data.size());
+            }
 
-        // Send audio first (high priority) — blocking sends (small packets)
-        for (auto& item : audio_items) {
-            send_to_subscribers(item.sharer_id, item.data.data(), item.data.size(), false);
+            if (need_keyframe) request_keyframe_throttled(*sharer);
         }
+    }
+}
 
-        // For video, only send the NEWEST frame per sharer
+// ── A frame the media relay reassembled from a sharer's UDP stream ──
+// Goes the same way as one received over TLS (GOP cache, TCP viewers, peers),
+// minus the viewers the media relay has already sent it to.
+static void on_media_frame(uint32_t sharer_id, lilypad::MediaType type, lilypad::MediaFrame& frame) {
+    bool    is_audio = type == lilypad::MediaType::AUDIO;
+    uint8_t layer    = lilypad::screen_layer(frame.flags);
+    if (frame.lost) {
+        if (is_audio) return;  // audio frames stand alone; viewers conceal the gap
         {
-            std::unordered_map<uint32_t, size_t> newest;
-            for (size_t i = 0; i < frame_items.size(); ++i) {
-                newest[frame_items[i].sharer_id] = i;
+            auto snap = g_registry.snapshot();
+            const lilypad::ClientView* sharer = snap->find(sharer_id);
+            if (!sharer) return;
+            std::lock_guard<std::mutex> cache_lock(sharer->screen_cache->mutex);
+            sharer->screen_cache->gop[layer].complete = false;  // replays wait for the next keyframe
+        }
+        {
+            std::lock_guard<std::mutex> lock(g_relay_mutex);
+            g_relay_queue.push_back({lilypad::SharedBuffer(), sharer_id, false, false, 0, layer, true, true});
+        }
+        g_relay_cv.notify_one();
+        return;
+    }
+    if (!is_audio && frame.data.size() < 5) return;
+
+    std::vector<uint8_t> msg(lilypad::SCREEN_RELAY_PREFIX + frame.data.size());
+    lilypad::write_screen_relay_prefix(msg.data(), is_audio ? lilypad::MsgType::SCREEN_AUDIO
+                                                            : lilypad::MsgType::SCREEN_FRAME,
+                                       sharer_id, frame.data.size());
+    std::memcpy(msg.data() + lilypad::SCREEN_RELAY_PREFIX, frame.data.data(), frame.data.size());
+    lilypad::SharedBuffer relay(std::move(msg));
+    if (is_audio) {
+        enqueue_relay(std::move(relay), sharer_id, true, false, 0, 0, true);
+        return;
+    }
+    bool     is_keyframe = (frame.data[4] & lilypad::SCREEN_FLAG_KEYFRAME) != 0;
+    uint64_t seq         = cache_screen_frame(sharer_id, relay, is_keyframe, layer);
+    enqueue_relay(std::move(relay), sharer_id, false, is_keyframe, seq, layer, true);
+}
+
+// ── Messages from a peer server (runs on the link's IoWorker thread) ──
+// A peer only speaks for its own clients, whose ids carry its node id.
+static void handle_peer_message(lilypad::ClientConnection& link,
+                                const lilypad::SignalHeader& header,
+                                lilypad::MutableBuffer& payload) {
+    const uint32_t node = lilypad::peer_link_node(link.id());
+    if (payload.size() < 4) return;
+    const uint32_t subject_id = lilypad::read_u32(payload.data());
+    const bool     theirs     = (subject_id >> lilypad::NODE_ID_SHIFT) == node;
+
+    if (header.type == lilypad::MsgType::USER_JOINED && theirs) {
+        std::string username(reinterpret_cast<const char*>(payload.data() + 4));
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            auto peer_it = txn.peers().find(node);
+            if (peer_it == txn.peers().end() || txn.find(subject_id)) return;
+            const lilypad::PeerView* peer = peer_it->second.get();
+            lilypad::ClientView info;
+            info.id           = subject_id;
+            info.username     = username;
+            info.conn         = peer->conn;
+            info.screen_cache = std::make_shared<lilypad::ScreenCache>();
+            info.udp_addr     = peer->udp_addr;  // their voice arrives from the peer's relay
+            info.home_node    = node;
+            broadcast_tcp(txn.clients(), lilypad::make_user_joined_msg(subject_id, username));
+            txn.insert(std::move(info));
+        });
+    } else if (header.type == lilypad::MsgType::USER_LEFT && theirs) {
+        std::string name;
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            remove_client_locked(txn, subject_id, name);
+        });
+    } else if (header.type == lilypad::MsgType::VOICE_JOINED && theirs) {
+        std::string room(reinterpret_cast<const char*>(payload.data() + 4), payload.size() - 4);
+        if (!lilypad::is_valid_voice_room(room)) return;
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            if (lilypad::ClientView* user = txn.edit(subject_id)) {
+                user->voice_room = room;
+                broadcast_tcp(txn.clients(), lilypad::make_voice_joined_broadcast(subject_id, room));
+            }
+        });
+    } else if (header.type == lilypad::MsgType::VOICE_LEFT && theirs) {
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            const lilypad::ClientView* current = txn.find(subject_id);
+            if (!current || !current->in_voice()) return;
+            lilypad::ClientView* user = txn.edit(subject_id);
+            std::string left = std::move(user->voice_room);
+            user->voice_room.clear();
+            broadcast_tcp(txn.clients(), lilypad::make_voice_left_broadcast(subject_id, left));
+        });
+    } else if (header.type == lilypad::MsgType::SCREEN_START && theirs) {
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            if (lilypad::ClientView* user = txn.edit(subject_id)) {
+                user->screen_sharing = true;
+                broadcast_tcp(txn.clients(), lilypad::make_screen_start_broadcast(subject_id));
             }
-            for (auto& [id, idx] : newest) {
-                auto& item = frame_items[idx];
-                send_to_subscribers(item.sharer_id, item.data.data(), item.data.size(), true);
+        });
+    } else if (header.type == lilypad::MsgType::SCREEN_STOP && theirs) {
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            stop_screen_share(txn, subject_id);
+        });
+    } else if ((header.type == lilypad::MsgType::SCREEN_FRAME && payload.size() >= 9) ||
+               (header.type == lilypad::MsgType::SCREEN_AUDIO && payload.size() > 4)) {
+        // Already in relay form minus the header: [sharer_id:4][body]
+        if (!theirs) return;
+        bool    is_audio    = header.type == lilypad::MsgType::SCREEN_AUDIO;
+        bool    is_keyframe = !is_audio && (payload[8] & lilypad::SCREEN_FLAG_KEYFRAME) != 0;
+        uint8_t layer       = is_audio ? 0 : lilypad::screen_layer(payload[8]);
+        size_t  body_len    = payload.size() - 4;
+        lilypad::write_screen_relay_prefix(payload.prepend(lilypad::SIGNAL_HEADER_SIZE),
+                                           header.type, subject_id, body_len);
+        lilypad::SharedBuffer relay = payload.freeze();
+        uint64_t seq = is_audio ? 0 : cache_screen_frame(subject_id, relay, is_keyframe, layer);
+        enqueue_relay(std::move(relay), subject_id, is_audio, is_keyframe, seq, layer);
+    } else if (header.type == lilypad::MsgType::SCREEN_SUBSCRIBE) {
+        // Some of the peer's clients watch one of ours
+        std::shared_ptr<lilypad::ScreenCache>      cache;
+        std::shared_ptr<lilypad::ClientConnection> sharer_conn;
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            const lilypad::ClientView* sharer = txn.find(subject_id);
+            if (!sharer || !sharer->local() || !sharer->screen_sharing) return;
+            lilypad::ClientView* target = txn.edit(subject_id);
+            add_subscriber(target->peer_subscribers, node);
+            cache       = target->screen_cache;
+            sharer_conn = target->conn;
+        });
+        if (cache) {
+            std::lock_guard<std::mutex> cache_lock(cache->mutex);
+            if (!send_all_gops(link, subject_id, *cache)) {
+                sharer_conn->send(lilypad::make_screen_request_keyframe_msg());
             }
         }
+    } else if (header.type == lilypad::MsgType::SCREEN_UNSUBSCRIBE) {
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            const lilypad::ClientView* sharer = txn.find(subject_id);
+            if (sharer && sharer->local()) {
+                remove_subscriber(txn.edit(subject_id)->peer_subscribers, node);
+            }
+            link.drop_stream(subject_id);
+        });
+    } else if (header.type == lilypad::MsgType::SCREEN_REQUEST_KEYFRAME) {
+        auto snap = g_registry.snapshot();
+        const lilypad::ClientView* sharer = snap->find(subject_id);
+        if (sharer && sharer->local()) request_keyframe(*sharer);
     }
 }
 
-// ── Per-client read loop ──
-static void client_read_loop(uint32_t id) {
-    while (g_running) {
-        SOCKET raw_sock = INVALID_SOCKET;
-        {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it == g_clients.end()) return;
-            raw_sock = it->second.tls_socket.get();
+// ── A peer link came up (on a federation thread) ──
+// Registers the peer and sends it our own clients; it does the same for us.
+static void add_peer_link(uint32_t node, lilypad::TlsSocket&& tls, const sockaddr_in& peer_udp) {
+    tls.set_nonblocking();
+    auto link = std::make_shared<lilypad::ClientConnection>(lilypad::peer_link_id(node), std::move(tls));
+
+    g_registry.update([&](lilypad::RegistryTxn& txn) {
+        lilypad::PeerView peer;
+        peer.node     = node;
+        peer.conn     = link;
+        peer.udp_addr = peer_udp;
+        txn.set_peer(std::move(peer));
+
+        for (auto& [id, c] : txn.clients()) {
+            if (!c->local()) continue;
+            link->send(lilypad::make_user_joined_msg(c->id, c->username));
+            if (c->in_voice()) link->send(lilypad::make_voice_joined_broadcast(c->id, c->voice_room));
+            if (c->screen_sharing) link->send(lilypad::make_screen_start_broadcast(c->id));
         }
-        if (raw_sock == INVALID_SOCKET) return;
+    });
 
-        fd_set read_set;
-        FD_ZERO(&read_set);
-        FD_SET(raw_sock, &read_set);
+    g_io_pool->adopt(std::move(link));
+}
 
-        timeval timeout{};
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 200000; // 200ms
+// ── A peer link closed: its clients leave with it ──
+static void drop_peer_link(uint32_t node) {
+    size_t dropped = 0;
+    g_registry.update([&](lilypad::RegistryTxn& txn) {
+        if (!txn.erase_peer(node)) return;
+
+        std::vector<uint32_t> remote;
+        std::vector<uint32_t> watched;
+        for (auto& [id, c] : txn.clients()) {
+            if (c->home_node == node) remote.push_back(id);
+            else if (std::binary_search(c->peer_subscribers.begin(), c->peer_subscribers.end(), node))
+                watched.push_back(id);
+        }
+        std::string name;
+        for (uint32_t id : remote) {
+            if (remove_client_locked(txn, id, name)) dropped++;
+        }
+        for (uint32_t id : watched) {
+            remove_subscriber(txn.edit(id)->peer_subscribers, node);
+        }
+    });
+    std::cout << "[Federation] Link to node " << node << " closed (" << dropped << " users dropped)\n";
+    if (g_federation) g_federation->link_closed(node);
+}
 
-        int ready = select(0, &read_set, nullptr, nullptr, &timeout);
-        if (ready <= 0) continue;
+// ── Per-client message handler (runs on the connection's IoWorker thread) ──
+static void handle_client_message(lilypad::ClientConnection& conn,
+                                  const lilypad::SignalHeader& header,
+                                  lilypad::MutableBuffer& payload) {
+    const uint32_t id = conn.id();
+    if (lilypad::is_peer_link(id)) {
+        handle_peer_message(conn, header, payload);
+        return;
+    }
 
-        // Read header via TLS
-        uint8_t hdr_buf[lilypad::SIGNAL_HEADER_SIZE];
+    if (header.type == lilypad::MsgType::LEAVE) {
+        remove_client(id);
+        return;
+    } else if (header.type == lilypad::MsgType::TEXT_CHAT && !payload.empty()) {
+        std::string text(reinterpret_cast<const char*>(payload.data()));
+        std::string sender_name;
+        auto snap = g_registry.snapshot();
+        if (const lilypad::ClientView* self = snap->find(id))
+            sender_name = self->username;
+        else
+            sender_name = "User #" + std::to_string(id);
+        ChatEntry ce;
+        int64_t now_ts = static_cast<int64_t>(std::time(nullptr));
         {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it == g_clients.end()) return;
-            if (!it->second.tls_socket.recv_all(hdr_buf, lilypad::SIGNAL_HEADER_SIZE)) {
-                lock.~lock_guard();
-                remove_client(id);
-                return;
-            }
+            std::lock_guard<std::mutex> chat_lock(g_chat_mutex);
+            ce.seq         = g_next_seq++;
+            ce.sender_name = sender_name;
+            ce.timestamp   = now_ts;
+            ce.text        = text;
+            g_chat_history.push_back(ce);
         }
-
-        auto header = lilypad::deserialize_header(hdr_buf);
-
-        // Read payload
-        std::vector<uint8_t> payload;
-        if (header.payload_len > 0) {
-            payload.resize(header.payload_len);
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it == g_clients.end()) return;
-            if (!it->second.tls_socket.recv_all(payload.data(), header.payload_len)) {
-                lock.~lock_guard();
-                remove_client(id);
-                return;
+        append_chat_to_file(ce);
+        auto broadcast = lilypad::make_text_chat_broadcast_v2(
+            ce.seq, id, ce.timestamp, ce.sender_name, ce.text);
+        broadcast_tcp(g_registry.snapshot()->clients, std::move(broadcast));
+    } else if (header.type == lilypad::MsgType::VOICE_JOIN) {
+        // Joining while in another room moves the client; receivers just update it
+        std::string room(reinterpret_cast<const char*>(payload.data()), payload.size());
+        if (room.empty()) room = lilypad::DEFAULT_VOICE_ROOM;
+        if (!lilypad::is_valid_voice_room(room)) return;
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            if (lilypad::ClientView* self = txn.edit(id)) {
+                self->voice_room = room;
+                broadcast_event(txn, *self, lilypad::make_voice_joined_broadcast(id, room));
             }
-        }
-
-        if (header.type == lilypad::MsgType::LEAVE) {
-            remove_client(id);
-            return;
-        } else if (header.type == lilypad::MsgType::TEXT_CHAT && !payload.empty()) {
-            std::string text(reinterpret_cast<const char*>(payload.data()));
-            std::string sender_name;
-            {
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto cit = g_clients.find(id);
-                if (cit != g_clients.end())
-                    sender_name = cit->second.username;
-                else
-                    sender_name = "User #" + std::to_string(id);
+        });
+    } else if (header.type == lilypad::MsgType::VOICE_LEAVE) {
+        // A stale leave for a room the client already moved out of is ignored
+        std::string room(reinterpret_cast<const char*>(payload.data()), payload.size());
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            const lilypad::ClientView* current = txn.find(id);
+            if (!current || !current->in_voice()) return;
+            if (!room.empty() && room != current->voice_room) return;
+            lilypad::ClientView* self = txn.edit(id);
+            std::string left = std::move(self->voice_room);
+            self->voice_room.clear();
+            broadcast_event(txn, *self, lilypad::make_voice_left_broadcast(id, left));
+        });
+    } else if (header.type == lilypad::MsgType::VOICE_LOSS_REPORT && payload.size() >= 5) {
+        // Passed on to the talker, who sizes its FEC for its worst listener. Only
+        // between members of one room, and only to local talkers: a peer server's
+        // talkers are reached through that server's relay, not ours.
+        uint32_t sender_id = lilypad::read_u32(payload.data());
+        uint8_t  loss_pct  = (std::min)(payload[4], static_cast<uint8_t>(100));
+        auto snap = g_registry.snapshot();
+        const lilypad::ClientView* self   = snap->find(id);
+        const lilypad::ClientView* sender = snap->find(sender_id);
+        if (self && sender && sender_id != id && sender->local() && self->in_voice() &&
+            sender->voice_room == self->voice_room)
+            sender->conn->send(lilypad::make_voice_loss_report_msg(id, loss_pct));
+    } else if (header.type == lilypad::MsgType::CHAT_SYNC && payload.size() >= 8) {
+        uint64_t last_seq = lilypad::read_u64(payload.data());
+        std::lock_guard<std::mutex> chat_lock(g_chat_mutex);
+        for (auto& entry : g_chat_history) {
+            if (entry.seq > last_seq) {
+                conn.send(lilypad::make_text_chat_broadcast_v2(
+                    entry.seq, 0, entry.timestamp, entry.sender_name, entry.text));
             }
-            ChatEntry ce;
-            int64_t now_ts = static_cast<int64_t>(std::time(nullptr));
-            {
-                std::lock_guard<std::mutex> chat_lock(g_chat_mutex);
-                ce.seq         = g_next_seq++;
-                ce.sender_name = sender_name;
-                ce.timestamp   = now_ts;
-                ce.text        = text;
-                g_chat_history.push_back(ce);
-            }
-            append_chat_to_file(ce);
-            auto broadcast = lilypad::make_text_chat_broadcast_v2(
-                ce.seq, id, ce.timestamp, ce.sender_name, ce.text);
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            broadcast_tcp(broadcast);
-        } else if (header.type == lilypad::MsgType::VOICE_JOIN) {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it != g_clients.end()) {
-                it->second.in_voice = true;
-                auto msg = lilypad::make_voice_joined_broadcast(id);
-                broadcast_tcp(msg);
-            }
-        } else if (header.type == lilypad::MsgType::VOICE_LEAVE) {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it != g_clients.end()) {
-                it->second.in_voice = false;
-                auto msg = lilypad::make_voice_left_broadcast(id);
-                broadcast_tcp(msg);
-            }
-        } else if (header.type == lilypad::MsgType::CHAT_SYNC && payload.size() >= 8) {
-            uint64_t last_seq = lilypad::read_u64(payload.data());
-            std::lock_guard<std::mutex> chat_lock(g_chat_mutex);
-            for (auto& entry : g_chat_history) {
-                if (entry.seq > last_seq) {
-                    auto msg = lilypad::make_text_chat_broadcast_v2(
-                        entry.seq, 0, entry.timestamp, entry.sender_name, entry.text);
-                    std::lock_guard<std::mutex> lock(g_clients_mutex);
-                    auto cit = g_clients.find(id);
-                    if (cit != g_clients.end()) {
-                        cit->second.tls_socket.send_all(msg);
-                    }
-                }
+        }
+    } else if (header.type == lilypad::MsgType::SCREEN_START) {
+        // Fresh UDP media keys per share; handed out on SCREEN_MEDIA_REQ
+        std::shared_ptr<lilypad::MediaKeys> keys;
+        if (g_media_port != 0) {
+            keys = std::make_shared<lilypad::MediaKeys>();
+            randombytes_buf(keys->sender.data(), keys->sender.size());
+            randombytes_buf(keys->viewer.data(), keys->viewer.size());
+        }
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            if (lilypad::ClientView* self = txn.edit(id)) {
+                self->screen_sharing = true;
+                self->media_keys     = keys;
+                broadcast_event(txn, *self, lilypad::make_screen_start_broadcast(id));
             }
-        } else if (header.type == lilypad::MsgType::SCREEN_START) {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it != g_clients.end()) {
-                it->second.screen_sharing = true;
-                auto msg = lilypad::make_screen_start_broadcast(id);
-                broadcast_tcp(msg);
-            }
-        } else if (header.type == lilypad::MsgType::SCREEN_STOP) {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(id);
-            if (it != g_clients.end()) {
-                it->second.screen_sharing = false;
-                it->second.screen_subscribers.clear();
-                it->second.cached_keyframe.clear();
-                auto msg = lilypad::make_screen_stop_broadcast(id);
-                broadcast_tcp(msg);
-            }
-        } else if (header.type == lilypad::MsgType::SCREEN_SUBSCRIBE && payload.size() >= 4) {
-            uint32_t target_id = lilypad::read_u32(payload.data());
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(target_id);
-            if (it != g_clients.end() && it->second.screen_sharing) {
-                it->second.screen_subscribers.insert(id);
-                auto sub_it = g_clients.find(id);
-                if (sub_it != g_clients.end()) {
-                    if (!it->second.cached_keyframe.empty()) {
-                        sub_it->second.tls_socket.send_all(it->second.cached_keyframe);
-                    } else {
-                        auto req = lilypad::make_screen_request_keyframe_msg();
-                        it->second.tls_socket.send_all(req);
-                    }
-                }
+        });
+    } else if (header.type == lilypad::MsgType::SCREEN_STOP) {
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            stop_screen_share(txn, id);
+        });
+    } else if (header.type == lilypad::MsgType::SCREEN_SUBSCRIBE && payload.size() >= 4) {
+        uint32_t target_id = lilypad::read_u32(payload.data());
+        std::shared_ptr<const lilypad::ClientView> sharer_view;
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            const lilypad::ClientView* sharer = txn.find(target_id);
+            if (!sharer || !sharer->screen_sharing) return;
+            const lilypad::ClientView* self = txn.find(id);
+            if (self && self->media_stream == target_id) txn.edit(id)->media_stream = 0;  // TCP until its next keepalive
+            lilypad::ClientView* target = txn.edit(target_id);
+            bool first = target->screen_subscribers.empty();
+            add_subscriber(target->screen_subscribers, id);
+            if (!target->local() && first) {
+                // Nothing cached here yet: the sharer's server replays its GOP to us
+                target->conn->send(lilypad::make_screen_subscribe_msg(target_id));
+                return;
             }
-        } else if (header.type == lilypad::MsgType::SCREEN_UNSUBSCRIBE && payload.size() >= 4) {
-            uint32_t target_id = lilypad::read_u32(payload.data());
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(target_id);
-            if (it != g_clients.end()) {
-                it->second.screen_subscribers.erase(id);
-            }
-        } else if (header.type == lilypad::MsgType::SCREEN_FRAME && payload.size() >= 5) {
-            uint16_t w = lilypad::read_u16(payload.data());
-            uint16_t h = lilypad::read_u16(payload.data() + 2);
-            uint8_t flags = payload[4];
-            const uint8_t* frame_data = payload.data() + 5;
-            size_t frame_len = payload.size() - 5;
-
-            bool is_keyframe = (flags & lilypad::SCREEN_FLAG_KEYFRAME) != 0;
-
-            auto relay = lilypad::make_screen_frame_relay(id, w, h, flags, frame_data, frame_len);
-
-            if (is_keyframe) {
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) {
-                    it->second.cached_keyframe = relay;
+            sharer_view = txn.clients().at(target_id);
+        });
+
+        // Replay the cached GOP only once the subscription is published: every frame
+        // cached after this point is fanned out live, and the frame sequence numbers
+        // let the connection skip ones it already got from the replay. A new viewer
+        // aims for the best layer but starts from the best one it can see at once.
+        if (sharer_view) {
+            auto& cache = *sharer_view->screen_cache;
+            auto  now   = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> cache_lock(cache.mutex);
+            uint8_t live = cache.layers.live(now);
+            auto&   v    = cache.viewer_layers[id];
+            v             = lilypad::ViewerLayer();
+            v.target      = lilypad::best_layer(live);
+            v.current     = v.target;
+            v.switched_at = now;
+            for (uint8_t layer = 0; layer < lilypad::SCREEN_LAYER_COUNT; ++layer) {
+                if ((live & (1u << layer)) && !cache.gop[layer].frames.empty() && cache.gop[layer].complete) {
+                    v.current = layer;
+                    break;
                 }
             }
-
-            enqueue_relay(std::move(relay), id, false, is_keyframe);
-        } else if (header.type == lilypad::MsgType::SCREEN_AUDIO && !payload.empty()) {
-            auto relay = lilypad::make_screen_audio_relay(id, payload.data(), payload.size());
-            enqueue_relay(std::move(relay), id, true);
-        } else if (header.type == lilypad::MsgType::AUTH_CHANGE_PASS_REQ) {
-            // Parse: old_password\0 + new_password\0
-            const char* p = reinterpret_cast<const char*>(payload.data());
-            std::string old_pass(p);
-            size_t new_offset = old_pass.size() + 1;
-            std::string new_pass;
-            if (new_offset < payload.size()) {
-                new_pass = std::string(reinterpret_cast<const char*>(payload.data() + new_offset));
+            const auto& gop = cache.gop[v.current];
+            if (!gop.frames.empty()) {
+                conn.send_gop(target_id, v.current, gop.frames, cache.next_seq - 1, gop.complete);
             }
-
-            int64_t db_user_id = 0;
-            {
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) db_user_id = it->second.db_user_id;
-            }
-
-            if (!lilypad::is_valid_password(new_pass)) {
-                auto resp = lilypad::make_auth_change_pass_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
-                                                                 "Password must be 8-128 characters");
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) it->second.tls_socket.send_all(resp);
-            } else {
-                auto result = g_auth_db->change_password(db_user_id, old_pass, new_pass);
-                auto status = result.success ? lilypad::AuthStatus::OK : lilypad::AuthStatus::ERR_INVALID_CREDS;
-                auto resp = lilypad::make_auth_change_pass_resp(status, result.message);
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) it->second.tls_socket.send_all(resp);
+            if (gop.frames.empty() || !gop.complete) {
+                request_keyframe(*sharer_view);
             }
-        } else if (header.type == lilypad::MsgType::AUTH_DELETE_ACCT_REQ) {
-            const char* p = reinterpret_cast<const char*>(payload.data());
-            std::string password(p);
-
-            int64_t db_user_id = 0;
-            {
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) db_user_id = it->second.db_user_id;
-            }
-
-            auto result = g_auth_db->delete_account(db_user_id, password);
-            auto status = result.success ? lilypad::AuthStatus::OK : lilypad::AuthStatus::ERR_INVALID_CREDS;
-            auto resp = lilypad::make_auth_delete_acct_resp(status, result.message);
-            {
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) it->second.tls_socket.send_all(resp);
-            }
-
-            if (result.success) {
-                remove_client(id);
-                return;
-            }
-        } else if (header.type == lilypad::MsgType::AUTH_LOGOUT) {
-            // Invalidate all sessions for this user
-            int64_t db_user_id = 0;
-            {
-                std::lock_guard<std::mutex> lock(g_clients_mutex);
-                auto it = g_clients.find(id);
-                if (it != g_clients.end()) db_user_id = it->second.db_user_id;
+        }
+    } else if (header.type == lilypad::MsgType::SCREEN_UNSUBSCRIBE && payload.size() >= 4) {
+        uint32_t target_id = lilypad::read_u32(payload.data());
+        g_registry.update([&](lilypad::RegistryTxn& txn) {
+            if (lilypad::ClientView* target = txn.edit(target_id)) {
+                if (remove_subscriber(target->screen_subscribers, id)) {
+                    {
+                        std::lock_guard<std::mutex> cache_lock(target->screen_cache->mutex);
+                        target->screen_cache->viewer_layers.erase(id);
+                    }
+                    release_remote_stream(txn, target_id);
+                }
             }
-            if (db_user_id > 0) {
-                g_auth_db->invalidate_all_sessions(db_user_id);
+            const lilypad::ClientView* self = txn.find(id);
+            if (self && self->media_stream == target_id) txn.edit(id)->media_stream = 0;
+            conn.drop_stream(target_id);
+        });
+    } else if (header.type == lilypad::MsgType::SCREEN_FRAME && payload.size() >= 5) {
+        uint8_t flags = payload[4];
+        bool    is_keyframe = (flags & lilypad::SCREEN_FLAG_KEYFRAME) != 0;
+        uint8_t layer       = lilypad::screen_layer(flags);
+
+        // The relay msg is the received payload with sharer_id prepended: write the
+        // prefix into the headroom and share that one allocation from here on.
+        size_t body_len = payload.size();
+        lilypad::write_screen_relay_prefix(payload.prepend(lilypad::SCREEN_RELAY_PREFIX),
+                                           lilypad::MsgType::SCREEN_FRAME, id, body_len);
+        lilypad::SharedBuffer relay = payload.freeze();
+        uint64_t seq = cache_screen_frame(id, relay, is_keyframe, layer);
+        enqueue_relay(std::move(relay), id, false, is_keyframe, seq, layer);
+    } else if (header.type == lilypad::MsgType::SCREEN_AUDIO && !payload.empty()) {
+        size_t body_len = payload.size();
+        lilypad::write_screen_relay_prefix(payload.prepend(lilypad::SCREEN_RELAY_PREFIX),
+                                           lilypad::MsgType::SCREEN_AUDIO, id, body_len);
+        enqueue_relay(payload.freeze(), id, true);
+    } else if (header.type == lilypad::MsgType::SCREEN_MEDIA_REQ && payload.size() >= 4) {
+        // The sharer gets the key it seals with; a subscriber the key its copy is sealed with
+        uint32_t stream_id = lilypad::read_u32(payload.data());
+        auto snap = g_registry.snapshot();
+        const lilypad::ClientView* sharer = snap->find(stream_id);
+        if (sharer && sharer->media_keys) {
+            if (stream_id == id) {
+                conn.send(lilypad::make_screen_media_key_msg(stream_id, g_media_port, sharer->media_keys->sender.data()));
+            } else if (std::binary_search(sharer->screen_subscribers.begin(), sharer->screen_subscribers.end(), id)) {
+                conn.send(lilypad::make_screen_media_key_msg(stream_id, g_media_port, sharer->media_keys->viewer.data()));
             }
-            remove_client(id);
-            return;
         }
-    }
-}
-
-// ── Thread 3: UDP voice relay ──
-static void udp_relay_loop(SOCKET udp_sock) {
-    uint8_t buf[lilypad::MAX_VOICE_PACKET];
-
-    while (g_running) {
-        fd_set read_set;
-        FD_ZERO(&read_set);
-        FD_SET(udp_sock, &read_set);
-
-        timeval timeout{};
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 200000;
-
-        int ready = select(0, &read_set, nullptr, nullptr, &timeout);
-        if (ready <= 0) continue;
-
-        sockaddr_in sender_addr{};
-        int addr_len = sizeof(sender_addr);
-        int received = recvfrom(udp_sock, reinterpret_cast<char*>(buf), sizeof(buf), 0,
-                                reinterpret_cast<sockaddr*>(&sender_addr), &addr_len);
-
-        if (received < static_cast<int>(lilypad::VOICE_HEADER_SIZE)) continue;
-
-        uint32_t sender_id = lilypad::read_u32(buf);
-
-        // Register the sender's UDP address on first packet
-        {
-            std::lock_guard<std::mutex> lock(g_clients_mutex);
-            auto it = g_clients.find(sender_id);
-            if (it == g_clients.end()) continue; // unknown client
+    } else if (header.type == lilypad::MsgType::SCREEN_REQUEST_KEYFRAME && payload.size() >= 4) {
+        // A UDP viewer lost a frame the parity couldn't rebuild
+        uint32_t target_id = lilypad::read_u32(payload.data());
+        auto snap = g_registry.snapshot();
+        const lilypad::ClientView* sharer = snap->find(target_id);
+        if (sharer && sharer->screen_sharing &&
+            std::binary_search(sharer->screen_subscribers.begin(), sharer->screen_subscribers.end(), id))
+            request_keyframe_throttled(*sharer);
+    } else if (header.type == lilypad::MsgType::SCREEN_RECEIVER_REPORT) {
+        // A viewer's report on the stream it watches: picks the layer it is sent,
+        // and feeds a local sharer's bitrate
+        lilypad::ScreenReceiverReport report;
+        if (!lilypad::parse_screen_receiver_report(payload.data(), payload.size(), report)) return;
+        auto snap = g_registry.snapshot();
+        const lilypad::ClientView* sharer = snap->find(report.sharer_id);
+        if (sharer && sharer->screen_sharing &&
+            std::binary_search(sharer->screen_subscribers.begin(), sharer->screen_subscribers.end(), id)) {
+            choose_viewer_layer(*sharer, id, conn, report);
+            if (sharer->local()) merge_receiver_report(*sharer, id, report);
+        }
+    } else if (header.type == lilypad::MsgType::AUTH_CHANGE_PASS_REQ) {
+        // Parse: old_password\0 + new_password\0
+        const char* p = reinterpret_cast<const char*>(payload.data());
+        std::string old_pass(p);
+        size_t new_offset = old_pass.size() + 1;
+        std::string new_pass;
+        if (new_offset < payload.size()) {
+            new_pass = std::string(reinterpret_cast<const char*>(payload.data() + new_offset));
+        }
 
-            if (!it->second.udp_known) {
-                it->second.udp_addr  = sender_addr;
-                it->second.udp_known = true;
-            }
+        int64_t db_user_id = 0;
+        std::shared_ptr<lilypad::ClientConnection> self_conn;
+        if (const lilypad::ClientView* self = g_registry.snapshot()->find(id)) {
+            db_user_id = self->db_user_id;
+            self_conn  = self->conn;
+        }
 
-            // Only relay voice if sender is in voice channel
-            if (!it->second.in_voice) continue;
+        if (!lilypad::is_valid_password(new_pass)) {
+            conn.send(lilypad::make_auth_change_pass_resp(lilypad::AuthStatus::ERR_INVALID_INPUT,
+                                                          "Password must be 8-128 characters"));
+        } else if (!self_conn || !g_auth_pool->submit([self_conn, db_user_id, old_pass, new_pass] {
+                       // Two Argon2 runs: keep them off the I/O thread
+                       auto result = g_auth_db->change_password(db_user_id, old_pass, new_pass);
+                       auto status = result.success ? lilypad::AuthStatus::OK : lilypad::AuthStatus::ERR_INVALID_CREDS;
+                       self_conn->send(lilypad::make_auth_change_pass_resp(status, result.message));
+                   })) {
+            conn.send(lilypad::make_auth_change_pass_resp(lilypad::AuthStatus::ERR_INVALID_CREDS,
+                                                          "Server busy, try again"));
+        }
+    } else if (header.type == lilypad::MsgType::AUTH_DELETE_ACCT_REQ) {
+        const char* p = reinterpret_cast<const char*>(payload.data());
+        std::string password(p);
+
+        int64_t db_user_id = 0;
+        std::shared_ptr<lilypad::ClientConnection> self_conn;
+        if (const lilypad::ClientView* self = g_registry.snapshot()->find(id)) {
+            db_user_id = self->db_user_id;
+            self_conn  = self->conn;
+        }
 
-            // Forward to all other clients with known UDP addresses that are in voice
-            for (auto& [cid, client] : g_clients) {
-                if (cid == sender_id || !client.udp_known || !client.in_voice) continue;
-                sendto(udp_sock, reinterpret_cast<const char*>(buf), received, 0,
-                       reinterpret_cast<const sockaddr*>(&client.udp_addr),
-                       sizeof(client.udp_addr));
-            }
+        if (!self_conn || !g_auth_pool->submit([self_conn, id, db_user_id, password] {
+                auto result = g_auth_db->delete_account(db_user_id, password);
+                auto status = result.success ? lilypad::AuthStatus::OK : lilypad::AuthStatus::ERR_INVALID_CREDS;
+                self_conn->send(lilypad::make_auth_delete_acct_resp(status, result.message));
+                if (result.success) remove_client(id);
+            })) {
+            conn.send(lilypad::make_auth_delete_acct_resp(lilypad::AuthStatus::ERR_INVALID_CREDS,
+                                                          "Server busy, try again"));
         }
+    } else if (header.type == lilypad::MsgType::AUTH_LOGOUT) {
+        // Invalidate all sessions for this user
+        int64_t db_user_id = 0;
+        if (const lilypad::ClientView* self = g_registry.snapshot()->find(id))
+            db_user_id = self->db_user_id;
+        if (db_user_id > 0) {
+            g_auth_db->invalidate_all_sessions(db_user_id);
+        }
+        remove_client(id);
+        return;
     }
 }
 
@@ -899,23 +1404,81 @@ static void session_cleanup_loop() {
         // Sleep for 1 hour, checking g_running every second
         for (int i = 0; i < 3600 && g_running; ++i) {
             std::this_thread::sleep_for(std::chrono::seconds(1));
+#ifdef LILYPAD_TRACE
+            lilypad::trace_poll();  // a requested trace dump is written from here
+#endif
         }
         if (!g_running) break;
         g_auth_db->cleanup_expired_sessions();
+        g_ticket_keys->rotate_if_due();
     }
 }
 
 int main(int argc, char* argv[]) {
     std::signal(SIGINT, signal_handler);
+#ifndef _WIN32
+    std::signal(SIGTERM, signal_handler);
+    std::signal(SIGPIPE, SIG_IGN);  // peer resets surface as SSL_write errors instead
+#endif
+#ifdef LILYPAD_TRACE
+    lilypad::trace_install_signal();
+#endif
 
     // Parse CLI args
     std::string cert_path = "server.crt";
     std::string key_path  = "server.key";
+    std::string ticket_keys_path = "server.tickets";
+    auto        cert_key_type    = lilypad::CertKeyType::RSA_2048;
+    size_t io_threads  = std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 8);
+    size_t udp_workers = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 8);
+    size_t auth_threads   = std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 8);
+    size_t auth_memory_mb = 1024;  // budget for concurrent Argon2 hashes
+    size_t mix_threshold  = 16;    // voice members at which the server mixes (0 = never)
+    size_t speakers       = 3;     // talkers forwarded to each listener (0 = all)
+    bool   relay_stats = false;
+    uint16_t tcp_port  = DEFAULT_TCP_PORT;
+    uint16_t peer_port = 0;                 // federation listener (0 = dial out only)
+    uint16_t metrics_port = 0;              // Prometheus endpoint on loopback (0 = off)
+    int      media_port   = -1;             // screen media over UDP (-1 = UDP port + 1, 0 = off)
+    std::string peer_secret;
+    std::vector<std::pair<std::string, uint16_t>> peers;
     for (int i = 1; i < argc; ++i) {
         std::string arg(argv[i]);
         if (arg == "--cert" && i + 1 < argc) cert_path = argv[++i];
         else if (arg == "--key" && i + 1 < argc) key_path = argv[++i];
+        else if (arg == "--ticket-keys" && i + 1 < argc) ticket_keys_path = argv[++i];
+        else if (arg == "--ecdsa") cert_key_type = lilypad::CertKeyType::ECDSA_P256;  // for newly generated certs
+        else if (arg == "--io-threads" && i + 1 < argc) io_threads = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--udp-workers" && i + 1 < argc) udp_workers = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--auth-threads" && i + 1 < argc) auth_threads = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--auth-memory-mb" && i + 1 < argc) auth_memory_mb = (std::max)(1, std::atoi(argv[++i]));
+        else if (arg == "--mix-threshold" && i + 1 < argc) mix_threshold = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--speakers" && i + 1 < argc) speakers = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--relay-stats") relay_stats = true;
+        else if (arg == "--ktls") g_ktls = true;
+        else if (arg == "--port" && i + 1 < argc) tcp_port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--udp-port" && i + 1 < argc) g_udp_port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--node-id" && i + 1 < argc) g_node_id = static_cast<uint32_t>((std::max)(0, std::atoi(argv[++i])));
+        else if (arg == "--peer-port" && i + 1 < argc) peer_port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--peer-secret" && i + 1 < argc) peer_secret = argv[++i];
+        else if (arg == "--metrics-port" && i + 1 < argc) metrics_port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (arg == "--media-port" && i + 1 < argc) media_port = (std::max)(0, std::atoi(argv[++i]));
+        else if (arg == "--peer" && i + 1 < argc) {
+            // host:port of another server's --peer-port
+            std::string spec(argv[++i]);
+            size_t colon = spec.rfind(':');
+            if (colon != std::string::npos)
+                peers.emplace_back(spec.substr(0, colon), static_cast<uint16_t>(std::atoi(spec.c_str() + colon + 1)));
+        }
+    }
+
+    bool federated = peer_port != 0 || !peers.empty();
+    if (federated && (g_node_id == 0 || g_node_id > lilypad::MAX_NODE_ID || peer_secret.empty())) {
+        std::cerr << "Federation needs --node-id 1-" << lilypad::MAX_NODE_ID << " and --peer-secret\n";
+        return 1;
     }
+    if (g_node_id > lilypad::MAX_NODE_ID) g_node_id = 0;
+    g_media_port = static_cast<uint16_t>(media_port < 0 ? g_udp_port + 1 : media_port);
 
     load_update_config();
     load_chat_history();
@@ -930,20 +1493,25 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        // Initialize auth database
-        g_auth_db = std::make_unique<lilypad::AuthDB>("lilypad.db");
+        // Initialize auth database. Each Argon2 run allocates its full memory cost,
+        // so the number allowed at once comes from the memory budget, not the thread count.
+        size_t hash_slots = std::clamp<size_t>(
+            auth_memory_mb * 1024 * 1024 / lilypad::AuthDB::hash_memory_per_op(), 1, auth_threads);
+        g_auth_db = std::make_unique<lilypad::AuthDB>("lilypad.db", hash_slots);
         g_auth_db->cleanup_expired_sessions();
 
         // Load or generate TLS certificate
-        if (!lilypad::load_or_generate_cert(cert_path, key_path)) {
+        if (!lilypad::load_or_generate_cert(cert_path, key_path, cert_key_type)) {
             std::cerr << "Failed to load/generate TLS certificate\n";
             return 1;
         }
-        g_ssl_ctx = lilypad::create_server_ssl_ctx(cert_path, key_path);
+        g_ssl_ctx = lilypad::create_server_ssl_ctx(cert_path, key_path, g_ktls);
         if (!g_ssl_ctx) {
             std::cerr << "Failed to create SSL context\n";
             return 1;
         }
+        g_ticket_keys = std::make_unique<lilypad::TicketKeyRing>(ticket_keys_path);
+        g_ticket_keys->install(g_ssl_ctx);
 
         // ── Create and bind TCP listen socket ──
         auto tcp_listen = lilypad::create_tcp_socket();
@@ -955,7 +1523,7 @@ int main(int argc, char* argv[]) {
         sockaddr_in tcp_addr{};
         tcp_addr.sin_family      = AF_INET;
         tcp_addr.sin_addr.s_addr = INADDR_ANY;
-        tcp_addr.sin_port        = htons(TCP_PORT);
+        tcp_addr.sin_port        = htons(tcp_port);
 
         if (bind(tcp_listen.get(), reinterpret_cast<sockaddr*>(&tcp_addr),
                  sizeof(tcp_addr)) == SOCKET_ERROR) {
@@ -968,46 +1536,94 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        // ── Create and bind UDP socket ──
-        auto udp_sock = lilypad::create_udp_socket();
-
-        sockaddr_in udp_addr{};
-        udp_addr.sin_family      = AF_INET;
-        udp_addr.sin_addr.s_addr = INADDR_ANY;
-        udp_addr.sin_port        = htons(UDP_PORT);
+        // ── Bind UDP voice relay sockets (one per worker) ──
+        lilypad::VoiceRelay voice_relay(g_registry, relay_stats, mix_threshold, speakers);
+        if (!voice_relay.bind(g_udp_port, udp_workers)) {
+            return 1;
+        }
 
-        if (bind(udp_sock.get(), reinterpret_cast<sockaddr*>(&udp_addr),
-                 sizeof(udp_addr)) == SOCKET_ERROR) {
-            std::cerr << "UDP bind failed: " << WSAGetLastError() << "\n";
+        // ── Bind the UDP screen media relay ──
+        lilypad::MediaRelay media_relay(g_registry, on_media_frame, [](uint32_t sharer_id) {
+            auto snap = g_registry.snapshot();
+            if (const lilypad::ClientView* sharer = snap->find(sharer_id)) request_keyframe_throttled(*sharer);
+        }, [](uint32_t sharer_id, const lilypad::ScreenReceiverReport& report) {
+            auto snap = g_registry.snapshot();
+            if (const lilypad::ClientView* sharer = snap->find(sharer_id)) merge_receiver_report(*sharer, 0, report);
+        });
+        if (g_media_port != 0 && !media_relay.bind(g_media_port)) {
             return 1;
         }
 
-        std::cout << "Listening on TCP port " << TCP_PORT
-                  << ", UDP port " << UDP_PORT << " (TLS enabled)\n";
+        std::cout << "Listening on TCP port " << tcp_port
+                  << ", UDP port " << g_udp_port << " (TLS enabled)\n";
+        if (g_media_port != 0)
+            std::cout << "[Server] Screen media over UDP on port " << g_media_port << "\n";
+
+        // ── Federation: links to the other servers ──
+        if (federated) {
+            g_federation = std::make_unique<lilypad::Federation>(g_node_id, g_udp_port, peer_secret,
+                                                                 g_ssl_ctx, add_peer_link);
+            for (auto& [host, port] : peers) g_federation->add_peer(host, port);
+            if (peer_port != 0 && !g_federation->listen(peer_port)) return 1;
+        }
+
+        lilypad::MetricsEndpoint metrics;
+        if (metrics_port != 0 && !metrics.listen(metrics_port)) return 1;
 
         // ── Launch threads ──
+        g_io_pool = std::make_unique<lilypad::IoWorkerPool>(
+            io_threads, handle_client_message,
+            [](lilypad::ClientConnection& conn) {
+                if (lilypad::is_peer_link(conn.id()))
+                    drop_peer_link(lilypad::peer_link_node(conn.id()));
+                else
+                    remove_client(conn.id());
+            });
+        g_io_pool->start();
+        g_auth_pool = std::make_unique<lilypad::AuthPool>(auth_threads, AUTH_PENDING_LIMIT,
+                                                          AUTH_PARKED_LIMIT);
+        g_auth_pool->start();
+        std::cout << "[Server] " << io_threads << " I/O worker threads, "
+                  << voice_relay.worker_count() << " UDP relay workers, "
+                  << auth_threads << " auth threads (" << hash_slots << " concurrent hashes)\n";
+        if (mix_threshold > 0)
+            std::cout << "[Server] Voice mixing from " << mix_threshold << " participants per room\n";
+        if (g_federation) {
+            g_federation->start();
+            std::cout << "[Federation] Node " << g_node_id << ", " << peers.size() << " configured peers"
+                      << (peer_port ? ", accepting links on port " + std::to_string(peer_port) : "") << "\n";
+        }
+
         std::thread tcp_accept_thread(tcp_accept_loop, tcp_listen.get());
-        std::thread udp_relay_thread(udp_relay_loop, udp_sock.get());
+        voice_relay.start();
+        media_relay.start();
         std::thread screen_relay_thread(screen_relay_loop);
         std::thread cleanup_thread(session_cleanup_loop);
+        if (metrics_port != 0) metrics.start();
 
         // Wait for Ctrl+C
         tcp_accept_thread.join();
 
-        // Join all per-client read threads
-        {
-            std::lock_guard<std::mutex> lock(g_client_threads_mutex);
-            for (auto& t : g_client_threads) {
-                if (t.joinable()) t.join();
-            }
-        }
+        // Abandons connections still logging in; finishes running auth tasks first,
+        // since those may hand connections to the I/O pool
+        g_auth_pool->stop();
+
+        // No new links; existing ones close with the I/O pool
+        if (g_federation) g_federation->stop();
+
+        // Closes every remaining connection on its worker thread
+        g_io_pool->stop();
 
-        udp_relay_thread.join();
+        voice_relay.stop();
+        media_relay.stop();
         g_relay_cv.notify_all();
         screen_relay_thread.join();
         cleanup_thread.join();
+        metrics.stop();
 
+        g_federation.reset();
         if (g_ssl_ctx) SSL_CTX_free(g_ssl_ctx);
+        g_ticket_keys.reset();
         g_auth_db.reset();
 
         std::cout << "[Server] Shutting down.\n";
@@ -0,0 +1,251 @@
+#include "media_relay.h"
+#include "metrics.h"
+#include "trace.h"
+#include "udp_batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace lilypad {
+
+constexpr auto MEDIA_PRUNE_INTERVAL = std::chrono::seconds(10);
+constexpr int  MEDIA_SOCKET_BUFFER  = 4 * 1024 * 1024;  // a keyframe arrives as a burst of hundreds of datagrams
+
+MediaRelay::MediaRelay(ClientRegistry& registry, FrameSink on_frame, KeyframeSink on_viewer_joined,
+                       ReportSink on_ingress_report)
+    : registry_(registry), on_frame_(std::move(on_frame)), on_viewer_joined_(std::move(on_viewer_joined)),
+      on_ingress_report_(std::move(on_ingress_report)) {}
+
+MediaRelay::~MediaRelay() {
+    stop();
+}
+
+bool MediaRelay::bind(uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(port);
+
+    Socket sock = create_udp_socket();
+    int buf = MEDIA_SOCKET_BUFFER;
+    setsockopt(sock.get(), SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&buf), sizeof(buf));
+    setsockopt(sock.get(), SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&buf), sizeof(buf));
+    if (::bind(sock.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+        std::cerr << "[Media] UDP bind failed: " << WSAGetLastError() << "\n";
+        return false;
+    }
+    set_nonblocking(sock.get());
+    sock_ = std::move(sock);
+    port_ = port;
+    return true;
+}
+
+void MediaRelay::start() {
+    if (!sock_.valid()) return;
+    running_ = true;
+    thread_  = std::thread(&MediaRelay::run, this);
+}
+
+void MediaRelay::stop() {
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+}
+
+// Ciphers and reassembly state for the keys `sharer` currently has; rebuilt
+// when it starts a new share. Null if it isn't sharing over UDP.
+MediaRelay::Stream* MediaRelay::stream_for(const ClientView& sharer) {
+    if (!sharer.local() || !sharer.screen_sharing || !sharer.media_keys) return nullptr;
+    Stream& st = streams_[sharer.id];
+    if (st.keys != sharer.media_keys) {
+        st.keys   = sharer.media_keys;
+        st.sender = std::make_unique<MediaCipher>(st.keys->sender);
+        st.viewer = std::make_unique<MediaCipher>(st.keys->viewer);
+        for (auto& video : st.video) video.reset();
+        st.audio.reset();
+        st.ingress.reset(std::chrono::steady_clock::now());
+        st.keyframe_seen = 0;
+        st.viewer_layer.clear();
+    }
+    return &st;
+}
+
+// Points `viewer_id`'s copy of the stream at `from`. Returns true if it was not
+// getting this stream over UDP before.
+bool MediaRelay::register_viewer(uint32_t sharer_id, uint32_t viewer_id, const sockaddr_in& from) {
+    bool joined = false;
+    registry_.update([&](RegistryTxn& txn) {
+        const ClientView* sharer = txn.find(sharer_id);
+        if (!sharer || !sharer->screen_sharing ||
+            !std::binary_search(sharer->screen_subscribers.begin(), sharer->screen_subscribers.end(), viewer_id))
+            return;
+        ClientView* viewer = txn.edit(viewer_id);
+        if (!viewer || !viewer->local()) return;
+        joined               = viewer->media_stream != sharer_id;
+        viewer->media_stream = sharer_id;
+        viewer->media_addr   = from;
+    });
+    return joined;
+}
+
+static bool same_addr(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+// A keyframe of `layer` begins: viewers waiting to move to that layer move now,
+// and every UDP viewer's layer is refreshed from the cache (new ones included)
+void MediaRelay::on_keyframe_start(const ClientView& sharer, Stream& st, const MediaRoute* route, uint8_t layer) {
+    if (!route) return;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> cache_lock(sharer.screen_cache->mutex);
+    for (uint32_t id : route->ids) {
+        auto& v = sharer.screen_cache->viewer_layers[id];
+        if (v.target == layer && v.current != layer) {
+            v.current     = layer;
+            v.switched_at = now;
+        }
+        st.viewer_layer[id] = v.current;
+    }
+}
+
+void MediaRelay::run() {
+    SOCKET           udp_sock = sock_.get();
+    UdpBatchReceiver rx(MAX_MEDIA_PACKET);
+    UdpBatchSender   tx;
+
+    // Re-sealed copies live until the batch is flushed: one slot per received datagram
+    std::vector<uint8_t>    sealed(UDP_BATCH_SIZE * MAX_MEDIA_PACKET);
+    std::vector<uint8_t>    body(MAX_MEDIA_PACKET);
+    std::vector<MediaFrame> frames;
+    LP_TRACE_THREAD("media_relay");
+    auto prune_at  = std::chrono::steady_clock::now() + MEDIA_PRUNE_INTERVAL;
+    auto report_at = std::chrono::steady_clock::now() + SCREEN_REPORT_INTERVAL;
+
+    while (running_) {
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(udp_sock, &read_set);
+
+        timeval timeout{};
+        timeout.tv_sec  = 0;
+        timeout.tv_usec = 200000;
+
+        int    ready = select(static_cast<int>(udp_sock) + 1, &read_set, nullptr, nullptr, &timeout);
+        size_t count = ready > 0 ? rx.receive(udp_sock) : 0;
+        auto   now   = std::chrono::steady_clock::now();
+
+        uint64_t bytes_in = 0, relayed = 0, relayed_bytes = 0, rejected = 0, lost = 0;
+        auto snap = count > 0 ? registry_.snapshot() : nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* data = rx.data(i);
+            size_t         len  = rx.size(i);
+            bytes_in += len;
+
+            MediaHeader h;
+            const ClientView* sharer = parse_media_header(data, len, h) ? snap->find(h.stream_id) : nullptr;
+            Stream* st = sharer ? stream_for(*sharer) : nullptr;
+            if (!st) {
+                rejected++;
+                continue;
+            }
+
+            if (h.type == MediaType::KEEPALIVE) {
+                if (h.client_id == h.stream_id || st->viewer->open(h, data, len, body.data()) < 0) {
+                    rejected++;
+                    continue;
+                }
+                const MediaRoute* route = snap->find_media_route(h.stream_id);
+                bool known = false;
+                for (size_t j = 0; route && j < route->ids.size() && !known; ++j)
+                    known = route->ids[j] == h.client_id && same_addr(route->addrs[j], rx.from(i));
+                if (!known) {
+                    if (register_viewer(h.stream_id, h.client_id, rx.from(i))) on_viewer_joined_(h.stream_id);
+                    snap = registry_.snapshot();
+                }
+                continue;
+            }
+
+            // Media: only the sharer holds the sender key
+            int n = h.client_id == h.stream_id ? st->sender->open(h, data, len, body.data()) : -1;
+            if (n < 0) {
+                rejected++;
+                continue;
+            }
+            st->ingress.on_datagram(h, len, now);
+
+            bool    is_video = h.type == MediaType::VIDEO;
+            uint8_t layer    = screen_layer(h.flags);
+            const MediaRoute* route = snap->find_media_route(h.stream_id);
+            if (is_video && (h.flags & SCREEN_FLAG_KEYFRAME) &&
+                (!(st->keyframe_seen & (1u << layer)) ||
+                 static_cast<int32_t>(h.seq - st->keyframe_seq[layer]) > 0)) {
+                st->keyframe_seen        |= static_cast<uint8_t>(1u << layer);
+                st->keyframe_seq[layer]   = h.seq;
+                on_keyframe_start(*sharer, *st, route, layer);
+            }
+
+            if (route && !route->addrs.empty()) {
+                uint8_t* out     = sealed.data() + i * MAX_MEDIA_PACKET;
+                size_t   out_len = st->viewer->seal(h, body.data(), static_cast<size_t>(n), out);
+                for (size_t j = 0; j < route->addrs.size(); ++j) {
+                    if (is_video) {
+                        auto it = st->viewer_layer.find(route->ids[j]);
+                        if (it == st->viewer_layer.end() || it->second != layer) continue;
+                    }
+                    tx.add(out, out_len, route->addrs[j]);
+                    relayed++;
+                    relayed_bytes += out_len;
+                }
+            }
+
+            frames.clear();
+            MediaReassembler& reassembler = is_video ? st->video[layer] : st->audio;
+            reassembler.push(h, body.data(), static_cast<size_t>(n), frames);
+            for (MediaFrame& frame : frames) {
+                if (frame.lost) {
+                    lost++;
+                    frame.flags = h.flags & SCREEN_FLAG_LAYER;  // which layer lost it
+                }
+                if (is_video) st->ingress.on_frame(frame.lost);
+                on_frame_(h.stream_id, h.type, frame);
+            }
+        }
+        if (tx.pending() > 0) {
+            LP_TRACE_SCOPE_ARG("media.send", tx.pending());
+            tx.flush(udp_sock);
+        }
+
+        if (count > 0) {
+            metric_add(Counter::SCREEN_UDP_PACKETS_IN, count);
+            metric_add(Counter::SCREEN_UDP_BYTES_IN, bytes_in);
+            metric_add(Counter::SCREEN_UDP_PACKETS_RELAYED, relayed);
+            metric_add(Counter::SCREEN_UDP_BYTES_RELAYED, relayed_bytes);
+            metric_add(Counter::SCREEN_UDP_REJECTED, rejected);
+            metric_add(Counter::DROP_UDP_LOST, lost);
+        }
+
+        // What each sharer's uplink got through, for its bitrate
+        now = std::chrono::steady_clock::now();
+        if (now >= report_at) {
+            report_at = now + SCREEN_REPORT_INTERVAL;
+            for (auto& [sharer_id, st] : streams_) {
+                ScreenReceiverReport report = st.ingress.take(sharer_id, now);
+                if (report.frames + report.lost > 0) on_ingress_report_(sharer_id, report);
+            }
+        }
+
+        // Forget streams whose share ended
+        if (now >= prune_at) {
+            prune_at     = now + MEDIA_PRUNE_INTERVAL;
+            auto current = registry_.snapshot();
+            for (auto it = streams_.begin(); it != streams_.end();) {
+                const ClientView* c = current->find(it->first);
+                if (c && c->media_keys == it->second.keys) ++it;
+                else it = streams_.erase(it);
+            }
+        }
+    }
+}
+
+} // namespace lilypad
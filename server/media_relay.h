@@ -0,0 +1,79 @@
+#pragma once
+
+#include "client_registry.h"
+#include "network.h"
+#include "screen_media.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+namespace lilypad {
+
+// ── UDP screen media relay ──
+// One thread on its own port. A sharer's datagrams are opened with its sender
+// key, re-sealed once with the stream's viewer key and sent to every UDP viewer
+// in the stream's MediaRoute, like the voice relay fans out a room. The relay
+// also reassembles each stream, so viewers still on TCP, peer servers and the
+// GOP cache get whole frames through `on_frame` as if they had come over TLS.
+// A viewer joins a stream's route by sending a keepalive sealed with the viewer
+// key (only subscribers are ever given it) and stays until it unsubscribes; a
+// keepalive from a new address (NAT rebinding) moves it. Of a simulcast share
+// each viewer is sent the one layer its ScreenCache entry says, switching when
+// a keyframe of its target layer starts arriving.
+class MediaRelay {
+public:
+    // A frame reassembled from sharer `sharer_id`, or one given up on (frame.lost)
+    using FrameSink = std::function<void(uint32_t sharer_id, MediaType type, MediaFrame& frame)>;
+    // A viewer just switched to UDP mid-GOP and needs a keyframe to start from
+    using KeyframeSink = std::function<void(uint32_t sharer_id)>;
+    // What arrived from a sharer over the last SCREEN_REPORT_INTERVAL
+    using ReportSink = std::function<void(uint32_t sharer_id, const ScreenReceiverReport& report)>;
+
+    MediaRelay(ClientRegistry& registry, FrameSink on_frame, KeyframeSink on_viewer_joined,
+               ReportSink on_ingress_report);
+    ~MediaRelay();
+    MediaRelay(const MediaRelay&) = delete;
+    MediaRelay& operator=(const MediaRelay&) = delete;
+
+    bool     bind(uint16_t port);
+    uint16_t port() const { return port_; }
+
+    void start();
+    void stop();
+
+private:
+    // Per-stream state the relay thread keeps for the keys currently published
+    struct Stream {
+        std::shared_ptr<const MediaKeys> keys;
+        std::unique_ptr<MediaCipher>     sender;
+        std::unique_ptr<MediaCipher>     viewer;
+        MediaReassembler                 video[SCREEN_LAYER_COUNT];
+        MediaReassembler                 audio;
+        MediaRateMonitor                 ingress;  // the sharer's uplink, as seen here
+        uint32_t                         keyframe_seq[SCREEN_LAYER_COUNT] = {};  // newest keyframe begun
+        uint8_t                          keyframe_seen = 0;                      // bit per layer
+        std::unordered_map<uint32_t, uint8_t> viewer_layer;  // layer each UDP viewer is sent
+    };
+
+    void    run();
+    Stream* stream_for(const ClientView& sharer);
+    void    on_keyframe_start(const ClientView& sharer, Stream& st, const MediaRoute* route, uint8_t layer);
+    bool    register_viewer(uint32_t sharer_id, uint32_t viewer_id, const sockaddr_in& from);
+
+    ClientRegistry&   registry_;
+    FrameSink         on_frame_;
+    KeyframeSink      on_viewer_joined_;
+    ReportSink        on_ingress_report_;
+    Socket            sock_;
+    uint16_t          port_ = 0;
+    std::thread       thread_;
+    std::atomic<bool> running_{false};
+
+    std::unordered_map<uint32_t, Stream> streams_;  // relay thread only
+};
+
+} // namespace lilypad
@@ -0,0 +1,312 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lilypad {
+
+constexpr size_t COUNTER_COUNT   = static_cast<size_t>(Counter::COUNT);
+constexpr size_t GAUGE_COUNT     = static_cast<size_t>(Gauge::COUNT);
+constexpr size_t HISTOGRAM_COUNT = static_cast<size_t>(Histogram::COUNT);
+
+// Histogram bucket upper bounds in microseconds (10us to 5s); one more for +Inf
+constexpr uint64_t BUCKET_BOUNDS_US[] = {
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000,
+};
+constexpr size_t BUCKET_COUNT = sizeof(BUCKET_BOUNDS_US) / sizeof(BUCKET_BOUNDS_US[0]) + 1;
+
+constexpr int    METRICS_TICK_MS      = 200;
+constexpr int    METRICS_IO_TIMEOUT_S = 2;
+constexpr size_t METRICS_MAX_REQUEST  = 8192;
+
+// ── Names; entries sharing a name are one metric family with different labels ──
+struct MetricInfo {
+    const char* name;
+    const char* labels;  // inside the braces, or empty
+    const char* help;
+};
+
+static const MetricInfo COUNTER_INFO[COUNTER_COUNT] = {
+    {"lilypad_received_packets_total", "type=\"voice\"",        "Media packets received from clients, by type"},
+    {"lilypad_received_bytes_total",   "type=\"voice\"",        "Media bytes received from clients, by type"},
+    {"lilypad_relayed_packets_total",  "type=\"voice\"",        "Media packets relayed to clients and peers, by type"},
+    {"lilypad_relayed_bytes_total",    "type=\"voice\"",        "Media bytes relayed to clients and peers, by type"},
+    {"lilypad_relayed_packets_total",  "type=\"voice_mix\"",    ""},
+    {"lilypad_relayed_bytes_total",    "type=\"voice_mix\"",    ""},
+    {"lilypad_received_packets_total", "type=\"screen_frame\"", ""},
+    {"lilypad_received_bytes_total",   "type=\"screen_frame\"", ""},
+    {"lilypad_received_packets_total", "type=\"screen_audio\"", ""},
+    {"lilypad_received_bytes_total",   "type=\"screen_audio\"", ""},
+    {"lilypad_relayed_packets_total",  "type=\"screen_frame\"", ""},
+    {"lilypad_relayed_bytes_total",    "type=\"screen_frame\"", ""},
+    {"lilypad_relayed_packets_total",  "type=\"screen_audio\"", ""},
+    {"lilypad_relayed_bytes_total",    "type=\"screen_audio\"", ""},
+    {"lilypad_screen_dropped_total",   "reason=\"sharer_gone\"",    "Screen-share messages not delivered, by reason"},
+    {"lilypad_screen_dropped_total",   "reason=\"audio_overflow\"", ""},
+    {"lilypad_screen_dropped_total",   "reason=\"superseded\"",     ""},
+    {"lilypad_screen_dropped_total",   "reason=\"unsynced\"",       ""},
+    {"lilypad_screen_dropped_total",   "reason=\"delta_budget\"",   ""},
+    {"lilypad_screen_dropped_total",   "reason=\"stream_closed\"",  ""},
+    {"lilypad_slow_consumer_disconnects_total", "", "Connections dropped for not reading their signaling queue"},
+    {"lilypad_tls_clients_total", "send=\"kernel\"",    "Authenticated clients by where their TLS records are encrypted"},
+    {"lilypad_tls_clients_total", "send=\"userspace\"", ""},
+    {"lilypad_received_packets_total", "type=\"screen_udp\"", ""},
+    {"lilypad_received_bytes_total",   "type=\"screen_udp\"", ""},
+    {"lilypad_relayed_packets_total",  "type=\"screen_udp\"", ""},
+    {"lilypad_relayed_bytes_total",    "type=\"screen_udp\"", ""},
+    {"lilypad_screen_udp_rejected_total", "", "Screen media datagrams failing authentication or for no stream on UDP"},
+    {"lilypad_screen_dropped_total",   "reason=\"udp_lost\"",     ""},
+};
+
+static const MetricInfo GAUGE_INFO[GAUGE_COUNT] = {
+    {"lilypad_screen_relay_queue_depth", "", "Frames waiting for the screen relay thread"},
+};
+
+static const MetricInfo HISTOGRAM_INFO[HISTOGRAM_COUNT] = {
+    {"lilypad_auth_seconds",            "op=\"register\"",    "Time to serve an authentication request"},
+    {"lilypad_auth_seconds",            "op=\"login\"",       ""},
+    {"lilypad_auth_seconds",            "op=\"token_login\"", ""},
+    {"lilypad_chat_append_seconds",     "", "Time to append a chat message to the history file"},
+    {"lilypad_subscriber_send_seconds", "", "Screen-share message queued on a connection until written"},
+    {"lilypad_voice_batch_seconds",     "", "Voice relay worker time per received batch"},
+};
+
+// ── Per-thread shards ──
+struct MetricShard {
+    std::atomic<uint64_t> counters[COUNTER_COUNT] = {};
+    std::atomic<uint64_t> buckets[HISTOGRAM_COUNT][BUCKET_COUNT] = {};
+    std::atomic<uint64_t> sums_us[HISTOGRAM_COUNT] = {};
+};
+
+struct ShardList {
+    std::mutex                                mutex;
+    std::vector<std::unique_ptr<MetricShard>> shards;
+};
+
+static ShardList& shard_list() {
+    static ShardList list;
+    return list;
+}
+
+static MetricShard& local_shard() {
+    thread_local MetricShard* shard = [] {
+        auto& list = shard_list();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        list.shards.push_back(std::make_unique<MetricShard>());
+        return list.shards.back().get();
+    }();
+    return *shard;
+}
+
+// Single writer per shard, so a plain load and store is enough
+static void bump(std::atomic<uint64_t>& v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static std::atomic<int64_t> g_gauges[GAUGE_COUNT] = {};
+
+void metric_add(Counter c, uint64_t n) {
+    bump(local_shard().counters[static_cast<size_t>(c)], n);
+}
+
+void metric_set(Gauge g, int64_t value) {
+    g_gauges[static_cast<size_t>(g)].store(value, std::memory_order_relaxed);
+}
+
+void metric_observe(Histogram h, std::chrono::steady_clock::duration d) {
+    auto us = static_cast<uint64_t>((std::max)(int64_t{0}, static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(d).count())));
+    size_t b = 0;
+    while (b < BUCKET_COUNT - 1 && us > BUCKET_BOUNDS_US[b]) ++b;
+
+    MetricShard& shard = local_shard();
+    auto i = static_cast<size_t>(h);
+    bump(shard.buckets[i][b], 1);
+    bump(shard.sums_us[i], us);
+}
+
+// ── Prometheus text format ──
+
+static void append_header(std::string& out, const MetricInfo& info, const char* type, const char*& last_name) {
+    if (last_name && std::string(last_name) == info.name) return;
+    last_name = info.name;
+    out += "# HELP ";
+    out += info.name;
+    out += ' ';
+    out += info.help;
+    out += "\n# TYPE ";
+    out += info.name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+static void append_sample(std::string& out, const char* name, const char* suffix, const std::string& labels,
+                          const std::string& value) {
+    out += name;
+    out += suffix;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+static std::string seconds(uint64_t us) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6f", static_cast<double>(us) / 1e6);
+    return buf;
+}
+
+std::string render_metrics() {
+    uint64_t counters[COUNTER_COUNT] = {};
+    uint64_t buckets[HISTOGRAM_COUNT][BUCKET_COUNT] = {};
+    uint64_t sums_us[HISTOGRAM_COUNT] = {};
+    {
+        auto& list = shard_list();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        for (auto& shard : list.shards) {
+            for (size_t c = 0; c < COUNTER_COUNT; ++c)
+                counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+            for (size_t h = 0; h < HISTOGRAM_COUNT; ++h) {
+                for (size_t b = 0; b < BUCKET_COUNT; ++b)
+                    buckets[h][b] += shard->buckets[h][b].load(std::memory_order_relaxed);
+                sums_us[h] += shard->sums_us[h].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Families are emitted contiguously, so sort each kind's entries by name first
+    std::string out;
+    auto by_name = [](const MetricInfo* info, size_t n) {
+        std::vector<size_t> order(n);
+        for (size_t i = 0; i < n; ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return std::string(info[a].name) < info[b].name;
+        });
+        return order;
+    };
+    const char* last_name = nullptr;
+
+    for (size_t c : by_name(COUNTER_INFO, COUNTER_COUNT)) {
+        const MetricInfo& info = COUNTER_INFO[c];
+        append_header(out, info, "counter", last_name);
+        append_sample(out, info.name, "", info.labels, std::to_string(counters[c]));
+    }
+    for (size_t g : by_name(GAUGE_INFO, GAUGE_COUNT)) {
+        const MetricInfo& info = GAUGE_INFO[g];
+        append_header(out, info, "gauge", last_name);
+        append_sample(out, info.name, "", info.labels,
+                      std::to_string(g_gauges[g].load(std::memory_order_relaxed)));
+    }
+    for (size_t h : by_name(HISTOGRAM_INFO, HISTOGRAM_COUNT)) {
+        const MetricInfo& info = HISTOGRAM_INFO[h];
+        append_header(out, info, "histogram", last_name);
+        std::string prefix = info.labels[0] ? std::string(info.labels) + "," : std::string();
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+            cumulative += buckets[h][b];
+            std::string le = b < BUCKET_COUNT - 1 ? seconds(BUCKET_BOUNDS_US[b]) : "+Inf";
+            append_sample(out, info.name, "_bucket", prefix + "le=\"" + le + "\"", std::to_string(cumulative));
+        }
+        append_sample(out, info.name, "_sum", info.labels, seconds(sums_us[h]));
+        append_sample(out, info.name, "_count", info.labels, std::to_string(cumulative));
+    }
+    return out;
+}
+
+// ── HTTP endpoint ──
+
+MetricsEndpoint::~MetricsEndpoint() {
+    stop();
+}
+
+bool MetricsEndpoint::listen(uint16_t port) {
+    Socket sock = create_tcp_socket();
+    int opt = 1;
+    setsockopt(sock.get(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(port);
+    if (bind(sock.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+        ::listen(sock.get(), 8) == SOCKET_ERROR) {
+        std::cerr << "[Metrics] Cannot listen on port " << port << ": " << WSAGetLastError() << "\n";
+        return false;
+    }
+    listen_sock_ = std::move(sock);
+    return true;
+}
+
+void MetricsEndpoint::start() {
+    if (!listen_sock_.valid()) return;
+    running_ = true;
+    thread_  = std::thread(&MetricsEndpoint::run, this);
+}
+
+void MetricsEndpoint::stop() {
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+    listen_sock_.close();
+}
+
+void MetricsEndpoint::run() {
+    while (running_) {
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(listen_sock_.get(), &read_set);
+        timeval timeout{};
+        timeout.tv_usec = METRICS_TICK_MS * 1000;
+        if (select(static_cast<int>(listen_sock_.get()) + 1, &read_set, nullptr, nullptr, &timeout) <= 0)
+            continue;
+
+        SOCKET s = accept(listen_sock_.get(), nullptr, nullptr);
+        if (s == INVALID_SOCKET) continue;
+        serve(Socket(s));  // inline: scrapes are rare and the timeouts bound a stalled one
+    }
+}
+
+void MetricsEndpoint::serve(Socket client) {
+#ifdef _WIN32
+    DWORD timeout = METRICS_IO_TIMEOUT_S * 1000;
+#else
+    timeval timeout{};
+    timeout.tv_sec = METRICS_IO_TIMEOUT_S;
+#endif
+    setsockopt(client.get(), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    setsockopt(client.get(), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+    // Only the request line matters; read until the end of the headers
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < METRICS_MAX_REQUEST) {
+        int n = recv(client.get(), buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 14, "GET /metrics?") == 0) {
+        body = render_metrics();
+    } else {
+        status = "404 Not Found";
+        body   = "Not found; try /metrics\n";
+    }
+    std::string response = "HTTP/1.1 " + status +
+                           "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8"
+                           "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n" + body;
+    client.send_all(reinterpret_cast<const uint8_t*>(response.data()), response.size());
+}
+
+} // namespace lilypad
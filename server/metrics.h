@@ -0,0 +1,110 @@
+#pragma once
+
+#include "network.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace lilypad {
+
+// ── Server metrics ──
+// Counters and histograms are kept per thread: each thread writes only its own
+// shard (relaxed loads and stores, no read-modify-write, no lock), and a scrape
+// sums all shards. Shards outlive their threads, so totals never go backwards.
+// Gauges are plain shared atomics.
+
+enum class Counter : uint8_t {
+    VOICE_PACKETS_IN,
+    VOICE_BYTES_IN,
+    VOICE_PACKETS_RELAYED,
+    VOICE_BYTES_RELAYED,
+    VOICE_MIX_PACKETS_RELAYED,
+    VOICE_MIX_BYTES_RELAYED,
+    SCREEN_FRAMES_IN,
+    SCREEN_FRAME_BYTES_IN,
+    SCREEN_AUDIO_IN,
+    SCREEN_AUDIO_BYTES_IN,
+    SCREEN_FRAMES_RELAYED,
+    SCREEN_FRAME_BYTES_RELAYED,
+    SCREEN_AUDIO_RELAYED,
+    SCREEN_AUDIO_BYTES_RELAYED,
+    DROP_SHARER_GONE,      // queued for fan-out, but the sharer left first
+    DROP_AUDIO_OVERFLOW,   // oldest screen audio shed for a slow subscriber
+    DROP_SUPERSEDED,       // queued video replaced by a newer keyframe
+    DROP_UNSYNCED,         // delta for a stream still waiting on a keyframe
+    DROP_DELTA_BUDGET,     // delta over the subscriber's queue budget
+    DROP_STREAM_CLOSED,    // queued media of a stream that stopped or was unsubscribed
+    SLOW_CONSUMER_DISCONNECTS,
+    TLS_SEND_KERNEL,       // clients whose records the kernel encrypts (kTLS)
+    TLS_SEND_USERSPACE,
+    SCREEN_UDP_PACKETS_IN,
+    SCREEN_UDP_BYTES_IN,
+    SCREEN_UDP_PACKETS_RELAYED,
+    SCREEN_UDP_BYTES_RELAYED,
+    SCREEN_UDP_REJECTED,   // failed authentication, or for no stream that is on UDP
+    DROP_UDP_LOST,         // frame the media relay could not reassemble, even with parity
+    COUNT
+};
+
+enum class Gauge : uint8_t {
+    SCREEN_RELAY_QUEUE_DEPTH,
+    COUNT
+};
+
+enum class Histogram : uint8_t {
+    AUTH_REGISTER,
+    AUTH_LOGIN,
+    AUTH_TOKEN_LOGIN,
+    CHAT_APPEND,
+    SUBSCRIBER_SEND,   // media message queued on a connection until fully written
+    VOICE_BATCH,       // one relay worker wakeup: receive, route, send
+    COUNT
+};
+
+void metric_add(Counter c, uint64_t n = 1);
+void metric_set(Gauge g, int64_t value);
+void metric_observe(Histogram h, std::chrono::steady_clock::duration d);
+
+// Observes the time from construction to destruction
+class MetricTimer {
+public:
+    explicit MetricTimer(Histogram h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~MetricTimer() { metric_observe(h_, std::chrono::steady_clock::now() - start_); }
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+private:
+    Histogram                             h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Everything, in the Prometheus text exposition format
+std::string render_metrics();
+
+// ── Serves GET /metrics over plain HTTP ──
+// Binds to loopback only: put a reverse proxy or a local scraper in front.
+class MetricsEndpoint {
+public:
+    MetricsEndpoint() = default;
+    ~MetricsEndpoint();
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    bool listen(uint16_t port);
+    void start();
+    void stop();
+
+private:
+    void run();
+    void serve(Socket client);
+
+    Socket            listen_sock_;
+    std::atomic<bool> running_{false};
+    std::thread       thread_;
+};
+
+} // namespace lilypad
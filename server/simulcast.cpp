@@ -0,0 +1,114 @@
+#include "simulcast.h"
+
+#include <algorithm>
+
+namespace lilypad {
+
+constexpr auto   LAYER_TIMEOUT     = std::chrono::seconds(3);   // no frames this long = not sent any more
+constexpr auto   RATE_WINDOW       = std::chrono::seconds(1);
+constexpr auto   SWITCH_SETTLE     = std::chrono::seconds(2);   // reports still cover the previous layer
+constexpr auto   UPGRADE_HOLD      = std::chrono::seconds(10);
+constexpr auto   MAX_UPGRADE_HOLD  = std::chrono::seconds(80);
+constexpr auto   PROBE_WINDOW      = std::chrono::seconds(8);   // back down this soon = moving up failed
+constexpr int    OVERUSE_SLOPE_MS  = 8;                         // as the sharer's rate control
+constexpr double HEAVY_LOSS        = 0.05;
+constexpr double RATE_SHORTFALL    = 0.5;  // getting under this share of the layer's rate = behind
+
+// ── SimulcastLayers ──
+
+void SimulcastLayers::on_frame(uint8_t layer, size_t bytes, Clock::time_point now) {
+    last_frame_[layer]  = now;
+    bytes_[layer]      += bytes;
+    if (window_start_ == Clock::time_point{}) window_start_ = now;
+
+    auto elapsed = now - window_start_;
+    if (elapsed < RATE_WINDOW) return;
+    double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    for (uint8_t l = 0; l < SCREEN_LAYER_COUNT; ++l) {
+        kbps_[l]  = static_cast<uint32_t>(static_cast<double>(bytes_[l]) * 8.0 / ms);
+        bytes_[l] = 0;
+    }
+    window_start_ = now;
+}
+
+void SimulcastLayers::reset() {
+    *this = SimulcastLayers();
+}
+
+uint8_t SimulcastLayers::live(Clock::time_point now) const {
+    uint8_t mask = 0;
+    for (uint8_t l = 0; l < SCREEN_LAYER_COUNT; ++l) {
+        if (last_frame_[l] != Clock::time_point{} && now - last_frame_[l] < LAYER_TIMEOUT)
+            mask |= static_cast<uint8_t>(1u << l);
+    }
+    return mask;
+}
+
+uint8_t best_layer(uint8_t live) {
+    for (uint8_t l = 0; l < SCREEN_LAYER_COUNT; ++l) {
+        if (live & (1u << l)) return l;
+    }
+    return 0;
+}
+
+// ── Layer choice ──
+
+static void move_down(ViewerLayer& v, uint8_t live, ViewerLayer::Clock::time_point now) {
+    // A move still waiting for its keyframe: only a pending move up can be called off
+    if (v.target != v.current) {
+        if (v.target < v.current) v.target = v.current;
+        return;
+    }
+    if (now - v.switched_at < SWITCH_SETTLE) return;
+
+    for (uint8_t l = static_cast<uint8_t>(v.current + 1); l < SCREEN_LAYER_COUNT; ++l) {
+        if (!(live & (1u << l))) continue;
+        v.target     = l;
+        v.probe_hold = now - v.upgraded_at < PROBE_WINDOW
+                           ? (std::min)(v.probe_hold * 2, ViewerLayer::Clock::duration(MAX_UPGRADE_HOLD))
+                           : ViewerLayer::Clock::duration(UPGRADE_HOLD);
+        v.hold_until = now + v.probe_hold;
+        break;
+    }
+}
+
+void step_down(ViewerLayer& v, const SimulcastLayers& layers, ViewerLayer::Clock::time_point now) {
+    if (v.probe_hold == ViewerLayer::Clock::duration{}) v.probe_hold = UPGRADE_HOLD;
+    move_down(v, layers.live(now), now);
+}
+
+void choose_layer(ViewerLayer& v, const ViewerHealth& health, const SimulcastLayers& layers,
+                  ViewerLayer::Clock::time_point now) {
+    uint8_t live = layers.live(now);
+    if (live == 0) return;
+    if (v.probe_hold == ViewerLayer::Clock::duration{}) v.probe_hold = UPGRADE_HOLD;
+
+    // The sharer stopped sending the target: the best one it still sends
+    if (!(live & (1u << v.target))) {
+        v.target = best_layer(live);
+        return;
+    }
+
+    const ScreenReceiverReport& r = health.report;
+    uint32_t total    = static_cast<uint32_t>(r.frames) + r.lost;
+    uint32_t rate     = layers.kbps(v.current);
+    bool     overuse  = r.delay_slope != SCREEN_DELAY_UNKNOWN && r.delay_slope > OVERUSE_SLOPE_MS;
+    bool     lossy    = total > 0 && static_cast<double>(r.lost) / total > HEAVY_LOSS;
+    bool     backlog  = health.queued_bytes > SIMULCAST_QUEUE_BACKLOG || health.dropped;
+    bool     short_of = total > 0 && rate > 0 && r.recv_kbps < rate * RATE_SHORTFALL;
+    if (overuse || lossy || backlog || short_of) {
+        move_down(v, live, now);
+        return;
+    }
+
+    if (v.target != v.current || now - v.switched_at < SWITCH_SETTLE || now < v.hold_until) return;
+    for (uint8_t l = v.current; l-- > 0;) {
+        if (!(live & (1u << l))) continue;
+        v.target      = l;
+        v.upgraded_at = now;
+        v.hold_until  = now + v.probe_hold;
+        break;
+    }
+}
+
+} // namespace lilypad
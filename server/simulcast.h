@@ -0,0 +1,70 @@
+#pragma once
+
+#include "client_connection.h"
+#include "protocol.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace lilypad {
+
+// ── What a sharer currently sends, per simulcast layer ──
+// Fed with every video frame; a layer that hasn't had a frame for a few
+// seconds is not offered to anyone.
+class SimulcastLayers {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void on_frame(uint8_t layer, size_t bytes, Clock::time_point now);
+    void reset();
+
+    uint8_t  live(Clock::time_point now) const;  // bit per layer
+    uint32_t kbps(uint8_t layer) const { return kbps_[layer]; }
+
+private:
+    Clock::time_point last_frame_[SCREEN_LAYER_COUNT] = {};
+    uint64_t          bytes_[SCREEN_LAYER_COUNT]      = {};
+    uint32_t          kbps_[SCREEN_LAYER_COUNT]       = {};  // over the last full window
+    Clock::time_point window_start_{};
+};
+
+// Best (lowest-numbered) layer in `live`, or 0 if none is
+uint8_t best_layer(uint8_t live);
+
+// ── Which layer one viewer of a stream gets ──
+// `current` is what it is being sent; `target` is where it moves at that
+// layer's next keyframe. The relay paths only ever set current = target.
+struct ViewerLayer {
+    using Clock = std::chrono::steady_clock;
+
+    uint8_t           current = 0;
+    uint8_t           target  = 0;
+    Clock::time_point switched_at{};   // current last changed
+    Clock::time_point upgraded_at{};   // target last moved up
+    Clock::time_point hold_until{};    // no moving up before this
+    Clock::duration   probe_hold{};    // grows while moving up keeps failing
+    uint64_t          dropped = 0;     // connection's drop count at the last check
+};
+
+// A viewer's send queue this deep means it isn't keeping up with its layer
+constexpr size_t SIMULCAST_QUEUE_BACKLOG = DELTA_QUEUE_LIMIT / 2;
+
+// One report interval's worth of how a viewer keeps up
+struct ViewerHealth {
+    ScreenReceiverReport report;
+    size_t               queued_bytes = 0;  // its TLS send queue
+    bool                 dropped      = false;  // its connection shed media since the last check
+};
+
+// Moves `v.target` one layer down when the viewer falls behind on its current
+// layer (delay building, loss, a backed-up or shedding send queue, or getting
+// well under the layer's rate), and one layer up again once it has kept up
+// for a while. Only layers the sharer is sending are chosen.
+void choose_layer(ViewerLayer& v, const ViewerHealth& health, const SimulcastLayers& layers,
+                  ViewerLayer::Clock::time_point now);
+
+// The downward half on its own, for a viewer seen falling behind between reports
+void step_down(ViewerLayer& v, const SimulcastLayers& layers, ViewerLayer::Clock::time_point now);
+
+} // namespace lilypad
@@ -1,15 +1,29 @@
 #include "tls_config.h"
 
 #include <openssl/ssl.h>
+#include <openssl/core_names.h>
+#include <openssl/ec.h>
 #include <openssl/err.h>
 #include <openssl/pem.h>
+#include <openssl/rand.h>
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 namespace lilypad {
 
@@ -18,17 +32,21 @@ static bool file_exists(const std::string& path) {
     return f.good();
 }
 
-static bool generate_self_signed(const std::string& cert_path, const std::string& key_path) {
-    std::cout << "[TLS] Generating self-signed certificate...\n";
+static bool generate_self_signed(const std::string& cert_path, const std::string& key_path,
+                                 CertKeyType key_type) {
+    bool ecdsa = key_type == CertKeyType::ECDSA_P256;
+    std::cout << "[TLS] Generating self-signed " << (ecdsa ? "ECDSA P-256" : "RSA-2048")
+              << " certificate...\n";
 
     EVP_PKEY* pkey = EVP_PKEY_new();
     if (!pkey) return false;
 
-    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(ecdsa ? EVP_PKEY_EC : EVP_PKEY_RSA, nullptr);
     if (!pctx) { EVP_PKEY_free(pkey); return false; }
 
     if (EVP_PKEY_keygen_init(pctx) <= 0 ||
-        EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) <= 0 ||
+        (ecdsa ? EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1)
+               : EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048)) <= 0 ||
         EVP_PKEY_keygen(pctx, &pkey) <= 0) {
         EVP_PKEY_CTX_free(pctx);
         EVP_PKEY_free(pkey);
@@ -71,15 +89,189 @@ static bool generate_self_signed(const std::string& cert_path, const std::string
     return true;
 }
 
-bool load_or_generate_cert(const std::string& cert_path, const std::string& key_path) {
+bool load_or_generate_cert(const std::string& cert_path, const std::string& key_path,
+                           CertKeyType key_type) {
     if (file_exists(cert_path) && file_exists(key_path)) {
         std::cout << "[TLS] Using existing cert: " << cert_path << "\n";
         return true;
     }
-    return generate_self_signed(cert_path, key_path);
+    return generate_self_signed(cert_path, key_path, key_type);
+}
+
+// ── TicketKeyRing ──
+
+constexpr std::time_t TICKET_KEY_ROTATION_SECS = 12 * 3600;
+constexpr long        TICKET_LIFETIME_SECS     = 24 * 3600;
+
+static int ticket_ring_index() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+static std::string to_hex(const uint8_t* data, size_t len) {
+    std::ostringstream oss;
+    for (size_t i = 0; i < len; ++i)
+        oss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(data[i]);
+    return oss.str();
+}
+
+static bool from_hex(const std::string& hex, uint8_t* out, size_t len) {
+    if (hex.size() != len * 2) return false;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned int byte;
+        std::istringstream iss(hex.substr(i * 2, 2));
+        if (!(iss >> std::hex >> byte)) return false;
+        out[i] = static_cast<uint8_t>(byte);
+    }
+    return true;
+}
+
+TicketKeyRing::TicketKeyRing(std::string path) : path_(std::move(path)) {
+    // File format: one key per line: created name_hex aes_hex hmac_hex (oldest first)
+    std::ifstream file(path_);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        long long created = 0;
+        std::string name, aes, hmac;
+        if (!(iss >> created >> name >> aes >> hmac)) continue;
+        Key key{};
+        key.created = static_cast<std::time_t>(created);
+        if (from_hex(name, key.name.data(), key.name.size()) &&
+            from_hex(aes, key.aes_key.data(), key.aes_key.size()) &&
+            from_hex(hmac, key.hmac_key.data(), key.hmac_key.size())) {
+            keys_.push_back(key);
+        }
+    }
+    std::cout << "[TLS] Loaded " << keys_.size() << " session ticket key(s)\n";
+#ifndef _WIN32
+    if (file.is_open()) ::chmod(path_.c_str(), 0600);  // older builds wrote it world-readable
+#endif
+    rotate_if_due();
+}
+
+void TicketKeyRing::rotate_if_due() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::time_t now = std::time(nullptr);
+    size_t before = keys_.size();
+    prune_locked(now);
+    bool rotated = keys_.empty() || now - keys_.back().created >= TICKET_KEY_ROTATION_SECS;
+    if (rotated) {
+        add_key_locked(now);
+        std::cout << "[TLS] Rotated session ticket key\n";
+    }
+    if (rotated || keys_.size() != before) save_locked();
+}
+
+void TicketKeyRing::add_key_locked(std::time_t now) {
+    Key key{};
+    RAND_bytes(key.name.data(), static_cast<int>(key.name.size()));
+    RAND_bytes(key.aes_key.data(), static_cast<int>(key.aes_key.size()));
+    RAND_bytes(key.hmac_key.data(), static_cast<int>(key.hmac_key.size()));
+    key.created = now;
+    keys_.push_back(key);
+}
+
+// A key encrypts for one rotation interval; its tickets stay valid for one
+// ticket lifetime after that
+void TicketKeyRing::prune_locked(std::time_t now) {
+    keys_.erase(std::remove_if(keys_.begin(), keys_.end(), [&](const Key& k) {
+                    return now - k.created >= TICKET_KEY_ROTATION_SECS + TICKET_LIFETIME_SECS;
+                }),
+                keys_.end());
 }
 
-SSL_CTX* create_server_ssl_ctx(const std::string& cert_path, const std::string& key_path) {
+// Create or truncate `path` readable by its owner only, and write `data` to it
+static bool write_owner_only(const std::string& path, const std::string& data) {
+#ifdef _WIN32
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);  // per-user ACL from the directory
+    file << data;
+    return static_cast<bool>(file);
+#else
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return false;
+    bool ok = ::fchmod(fd, 0600) == 0;  // a leftover file may have been created looser
+    for (size_t off = 0; ok && off < data.size();) {
+        ssize_t n = ::write(fd, data.data() + off, data.size() - off);
+        if (n <= 0) ok = false;
+        else off += static_cast<size_t>(n);
+    }
+    return ::close(fd) == 0 && ok;
+#endif
+}
+
+void TicketKeyRing::save_locked() const {
+    // Whoever can read this file can decrypt recorded sessions: owner-only, and
+    // swapped in whole so a crash mid-write never leaves a truncated ring
+    std::ostringstream out;
+    for (auto& k : keys_) {
+        out << static_cast<long long>(k.created) << ' '
+            << to_hex(k.name.data(), k.name.size()) << ' '
+            << to_hex(k.aes_key.data(), k.aes_key.size()) << ' '
+            << to_hex(k.hmac_key.data(), k.hmac_key.size()) << '\n';
+    }
+    std::string tmp = path_ + ".tmp";
+    if (!write_owner_only(tmp, out.str())) {
+        std::cerr << "[TLS] Failed to write session ticket keys: " << tmp << "\n";
+        std::remove(tmp.c_str());
+        return;
+    }
+#ifdef _WIN32
+    std::remove(path_.c_str());  // rename() does not replace on Windows
+#endif
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+        std::cerr << "[TLS] Failed to write session ticket keys: " << path_ << "\n";
+        std::remove(tmp.c_str());
+    }
+}
+
+void TicketKeyRing::install(SSL_CTX* ctx) {
+    SSL_CTX_set_ex_data(ctx, ticket_ring_index(), this);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_callback);
+}
+
+// Returns 1 on success; on decrypt, 2 asks OpenSSL to reissue the ticket under the
+// current key and 0 means "unknown key" (fall back to a full handshake)
+int TicketKeyRing::ticket_callback(SSL* ssl, unsigned char key_name[16], unsigned char iv[16],
+                                   EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc) {
+    auto* ring = static_cast<TicketKeyRing*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ticket_ring_index()));
+    if (!ring) return -1;
+
+    Key  key{};
+    bool current = true;
+    {
+        std::lock_guard<std::mutex> lock(ring->mutex_);
+        if (ring->keys_.empty()) return enc ? -1 : 0;
+        if (enc) {
+            key = ring->keys_.back();
+        } else {
+            auto it = std::find_if(ring->keys_.begin(), ring->keys_.end(), [&](const Key& k) {
+                return std::memcmp(k.name.data(), key_name, k.name.size()) == 0;
+            });
+            if (it == ring->keys_.end()) return 0;
+            key     = *it;
+            current = (it + 1 == ring->keys_.end());
+        }
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key.data(), key.hmac_key.size()),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+        OSSL_PARAM_construct_end(),
+    };
+    if (!EVP_MAC_CTX_set_params(mac, params)) return -1;
+
+    if (enc) {
+        std::memcpy(key_name, key.name.data(), key.name.size());
+        if (RAND_bytes(iv, 16) <= 0) return -1;  // AES-CBC IV
+        if (!EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv)) return -1;
+        return 1;
+    }
+    if (!EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv)) return -1;
+    return current ? 1 : 2;
+}
+
+SSL_CTX* create_server_ssl_ctx(const std::string& cert_path, const std::string& key_path, bool ktls) {
     const SSL_METHOD* method = TLS_server_method();
     SSL_CTX* ctx = SSL_CTX_new(method);
     if (!ctx) {
@@ -90,6 +282,11 @@ SSL_CTX* create_server_ssl_ctx(const std::string& cert_path, const std::string&
     // Require TLS 1.2 minimum
     SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
 
+    // Resumption via stateless tickets (keys come from a TicketKeyRing); one ticket
+    // per connection is enough, clients keep only the latest
+    SSL_CTX_set_timeout(ctx, TICKET_LIFETIME_SECS);
+    SSL_CTX_set_num_tickets(ctx, 1);
+
     if (SSL_CTX_use_certificate_chain_file(ctx, cert_path.c_str()) <= 0) {
         std::cerr << "[TLS] Failed to load certificate: " << cert_path << "\n";
         ERR_print_errors_fp(stderr);
@@ -110,6 +307,16 @@ SSL_CTX* create_server_ssl_ctx(const std::string& cert_path, const std::string&
         return nullptr;
     }
 
+    if (ktls) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(_WIN32)
+        // Needs the kernel's tls module; AES-GCM suites are the ones every kernel offloads
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+        std::cout << "[TLS] Kernel TLS offload requested\n";
+#else
+        std::cout << "[TLS] Kernel TLS is not available in this build; using userspace TLS\n";
+#endif
+    }
+
     std::cout << "[TLS] Server SSL context created successfully\n";
     return ctx;
 }
@@ -1,16 +1,68 @@
 #pragma once
 
 #include <openssl/ssl.h>
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace lilypad {
 
+// Key type for a generated self-signed certificate. ECDSA P-256 signs handshakes
+// far faster than RSA-2048 and is accepted by every TLS 1.2+ client.
+enum class CertKeyType { RSA_2048, ECDSA_P256 };
+
 // Load cert/key from paths. If they don't exist, generates a self-signed cert and saves it.
 // Returns true on success.
-bool load_or_generate_cert(const std::string& cert_path, const std::string& key_path);
+bool load_or_generate_cert(const std::string& cert_path, const std::string& key_path,
+                           CertKeyType key_type = CertKeyType::RSA_2048);
+
+// ── Session ticket keys ──
+// Tickets are encrypted under the newest key and accepted under any key still in
+// the ring, so clients keep resuming across rotations. Keys are persisted, so
+// tickets also survive a server restart. Thread-safe.
+class TicketKeyRing {
+public:
+    // Loads keys from `path`, adding a fresh one if none is current
+    explicit TicketKeyRing(std::string path);
+
+    // Starts a new encryption key once the newest is older than the rotation
+    // interval and forgets keys whose tickets can no longer be valid. Cheap to
+    // call often.
+    void rotate_if_due();
+
+    // Install the ticket callback on a server context (the ring must outlive it)
+    void install(SSL_CTX* ctx);
+
+private:
+    struct Key {
+        std::array<uint8_t, 16> name;
+        std::array<uint8_t, 32> aes_key;
+        std::array<uint8_t, 32> hmac_key;
+        std::time_t             created;
+    };
+
+    static int ticket_callback(SSL* ssl, unsigned char key_name[16], unsigned char iv[16],
+                               EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc);
+
+    void add_key_locked(std::time_t now);
+    void prune_locked(std::time_t now);
+    void save_locked() const;
+
+    std::string      path_;
+    std::mutex       mutex_;
+    std::vector<Key> keys_;  // newest last
+};
 
 // Create server SSL_CTX using the specified cert/key files.
+// With `ktls`, connections hand record encryption to the kernel (Linux kTLS)
+// once the handshake is done, where the kernel and negotiated cipher allow it;
+// the rest silently stay in userspace. Check TlsSocket::ktls_send().
 // Returns nullptr on failure.
-SSL_CTX* create_server_ssl_ctx(const std::string& cert_path, const std::string& key_path);
+SSL_CTX* create_server_ssl_ctx(const std::string& cert_path, const std::string& key_path,
+                               bool ktls = false);
 
 } // namespace lilypad
@@ -0,0 +1,163 @@
+#include "trace.h"
+
+#ifdef LILYPAD_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lilypad {
+
+constexpr size_t TRACE_RING_EVENTS = 1 << 15;  // per thread; 1 MB each
+constexpr size_t TRACE_RING_MASK   = TRACE_RING_EVENTS - 1;
+
+// ── Per-thread rings ──
+// Only the owning thread writes a ring. The dump copies it while it may still be
+// written and then discards whatever the writer could have overwritten meanwhile.
+struct TraceRing {
+    std::atomic<uint64_t>    head{0};  // events ever written
+    std::atomic<const char*> thread_name{nullptr};
+    uint32_t                 tid = 0;
+    TraceEvent               events[TRACE_RING_EVENTS];
+};
+
+struct RingList {
+    std::mutex                              mutex;
+    std::vector<std::unique_ptr<TraceRing>> rings;  // never freed, so dumps survive thread exit
+};
+
+static RingList& ring_list() {
+    static RingList list;
+    return list;
+}
+
+static TraceRing& local_ring() {
+    thread_local TraceRing* ring = [] {
+        auto& list = ring_list();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        list.rings.push_back(std::make_unique<TraceRing>());
+        list.rings.back()->tid = static_cast<uint32_t>(list.rings.size());
+        return list.rings.back().get();
+    }();
+    return *ring;
+}
+
+void trace_record(const char* name, uint64_t start_ns, uint64_t dur_ns, uint64_t arg) {
+    TraceRing& ring = local_ring();
+    uint64_t   h    = ring.head.load(std::memory_order_relaxed);
+    ring.events[h & TRACE_RING_MASK] = {name, start_ns, dur_ns, arg};
+    ring.head.store(h + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char* name) {
+    local_ring().thread_name.store(name, std::memory_order_release);
+}
+
+// ── Dump on signal ──
+static volatile std::sig_atomic_t g_dump_requested = 0;
+
+static void trace_signal_handler(int) {
+    g_dump_requested = 1;
+}
+
+void trace_install_signal() {
+#ifdef _WIN32
+    std::signal(SIGBREAK, trace_signal_handler);
+#else
+    std::signal(SIGUSR1, trace_signal_handler);
+#endif
+}
+
+void trace_poll() {
+    if (!g_dump_requested) return;
+    g_dump_requested = 0;
+    trace_dump("lilypad-trace-" + std::to_string(static_cast<long long>(std::time(nullptr))) + ".json");
+}
+
+// ── Chrome trace event format ──
+
+static void append_json_string(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') out += '\\';
+        out += *s;
+    }
+    out += '"';
+}
+
+bool trace_dump(const std::string& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "[Trace] Cannot write " << path << "\n";
+        return false;
+    }
+
+    std::vector<TraceRing*> rings;
+    {
+        auto& list = ring_list();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        for (auto& r : list.rings) rings.push_back(r.get());
+    }
+
+    std::vector<TraceEvent> copy(TRACE_RING_EVENTS);
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    size_t total = 0;
+    bool   first = true;
+    char   line[256];
+    auto separator = [&] {
+        if (!first) out += ",\n";
+        first = false;
+    };
+
+    for (TraceRing* ring : rings) {
+        uint64_t before = ring->head.load(std::memory_order_acquire);
+        std::copy(std::begin(ring->events), std::end(ring->events), copy.begin());
+        uint64_t after = ring->head.load(std::memory_order_acquire);
+
+        // Slots rewritten during the copy (and the one being written now) are unreliable
+        uint64_t begin = after + 1 > TRACE_RING_EVENTS ? after + 1 - TRACE_RING_EVENTS : 0;
+        if (const char* name = ring->thread_name.load(std::memory_order_acquire)) {
+            separator();
+            std::snprintf(line, sizeof(line), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                          ring->tid);
+            out += line;
+            append_json_string(out, name);
+            out += "}}";
+        }
+        for (uint64_t i = begin; i < before; ++i) {
+            const TraceEvent& ev = copy[i & TRACE_RING_MASK];
+            separator();
+            out += "{\"name\":";
+            append_json_string(out, ev.name);
+            if (ev.dur_ns > 0) {
+                std::snprintf(line, sizeof(line), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f",
+                              ev.start_ns / 1000.0, ev.dur_ns / 1000.0);
+            } else {
+                std::snprintf(line, sizeof(line), ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f", ev.start_ns / 1000.0);
+            }
+            out += line;
+            std::snprintf(line, sizeof(line), ",\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%llu}}",
+                          ring->tid, static_cast<unsigned long long>(ev.arg));
+            out += line;
+            total++;
+        }
+        file << out;
+        out.clear();
+    }
+    file << "\n]}\n";
+    file.close();
+
+    std::cout << "[Trace] Wrote " << total << " events from " << rings.size() << " threads to " << path << "\n";
+    return true;
+}
+
+} // namespace lilypad
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+// ── Relay pipeline trace recorder ──
+// Built only with -DLILYPAD_TRACE=ON; otherwise every macro below expands to
+// nothing. When enabled, each event is one fixed-size record written into the
+// calling thread's own ring buffer (a clock read and a few stores, no lock), so
+// the newest TRACE_RING_EVENTS events per thread are always available. Sending
+// the server SIGUSR1 (Ctrl+Break on Windows) writes them all out as a
+// Chrome/Perfetto trace: load the file in ui.perfetto.dev or chrome://tracing.
+//
+//   LP_TRACE_SCOPE(name)            duration of the enclosing scope
+//   LP_TRACE_SCOPE_ARG(name, arg)   same, with one integer argument
+//   LP_TRACE_INSTANT(name, arg)     a point in time, with one integer argument
+//   LP_TRACE_THREAD(name)           label the calling thread in the viewer
+//
+// Names must be string literals: only the pointer is recorded.
+
+#ifdef LILYPAD_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace lilypad {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t    start_ns;  // steady clock
+    uint64_t    dur_ns;    // 0 for instants
+    uint64_t    arg;
+};
+
+inline uint64_t trace_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void trace_record(const char* name, uint64_t start_ns, uint64_t dur_ns, uint64_t arg);
+void trace_thread_name(const char* name);
+
+// Installs the dump signal handler; trace_poll() does the writing when it fires
+// (the handler only sets a flag), and must be called regularly by some thread.
+void trace_install_signal();
+void trace_poll();
+
+// Writes every thread's buffered events to `path`; false if it cannot be opened
+bool trace_dump(const std::string& path);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uint64_t arg = 0) : name_(name), arg_(arg), start_(trace_now_ns()) {}
+    ~TraceScope() { trace_record(name_, start_, trace_now_ns() - start_, arg_); }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t    arg_;
+    uint64_t    start_;
+};
+
+} // namespace lilypad
+
+#define LP_TRACE_CONCAT2(a, b) a##b
+#define LP_TRACE_CONCAT(a, b) LP_TRACE_CONCAT2(a, b)
+#define LP_TRACE_SCOPE(name) ::lilypad::TraceScope LP_TRACE_CONCAT(lp_trace_, __LINE__)(name)
+#define LP_TRACE_SCOPE_ARG(name, arg) \
+    ::lilypad::TraceScope LP_TRACE_CONCAT(lp_trace_, __LINE__)(name, static_cast<uint64_t>(arg))
+#define LP_TRACE_INSTANT(name, arg) \
+    ::lilypad::trace_record(name, ::lilypad::trace_now_ns(), 0, static_cast<uint64_t>(arg))
+#define LP_TRACE_THREAD(name) ::lilypad::trace_thread_name(name)
+
+#else
+
+#define LP_TRACE_SCOPE(name) ((void)0)
+#define LP_TRACE_SCOPE_ARG(name, arg) ((void)0)
+#define LP_TRACE_INSTANT(name, arg) ((void)0)
+#define LP_TRACE_THREAD(name) ((void)0)
+
+#endif
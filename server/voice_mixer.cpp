@@ -0,0 +1,222 @@
+#include "voice_mixer.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "udp_batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+namespace lilypad {
+
+constexpr auto   MIX_FRAME            = std::chrono::milliseconds(1000 * FRAME_SIZE / SAMPLE_RATE);
+constexpr auto   MIX_STATS_INTERVAL   = std::chrono::seconds(10);
+constexpr size_t MIX_PRE_BUFFER       = 2;  // frames queued before a talker is mixed in
+constexpr size_t MIX_MAX_DEPTH        = 6;  // older frames are dropped to bound latency
+constexpr int    MIX_MAX_CONCEALED    = 5;  // PLC frames before a silent talker drops out
+
+VoiceMixer::VoiceMixer(ClientRegistry& registry, size_t threshold, bool log_stats)
+    : registry_(registry), threshold_((std::max)(threshold, size_t{1})), log_stats_(log_stats) {}
+
+VoiceMixer::~VoiceMixer() {
+    stop();
+}
+
+void VoiceMixer::push(uint32_t sender_id, const uint8_t* opus, size_t len, bool speech) {
+    std::lock_guard<std::mutex> lock(inbox_mutex_);
+    auto& q = inbox_[sender_id];
+    q.push_back(Frame{std::vector<uint8_t>(opus, opus + len), speech});
+    if (q.size() > MIX_MAX_DEPTH) q.pop_front();
+}
+
+void VoiceMixer::start(SOCKET send_sock) {
+    send_sock_ = send_sock;
+    running_   = true;
+    thread_    = std::thread(&VoiceMixer::run, this);
+}
+
+void VoiceMixer::stop() {
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+}
+
+void VoiceMixer::run() {
+    UdpBatchSender tx;
+    auto next        = std::chrono::steady_clock::now();
+    auto stats_start = next;
+
+    while (running_) {
+        next += MIX_FRAME;
+        std::this_thread::sleep_until(next);
+        auto now = std::chrono::steady_clock::now();
+        if (now - next > 5 * MIX_FRAME) next = now;  // fell far behind: skip, don't burst
+
+        auto   snap = registry_.snapshot();
+        size_t mixed_rooms = 0, mixed_members = 0;
+        for (auto& [name, room] : snap->voice_rooms) {
+            if (!active(room.size())) continue;
+            mixed_rooms++;
+            mixed_members += room.size();
+        }
+        if (mixed_rooms == 0) {
+            // Every room is forwarded: drop codec state so a later switch starts clean
+            if (!talkers_.empty() || !listeners_.empty() || !shared_mixes_.empty()) {
+                talkers_.clear();
+                listeners_.clear();
+                shared_mixes_.clear();
+                std::lock_guard<std::mutex> lock(inbox_mutex_);
+                inbox_.clear();
+            }
+            continue;
+        }
+
+        mix_frame(*snap, tx);
+        stat_frames_++;
+        stat_busy_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - now).count();
+
+        if (log_stats_ && now - stats_start >= MIX_STATS_INTERVAL) {
+            if (stat_frames_ > 0) {
+                std::ostringstream line;
+                line << "[Mixer] " << mixed_members << " members in " << mixed_rooms << " rooms, "
+                     << static_cast<double>(stat_encodes_) / stat_frames_ << " encodes/frame, "
+                     << stat_busy_us_ / stat_frames_ << " us/frame\n";
+                std::cout << line.str();
+            }
+            stat_frames_ = stat_encodes_ = stat_busy_us_ = 0;
+            stats_start = now;
+        }
+    }
+}
+
+// A room currently mixed rather than forwarded, or nullptr
+const VoiceRoom* VoiceMixer::mixed_room(const RegistrySnapshot& snap, uint32_t client_id) const {
+    const ClientView* c = snap.find(client_id);
+    if (!c || !c->in_voice()) return nullptr;
+    const VoiceRoom* room = snap.find_room(c->voice_room);
+    return room && active(room->size()) ? room : nullptr;
+}
+
+void VoiceMixer::mix_frame(const RegistrySnapshot& snap, UdpBatchSender& tx) {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        for (auto& [id, frames] : inbox_) {
+            auto& talker = talkers_.try_emplace(id).first->second;
+            for (auto& f : frames) talker.frames.push_back(std::move(f));
+        }
+        inbox_.clear();
+    }
+
+    // One decoded frame per talker (or concealment while their packets are late),
+    // grouped by the room it is mixed into
+    std::unordered_map<const VoiceRoom*, std::vector<std::pair<uint32_t, std::vector<float>>>> voices;
+    for (auto it = talkers_.begin(); it != talkers_.end();) {
+        uint32_t         id   = it->first;
+        const VoiceRoom* room = mixed_room(snap, id);
+        if (!room) {
+            it = talkers_.erase(it);  // left, or their room went back to forwarding
+            continue;
+        }
+        Talker& t = it->second;
+        ++it;
+
+        if (!t.primed) {
+            if (t.frames.size() < MIX_PRE_BUFFER) continue;
+            t.primed = true;
+        }
+        while (t.frames.size() > MIX_MAX_DEPTH) t.frames.pop_front();
+
+        std::vector<float> pcm;
+        try {
+            if (!t.frames.empty()) {
+                auto& f = t.frames.front();
+                pcm      = t.decoder.decode(f.opus.data(), static_cast<int>(f.opus.size()));
+                t.speech = f.speech;
+                t.frames.pop_front();
+                t.concealed = 0;
+            } else if (++t.concealed <= MIX_MAX_CONCEALED) {
+                pcm = t.decoder.decode_plc();
+            } else {
+                t.primed = false;  // stopped talking; re-buffer on the next burst
+            }
+        } catch (const std::exception&) {
+            pcm = t.decoder.decode_plc();  // corrupt packet
+            t.frames.clear();
+        }
+        // Decoded either way so the decoder state stays continuous
+        if (t.speech && pcm.size() == static_cast<size_t>(FRAME_SIZE * CHANNELS))
+            voices[room].emplace_back(id, std::move(pcm));
+    }
+
+    for (auto it = listeners_.begin(); it != listeners_.end();) {
+        if (!mixed_room(snap, it->first)) it = listeners_.erase(it);
+        else ++it;
+    }
+    for (auto it = shared_mixes_.begin(); it != shared_mixes_.end();) {
+        const VoiceRoom* room = snap.find_room(it->first);
+        if (!room || !active(room->size())) it = shared_mixes_.erase(it);
+        else ++it;
+    }
+
+    // Rooms with nobody talking send nothing; their clients conceal
+    const size_t frame_len = static_cast<size_t>(FRAME_SIZE * CHANNELS);
+    std::vector<float>                total(frame_len);
+    std::vector<float>                mix(frame_len);
+    std::vector<std::vector<uint8_t>> packets;  // alive until flush()
+
+    for (auto& [room, room_voices] : voices) {
+        std::fill(total.begin(), total.end(), 0.0f);
+        for (auto& [id, pcm] : room_voices) {
+            for (size_t i = 0; i < frame_len; ++i) total[i] += pcm[i];
+        }
+
+        SharedMix&           shared = shared_mixes_[room->name];
+        std::vector<uint8_t> shared_opus;
+        uint32_t             shared_seq = 0;
+        packets.reserve(packets.size() + room->size());
+
+        for (size_t m = 0; m < room->ids.size(); ++m) {
+            uint32_t  member_id = room->ids[m];
+            Listener& l         = listeners_[member_id];
+            auto own = std::find_if(room_voices.begin(), room_voices.end(),
+                                    [&](const auto& v) { return v.first == member_id; });
+
+            VoicePacket pkt;
+            try {
+                if (own != room_voices.end()) {
+                    // Talkers must not hear themselves: their own stream, own encoder
+                    for (size_t i = 0; i < frame_len; ++i)
+                        mix[i] = std::clamp(total[i] - own->second[i], -1.0f, 1.0f);
+                    if (!l.encoder) l.encoder = std::make_unique<OpusEncoderWrapper>();
+                    pkt.client_id = VOICE_MIX_MINUS_SENDER_ID;
+                    pkt.sequence  = l.seq++;
+                    pkt.opus_data = l.encoder->encode(mix.data());
+                    stat_encodes_++;
+                } else {
+                    if (shared_opus.empty()) {
+                        for (size_t i = 0; i < frame_len; ++i)
+                            mix[i] = std::clamp(total[i], -1.0f, 1.0f);
+                        shared_opus = shared.encoder.encode(mix.data());
+                        shared_seq  = shared.seq++;
+                        stat_encodes_++;
+                    }
+                    pkt.client_id = VOICE_MIX_SENDER_ID;
+                    pkt.sequence  = shared_seq;
+                    pkt.opus_data = shared_opus;
+                }
+            } catch (const std::exception&) {
+                continue;
+            }
+            if (pkt.opus_data.empty()) continue;
+
+            packets.push_back(pkt.to_bytes());
+            tx.add(packets.back().data(), packets.back().size(), room->addrs[m]);
+            metric_add(Counter::VOICE_MIX_PACKETS_RELAYED);
+            metric_add(Counter::VOICE_MIX_BYTES_RELAYED, packets.back().size());
+        }
+    }
+    tx.flush(send_sock_);
+}
+
+} // namespace lilypad
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "audio_codec.h"
+#include "client_registry.h"
+#include "network.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lilypad {
+
+class UdpBatchSender;
+
+// ── Server-side voice mixing (MCU mode) ──
+// Used instead of plain forwarding once a voice room reaches `threshold`
+// members: each client then downloads and decodes one stream instead of N-1.
+// Relay workers push received Opus packets here; a 20ms-paced thread decodes one
+// frame per talker, sums each room's talkers, and sends every listener the mix
+// of their room minus their own voice as a single packet. Listeners who did not
+// talk this frame all hear the same mix, so it is encoded once per room and
+// shared (from VOICE_MIX_SENDER_ID); only current talkers cost an encode each,
+// on an encoder of their own that lasts as long as they are in the room (from
+// VOICE_MIX_MINUS_SENDER_ID). Each id carries one encoder's continuous output,
+// so the client's decoder for it never sees a switch. Frames the sender marked
+// as non-speech
+// (VAD bit in the header extension) are decoded but left out of the mix.
+class VoiceMixer {
+public:
+    VoiceMixer(ClientRegistry& registry, size_t threshold, bool log_stats);
+    ~VoiceMixer();
+    VoiceMixer(const VoiceMixer&) = delete;
+    VoiceMixer& operator=(const VoiceMixer&) = delete;
+
+    // True if a room this size is mixed rather than forwarded
+    bool active(size_t room_size) const { return room_size >= threshold_; }
+
+    // Thread-safe: queue one Opus frame from `sender_id` for mixing; `speech` is
+    // the sender's VAD decision (true for packets without the header extension)
+    void push(uint32_t sender_id, const uint8_t* opus, size_t len, bool speech);
+
+    // Mixed packets go out through `send_sock` (bound to the voice port)
+    void start(SOCKET send_sock);
+    void stop();
+
+private:
+    struct Frame {
+        std::vector<uint8_t> opus;
+        bool                 speech = true;
+    };
+    struct Talker {
+        OpusDecoderWrapper                decoder;
+        std::deque<Frame>                 frames;  // jitter buffer
+        bool                              primed = false;
+        int                               concealed = 0;  // consecutive PLC frames
+        bool                              speech = true;  // VAD of the last real frame
+    };
+    struct Listener {
+        std::unique_ptr<OpusEncoderWrapper> encoder;  // their mix-minus, from their first talk on
+        uint32_t                            seq = 0;
+    };
+    struct SharedMix {
+        OpusEncoderWrapper encoder;
+        uint32_t           seq = 0;  // a listener who talked meanwhile sees the frames it missed
+    };
+
+    void run();
+    void             mix_frame(const RegistrySnapshot& snap, UdpBatchSender& tx);
+    const VoiceRoom* mixed_room(const RegistrySnapshot& snap, uint32_t client_id) const;
+
+    ClientRegistry& registry_;
+    size_t          threshold_;
+    bool            log_stats_;
+    SOCKET          send_sock_ = INVALID_SOCKET;
+
+    std::thread       thread_;
+    std::atomic<bool> running_{false};
+
+    // Relay workers -> mixer thread
+    std::mutex                                                     inbox_mutex_;
+    std::unordered_map<uint32_t, std::deque<Frame>> inbox_;
+
+    // Owned by the mixer thread
+    std::unordered_map<uint32_t, Talker>   talkers_;
+    std::unordered_map<uint32_t, Listener>     listeners_;
+    std::unordered_map<std::string, SharedMix> shared_mixes_;  // per mixed room
+
+    uint64_t stat_frames_  = 0;
+    uint64_t stat_encodes_ = 0;
+    uint64_t stat_busy_us_ = 0;
+};
+
+} // namespace lilypad
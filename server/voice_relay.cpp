@@ -0,0 +1,251 @@
+#include "voice_relay.h"
+#include "audio_codec.h"
+#include "metrics.h"
+#include "protocol.h"
+#include "trace.h"
+#include "udp_batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace lilypad {
+
+constexpr auto RELAY_STATS_INTERVAL  = std::chrono::seconds(10);
+constexpr auto DECODER_PRUNE_INTERVAL = std::chrono::seconds(10);
+
+VoiceRelay::VoiceRelay(ClientRegistry& registry, bool log_stats, size_t mix_threshold,
+                       size_t active_speakers)
+    : registry_(registry), log_stats_(log_stats), active_speakers_(active_speakers) {
+    if (mix_threshold > 0) mixer_ = std::make_unique<VoiceMixer>(registry, mix_threshold, log_stats);
+}
+
+VoiceRelay::~VoiceRelay() {
+    stop();
+}
+
+bool VoiceRelay::bind(uint16_t port, size_t workers) {
+#ifndef SO_REUSEPORT
+    workers = 1;
+#endif
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(port);
+
+    for (size_t i = 0; i < (std::max)(workers, size_t{1}); ++i) {
+        Socket sock = create_udp_socket();
+#ifdef SO_REUSEPORT
+        int opt = 1;
+        setsockopt(sock.get(), SOL_SOCKET, SO_REUSEPORT,
+                   reinterpret_cast<const char*>(&opt), sizeof(opt));
+#endif
+        if (::bind(sock.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR) {
+            std::cerr << "[Relay] UDP bind failed: " << WSAGetLastError() << "\n";
+            break;
+        }
+        set_nonblocking(sock.get());  // workers drain batches until empty
+        sockets_.push_back(std::move(sock));
+    }
+    return !sockets_.empty();
+}
+
+void VoiceRelay::start() {
+    if (active_speakers_ > 0) speakers_ = std::make_unique<ActiveSpeakers>(active_speakers_, sockets_.size());
+    running_ = true;
+    for (size_t i = 0; i < sockets_.size(); ++i) {
+        threads_.emplace_back(&VoiceRelay::run, this, i);
+    }
+    if (mixer_ && !sockets_.empty()) mixer_->start(sockets_[0].get());
+}
+
+void VoiceRelay::stop() {
+    running_ = false;
+    for (auto& t : threads_) {
+        if (t.joinable()) t.join();
+    }
+    threads_.clear();
+    if (mixer_) mixer_->stop();
+}
+
+// Each wakeup drains up to UDP_BATCH_SIZE datagrams in one call, builds the whole
+// fan-out against a single registry snapshot and emits it in one batched send.
+void VoiceRelay::run(size_t index) {
+    SOCKET           udp_sock = sockets_[index].get();
+    UdpBatchReceiver rx(MAX_VOICE_PACKET);
+    UdpBatchSender   tx;
+
+    // Level estimation for active-speaker selection. The kernel pins each sender
+    // to one worker, so a decoder here always sees that sender's whole stream.
+    std::unordered_map<uint32_t, OpusDecoderWrapper> decoders;
+    auto                                             last_rank = std::chrono::steady_clock::now();
+
+    uint64_t packets_in = 0, packets_out = 0, selects = 0, syscalls_mark = 0;
+    LP_TRACE_THREAD("voice_relay");
+    auto stats_start = std::chrono::steady_clock::now();
+    auto prune_at    = stats_start + DECODER_PRUNE_INTERVAL;
+
+    while (running_) {
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(udp_sock, &read_set);
+
+        timeval timeout{};
+        timeout.tv_sec  = 0;
+        timeout.tv_usec = 200000;
+
+        selects++;
+        int ready = select(static_cast<int>(udp_sock) + 1, &read_set, nullptr, nullptr, &timeout);
+        size_t count = 0;
+        if (ready > 0) {
+            LP_TRACE_SCOPE("voice.recv");
+            count = rx.receive(udp_sock);
+        }
+        packets_in += count;
+
+        // Totals for the batch, added to the metrics once at the end
+        auto     batch_start = std::chrono::steady_clock::now();
+        uint64_t bytes_in = 0, relayed = 0, relayed_bytes = 0;
+
+        auto snap = count > 0 ? registry_.snapshot() : nullptr;
+        auto now  = std::chrono::steady_clock::now();
+
+        // Before the batch, so a worker back from idle doesn't route by an old ranking
+        if (speakers_ && now - last_rank >= ActiveSpeakers::RANK_INTERVAL) {
+            speakers_->publish(index, now);
+            last_rank = now;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            bytes_in += rx.size(i);
+            VoiceHeader hdr;
+            if (!parse_voice_header(rx.data(i), rx.size(i), hdr)) continue;
+            uint32_t       sender_id   = hdr.client_id;
+            const uint8_t* payload     = rx.data(i) + hdr.payload_offset;
+            size_t         payload_len = rx.size(i) - hdr.payload_offset;
+
+            const ClientView* sender = snap->find(sender_id);
+            if (!sender) continue; // unknown client
+
+            if (!sender->local()) {
+                // A peer server's client: accepted only from that server's relay
+                const sockaddr_in& from = rx.from(i);
+                if (from.sin_addr.s_addr != sender->udp_addr.sin_addr.s_addr ||
+                    from.sin_port != sender->udp_addr.sin_port) continue;
+            } else if (!sender->udp_known) {
+                // Register the sender's UDP address on first packet (the only write on this path)
+                const sockaddr_in& sender_addr = rx.from(i);
+                snap = registry_.update([&](RegistryTxn& txn) {
+                    ClientView* self = txn.edit(sender_id);
+                    if (self && !self->udp_known) {
+                        self->udp_addr  = sender_addr;
+                        self->udp_known = true;
+                    }
+                });
+                sender = snap->find(sender_id);
+                if (!sender) continue;
+            }
+
+            // Only relay voice if sender is in a voice room; it is their whole audience
+            const VoiceRoom* room = sender->in_voice() ? snap->find_room(sender->voice_room) : nullptr;
+            if (!room) continue;
+
+            // Peer servers with members here get every local talker once and run their
+            // own mixing and selection. What arrives from a peer is not passed on to
+            // other peers: federated servers link directly with each other.
+            if (sender->local()) {
+                for (const sockaddr_in& peer_addr : room->peer_addrs) {
+                    tx.add(rx.data(i), rx.size(i), peer_addr);
+                    relayed++;
+                    relayed_bytes += rx.size(i);
+                }
+            }
+
+            // Large room: the mixer sends everyone one combined stream instead
+            if (mixer_ && mixer_->active(room->size())) {
+                mixer_->push(sender_id, payload, payload_len, !hdr.audio.present || hdr.audio.vad);
+                continue;
+            }
+
+            // Larger room: only the loudest few talkers reach each listener.
+            // (With K+1 members or fewer everyone is forwarded anyway.)
+            bool                          selective = speakers_ && room->size() > speakers_->k() + 1;
+            const ActiveSpeakers::Ranked* ranked    = nullptr;
+            if (selective) {
+                float level = -100.0f;
+                if (hdr.audio.present) {
+                    // The sender measured it for us; no decode needed
+                    if (hdr.audio.vad) level = hdr.audio.level_db();
+                } else {
+                    // Older client: decode to measure the level ourselves
+                    auto& decoder = decoders.try_emplace(sender_id).first->second;
+                    try {
+                        auto pcm = decoder.decode(payload, static_cast<int>(payload_len));
+                        level = frame_level_db(pcm.data(), pcm.size());
+                    } catch (const std::exception&) {
+                        // undecodable: treat as silence
+                    }
+                }
+                speakers_->record(index, room->name, sender_id, level, now);
+                ranked = &speakers_->ranked(index, room->name);
+                if (std::find(ranked->begin(), ranked->end(), sender_id) == ranked->end()) continue;
+            }
+
+            // Forward to everyone else in the room
+            for (size_t j = 0; j < room->ids.size(); ++j) {
+                uint32_t listener = room->ids[j];
+                if (listener == sender_id) continue;
+                if (selective && !speakers_->forwards(*ranked, sender_id, listener)) continue;
+                tx.add(rx.data(i), rx.size(i), room->addrs[j]);
+                relayed++;
+                relayed_bytes += rx.size(i);
+            }
+        }
+        if (tx.pending() > 0) {
+            LP_TRACE_SCOPE_ARG("voice.send", tx.pending());
+            packets_out += tx.flush(udp_sock);
+        }
+
+        if (count > 0) {
+            metric_add(Counter::VOICE_PACKETS_IN, count);
+            metric_add(Counter::VOICE_BYTES_IN, bytes_in);
+            metric_add(Counter::VOICE_PACKETS_RELAYED, relayed);
+            metric_add(Counter::VOICE_BYTES_RELAYED, relayed_bytes);
+            metric_observe(Histogram::VOICE_BATCH, std::chrono::steady_clock::now() - batch_start);
+        }
+
+        now = std::chrono::steady_clock::now();
+        if (now >= prune_at) {
+            // Forget decoders of senders that left voice
+            prune_at     = now + DECODER_PRUNE_INTERVAL;
+            auto current = registry_.snapshot();
+            for (auto it = decoders.begin(); it != decoders.end();) {
+                const ClientView* c = current->find(it->first);
+                if (c && c->in_voice()) ++it;
+                else it = decoders.erase(it);
+            }
+        }
+
+        if (log_stats_ && now - stats_start >= RELAY_STATS_INTERVAL) {
+            double   secs     = std::chrono::duration<double>(now - stats_start).count();
+            uint64_t syscalls = selects + rx.syscalls() + tx.syscalls();
+            uint64_t sys      = syscalls - syscalls_mark;
+            uint64_t pkts     = packets_in + packets_out;
+            if (pkts > 0) {
+                // One line per worker, built first so workers don't interleave
+                std::ostringstream line;
+                line << "[Relay] worker " << index << ": "
+                     << static_cast<uint64_t>(packets_in / secs) << " pkt/s in, "
+                     << static_cast<uint64_t>(packets_out / secs) << " pkt/s out, "
+                     << static_cast<double>(sys) / pkts << " syscalls/pkt\n";
+                std::cout << line.str();
+            }
+            packets_in = packets_out = 0;
+            syscalls_mark = syscalls;
+            stats_start = now;
+        }
+    }
+}
+
+} // namespace lilypad
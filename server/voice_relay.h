@@ -0,0 +1,55 @@
+#pragma once
+
+#include "active_speakers.h"
+#include "client_registry.h"
+#include "network.h"
+#include "voice_mixer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace lilypad {
+
+// ── UDP voice relay ──
+// N workers, each with its own socket bound to the voice port via SO_REUSEPORT
+// (Linux). The kernel hashes each sender's address to one socket, so a given
+// talker is always relayed by the same worker and its packets stay in order,
+// while different talkers' fan-out runs on different cores. Workers route from
+// registry snapshots and only write to the registry to learn a client's address.
+// Channels of `mix_threshold` or more members are handed to a VoiceMixer instead
+// (0 disables mixing). Below that, each listener only gets the `active_speakers`
+// loudest talkers (0 forwards everyone).
+class VoiceRelay {
+public:
+    VoiceRelay(ClientRegistry& registry, bool log_stats, size_t mix_threshold = 0,
+               size_t active_speakers = 0);
+    ~VoiceRelay();
+    VoiceRelay(const VoiceRelay&) = delete;
+    VoiceRelay& operator=(const VoiceRelay&) = delete;
+
+    // Bind up to `workers` sockets to `port`. Platforms without SO_REUSEPORT get
+    // one. Returns false if not even one socket could be bound.
+    bool bind(uint16_t port, size_t workers);
+
+    void   start();
+    void   stop();
+    size_t worker_count() const { return sockets_.size(); }
+
+private:
+    void run(size_t index);
+
+    ClientRegistry&          registry_;
+    bool                     log_stats_;
+    std::vector<Socket>      sockets_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool>        running_{false};
+
+    size_t                          active_speakers_;
+    std::unique_ptr<VoiceMixer>     mixer_;     // null when mixing is disabled
+    std::unique_ptr<ActiveSpeakers> speakers_;  // null when forwarding everyone; one shard per worker
+};
+
+} // namespace lilypad